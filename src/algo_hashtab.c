@@ -0,0 +1,248 @@
+/*
+ * algo_hashtab - open addressing hash table with incremental resize
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+
+#include "algo_hashtab.h"
+
+#include <stdlib.h>
+
+#include "ck.h"
+
+#define XXH_INLINE_ALL
+#include "algo_xxhash.h"
+
+/* Linear probing with backward shift deletion (no tombstones) in current
+ * table.  During incremental resize, entries migrated out of (or removed
+ * from) the prior table are replaced with tombstones so that probe sequences
+ * in the prior table remain intact until the prior table is freed.
+ * New entries are always inserted into the current table. */
+
+#define HASHTAB_INIT_SIZE 64     /* (must be power of 2) */
+#define HASHTAB_MIGRATE   32     /* slots of prior table migrated per op */
+
+static char hashtab_tombstone;
+#define HASHTAB_TOMBSTONE ((void *)&hashtab_tombstone)
+
+
+uint32_t
+hashtab_hash (const char * const str, const uint32_t len)
+{
+    return XXH32(str, len, 0);
+}
+
+
+uint32_t
+hashtab_hash_seed (const char * const str, const uint32_t len, const uint32_t seed)
+{
+    return XXH32(str, len, seed);
+}
+
+
+__attribute_pure__
+static hashtab_slot *
+hashtab_slot_find (hashtab_slot * const tab, const uint32_t mask, const uint32_t key)
+{
+    for (uint32_t i = key & mask; tab[i].data; i = (i+1) & mask) {
+        if (tab[i].key == key && tab[i].data != HASHTAB_TOMBSTONE)
+            return tab+i;
+    }
+    return NULL;
+}
+
+
+static void *
+hashtab_slot_insert (hashtab_slot * const tab, const uint32_t mask, const uint32_t key, void * const data, uint32_t * const used)
+{
+    uint32_t i = key & mask;
+    for (; tab[i].data; i = (i+1) & mask) {
+        if (tab[i].key == key) {
+            void * const prev = tab[i].data;
+            tab[i].data = data;
+            return prev;
+        }
+    }
+    tab[i].key = key;
+    tab[i].data = data;
+    ++*used;
+    return NULL;
+}
+
+
+static void
+hashtab_slot_remove (hashtab_slot * const tab, const uint32_t mask, uint32_t i)
+{
+    /* backward shift deletion: move subsequent entries in cluster into hole
+     * if hole is between their home slot and their current slot */
+    for (uint32_t j = i; ; ) {
+        j = (j+1) & mask;
+        if (NULL == tab[j].data) break;
+        const uint32_t h = tab[j].key & mask;
+        if (j > i ? (h <= i || h > j) : (h <= i && h > j)) {
+            tab[i] = tab[j];
+            i = j;
+        }
+    }
+    tab[i].data = NULL;
+}
+
+
+static void
+hashtab_migrate (hashtab * const ht, uint32_t n)
+{
+    hashtab_slot * const old = ht->old;
+    uint32_t pos = ht->old_pos;
+    for (; n && pos <= ht->old_mask; --n, ++pos) {
+        if (old[pos].data && old[pos].data != HASHTAB_TOMBSTONE) {
+            hashtab_slot_insert(ht->tab, ht->mask,
+                                old[pos].key, old[pos].data, &ht->used);
+            old[pos].data = HASHTAB_TOMBSTONE;
+            --ht->old_used;
+        }
+    }
+    ht->old_pos = pos;
+    if (pos > ht->old_mask || 0 == ht->old_used) {
+        free(old);
+        ht->old = NULL;
+        ht->old_mask = 0;
+        ht->old_used = 0;
+        ht->old_pos = 0;
+    }
+}
+
+
+__attribute_cold__
+__attribute_noinline__
+static void
+hashtab_grow (hashtab * const ht)
+{
+    if (ht->old) /* complete prior resize (not expected) */
+        hashtab_migrate(ht, ht->old_mask+1);
+    const uint32_t sz = ht->tab ? (ht->mask+1) << 1 : HASHTAB_INIT_SIZE;
+    ht->old = ht->tab;
+    ht->old_mask = ht->mask;
+    ht->old_used = ht->used;
+    ht->old_pos = 0;
+    ht->tab = ck_calloc(sz, sizeof(*ht->tab));
+    ht->mask = sz - 1;
+    ht->used = 0;
+    if (NULL == ht->old) {
+        ht->old_mask = 0;
+        ht->old_used = 0;
+    }
+}
+
+
+void *
+hashtab_find (const hashtab * const ht, const uint32_t key)
+{
+    const hashtab_slot *slot;
+    if (ht->tab && (slot = hashtab_slot_find(ht->tab, ht->mask, key)))
+        return slot->data;
+    if (ht->old && (slot = hashtab_slot_find(ht->old, ht->old_mask, key)))
+        return slot->data;
+    return NULL;
+}
+
+
+void *
+hashtab_insert (hashtab * const ht, const uint32_t key, void * const data)
+{
+    if (ht->old) {
+        hashtab_slot * const slot =
+          hashtab_slot_find(ht->old, ht->old_mask, key);
+        if (slot) { /* replace in prior table; entry will be migrated */
+            void * const prev = slot->data;
+            slot->data = data;
+            return prev;
+        }
+        hashtab_migrate(ht, HASHTAB_MIGRATE);
+    }
+    /* grow at 3/4 load (including entries pending migration) */
+    if (NULL == ht->tab
+        || hashtab_used(ht) + 1 > ((ht->mask+1) >> 2) * 3)
+        hashtab_grow(ht);
+    return hashtab_slot_insert(ht->tab, ht->mask, key, data, &ht->used);
+}
+
+
+void *
+hashtab_remove (hashtab * const ht, const uint32_t key)
+{
+    void *data = NULL;
+    hashtab_slot *slot;
+    if (ht->tab && (slot = hashtab_slot_find(ht->tab, ht->mask, key))) {
+        data = slot->data;
+        hashtab_slot_remove(ht->tab, ht->mask, (uint32_t)(slot - ht->tab));
+        --ht->used;
+    }
+    else if (ht->old && (slot = hashtab_slot_find(ht->old,ht->old_mask,key))){
+        data = slot->data;
+        slot->data = HASHTAB_TOMBSTONE;
+        --ht->old_used;
+    }
+    if (ht->old)
+        hashtab_migrate(ht, HASHTAB_MIGRATE);
+    return data;
+}
+
+
+void
+hashtab_sweep (hashtab * const ht, int (*fn)(void *data, void *arg), void * const arg)
+{
+    hashtab_slot * const old = ht->old;
+    if (old) {
+        for (uint32_t i = 0; i <= ht->old_mask; ++i) {
+            void * const data = old[i].data;
+            if (data && data != HASHTAB_TOMBSTONE && fn(data, arg)) {
+                old[i].data = HASHTAB_TOMBSTONE;
+                --ht->old_used;
+            }
+        }
+    }
+
+    hashtab_slot * const tab = ht->tab;
+    if (tab) {
+        for (uint32_t i = 0; i <= ht->mask; ) {
+            void * const data = tab[i].data;
+            if (data && fn(data, arg)) {
+                /*(backward shift might move another entry into slot i;
+                 * check slot i again)*/
+                hashtab_slot_remove(tab, ht->mask, i);
+                --ht->used;
+            }
+            else
+                ++i;
+        }
+    }
+
+    if (old)
+        hashtab_migrate(ht, ht->old_mask+1);
+}
+
+
+void
+hashtab_clear (hashtab * const ht, void (*free_fn)(void *data))
+{
+    if (free_fn) {
+        for (uint32_t i = 0; ht->tab && i <= ht->mask; ++i) {
+            if (ht->tab[i].data)
+                free_fn(ht->tab[i].data);
+        }
+        for (uint32_t i = 0; ht->old && i <= ht->old_mask; ++i) {
+            if (ht->old[i].data && ht->old[i].data != HASHTAB_TOMBSTONE)
+                free_fn(ht->old[i].data);
+        }
+    }
+    free(ht->tab);
+    free(ht->old);
+    ht->tab = NULL;
+    ht->mask = 0;
+    ht->used = 0;
+    ht->old = NULL;
+    ht->old_mask = 0;
+    ht->old_used = 0;
+    ht->old_pos = 0;
+}
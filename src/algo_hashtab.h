@@ -0,0 +1,60 @@
+#ifndef INCLUDED_ALGO_HASHTAB_H
+#define INCLUDED_ALGO_HASHTAB_H
+#include "first.h"
+
+/* open addressing hash table (linear probing) mapping uint32_t key to data
+ *
+ * Keys are typically hashes of strings (hashtab_hash()) and the table holds
+ * at most one entry per key, so callers must check that data found matches
+ * the full (string) key, and should replace the entry upon hash collision.
+ * Lookups do not modify the table.  The table grows incrementally: upon
+ * resize, entries are migrated from the prior table a few slots at a time
+ * during subsequent inserts and removals. */
+
+typedef struct hashtab_slot {
+    uint32_t key;
+    void *data;             /* NULL if slot is empty */
+} hashtab_slot;
+
+typedef struct hashtab {
+    hashtab_slot *tab;
+    uint32_t mask;
+    uint32_t used;
+    hashtab_slot *old;      /* prior table during incremental resize */
+    uint32_t old_mask;
+    uint32_t old_used;
+    uint32_t old_pos;       /* next slot in prior table to migrate */
+} hashtab;
+
+__attribute_pure__
+uint32_t hashtab_hash (const char *str, uint32_t len);
+
+/* (hash chaining: pass hash of prior string as seed to hash multiple strings)*/
+__attribute_pure__
+uint32_t hashtab_hash_seed (const char *str, uint32_t len, uint32_t seed);
+
+__attribute_pure__
+void * hashtab_find (const hashtab *ht, uint32_t key);
+
+/* insert (or replace) entry; returns data replaced, if any, else NULL */
+void * hashtab_insert (hashtab *ht, uint32_t key, void *data);
+
+/* remove entry; returns data removed, if any, else NULL */
+void * hashtab_remove (hashtab *ht, uint32_t key);
+
+/* call fn() on each entry; entry is removed if fn() returns non-zero
+ * (fn() is responsible for freeing data of removed entry, if needed)
+ * (fn() might be called more than once on some entries which are not
+ *  removed, so fn() should be idempotent on entries it does not remove) */
+void hashtab_sweep (hashtab *ht, int (*fn)(void *data, void *arg), void *arg);
+
+/* remove all entries, calling free_fn() on data (if free_fn not NULL) */
+void hashtab_clear (hashtab *ht, void (*free_fn)(void *data));
+
+static inline uint32_t hashtab_used (const hashtab *ht);
+static inline uint32_t hashtab_used (const hashtab *ht)
+{
+    return ht->used + ht->old_used;
+}
+
+#endif
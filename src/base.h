@@ -40,7 +40,7 @@ struct connection {
 	signed char is_readable;
 	signed char is_writable;
 	char is_ssl_sock;
-	char traffic_limit_reached;
+	char traffic_limit_reached; /* (bit 1: rate limit; bit 2: read-ahead) */
 	uint16_t revents_err;
 	uint16_t proto_default_port;
 
@@ -107,6 +107,10 @@ typedef struct {
 	unsigned short max_fds;
 	unsigned short max_conns;
 	unsigned short port;
+	unsigned short stat_cache_max_fds;
+	unsigned short stat_cache_fd_ttl;
+	unsigned int stat_cache_mem_max_file;
+	unsigned int stat_cache_mem_max;
 
 	unsigned int upload_temp_file_size;
 	array *upload_tempdirs;
@@ -126,6 +130,7 @@ typedef struct {
 	const buffer *groupname;
 	const buffer *network_backend;
 	const array *feature_flags;
+	const array *cpu_affinity;
 	const char *event_handler;
 	const char *modules_dir;
 	buffer *pid_file;
@@ -145,6 +150,9 @@ typedef struct server_socket {
 	fdnode *fdn;
 	server *srv;
 	buffer *srv_token;
+
+	int *wkr_fds;     /* additional SO_REUSEPORT listen sockets for workers */
+	uint32_t wkr_nfds;
 } server_socket;
 
 typedef struct {
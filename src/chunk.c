@@ -67,6 +67,11 @@ static size_t chunk_buf_sz = 8192;
 static chunk *chunks, *chunks_oversized, *chunks_filechunk;
 static chunk *chunk_buffers;
 static int chunks_oversized_n;
+#ifdef HAVE_SPLICE
+static chunk *chunks_pipechunk;
+static int chunks_pipechunk_n;
+static int *chunks_pipechunk_cur_fds; /*(srv->cur_fds)*/
+#endif
 static const array *chunkqueue_default_tempdirs = NULL;
 static off_t chunkqueue_default_tempfile_size = DEFAULT_TEMPFILE_SIZE;
 static const char *env_tmpdir = NULL;
@@ -121,6 +126,7 @@ static chunk *chunk_init(void) {
 	c->file.view = NULL;
       #endif
 	c->file.fd = -1;
+	c->file.pfd = -1;
 
 	c->mem = buffer_init();
 	return c;
@@ -228,6 +234,189 @@ chunk_file_preadv2_flags (chunk *c)
 }
 #endif
 
+#ifdef HAVE_CHUNK_FILE_READAHEAD
+
+/* Asynchronous read-ahead of file data into page cache using io_uring.
+ * Data is read into a shared scratch buffer and discarded; the purpose is
+ * to avoid blocking the (single-threaded) server process in sendfile() or
+ * read() while waiting on disk I/O.  The kernel holds its own reference to
+ * the file while read is in progress, so the chunk (and file descriptor)
+ * may be reset before the read completes. */
+
+#define CHUNK_AIO_OPS     256
+#define CHUNK_AIO_READ_SZ (512*1024)
+
+typedef struct chunk_aio_op {
+    chunk *c;
+    void(*cb)(void *);
+    void *ctx;
+    struct chunk_aio_op *next;
+} chunk_aio_op;
+
+static struct chunk_aio {
+    sys_uring ring;
+    fdevents *ev;
+    fdnode *fdn;
+    char *buf;
+    chunk_aio_op *freelist;
+    chunk_aio_op ops[CHUNK_AIO_OPS];
+} chunk_aio;
+
+static void
+chunk_file_readahead_detach (chunk * const c)
+{
+    chunk_aio_op * const op = c->file.aio;
+    c->file.aio = NULL;
+    op->c = NULL;
+    op->cb = NULL;
+}
+
+static int
+chunk_file_readahead_submit (chunk * const c, off_t len)
+{
+    if (c->file.aio)
+        return 1; /* read-ahead pending */
+    if (len > c->file.length - c->offset)
+        len = c->file.length - c->offset;
+    if (len > CHUNK_AIO_READ_SZ)
+        len = CHUNK_AIO_READ_SZ;
+    if (len <= 0 || NULL == chunk_aio.freelist)
+        return 0;
+
+    struct io_uring_sqe * const sqe = sys_uring_get_sqe(&chunk_aio.ring);
+    if (NULL == sqe)
+        return 0;
+    chunk_aio_op * const op = chunk_aio.freelist;
+    chunk_aio.freelist = op->next;
+    op->c = c;
+    op->cb = NULL;
+    op->ctx = NULL;
+    c->file.aio = op;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = c->file.fd;
+    sqe->off = (uint64_t)c->offset;
+    sqe->addr = (uint64_t)(uintptr_t)chunk_aio.buf;
+    sqe->len = (uint32_t)len;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    sys_uring_submit(&chunk_aio.ring);
+    return 1;
+}
+
+int
+chunk_file_readahead (chunk * const c, off_t len)
+{
+    /*(expects open file for non-empty FILE_CHUNK)*/
+    if (c->file.aio) {
+        /*(submit if previous attempt to submit was interrupted)*/
+        if (sys_uring_sq_flush(&chunk_aio.ring))
+            sys_uring_submit(&chunk_aio.ring);
+        return 1;
+    }
+    if (NULL == chunk_aio.freelist || 0 == chunk_file_preadv2_flags(c))
+        return 0;
+
+    if (len > c->file.length - c->offset)
+        len = c->file.length - c->offset;
+    if (len > CHUNK_AIO_READ_SZ)
+        len = CHUNK_AIO_READ_SZ;
+    if (len <= 0)
+        return 0;
+
+    /* check if end of range is already in page cache */
+    char ch;
+    struct iovec iov[1] = { { &ch, 1 } };
+    if (-1 != preadv2(c->file.fd, iov, 1, c->offset + len - 1, RWF_NOWAIT))
+        return 0;
+    if (errno != EAGAIN) {
+        if (errno == EOPNOTSUPP)
+            c->file.flagmask = ~RWF_NOWAIT;
+        return 0; /*(caller reports errors, if any, on subsequent read)*/
+    }
+
+    return chunk_file_readahead_submit(c, len);
+}
+
+int
+chunkqueue_readahead_wait (chunkqueue * const cq, void(*cb)(void *), void * const ctx)
+{
+    const chunk * const c = cq->first;
+    if (NULL == c || c->type != FILE_CHUNK || NULL == c->file.aio)
+        return 0;
+    c->file.aio->cb = cb;
+    c->file.aio->ctx = ctx;
+    return 1;
+}
+
+static handler_t
+chunk_aio_handle_fdevent (void * const ctx, const int revents)
+{
+    UNUSED(ctx);
+    UNUSED(revents);
+    sys_uring * const ring = &chunk_aio.ring;
+    uint32_t head = *ring->cq_khead;
+    const uint32_t tail = sys_uring_cq_tail(ring);
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe * const cqe = ring->cqes+(head & ring->cq_mask);
+        chunk_aio_op * const op = (chunk_aio_op *)(uintptr_t)cqe->user_data;
+        /*(read errors, if any, are reported by subsequent read or sendfile)*/
+        if (op->c) {
+            op->c->file.aio = NULL;
+            op->c->file.busy = 0; /*(retry non-blocking read)*/
+        }
+        void(* const cb)(void *) = op->cb;
+        void * const cbctx = op->ctx;
+        op->c = NULL;
+        op->cb = NULL;
+        op->next = chunk_aio.freelist;
+        chunk_aio.freelist = op;
+        if (cb)
+            cb(cbctx);
+    }
+    sys_uring_cq_advance(ring, head);
+    return HANDLER_FINISHED;
+}
+
+__attribute_cold__
+__attribute_noinline__
+int chunkqueue_internal_aio (fdevents * const ev, const int init) {
+    /*(intended for internal use within a single lighttpd process;
+     * must be initialized after fork() and graceful-restart to avoid
+     * sharing io_uring between processes)*/
+    if (chunk_aio.fdn) {
+        fdevent_fdnode_event_del(chunk_aio.ev, chunk_aio.fdn);
+        fdevent_unregister(chunk_aio.ev, chunk_aio.fdn);
+        chunk_aio.fdn = NULL;
+        sys_uring_free(&chunk_aio.ring); /*(cancels pending reads)*/
+        for (uint32_t i = 0; i < CHUNK_AIO_OPS; ++i) {
+            if (chunk_aio.ops[i].c)
+                chunk_file_readahead_detach(chunk_aio.ops[i].c);
+        }
+    }
+    chunk_aio.freelist = NULL;
+    chunk_aio.ev = NULL;
+    if (!init) {
+        free(chunk_aio.buf);
+        chunk_aio.buf = NULL;
+        return 0;
+    }
+
+    if (0 != sys_uring_init(&chunk_aio.ring, CHUNK_AIO_OPS, CHUNK_AIO_OPS*2))
+        return -1;
+    if (NULL == chunk_aio.buf)
+        chunk_aio.buf = ck_malloc(CHUNK_AIO_READ_SZ);
+    for (uint32_t i = 0; i < CHUNK_AIO_OPS; ++i) {
+        chunk_aio.ops[i].next = chunk_aio.freelist;
+        chunk_aio.freelist = chunk_aio.ops+i;
+    }
+    chunk_aio.ev = ev;
+    chunk_aio.fdn = fdevent_register(ev, chunk_aio.ring.fd,
+                                     chunk_aio_handle_fdevent, NULL);
+    fdevent_fdnode_event_set(ev, chunk_aio.fdn, FDEVENT_IN);
+    return 0;
+}
+
+#endif /* HAVE_CHUNK_FILE_READAHEAD */
+
 ssize_t
 chunk_file_pread_chunk (chunk *c, void *buf, size_t count)
 {
@@ -262,6 +451,14 @@ chunk_file_pread_chunk (chunk *c, void *buf, size_t count)
             return chunk_file_pread_chunk(c, buf, count);/*(tail recurse once)*/
         }
         c->file.busy = (errnum == EAGAIN || errnum == EINTR);
+      #ifdef HAVE_CHUNK_FILE_READAHEAD
+        /* read into page cache asynchronously, if enabled, so that the retry
+         * after read-ahead completes does not block (callers yield and retry
+         * if c->file.busy; see chunkqueue_readahead_wait()) */
+        if (errnum == EAGAIN && chunk_aio.fdn)
+            chunk_file_readahead_submit(c, CHUNK_AIO_READ_SZ);
+        errno = errnum;
+      #endif
         return rd;
     }
     /* Linux 5.9 and Linux 5.10 have a bug where preadv2() with the
@@ -295,6 +492,10 @@ static void chunk_reset_file_chunk(chunk *c) {
   #ifdef HAVE_MMAP
 	if (c->file.view)
 		c->file.view = chunk_file_view_release(c->file.view);
+  #endif
+  #ifdef HAVE_CHUNK_FILE_READAHEAD
+	if (c->file.aio)
+		chunk_file_readahead_detach(c);
   #endif
 	c->file.fd = -1;
 	c->file.length = 0;
@@ -303,8 +504,19 @@ static void chunk_reset_file_chunk(chunk *c) {
 	c->type = MEM_CHUNK;
 }
 
+static void chunk_reset_pipe_chunk(chunk *c) {
+	close(c->file.fd);
+	close(c->file.pfd);
+	if (chunks_pipechunk_cur_fds) *chunks_pipechunk_cur_fds -= 2;
+	c->file.fd = -1;
+	c->file.pfd = -1;
+	c->file.length = 0;
+	c->type = MEM_CHUNK;
+}
+
 static void chunk_reset(chunk *c) {
 	if (c->type == FILE_CHUNK) chunk_reset_file_chunk(c);
+	else if (c->type == PIPE_CHUNK) chunk_reset_pipe_chunk(c);
 
 	buffer_clear(c->mem);
 	c->offset = 0;
@@ -312,6 +524,7 @@ static void chunk_reset(chunk *c) {
 
 static void chunk_free(chunk *c) {
 	if (c->type == FILE_CHUNK) chunk_reset_file_chunk(c);
+	else if (c->type == PIPE_CHUNK) chunk_reset_pipe_chunk(c);
 	buffer_free(c->mem);
 	free(c);
 }
@@ -452,6 +665,23 @@ static chunk * chunk_acquire(size_t sz) {
 
 static void chunk_release(chunk *c) {
     const size_t sz = c->mem->size;
+  #ifdef HAVE_SPLICE
+    if (c->type == PIPE_CHUNK) {
+        /* keep (small number of) empty pipes for reuse */
+        if (c->file.length == c->offset && chunks_pipechunk_n < 16) {
+            ++chunks_pipechunk_n;
+            c->file.length = 0;
+            c->offset = 0;
+            c->next = chunks_pipechunk;
+            chunks_pipechunk = c;
+            return;
+        }
+        chunk_reset(c);
+        c->next = chunks_filechunk;
+        chunks_filechunk = c;
+        return;
+    }
+  #endif
     if (sz == (chunk_buf_sz|1)) {
         chunk_reset(c);
         c->next = chunks;
@@ -499,6 +729,14 @@ void chunkqueue_chunk_pool_clear(void)
         chunk_free(c);
     }
     chunks_filechunk = NULL;
+  #ifdef HAVE_SPLICE
+    for (chunk *next, *c = chunks_pipechunk; c; c = next) {
+        next = c->next;
+        chunk_free(c);
+    }
+    chunks_pipechunk = NULL;
+    chunks_pipechunk_n = 0;
+  #endif
 }
 
 void chunkqueue_chunk_pool_free(void)
@@ -518,7 +756,7 @@ void chunkqueue_chunk_pool_free(void)
 
 __attribute_pure__
 static off_t chunk_remaining_length(const chunk *c) {
-    /* MEM_CHUNK or FILE_CHUNK */
+    /* MEM_CHUNK or FILE_CHUNK or PIPE_CHUNK */
     return (c->type == MEM_CHUNK
               ? (off_t)buffer_clen(c->mem)
               : c->file.length)
@@ -800,7 +1038,28 @@ static void chunkqueue_steal_partial_file_chunk(chunkqueue * const restrict dest
     chunkqueue_dup_file_chunk_fd(dest->last, c);
 }
 
-void chunkqueue_steal(chunkqueue * const restrict dest, chunkqueue * const restrict src, off_t len) {
+__attribute_cold__
+__attribute_noinline__
+static off_t chunkqueue_steal_partial_pipe_chunk(chunkqueue * const restrict dest, const chunk * const restrict c, const off_t len) {
+    /* (not expected; PIPE_CHUNK is consumed by network write)
+     * pipe data can not be split in place, so read len from pipe into memory
+     * (pipe contains at least len, so read() does not block)
+     *(returns num bytes read from pipe; less than len on error) */
+    buffer * const b = chunkqueue_append_buffer_open_sz(dest, (size_t)len+1);
+    char * const ptr = b->ptr + buffer_clen(b);
+    off_t n = 0;
+    for (ssize_t rd; n < len; n += rd) {
+        do {
+            rd = read(c->file.fd, ptr+n, (size_t)(len - n));
+        } while (rd < 0 && errno == EINTR);
+        if (rd <= 0) break;
+        buffer_commit(b, (size_t)rd);
+    }
+    chunkqueue_append_buffer_commit(dest);
+    return n;
+}
+
+int chunkqueue_steal(chunkqueue * const restrict dest, chunkqueue * const restrict src, off_t len) {
 	/*(0-length first chunk (unexpected) is removed from src even if len == 0;
          * progress is made when caller loops on this func)*/
 	off_t clen;
@@ -832,6 +1091,15 @@ void chunkqueue_steal(chunkqueue * const restrict dest, chunkqueue * const restr
 				/* tempfile flag is in "last" chunk after the split */
 				chunkqueue_steal_partial_file_chunk(dest, c, len);
 				break;
+			case PIPE_CHUNK:
+				clen = chunkqueue_steal_partial_pipe_chunk(dest, c, len);
+				if (__builtin_expect( (clen != len), 0)) {
+					/* pipe data lost; response can not be completed */
+					c->offset += clen;
+					src->bytes_out += clen;
+					return -1;
+				}
+				break;
 			}
 
 			c->offset += len;
@@ -840,6 +1108,8 @@ void chunkqueue_steal(chunkqueue * const restrict dest, chunkqueue * const restr
 
 		src->bytes_out += clen;
 	} while ((len -= clen));
+
+	return 0;
 }
 
 static int chunkqueue_get_append_mkstemp(buffer * const b, const char *path, const uint32_t len) {
@@ -1278,6 +1548,67 @@ ssize_t chunkqueue_append_splice_sock_tempfile(chunkqueue * const restrict cq, c
     return wr;
 }
 
+void chunkqueue_pipechunk_cur_fds(int *cur_fds) {
+    /*(pipe fds in PIPE_CHUNK, including pipes kept in pool for reuse,
+     * are counted in server cur_fds, along with sockets and other fds)*/
+    chunks_pipechunk_cur_fds = cur_fds;
+}
+
+int chunkqueue_splice_pipe_enabled(void) {
+    /*(PIPE_CHUNK enabled along with internal pipes (feature chunkqueue.splice)
+     * and is used only where chunkqueue is written directly to socket)*/
+    return (-1 != cqpipes[1]);
+}
+
+__attribute_returns_nonnull__
+static chunk * chunk_acquire_pipechunk(void) {
+    if (chunks_pipechunk) {
+        --chunks_pipechunk_n;
+        chunk *c = chunks_pipechunk;
+        chunks_pipechunk = c->next;
+        c->next = NULL;
+        return c;
+    }
+    return chunk_acquire_filechunk();
+}
+
+ssize_t chunkqueue_append_splice_sock_pipe(chunkqueue * const restrict cq, const int fd, unsigned int len) {
+    /* splice() socket data into pipe in PIPE_CHUNK at end of cq,
+     * to later be splice()d from pipe to socket without copying to userspace
+     *(returns num bytes spliced, or 0 if not handled (e.g. pipe full);
+     * caller should fall back to read() to handle EOF or socket error)*/
+    chunk *c = cq->last;
+    if (NULL == c || c->type != PIPE_CHUNK) {
+        c = chunk_acquire_pipechunk();
+        if (c->type != PIPE_CHUNK) {
+            int fds[2];
+            if (0 != fdevent_pipe_cloexec(fds, 262144)) {
+                chunk_release(c);
+                return 0;
+            }
+            if (chunks_pipechunk_cur_fds) *chunks_pipechunk_cur_fds += 2;
+            c->type = PIPE_CHUNK;
+            c->file.fd = fds[0];
+            c->file.pfd = fds[1];
+        }
+        chunkqueue_append_chunk(cq, c);
+    }
+
+    ssize_t wr;
+    do {
+        wr = splice(fd, NULL, c->file.pfd, NULL, len,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    } while (wr < 0 && errno == EINTR);
+    if (__builtin_expect( (wr > 0), 1)) {
+        c->file.length += wr;
+        cq->bytes_in += wr;
+        return wr;
+    }
+    if (0 == chunk_remaining_length(c))
+        chunkqueue_remove_empty_chunks(cq); /*(return empty pipe to pool)*/
+    return 0;
+}
+
 #endif /* HAVE_SPLICE */
 
 int chunkqueue_steal_with_tempfiles(chunkqueue * const restrict dest, chunkqueue * const restrict src, off_t len, log_error_st * const restrict errh) {
@@ -1295,10 +1626,10 @@ int chunkqueue_steal_with_tempfiles(chunkqueue * const restrict dest, chunkqueue
 			if (__builtin_expect( (clen < 0), 0)) return -1;
 			chunkqueue_mark_written(src, clen);
 		}
-		else { /* (c->type == FILE_CHUNK) */
+		else { /* (c->type == FILE_CHUNK || c->type == PIPE_CHUNK) */
 			clen = chunk_remaining_length(c);
 			if (len < clen) clen = len;
-			chunkqueue_steal(dest, src, clen);
+			if (0 != chunkqueue_steal(dest, src, clen)) return -1;
 		}
 
 	  #else
@@ -1308,7 +1639,8 @@ int chunkqueue_steal_with_tempfiles(chunkqueue * const restrict dest, chunkqueue
 
 		switch (c->type) {
 		case FILE_CHUNK:
-			chunkqueue_steal(dest, src, clen);
+		case PIPE_CHUNK:
+			if (0 != chunkqueue_steal(dest, src, clen)) return -1;
 			break;
 
 		case MEM_CHUNK:
@@ -1348,11 +1680,13 @@ void chunkqueue_append_cq_range (chunkqueue * const dst, const chunkqueue * cons
             chunkqueue_append_file(dst, c->mem, c->offset + offset, clen);
             chunkqueue_dup_file_chunk_fd(dst->last, c);
         }
-        else { /*(c->type == MEM_CHUNK)*/
+        else if (c->type == MEM_CHUNK) {
             /*(string refs would reduce copying,
              * but this path is not expected to be hot)*/
             chunkqueue_append_mem(dst, c->mem->ptr + c->offset + offset, clen);
         }
+        /*(PIPE_CHUNK not expected here; pipe data can not be copied
+         * without consuming it)*/
         offset = 0;
     }
 }
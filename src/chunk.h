@@ -5,6 +5,7 @@
 #include "buffer.h"
 #include "array.h"
 #include "fdlog.h"
+#include "sys-uring.h"
 
 /* both should be way smaller than SSIZE_MAX :) */
 #define MAX_READ_LIMIT  (256*1024)
@@ -19,13 +20,16 @@ typedef struct chunk_file_view {
 
 typedef struct chunk {
 	struct chunk *next;
-	enum { MEM_CHUNK, FILE_CHUNK } type;
+	enum { MEM_CHUNK, FILE_CHUNK, PIPE_CHUNK } type;
 
 	buffer *mem; /* either the storage of the mem-chunk or the name of the file */
 
 	/* the size of the chunk is either:
 	 * - mem-chunk: buffer_string_length(chunk::mem) - c->offset
 	 * - file-chunk: chunk::file.length - c->offset
+	 * - pipe-chunk: chunk::file.length - c->offset
+	 *   (file.length is total octets spliced into pipe, c->offset is octets
+	 *    spliced out of pipe, file.fd is read end of pipe)
 	 */
 	off_t offset;
 
@@ -34,6 +38,7 @@ typedef struct chunk {
 		off_t  length; /* end pos + 1 in file (octets to send: file.length - c->offset) */
 
 		int    fd;
+		int    pfd;    /* pipechunk: write end of pipe */
 		uint8_t is_temp; /* file is temporary and will be deleted if on cleanup */
 		uint8_t busy;    /* file chunk not in page cache; reading might block */
 		uint8_t flagmask;/* (internal; used with preadv2() RWF_NOWAIT) */
@@ -42,6 +47,7 @@ typedef struct chunk {
 	  #endif
 		void *ref;
 		void(*refchg)(void *, int);
+		struct chunk_aio_op *aio; /* (internal; pending async read-ahead) */
 	} file;
 } chunk;
 
@@ -60,6 +66,27 @@ ssize_t chunk_file_pread (int fd, void *buf, size_t count, off_t offset);
 /* attempts non-blocking preadv2 RWF_NOWAIT on Linux, else chunk_file_pread() */
 ssize_t chunk_file_pread_chunk (chunk *c, void *buf, size_t count);
 
+#if defined(HAVE_SYS_URING) && defined(HAVE_PREADV2)
+#define HAVE_CHUNK_FILE_READAHEAD
+
+/* asynchronous read-ahead of (up to len) FILE_CHUNK data into page cache
+ * returns 1 if read-ahead is pending (caller should yield and try again later)
+ * returns 0 if data is in page cache, or if read-ahead is not available */
+int chunk_file_readahead (chunk *c, off_t len);
+
+/* returns 1 and schedules cb(ctx) upon completion if read-ahead is pending
+ * on first chunk in cq, else returns 0 */
+int chunkqueue_readahead_wait (chunkqueue *cq, void(*cb)(void *), void *ctx);
+
+struct fdevents;        /* declaration */
+__attribute_cold__
+int chunkqueue_internal_aio (struct fdevents *ev, int init);
+#else
+#define chunk_file_readahead(c, len) 0
+#define chunkqueue_readahead_wait(cq, cb, ctx) 0
+#define chunkqueue_internal_aio(ev, init) do { } while (0)
+#endif
+
 __attribute_returns_nonnull__
 buffer * chunk_buffer_acquire(void);
 
@@ -122,10 +149,17 @@ int chunkqueue_append_mem_to_tempfile(chunkqueue * restrict cq, const char * res
 #ifdef HAVE_SPLICE
 ssize_t chunkqueue_append_splice_pipe_tempfile(chunkqueue * restrict cq, int fd, unsigned int len, log_error_st * restrict errh);
 ssize_t chunkqueue_append_splice_sock_tempfile(chunkqueue * restrict cq, int fd, unsigned int len, log_error_st * restrict errh);
+ssize_t chunkqueue_append_splice_sock_pipe(chunkqueue * restrict cq, int fd, unsigned int len);
+__attribute_pure__
+int chunkqueue_splice_pipe_enabled(void);
 __attribute_cold__
 void chunkqueue_internal_pipes(int init);
+__attribute_cold__
+void chunkqueue_pipechunk_cur_fds(int *cur_fds);
 #else
 #define chunkqueue_internal_pipes(init) do { } while (0)
+#define chunkqueue_pipechunk_cur_fds(cur_fds) do { } while (0)
+#define chunkqueue_splice_pipe_enabled() 0
 #endif
 
 /* functions to handle buffers to read into: */
@@ -152,7 +186,7 @@ void chunkqueue_remove_finished_chunks(chunkqueue *cq);
 __attribute_cold__
 void chunkqueue_remove_empty_chunks(chunkqueue *cq);
 
-void chunkqueue_steal(chunkqueue * restrict dest, chunkqueue * restrict src, off_t len);
+int chunkqueue_steal(chunkqueue * restrict dest, chunkqueue * restrict src, off_t len);
 int chunkqueue_steal_with_tempfiles(chunkqueue * restrict dest, chunkqueue * restrict src, off_t len, log_error_st * const restrict errh);
 void chunkqueue_append_cq_range (chunkqueue *dst, const chunkqueue *src, off_t offset, off_t len);
 
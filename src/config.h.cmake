@@ -19,6 +19,7 @@
 #cmakedefine  HAVE_LINUX_RANDOM_H
 #cmakedefine  HAVE_MALLOC_H
 #cmakedefine  HAVE_POLL_H
+#cmakedefine  HAVE_PTHREAD_H
 #cmakedefine  HAVE_PORT_H
 #cmakedefine  HAVE_PRIV_H
 #cmakedefine  HAVE_PWD_H
@@ -28,6 +29,8 @@
 #cmakedefine  HAVE_SYSLOG_H
 #cmakedefine  HAVE_SYS_DEVPOLL_H
 #cmakedefine  HAVE_SYS_EPOLL_H
+#cmakedefine  HAVE_SYS_EVENTFD_H
+#cmakedefine  HAVE_LINUX_IO_URING_H
 #cmakedefine  HAVE_SYS_EVENT_H
 #cmakedefine  HAVE_SYS_FILIO_H
 #cmakedefine  HAVE_SYS_LOADAVG_H
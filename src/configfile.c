@@ -760,6 +760,21 @@ static int config_insert_srvconf(server *srv) {
      ,{ CONST_STR_LEN("server.feature-flags"),
         T_CONFIG_ARRAY_KVANY,
         T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.cpu-affinity"),
+        T_CONFIG_ARRAY_VLIST,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.stat-cache-max-fds"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.stat-cache-fd-ttl"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.stat-cache-mem-max-file"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("server.stat-cache-mem-max"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -916,6 +931,22 @@ static int config_insert_srvconf(server *srv) {
                     array_get_element_klen(cpv->v.a,
                       CONST_STR_LEN("server.absolute-dir-redirect")), 0);
                 break;
+              case 33:/* server.cpu-affinity */
+                if (cpv->v.a->used)
+                    srv->srvconf.cpu_affinity = cpv->v.a;
+                break;
+              case 34:/* server.stat-cache-max-fds */
+                srv->srvconf.stat_cache_max_fds = cpv->v.shrt;
+                break;
+              case 35:/* server.stat-cache-fd-ttl */
+                srv->srvconf.stat_cache_fd_ttl = cpv->v.shrt;
+                break;
+              case 36:/* server.stat-cache-mem-max-file */
+                srv->srvconf.stat_cache_mem_max_file = cpv->v.u;
+                break;
+              case 37:/* server.stat-cache-mem-max */
+                srv->srvconf.stat_cache_mem_max = cpv->v.u;
+                break;
               default:/* should not happen */
                 break;
             }
@@ -1371,6 +1402,11 @@ int config_finalize(server *srv, const buffer *default_server_tag) {
         config_feature_bool(srv, "server.metrics-high-precision",
                             srv->srvconf.high_precision_timestamps);
 
+    /* request phase timestamps might be enabled during set_defaults()
+     * (e.g. mod_accesslog %{PHASE}T) */
+    request_timing =
+      config_feature_bool(srv, "server.request-timing", request_timing);
+
     /* disable h2proto if mod_h2 was not found during plugin load */
     p->defaults.h2proto = srv->srvconf.h2proto;
 
@@ -17,6 +17,7 @@
 #include "plugins.h"
 
 #include "sock_addr_cache.h"
+#include "worker_stats.h"
 
 #include <sys/stat.h>
 #include "sys-unistd.h" /* <unistd.h> */
@@ -169,6 +170,7 @@ connection_handle_request_start_state (request_st * const r, connection * const
     r->loops_per_request = 0;
     if (r->conf.high_precision_timestamps)
         log_clock_gettime_realtime(&r->start_hp);
+    request_timing_start(r);
 }
 
 
@@ -180,13 +182,18 @@ static void connection_handle_response_end_state(request_st * const r, connectio
 		r->http_status = 100; /* XXX: what if con->state == CON_STATE_ERROR? */
 		/*if (r->http_status)*/
 			plugins_call_handle_request_done(r);
+		worker_stats_requests_inc();
 		connection_handle_shutdown(con);
 		return;
 	}
 
 	/* call request_done hook if http_status set (e.g. to log request) */
 	/* (even if error, connection dropped, as long as http_status is set) */
-	if (r->http_status) plugins_call_handle_request_done(r);
+	if (r->http_status) {
+		request_timing_set(r, REQ_TIMING_RESP_END);
+		plugins_call_handle_request_done(r);
+		worker_stats_request_done(r);
+	}
 
 	if (r->reqbody_length != r->reqbody_queue.bytes_in
 	    || r->state == CON_STATE_ERROR) {
@@ -245,6 +252,20 @@ connection_write_throttle (const connection * const con, off_t max_bytes)
 }
 
 
+#ifdef HAVE_CHUNK_FILE_READAHEAD
+static void
+connection_write_readahead_cb (void * const ctx)
+{
+    /* resume writing after async read-ahead of file data completes
+     * (rate limit, if reached, is reset by connection_check_timeout()) */
+    connection * const con = ctx;
+    con->traffic_limit_reached &= ~2;
+    con->is_writable = 1;
+    joblist_append(con);
+}
+#endif
+
+
 static int
 connection_write_chunkqueue (connection * const con, chunkqueue * const restrict cq, off_t max_bytes)
 {
@@ -253,8 +274,10 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
     con->write_request_ts = log_monotonic_secs;
 
     max_bytes = connection_write_throttle(con, max_bytes);
-    if (__builtin_expect( (0 == max_bytes), 0))
-        return (con->traffic_limit_reached = 1);
+    if (__builtin_expect( (0 == max_bytes), 0)) {
+        con->traffic_limit_reached |= 1;
+        return 1;
+    }
 
     off_t written = cq->bytes_out;
     int ret;
@@ -302,10 +325,21 @@ connection_write_chunkqueue (connection * const con, chunkqueue * const restrict
 
     written = cq->bytes_out - written;
     con->bytes_written_cur_second += written;
+    worker_stats_bytes_out_add(written);
     request_st * const r = &con->request;
+    if (request_timing && written && !r->timing[REQ_TIMING_RESP_START])
+        r->timing[REQ_TIMING_RESP_START] = request_timing_ns();
     if (r->conf.global_bytes_per_second_cnt_ptr)
         *(r->conf.global_bytes_per_second_cnt_ptr) += written;
 
+    /* pause writing (similar to rate limit) while waiting for file data
+     * to be read into page cache (network backend "io_uring") */
+    if (ret >= 0
+        && chunkqueue_readahead_wait(cq, connection_write_readahead_cb, con)) {
+        con->traffic_limit_reached |= 2;
+        return 1;
+    }
+
     /* return 1 for caller to set con->is_writable = 0 when cq not empty *and*
      * bytes have been sent from cq in order to not spin trying to send HTTP/2
      * server Connection Preface while waiting for TLS negotiation to complete*/
@@ -590,6 +624,7 @@ connection *connection_accepted(server *srv, const server_socket *srv_socket, so
 		connection *con;
 
 		srv->cur_fds++;
+		worker_stats_conns_inc();
 
 		con = connections_get_new_connection(srv);
 
@@ -22,6 +22,10 @@
 __attribute_cold__
 static int fdevent_linux_sysepoll_init(struct fdevents *ev);
 #endif
+#ifdef FDEVENT_USE_LINUX_IO_URING
+__attribute_cold__
+static int fdevent_linux_io_uring_init(struct fdevents *ev);
+#endif
 #ifdef FDEVENT_USE_FREEBSD_KQUEUE
 __attribute_cold__
 static int fdevent_freebsd_kqueue_init(struct fdevents *ev);
@@ -61,6 +65,10 @@ fdevent_config (const char **event_handler_name, log_error_st *errh)
         { FDEVENT_HANDLER_LINUX_SYSEPOLL, "linux-sysepoll" },
         { FDEVENT_HANDLER_LINUX_SYSEPOLL, "epoll" },
       #endif
+      #ifdef FDEVENT_USE_LINUX_IO_URING
+        { FDEVENT_HANDLER_LINUX_IO_URING, "linux-io_uring" },
+        { FDEVENT_HANDLER_LINUX_IO_URING, "io_uring" },
+      #endif
       #ifdef FDEVENT_USE_SOLARIS_PORT
         { FDEVENT_HANDLER_SOLARIS_PORT,   "solaris-eventports" },
       #endif
@@ -150,6 +158,11 @@ fdevent_show_event_handlers (void)
      #else
       "\t- epoll (Linux)\n"
      #endif
+     #ifdef FDEVENT_USE_LINUX_IO_URING
+      "\t+ io_uring (Linux)\n"
+     #else
+      "\t- io_uring (Linux)\n"
+     #endif
      #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
       "\t+ /dev/poll (Solaris)\n"
      #else
@@ -214,6 +227,11 @@ fdevent_init (const char *event_handler, int *max_fds, int *cur_fds, log_error_s
         if (0 == fdevent_linux_sysepoll_init(ev)) return ev;
         break;
      #endif
+     #ifdef FDEVENT_USE_LINUX_IO_URING
+      case FDEVENT_HANDLER_LINUX_IO_URING:
+        if (0 == fdevent_linux_io_uring_init(ev)) return ev;
+        break;
+     #endif
      #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
       case FDEVENT_HANDLER_SOLARIS_DEVPOLL:
         if (0 == fdevent_solaris_devpoll_init(ev)) return ev;
@@ -409,6 +427,193 @@ fdevent_linux_sysepoll_init (fdevents *ev)
 #endif /* FDEVENT_USE_LINUX_EPOLL */
 
 
+#ifdef FDEVENT_USE_LINUX_IO_URING
+
+/* io_uring
+ *
+ * Interest changes are queued in the submission queue (SQ) as one-shot
+ * IORING_OP_POLL_ADD and IORING_OP_POLL_REMOVE entries, and the queued
+ * entries are submitted in the same io_uring_enter() syscall which waits for
+ * completions in fdevent_linux_io_uring_poll(), instead of one epoll_ctl()
+ * syscall per interest change.  After a poll completes and the handler runs,
+ * the poll is re-armed with the current interest (unless the handler changed
+ * or removed the interest), and the re-armed poll completes immediately if
+ * the fd is still ready, providing the level-triggered behavior expected by
+ * lighttpd handlers.
+ *
+ * The user_data of each POLL_ADD encodes the fd and a sequence number which
+ * is saved in fdn->fde_ndx, so that completions from stale polls (interest
+ * changed, or fd closed and then reused) are ignored.  POLL_REMOVE entries
+ * are submitted with user_data 0.  Since a pending poll holds a reference to
+ * the file, callers must remove interest (fdevent_fdnode_event_del()) before
+ * closing an fd, as is already done throughout lighttpd.
+ */
+
+#include <poll.h>
+
+static uint64_t
+fdevent_linux_io_uring_udata (const int fd, const int seq)
+{
+    return ((uint64_t)(uint32_t)seq << 32) | (uint32_t)fd;
+}
+
+static int
+fdevent_linux_io_uring_poll_add (fdevents * const ev, const int fd, const int seq, int events)
+{
+    struct io_uring_sqe * const sqe = sys_uring_get_sqe(&ev->uring);
+    if (NULL == sqe) return -1;
+  #if (defined(__linux__) && (defined(__sparc__) || defined(__sparc)))
+    if (events & FDEVENT_RDHUP) {
+        events &= ~FDEVENT_RDHUP;
+        events |= POLLRDHUP;
+    }
+  #endif
+    uint32_t mask = (uint32_t)events;
+  #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    mask = (mask << 16) | (mask >> 16); /*(poll32_events is halfword-swapped)*/
+  #endif
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    sqe->user_data = fdevent_linux_io_uring_udata(fd, seq);
+    return 0;
+}
+
+static int
+fdevent_linux_io_uring_poll_remove (fdevents * const ev, const int fd, const int seq)
+{
+    struct io_uring_sqe * const sqe = sys_uring_get_sqe(&ev->uring);
+    if (NULL == sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = fdevent_linux_io_uring_udata(fd, seq);
+    sqe->user_data = 0;
+    return 0;
+}
+
+static int
+fdevent_linux_io_uring_event_del (fdevents *ev, fdnode *fdn)
+{
+    return fdevent_linux_io_uring_poll_remove(ev, fdn->fd, fdn->fde_ndx);
+}
+
+static int
+fdevent_linux_io_uring_event_set (fdevents *ev, fdnode *fdn, int events)
+{
+    if (-1 != fdn->fde_ndx
+        && 0 != fdevent_linux_io_uring_poll_remove(ev,fdn->fd,fdn->fde_ndx))
+        return -1;
+    /* (seq is never 0 (user_data 0 is reserved) and never -1 (unregistered))*/
+    int seq = (ev->uring_seq + 1) & 0x7FFFFFFF;
+    fdn->fde_ndx = ev->uring_seq = seq ? seq : 1;
+    return fdevent_linux_io_uring_poll_add(ev, fdn->fd, fdn->fde_ndx, events);
+}
+
+static int
+fdevent_linux_io_uring_poll (fdevents * const ev, int timeout_ms)
+{
+    sys_uring * const ring = &ev->uring;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0) {
+        ts.tv_sec  = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    /* submit queued interest changes and wait for completions */
+    uint32_t head = *ring->cq_khead;
+    const uint32_t to_submit = sys_uring_sq_flush(ring);
+    const uint32_t min_complete = (head == sys_uring_cq_tail(ring));
+    if (sys_uring_enter(ring, to_submit, min_complete,
+                        IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                        &arg, sizeof(arg)) < 0) {
+        switch (errno) {
+          case ETIME:
+          case EAGAIN:
+          case EBUSY:
+            break;
+          default:
+            return -1;
+        }
+    }
+
+    int n = 0;
+    fdnode ** const fdarray = ev->fdarray;
+    const uint32_t tail = sys_uring_cq_tail(ring);
+    while (head != tail) {
+        const struct io_uring_cqe * const cqe =
+          ring->cqes + (head & ring->cq_mask);
+        const uint64_t ud = cqe->user_data;
+        const int res = cqe->res;
+        /* release CQE before running handler (which might submit SQEs) */
+        sys_uring_cq_advance(ring, ++head);
+        if (0 == ud || -ECANCELED == res) continue;/*POLL_REMOVE or canceled*/
+        const int fd = (int)(uint32_t)ud;
+        const int seq = (int)(ud >> 32);
+        fdnode *fdn = fdarray[fd];
+        if (NULL == fdn || ((uintptr_t)fdn & 0x3) || fdn->fde_ndx != seq)
+            continue; /* stale completion */
+        ++n;
+        (*fdn->handler)(fdn->ctx, res >= 0 ? res : FDEVENT_ERR);
+        /* re-arm one-shot poll if interest was not modified by handler
+         * (fdn might have been freed by handler; check fdarray again) */
+        fdn = fdarray[fd];
+        if (NULL != fdn && 0 == ((uintptr_t)fdn & 0x3) && fdn->fde_ndx == seq
+            && 0 != fdevent_linux_io_uring_poll_add(ev, fd, seq, fdn->events))
+            log_perror(ev->errh, __FILE__, __LINE__,
+              "io_uring poll re-arm failed on fd %d", fd);
+    }
+    return n;
+}
+
+__attribute_cold__
+static void
+fdevent_linux_io_uring_free (fdevents *ev)
+{
+    sys_uring_free(&ev->uring);
+}
+
+__attribute_cold__
+static int
+fdevent_linux_io_uring_init (fdevents *ev)
+{
+    ck_static_assert(POLLIN    == FDEVENT_IN);
+    ck_static_assert(POLLPRI   == FDEVENT_PRI);
+    ck_static_assert(POLLOUT   == FDEVENT_OUT);
+    ck_static_assert(POLLERR   == FDEVENT_ERR);
+    ck_static_assert(POLLHUP   == FDEVENT_HUP);
+    ck_static_assert(POLLNVAL  == FDEVENT_NVAL);
+  #ifdef POLLRDHUP
+   #if (defined(__linux__) && (defined(__sparc__) || defined(__sparc)))
+    ck_static_assert(POLLRDHUP  & FDEVENT_RDHUP);
+   #else
+    ck_static_assert(POLLRDHUP == FDEVENT_RDHUP);
+   #endif
+  #endif
+
+    ev->type      = FDEVENT_HANDLER_LINUX_IO_URING;
+    ev->event_set = fdevent_linux_io_uring_event_set;
+    ev->event_del = fdevent_linux_io_uring_event_del;
+    ev->poll      = fdevent_linux_io_uring_poll;
+    ev->free      = fdevent_linux_io_uring_free;
+
+    /* SQ sized for interest changes batched per loop iteration (and
+     * submitted early if full); CQ sized for a completion from each fd */
+    const uint32_t entries = ev->maxfds < 2048 ? 2048 : ev->maxfds;
+    if (0 != sys_uring_init(&ev->uring, entries, entries * 2)) {
+        if (errno == ENOSYS)
+            log_error(ev->errh, __FILE__, __LINE__,
+              "io_uring event-handler requires Linux kernel 5.11 or later");
+        return -1;
+    }
+    return 0;
+}
+
+#endif /* FDEVENT_USE_LINUX_IO_URING */
+
+
 #ifdef FDEVENT_USE_FREEBSD_KQUEUE
 
 #include <sys/event.h>
@@ -9,6 +9,11 @@
 struct epoll_event;     /* declaration */
 #endif
 
+#include "sys-uring.h"
+#ifdef HAVE_SYS_URING
+# define FDEVENT_USE_LINUX_IO_URING
+#endif
+
 /* MacOS 10.3.x has poll.h under /usr/include/, all other unixes
  * under /usr/include/sys/ */
 #if defined HAVE_POLL && (defined(HAVE_SYS_POLL_H) || defined(HAVE_POLL_H))
@@ -60,6 +65,7 @@ typedef enum {
     FDEVENT_HANDLER_SELECT,
     FDEVENT_HANDLER_POLL,
     FDEVENT_HANDLER_LINUX_SYSEPOLL,
+    FDEVENT_HANDLER_LINUX_IO_URING,
     FDEVENT_HANDLER_SOLARIS_DEVPOLL,
     FDEVENT_HANDLER_SOLARIS_PORT,
     FDEVENT_HANDLER_FREEBSD_KQUEUE
@@ -97,6 +103,10 @@ struct fdevents {
     int epoll_fd;
     struct epoll_event *epoll_events;
   #endif
+  #ifdef FDEVENT_USE_LINUX_IO_URING
+    int uring_seq;
+    sys_uring uring;
+  #endif
   #ifdef FDEVENT_USE_SOLARIS_DEVPOLL
     int devpoll_fd;
     struct pollfd *devpollfds;
@@ -37,7 +37,9 @@
 #include "fdevent.h"
 #include "http_header.h"
 #include "log.h"
+#include "rand.h"
 #include "sock_addr.h"
+#include "worker_stats.h"
 
 
 
@@ -117,6 +119,9 @@ static void gw_status_init_proc(gw_host *host, gw_proc *proc) {
     proc->stats_load =
       gw_status_get_counter(host, proc, CONST_STR_LEN(".load"));
     *proc->stats_load = 0;
+    proc->stats_latency =
+      gw_status_get_counter(host, proc, CONST_STR_LEN(".latency-us"));
+    *proc->stats_latency = 0;
 }
 
 static void gw_status_init_host(gw_host *host) {
@@ -190,6 +195,11 @@ static void gw_proc_free(gw_proc *proc) {
 
     gw_proc_free(proc->next);
 
+    /*(fdnode is freed with fdevents; close idle connection fd)*/
+    for (uint32_t i = 0; i < proc->idle_used; ++i)
+        fdio_close_socket(proc->idle[i].fdn->fd);
+    free(proc->idle);
+
     buffer_free(proc->unixsocket);
     buffer_free(proc->connection_name);
     free(proc->saddr);
@@ -232,6 +242,7 @@ static void gw_extensions_free(gw_exts *f) {
             gw_host_free(fe->hosts[j]);
         }
         free(fe->hosts);
+        free(fe->ring);
     }
     free(f->exts);
     free(f);
@@ -264,7 +275,7 @@ static int gw_extension_insert(gw_exts *ext, const buffer *key, gw_host *fh) {
     return 0;
 }
 
-static void gw_proc_connect_success(gw_host *host, gw_proc *proc, int debug, request_st * const r) {
+void gw_proc_connect_success(gw_host *host, gw_proc *proc, int debug, request_st * const r) {
     gw_proc_connected_inc(host, proc); /*(".connected")*/
     proc->last_used = log_monotonic_secs;
 
@@ -276,7 +287,7 @@ static void gw_proc_connect_success(gw_host *host, gw_proc *proc, int debug, req
 }
 
 __attribute_cold__
-static void gw_proc_connect_error(request_st * const r, gw_host *host, gw_proc *proc, pid_t pid, int errnum, int debug) {
+void gw_proc_connect_error(request_st * const r, gw_host *host, gw_proc *proc, pid_t pid, int errnum, int debug) {
     const unix_time64_t cur_ts = log_monotonic_secs;
     log_error_st * const errh = r->conf.errh;
   #ifdef _WIN32
@@ -355,6 +366,24 @@ static void gw_proc_release(gw_host *host, gw_proc *proc, int debug, log_error_s
     }
 }
 
+static void gw_proc_idle_close(fdevents * const ev, gw_proc * const proc, const unix_time64_t ts) {
+    /* close idle connections which became idle at or before ts
+     * (oldest idle connections are first in list) */
+    uint32_t n = 0;
+    while (n < proc->idle_used && proc->idle[n].ts <= ts)
+        fdevent_sched_close(ev, proc->idle[n++].fdn);
+    if (0 == n) return;
+    proc->idle_used -= n;
+    memmove(proc->idle, proc->idle+n, proc->idle_used * sizeof(*proc->idle));
+}
+
+static handler_t gw_handle_fdevent_idle(void *ctx, int revents) {
+    /* (idle connection is not registered for events) */
+    UNUSED(ctx);
+    UNUSED(revents);
+    return HANDLER_FINISHED;
+}
+
 __attribute_cold__
 static void gw_proc_check_enable(gw_host * const host, gw_proc * const proc, log_error_st * const errh) {
     if (log_monotonic_secs <= proc->disabled_until) return;
@@ -852,9 +881,101 @@ enum {
   GW_BALANCE_LEAST_CONNECTION,
   GW_BALANCE_RR,
   GW_BALANCE_HASH,
-  GW_BALANCE_STICKY
+  GW_BALANCE_STICKY,
+  GW_BALANCE_LEAST_LATENCY,
+  GW_BALANCE_P2C
 };
 
+/* peak-EWMA backend response latency
+ * Latency (until response headers received) is sampled per proc.  A sample
+ * higher than the average replaces it immediately (peak), so a slow or
+ * stalled backend is penalized at once; lower samples decay the average
+ * with weight 1/8.  The average is halved for every GW_EWMA_DECAY_SECS
+ * without samples so that a backend which received no traffic after a slow
+ * period is tried again. */
+#define GW_EWMA_DECAY_SECS 5
+
+__attribute_pure__
+static uint32_t gw_proc_ewma(const gw_proc * const proc) {
+    const unix_time64_t idle = log_monotonic_secs - proc->ewma_ts;
+    return (idle < GW_EWMA_DECAY_SECS)
+      ? proc->ewma_us
+      : (idle < GW_EWMA_DECAY_SECS*32)
+      ? proc->ewma_us >> (idle / GW_EWMA_DECAY_SECS)
+      : 0;
+}
+
+__attribute_pure__
+static uint64_t gw_ewma_cost(const uint32_t ewma_us, const uint32_t load) {
+    /* expected latency weighted by outstanding requests */
+    return (uint64_t)(ewma_us + 1) * (load + 1);
+}
+
+__attribute_pure__
+static uint64_t gw_host_cost(const gw_host * const host) {
+    /* lowest latency of running procs weighted by requests assigned to host
+     * (host->load includes requests which have not yet acquired a proc) */
+    uint32_t ewma_us = UINT32_MAX;
+    for (const gw_proc *proc = host->first; proc; proc = proc->next) {
+        if (proc->state != PROC_STATE_RUNNING) continue;
+        const uint32_t us = gw_proc_ewma(proc);
+        if (ewma_us > us) ewma_us = us;
+    }
+    return gw_ewma_cost(ewma_us, (uint32_t)host->load);
+}
+
+static int gw_host_least_cost(const gw_extension * const extension) {
+    int ndx = -1;
+    uint64_t min_cost = UINT64_MAX;
+    for (int k = 0; k < (int)extension->used; ++k) {
+        const gw_host * const host = extension->hosts[k];
+        if (0 == host->active_procs) continue;
+        const uint64_t cost = gw_host_cost(host);
+        if (cost < min_cost) {
+            min_cost = cost;
+            ndx = k;
+        }
+    }
+    return ndx;
+}
+
+static void gw_proc_latency_update(gw_proc * const proc, const uint32_t us) {
+    uint32_t ewma_us = gw_proc_ewma(proc);
+    if (us > ewma_us)
+        ewma_us = us;
+    else
+        ewma_us -= (ewma_us - us) >> 3;
+    proc->ewma_us = ewma_us;
+    proc->ewma_ts = log_monotonic_secs;
+    *proc->stats_latency = (int)(ewma_us <= INT_MAX ? ewma_us : INT_MAX);
+}
+
+static uint32_t gw_proc_latency_us(gw_handler_ctx * const hctx) {
+    const uint64_t ns = request_timing_ns() - hctx->latency_ns;
+    hctx->latency_ns = 0;
+    return ns < (uint64_t)UINT32_MAX * 1000
+      ? (uint32_t)(ns / 1000)
+      : UINT32_MAX;
+}
+
+void gw_proc_latency_sample(gw_handler_ctx * const hctx) {
+    const uint32_t us = gw_proc_latency_us(hctx);
+    if (hctx->proc) gw_proc_latency_update(hctx->proc, us);
+}
+
+void gw_proc_latency_error(gw_handler_ctx * const hctx) {
+    /* timeout or error before response headers received; record as peak
+     * sample of at least read_timeout (if set) so that proc which fails
+     * quickly is not preferred for its low latency */
+    if (0 == hctx->latency_ns) return;
+    uint32_t us = gw_proc_latency_us(hctx);
+    if (NULL == hctx->proc) return;
+    const uint32_t rsecs = hctx->host ? hctx->host->read_timeout : 0;
+    if (us < (uint64_t)rsecs * 1000000)
+        us = rsecs < UINT32_MAX / 1000000 ? rsecs * 1000000 : UINT32_MAX;
+    gw_proc_latency_update(hctx->proc, us);
+}
+
 __attribute_noinline__
 __attribute_pure__
 static uint32_t
@@ -863,6 +984,84 @@ gw_hash(const char *str, const uint32_t len, uint32_t hash)
     return djbhash(str, len, hash);
 }
 
+/* consistent hash ring (balance "hash" and "sticky")
+ * Each host is placed on the ring at GW_RING_VNODES * weight points.
+ * A key maps to the host of the first point at or after the hash of the key.
+ * Keys of a host which is down move to the next hosts on the ring; keys of
+ * other hosts do not move.  Adding or removing a host, or changing its
+ * weight, moves only keys to or from that host. */
+#define GW_RING_VNODES 160
+#define GW_RING_MAX_WEIGHT 256
+
+__attribute_const__
+static uint32_t
+gw_ring_mix(uint32_t h)
+{
+    /* (murmur3 fmix32 finalizer; spread djbhash values around the ring) */
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static int
+gw_ring_point_cmp(const void *a, const void *b)
+{
+    const struct gw_ring_point * const x = a;
+    const struct gw_ring_point * const y = b;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return x->ndx < y->ndx ? -1 : x->ndx > y->ndx;
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void
+gw_extension_ring_build(gw_extension * const ext)
+{
+    /* (built on first use by balance "hash" or "sticky"; ext->used > 1) */
+    uint32_t n = 0;
+    for (uint32_t j = 0; j < ext->used; ++j)
+        n += ext->hosts[j]->weight * GW_RING_VNODES;
+    struct gw_ring_point * const ring = ck_malloc(n * sizeof(*ring));
+    n = 0;
+    for (uint32_t j = 0; j < ext->used; ++j) {
+        const gw_host * const host = ext->hosts[j];
+        const uint32_t vnodes = host->weight * GW_RING_VNODES;
+        for (uint32_t v = 0; v < vnodes; ++v, ++n) {
+            ring[n].hash = gw_ring_mix(host->gw_hash ^ gw_ring_mix(v+1));
+            ring[n].ndx = j;
+        }
+    }
+    qsort(ring, n, sizeof(*ring), gw_ring_point_cmp);
+    ext->ring = ring;
+    ext->ring_used = n;
+}
+
+static int
+gw_ring_get(const gw_extension * const extension, const uint32_t key)
+{
+    /* binary search for first point at or after key (wrap around ring) */
+    const struct gw_ring_point * const ring = extension->ring;
+    const uint32_t n = extension->ring_used;
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        const uint32_t mid = lo + ((hi - lo) >> 1);
+        if (ring[mid].hash < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    /* skip points of hosts which are down */
+    for (uint32_t i = 0; i < n; ++i, ++lo) {
+        if (lo == n) lo = 0;
+        if (0 != extension->hosts[ring[lo].ndx]->active_procs)
+            return (int)ring[lo].ndx;
+    }
+    return -1;
+}
+
 static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int balance, int debug) {
     int ndx = -1;
     const int ext_used = (int)extension->used;
@@ -913,6 +1112,28 @@ static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int
         extension->last_used_ndx = ndx;
         break;
        }
+      case GW_BALANCE_LEAST_LATENCY:
+        /* lowest peak-EWMA latency weighted by load */
+        ndx = gw_host_least_cost(extension);
+        break;
+      case GW_BALANCE_P2C:
+       { /* power of two random choices; lower peak-EWMA cost of the two */
+        const uint32_t rnd = (uint32_t)li_rand_pseudo();
+        const int k1 = (int)(rnd % (uint32_t)ext_used);
+        const int k2 = (k1 + 1 + (int)((rnd >> 16) % (uint32_t)(ext_used-1)))
+                     % ext_used; /*(distinct from k1)*/
+        const gw_host * const h1 = extension->hosts[k1];
+        const gw_host * const h2 = extension->hosts[k2];
+        if (0 != h1->active_procs && 0 != h2->active_procs)
+            ndx = (gw_host_cost(h2) < gw_host_cost(h1)) ? k2 : k1;
+        else if (0 != h1->active_procs)
+            ndx = k1;
+        else if (0 != h2->active_procs)
+            ndx = k2;
+        else /* both down; choose among remaining active hosts */
+            ndx = gw_host_least_cost(extension);
+        break;
+       }
       case GW_BALANCE_HASH:
       case GW_BALANCE_STICKY:
        { /* hash balancing or source sticky balancing */
@@ -920,16 +1141,9 @@ static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int
           ? gw_hash(BUF_PTR_LEN(&r->uri.authority),
                     gw_hash(BUF_PTR_LEN(&r->uri.path), DJBHASH_INIT))
           : gw_hash(BUF_PTR_LEN(r->dst_addr_buf), DJBHASH_INIT);
-        uint32_t last_max = 0;
-        for (int k = 0; k < ext_used; ++k) {
-            const gw_host * const host = extension->hosts[k];
-            if (0 == host->active_procs) continue;
-            const uint32_t cur_max = base_hash ^ host->gw_hash;
-            if (last_max <= cur_max) {
-                last_max = cur_max;
-                ndx = k;
-            }
-        }
+        if (__builtin_expect( (NULL == extension->ring), 0))
+            gw_extension_ring_build(extension);
+        ndx = gw_ring_get(extension, gw_ring_mix(base_hash));
         break;
        }
       default:
@@ -977,7 +1191,7 @@ static gw_host * gw_host_get(request_st * const r, gw_extension *extension, int
     return NULL;
 }
 
-static int gw_establish_connection(request_st * const r, gw_host *host, gw_proc *proc, pid_t pid, int gw_fd, int debug) {
+int gw_establish_connection(request_st * const r, gw_host *host, gw_proc *proc, pid_t pid, int gw_fd, int debug) {
     if (-1 == connect(gw_fd, proc->saddr, proc->saddrlen)) {
       #ifdef _WIN32
         /* MS returns WSAEWOULDBLOCK instead of WSAEINPROGRESS for connect()
@@ -1319,6 +1533,18 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
      ,{ CONST_STR_LEN("upgrade"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("keep-alive-max-idle"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("keep-alive-idle-timeout"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("multiplex"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("weight"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -1393,6 +1619,8 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
             host->fix_root_path_name = 0;
             host->listen_backlog = SOMAXCONN > 1024 ? SOMAXCONN : 1024;
             host->xsendfile_allow = 0;
+            host->keepalive_idle_timeout = 30;
+            host->weight = 1;
             host->refcount = 0;
 
             config_plugin_value_t *cpv = cvlist;
@@ -1534,6 +1762,31 @@ int gw_set_defaults_backend(server *srv, gw_plugin_data *p, const array *a, gw_p
                   case 26:/* upgrade */
                     host->upgrade = (0 != cpv->v.u);
                     break;
+                  case 27:/* keep-alive-max-idle */
+                    host->keepalive_max_idle = cpv->v.shrt;
+                    break;
+                  case 28:/* keep-alive-idle-timeout */
+                    host->keepalive_idle_timeout = cpv->v.shrt;
+                    break;
+                  case 29:/* multiplex */
+                    if (0 != strcmp(cpkkey, "fastcgi.server")) {
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "\"multiplex\" is not supported in %s "
+                          "(supported only in fastcgi.server)", cpkkey);
+                        goto error;
+                    }
+                    host->multiplex = cpv->v.shrt;
+                    break;
+                  case 30:/* weight */
+                    host->weight = cpv->v.shrt;
+                    if (0 == host->weight || host->weight > GW_RING_MAX_WEIGHT){
+                        log_error(srv->errh, __FILE__, __LINE__,
+                          "weight must be between 1 and %d in: "
+                          "%s = (%s => (%s ( ...", GW_RING_MAX_WEIGHT,
+                          cpkkey, da_ext->key.ptr, da_host->key.ptr);
+                        goto error;
+                    }
+                    break;
                   default:
                     break;
                 }
@@ -1797,10 +2050,15 @@ int gw_get_defaults_balance(server *srv, const buffer *b) {
         return GW_BALANCE_HASH;
     if (buffer_eq_slen(b, CONST_STR_LEN("sticky")))
         return GW_BALANCE_STICKY;
+    if (buffer_eq_slen(b, CONST_STR_LEN("least-latency")))
+        return GW_BALANCE_LEAST_LATENCY;
+    if (buffer_eq_slen(b, CONST_STR_LEN("power-of-two")))
+        return GW_BALANCE_P2C;
 
     log_error(srv->errh, __FILE__, __LINE__,
       "xxxxx.balance has to be one of: "
-      "least-connection, round-robin, hash, sticky, but not: %s", b->ptr);
+      "least-connection, round-robin, hash, sticky, least-latency, "
+      "power-of-two, but not: %s", b->ptr);
     return GW_BALANCE_LEAST_CONNECTION;
 }
 
@@ -1823,6 +2081,52 @@ void gw_set_transparent(gw_handler_ctx *hctx) {
 }
 
 
+int gw_proc_acquire(gw_handler_ctx * const hctx) {
+    hctx->proc = NULL;
+
+    for (gw_proc *proc = hctx->host->first; proc; proc = proc->next) {
+         if (proc->state == PROC_STATE_RUNNING) {
+             hctx->proc = proc;
+             break;
+         }
+    }
+
+    if (hctx->proc == NULL) {
+        return 0;
+    }
+
+    if (hctx->conf.balance < GW_BALANCE_LEAST_LATENCY) {
+        /* check the other procs if they have a lower load */
+        for (gw_proc *proc = hctx->proc->next; proc; proc = proc->next) {
+            if (proc->state != PROC_STATE_RUNNING) continue;
+            if (proc->load < hctx->proc->load) hctx->proc = proc;
+        }
+    }
+    else {
+        /* check the other procs if they have a lower latency cost */
+        uint64_t min_cost =
+          gw_ewma_cost(gw_proc_ewma(hctx->proc), hctx->proc->load);
+        for (gw_proc *proc = hctx->proc->next; proc; proc = proc->next) {
+            if (proc->state != PROC_STATE_RUNNING) continue;
+            const uint64_t cost = gw_ewma_cost(gw_proc_ewma(proc), proc->load);
+            if (cost < min_cost) {
+                min_cost = cost;
+                hctx->proc = proc;
+            }
+        }
+        hctx->latency_ns = request_timing_ns();
+    }
+
+    gw_proc_load_inc(hctx->host, hctx->proc);
+
+    if (hctx->proc->is_local) {
+        hctx->pid = hctx->proc->pid;
+    }
+
+    return 1;
+}
+
+
 static void gw_host_hctx_enq(gw_handler_ctx * const hctx) {
     gw_host * const host = hctx->host;
     /*if (__builtin_expect( (host == NULL), 0)) return;*/
@@ -1851,11 +2155,100 @@ static void gw_host_hctx_deq(gw_handler_ctx * const hctx) {
 }
 
 
+static int gw_backend_keepalive(gw_handler_ctx * const hctx, request_st * const r) {
+    /* save connection to backend in proc idle list for reuse if backend
+     * response completed (not read until backend closed connection) and
+     * backend did not indicate that it will close connection */
+    if (!hctx->opts.keepalive) return 0;
+    if (hctx->opts.upgrade == 2) return 0;
+    if (hctx->state != GW_STATE_READ) return 0; /* request sent */
+    if (r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BACKEND_SHUT_WR)
+        return 0;
+    switch (hctx->opts.backend) {
+      case BACKEND_PROXY:
+        if (!r->resp_body_finished) return 0;
+        if (r->resp_decode_chunked
+            ? !r->gw_dechunk->done
+            : 0 != r->resp_body_scratchpad)
+            return 0;
+        if (hctx->response && !buffer_is_blank(hctx->response)) return 0;
+        break;
+      case BACKEND_FASTCGI:
+        if (-1 != hctx->request_id) return 0; /* FCGI_END_REQUEST received */
+        if (!chunkqueue_is_empty(hctx->rb)) return 0;
+        break;
+      default:
+        return 0;
+    }
+
+    gw_host * const host = hctx->host;
+    gw_proc * const proc = hctx->proc;
+    if (proc->state != PROC_STATE_RUNNING) return 0;
+    if (proc->idle_used >= host->keepalive_max_idle) return 0;
+    if (NULL == proc->idle)
+        proc->idle = ck_malloc(host->keepalive_max_idle * sizeof(*proc->idle));
+
+    fdnode * const fdn = hctx->fdn;
+    fdn->handler = gw_handle_fdevent_idle;
+    fdn->ctx = NULL;
+    proc->idle[proc->idle_used].fdn = fdn;
+    proc->idle[proc->idle_used].ts = log_monotonic_secs;
+    ++proc->idle_used;
+    return 1;
+}
+
+static int gw_backend_reuse(gw_handler_ctx * const hctx) {
+    /* reuse most recently idle connection to proc if still open
+     * (not closed by backend) and no data unexpectedly received */
+    gw_proc * const proc = hctx->proc;
+    do {
+        fdnode * const fdn = proc->idle[--proc->idle_used].fdn;
+        char c;
+        if (-1 == recv(fdn->fd, &c, 1, MSG_PEEK)
+          #ifdef _WIN32
+            && WSAGetLastError() == WSAEWOULDBLOCK
+          #else
+            && errno == EAGAIN
+          #endif
+           ) {
+            fdn->handler = gw_handle_fdevent;
+            fdn->ctx = hctx;
+            hctx->fdn = fdn;
+            hctx->fd = fdn->fd;
+            hctx->reused = 1;
+            return 1;
+        }
+        fdevent_sched_close(hctx->ev, fdn);
+    } while (proc->idle_used);
+    return 0;
+}
+
+__attribute_cold__
+static int gw_backend_reuse_retry(gw_handler_ctx * const hctx, request_st * const r) {
+    /* reused idle connection might have been closed by backend (e.g. backend
+     * keep-alive timeout) while request was sent.  Retry on new connection
+     * if nothing received from backend and request has no request body */
+    if (!hctx->reused) return 0;
+    if (r->resp_body_started || 0 != r->http_status) return 0;
+    if (0 != r->reqbody_length || hctx->gw_mode == GW_AUTHORIZER) return 0;
+    if (-1 == hctx->request_id) return 0;
+    if (hctx->response && !buffer_is_blank(hctx->response)) return 0;
+    if (hctx->rb && !chunkqueue_is_empty(hctx->rb)) return 0;
+    if (hctx->reconnects++ >= 5) return 0;
+
+    /* close other idle connections to proc, too; likely also closed */
+    gw_proc_idle_close(hctx->ev, hctx->proc, log_monotonic_secs);
+    chunkqueue_reset(&hctx->wb);
+    hctx->wb_reqlen = 0;
+    return 1;
+}
+
 static void gw_backend_close(gw_handler_ctx * const hctx, request_st * const r) {
     if (hctx->fd >= 0) {
         fdevent_fdnode_event_del(hctx->ev, hctx->fdn);
         /*fdevent_unregister(ev, hctx->fdn);*//*(handled below)*/
-        fdevent_sched_close(hctx->ev, hctx->fdn);
+        if (!gw_backend_keepalive(hctx, r))
+            fdevent_sched_close(hctx->ev, hctx->fdn);
         hctx->fdn = NULL;
         hctx->fd = -1;
         gw_host_hctx_deq(hctx);
@@ -1876,6 +2269,11 @@ static void gw_backend_close(gw_handler_ctx * const hctx, request_st * const r)
 static void gw_connection_close(gw_handler_ctx * const hctx, request_st * const r) {
     gw_plugin_data *p = hctx->plugin_data;
 
+    if (worker_stats_metrics && hctx->proc)
+        worker_stats_backend_done(hctx->proc->connection_name, r->http_status,
+                                  r->write_queue.bytes_in,
+                                  r->reqbody_queue.bytes_out);
+
     gw_backend_close(hctx, r);
     handler_ctx_free(hctx);
     r->plugin_ctx[p->id] = NULL;
@@ -1885,21 +2283,354 @@ static void gw_connection_close(gw_handler_ctx * const hctx, request_st * const
     }
 }
 
-static handler_t gw_reconnect(gw_handler_ctx * const hctx, request_st * const r) {
+int gw_host_reacquire(gw_handler_ctx * const hctx, request_st * const r) {
     gw_backend_close(hctx, r);
 
     hctx->host = gw_host_get(r,hctx->ext,hctx->conf.balance,hctx->conf.debug);
-    if (NULL == hctx->host) return HANDLER_FINISHED;
+    if (NULL == hctx->host) return 0;
 
     gw_host_assign(hctx->host);
-    hctx->request_id = 0;
     hctx->opts.xsendfile_allow = hctx->host->xsendfile_allow;
     hctx->opts.xsendfile_docroot = hctx->host->xsendfile_docroot;
+    return 1;
+}
+
+static handler_t gw_reconnect(gw_handler_ctx * const hctx, request_st * const r) {
+    if (!gw_host_reacquire(hctx, r)) return HANDLER_FINISHED;
+
+    hctx->request_id = 0;
     gw_set_state(hctx, GW_STATE_INIT);
     return HANDLER_COMEBACK;
 }
 
 
+/*
+ * connections to backend procs shared by multiplexed requests
+ */
+
+void gw_mpx_unlink(gw_handler_ctx * const hctx) {
+    gw_mpx * const mpx = hctx->mpx;
+    if (hctx->mpx_prev)
+        hctx->mpx_prev->mpx_next = hctx->mpx_next;
+    else
+        mpx->reqs = hctx->mpx_next;
+    if (hctx->mpx_next)
+        hctx->mpx_next->mpx_prev = hctx->mpx_prev;
+    hctx->mpx_prev = hctx->mpx_next = NULL;
+    hctx->mpx = NULL;
+    if (0 == --mpx->nreqs)
+        mpx->idle_ts = log_monotonic_secs;
+}
+
+
+static void gw_mpx_release(gw_mpx * const mpx) {
+    mpx->ops->free(mpx);
+    chunk_buffer_release(mpx->rbuf);
+    chunkqueue_reset(&mpx->wq);
+    free(mpx);
+}
+
+
+void gw_mpx_close(gw_mpx * const mpx, const int status, const int retry) {
+    gw_mpx **mp = mpx->ops->list;
+    while (*mp != mpx) mp = &(*mp)->next;
+    *mp = mpx->next;
+
+    if (mpx->nreqs)
+        log_error(mpx->srv->errh, __FILE__, __LINE__,
+          "%s connection to backend closed with %u active requests: %s",
+          mpx->ops->proto, mpx->nreqs, mpx->proc->connection_name->ptr);
+    while (mpx->reqs)
+        mpx->ops->fail(mpx->reqs, status, retry);
+
+    fdevent_fdnode_event_del(mpx->srv->ev, mpx->fdn);
+    fdevent_sched_close(mpx->srv->ev, mpx->fdn);
+    gw_mpx_release(mpx);
+}
+
+
+void gw_mpx_free_all(const gw_mpx_ops * const ops) {
+    /*(fdnode is freed with fdevents; close connection fd)*/
+    for (gw_mpx *mpx = *ops->list, *next; mpx; mpx = next) {
+        next = mpx->next;
+        fdio_close_socket(mpx->fd);
+        gw_mpx_release(mpx);
+    }
+    *ops->list = NULL;
+}
+
+
+int gw_mpx_flush(gw_mpx * const mpx) {
+    if (mpx->connected) {
+        chunkqueue * const wq = &mpx->wq;
+        if (!chunkqueue_is_empty(wq)) {
+            server * const srv = mpx->srv;
+            const off_t bytes_out = wq->bytes_out;
+            if (srv->network_backend_write(mpx->fd, wq, MAX_WRITE_LIMIT,
+                                           srv->errh) < 0) {
+                gw_mpx_close(mpx, 502, 1);
+                return -1;
+            }
+            if (wq->bytes_out != bytes_out)
+                mpx->write_ts = mpx->proc->last_used = log_monotonic_secs;
+        }
+        const int events = fdevent_fdnode_interest(mpx->fdn);
+        if (chunkqueue_is_empty(wq)) {
+            if (events & FDEVENT_OUT)
+                fdevent_fdnode_event_clr(mpx->srv->ev, mpx->fdn, FDEVENT_OUT);
+        }
+        else if (!(events & FDEVENT_OUT)) {
+            mpx->write_ts = log_monotonic_secs;
+            fdevent_fdnode_event_add(mpx->srv->ev, mpx->fdn, FDEVENT_OUT);
+        }
+        if (mpx->wblocked && chunkqueue_length(wq) < 16384) {
+            mpx->wblocked = 0;
+            mpx->ops->wake(mpx);
+        }
+    }
+    if (mpx->closing && 0 == mpx->nreqs) {
+        gw_mpx_close(mpx, 0, 0);
+        return -1;
+    }
+    return 0;
+}
+
+
+void gw_mpx_read_resume(gw_mpx * const mpx) {
+    mpx->rblocked = 0;
+    fdevent_fdnode_event_add(mpx->srv->ev, mpx->fdn, FDEVENT_IN);
+}
+
+
+static void gw_mpx_connected(gw_mpx * const mpx) {
+    mpx->connected = 1;
+    mpx->read_ts = log_monotonic_secs;
+    if (mpx->reqs)
+        gw_proc_connect_success(mpx->host, mpx->proc, mpx->debug,
+                                mpx->reqs->r);
+    fdevent_fdnode_event_set(mpx->srv->ev, mpx->fdn,
+                             FDEVENT_IN | FDEVENT_RDHUP);
+}
+
+
+__attribute_cold__
+static void gw_mpx_connect_error(gw_mpx * const mpx, const int errnum) {
+    if (mpx->reqs) {
+        const gw_handler_ctx * const hctx = mpx->reqs;
+        gw_proc_connect_error(hctx->r, mpx->host, mpx->proc, hctx->pid,
+                              errnum, mpx->debug);
+    }
+    gw_mpx_close(mpx, 503, 1); /*(requests retry on another proc or host)*/
+}
+
+
+static int gw_mpx_recv(gw_mpx * const mpx) {
+    buffer * const b = mpx->rbuf;
+    ssize_t n;
+    do {
+        char * const s = buffer_string_prepare_append(b, 16384);
+        const size_t avail = buffer_string_space(b);
+      #ifdef _WIN32
+        n = recv(mpx->fd, s, (int)avail, 0);
+        if (n < 0) {
+            switch (WSAGetLastError()) {
+              case WSAEWOULDBLOCK:
+              case WSAEINTR:
+                return 0;
+              default:
+                log_serror(mpx->srv->errh, __FILE__, __LINE__,
+                  "recv() %d", mpx->fd);
+                return -1;
+            }
+        }
+      #else
+        n = read(mpx->fd, s, avail);
+        if (n < 0) {
+            switch (errno) {
+              case EAGAIN:
+             #ifdef EWOULDBLOCK
+             #if EWOULDBLOCK != EAGAIN
+              case EWOULDBLOCK:
+             #endif
+             #endif
+              case EINTR:
+                return 0;
+              default:
+                log_perror(mpx->srv->errh, __FILE__, __LINE__,
+                  "read() %d", mpx->fd);
+                return -1;
+            }
+        }
+      #endif
+        if (0 == n) return -1; /* EOF */
+        buffer_commit(b, (size_t)n);
+        mpx->read_ts = log_monotonic_secs;
+        if (0 != mpx->ops->recv(mpx)) return -1;
+        if (mpx->rblocked) {
+            fdevent_fdnode_event_clr(mpx->srv->ev, mpx->fdn, FDEVENT_IN);
+            break;
+        }
+        if ((size_t)n < avail) break;
+    } while (1);
+    return 0;
+}
+
+
+static handler_t gw_mpx_handle_fdevent(void * const ctx, const int revents) {
+    gw_mpx * const mpx = ctx;
+
+    if (!mpx->connected) {
+        /* connect() to backend completed (or failed) */
+        const int socket_error = fdevent_connect_status(mpx->fd);
+        if (0 != socket_error) {
+            gw_mpx_connect_error(mpx, socket_error);
+            return HANDLER_FINISHED;
+        }
+        gw_mpx_connected(mpx);
+    }
+
+    if ((revents & (FDEVENT_IN | FDEVENT_HUP | FDEVENT_RDHUP | FDEVENT_ERR))
+        && !mpx->rblocked) {
+        if (0 != gw_mpx_recv(mpx)) {
+            gw_mpx_close(mpx, 502, 1);
+            return HANDLER_FINISHED;
+        }
+    }
+
+    gw_mpx_flush(mpx);
+    return HANDLER_FINISHED;
+}
+
+
+static gw_mpx * gw_mpx_connect(gw_handler_ctx * const hctx, request_st * const r, const gw_mpx_ops * const ops) {
+    server * const srv = r->con->srv;
+    const int fd =
+      fdevent_socket_nb_cloexec(hctx->host->family, SOCK_STREAM, 0);
+    if (-1 == fd) {
+        log_perror(r->conf.errh, __FILE__, __LINE__,
+          "socket() failed (cur_fds:%d) (max_fds:%d)",
+          srv->cur_fds, srv->max_fds);
+        return NULL;
+    }
+    ++srv->cur_fds;
+
+    gw_mpx * const mpx = ck_calloc(1, ops->sz);
+    mpx->ops = ops;
+    mpx->host = hctx->host;
+    mpx->proc = hctx->proc;
+    mpx->srv = srv;
+    mpx->fd = fd;
+    mpx->fdn = fdevent_register(srv->ev, fd, gw_mpx_handle_fdevent, mpx);
+    mpx->debug = hctx->conf.debug;
+    mpx->read_ts = mpx->write_ts = mpx->idle_ts = log_monotonic_secs;
+    mpx->rbuf = chunk_buffer_acquire();
+    chunkqueue_init(&mpx->wq);
+    ops->init(mpx);
+
+    mpx->next = *ops->list;
+    *ops->list = mpx;
+
+    switch (gw_establish_connection(r, hctx->host, hctx->proc, hctx->pid, fd,
+                                    hctx->conf.debug)) {
+      case 1: /* connection is in progress */
+        fdevent_fdnode_event_set(srv->ev, mpx->fdn, FDEVENT_OUT);
+        break;
+      case -1:/* connection error */
+        gw_mpx_close(mpx, 503, 0);
+        return NULL;
+      case 0: /* everything is ok, go on */
+        gw_mpx_connected(mpx);
+        gw_proc_connect_success(hctx->host, hctx->proc, hctx->conf.debug, r);
+        break;
+    }
+
+    if (hctx->conf.debug)
+        log_debug(r->conf.errh, __FILE__, __LINE__,
+          "new multiplexed %s connection to backend: %s (fd: %d)",
+          ops->proto, hctx->proc->connection_name->ptr, fd);
+    return mpx;
+}
+
+
+gw_mpx * gw_mpx_attach(gw_handler_ctx * const hctx, request_st * const r, const gw_mpx_ops * const ops) {
+    gw_mpx *mpx = *ops->list;
+    for (; mpx; mpx = mpx->next) {
+        if (mpx->proc == hctx->proc && mpx->host == hctx->host
+            && !mpx->closing && ops->avail(mpx))
+            break;
+    }
+    if (NULL == mpx && NULL == (mpx = gw_mpx_connect(hctx, r, ops)))
+        return NULL;
+    hctx->mpx = mpx;
+    hctx->mpx_prev = NULL;
+    hctx->mpx_next = mpx->reqs;
+    if (mpx->reqs) mpx->reqs->mpx_prev = hctx;
+    mpx->reqs = hctx;
+    ++mpx->nreqs;
+    hctx->read_ts = log_monotonic_secs;
+    return mpx;
+}
+
+
+void gw_mpx_handle_trigger(server * const srv, const gw_mpx_ops * const ops) {
+    const unix_time64_t mono = log_monotonic_secs;
+    for (gw_mpx *mpx = *ops->list, *next; mpx; mpx = next) {
+        next = mpx->next;
+        const gw_host * const host = mpx->host;
+
+        if (!mpx->connected) {
+            if (host->connect_timeout
+                && mono - mpx->write_ts > (unix_time64_t)host->connect_timeout)
+                gw_mpx_connect_error(mpx, ETIMEDOUT);
+            continue;
+        }
+
+        if (NULL != ops->ready && !ops->ready(mpx)) {
+            /* backend not ready (e.g. no connection preface from backend) */
+            if (host->connect_timeout
+                && mono - mpx->read_ts > (unix_time64_t)host->connect_timeout)
+                gw_mpx_connect_error(mpx, ETIMEDOUT);
+            continue;
+        }
+
+        /* no new requests on connection to proc no longer running
+         * (connection closed in gw_mpx_flush() once requests complete) */
+        if (mpx->proc->state != PROC_STATE_RUNNING)
+            mpx->closing = 1;
+
+        if (0 == mpx->nreqs) {
+            /* close idle connection after keep-alive-idle-timeout
+             * (or if proc is not running) */
+            if (mpx->closing
+                || mono - mpx->idle_ts
+                     > (unix_time64_t)host->keepalive_idle_timeout)
+                gw_mpx_close(mpx, 0, 0);
+            continue;
+        }
+
+        if (host->write_timeout && !chunkqueue_is_empty(&mpx->wq)
+            && mono - mpx->write_ts > (unix_time64_t)host->write_timeout) {
+            log_error(srv->errh, __FILE__, __LINE__,
+              "write timeout on socket: %s (fd: %d)",
+              mpx->proc->connection_name->ptr, mpx->fd);
+            gw_mpx_close(mpx, 504, 0); /* Gateway Timeout */
+            continue;
+        }
+
+        if (host->read_timeout) {
+            int abort = 0;
+            for (gw_handler_ctx *hctx = mpx->reqs, *hnext; hctx; hctx = hnext){
+                hnext = hctx->mpx_next;
+                if (chunkqueue_is_empty(hctx->rb)
+                    && mono - hctx->read_ts > (unix_time64_t)host->read_timeout)
+                    abort |= ops->read_timeout(mpx, hctx);
+            }
+            if (abort) gw_mpx_flush(mpx);
+        }
+    }
+}
+
+
 handler_t gw_handle_request_reset(request_st * const r, void *p_d) {
     gw_plugin_data *p = p_d;
     gw_handler_ctx *hctx = r->plugin_ctx[p->id];
@@ -1992,57 +2723,49 @@ static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * cons
     switch(hctx->state) {
     case GW_STATE_INIT:
         /* do we have a running process for this host (max-procs) ? */
-        hctx->proc = NULL;
-
-        for (gw_proc *proc = hctx->host->first; proc; proc = proc->next) {
-             if (proc->state == PROC_STATE_RUNNING) {
-                 hctx->proc = proc;
-                 break;
-             }
-        }
-
-        /* all children are dead */
-        if (hctx->proc == NULL) {
+        if (!gw_proc_acquire(hctx)) {
+            /* all children are dead */
             return HANDLER_ERROR;
         }
 
-        /* check the other procs if they have a lower load */
-        for (gw_proc *proc = hctx->proc->next; proc; proc = proc->next) {
-            if (proc->state != PROC_STATE_RUNNING) continue;
-            if (proc->load < hctx->proc->load) hctx->proc = proc;
-        }
-
-        gw_proc_load_inc(hctx->host, hctx->proc);
-
-        hctx->fd = fdevent_socket_nb_cloexec(hctx->host->family,SOCK_STREAM,0);
-        if (-1 == hctx->fd) {
-            log_perror(r->conf.errh, __FILE__, __LINE__,
-              "socket() failed (cur_fds:%d) (max_fds:%d)",
-              r->con->srv->cur_fds, r->con->srv->max_fds);
-            return HANDLER_ERROR;
+        hctx->reused = 0;
+        if (hctx->proc->idle_used && gw_backend_reuse(hctx)) {
+            /* reuse idle (keep-alive) connection to backend */
+            hctx->write_ts = log_monotonic_secs;
+            gw_host_hctx_enq(hctx);
         }
+        else {
+            hctx->fd =
+              fdevent_socket_nb_cloexec(hctx->host->family, SOCK_STREAM, 0);
+            if (-1 == hctx->fd) {
+                log_perror(r->conf.errh, __FILE__, __LINE__,
+                  "socket() failed (cur_fds:%d) (max_fds:%d)",
+                  r->con->srv->cur_fds, r->con->srv->max_fds);
+                return HANDLER_ERROR;
+            }
 
-        ++r->con->srv->cur_fds;
-
-        hctx->fdn = fdevent_register(hctx->ev,hctx->fd,gw_handle_fdevent,hctx);
+            ++r->con->srv->cur_fds;
 
-        if (hctx->proc->is_local) {
-            hctx->pid = hctx->proc->pid;
-        }
+            hctx->fdn =
+              fdevent_register(hctx->ev, hctx->fd, gw_handle_fdevent, hctx);
 
-        hctx->write_ts = log_monotonic_secs;
-        gw_host_hctx_enq(hctx);
-        switch (gw_establish_connection(r, hctx->host, hctx->proc, hctx->pid,
-                                        hctx->fd, hctx->conf.debug)) {
-        case 1: /* connection is in progress */
-            fdevent_fdnode_event_set(hctx->ev, hctx->fdn, FDEVENT_OUT);
-            gw_set_state(hctx, GW_STATE_CONNECT_DELAYED);
-            return HANDLER_WAIT_FOR_EVENT;
-        case -1:/* connection error */
-            return HANDLER_ERROR;
-        case 0: /* everything is ok, go on */
-            hctx->reconnects = 0;
-            break;
+            hctx->write_ts = log_monotonic_secs;
+            if (request_timing)
+                hctx->connect_ns = request_timing_ns();
+            gw_host_hctx_enq(hctx);
+            switch (gw_establish_connection(r, hctx->host, hctx->proc,
+                                            hctx->pid, hctx->fd,
+                                            hctx->conf.debug)) {
+            case 1: /* connection is in progress */
+                fdevent_fdnode_event_set(hctx->ev, hctx->fdn, FDEVENT_OUT);
+                gw_set_state(hctx, GW_STATE_CONNECT_DELAYED);
+                return HANDLER_WAIT_FOR_EVENT;
+            case -1:/* connection error */
+                return HANDLER_ERROR;
+            case 0: /* everything is ok, go on */
+                hctx->reconnects = 0;
+                break;
+            }
         }
         __attribute_fallthrough__
     case GW_STATE_CONNECT_DELAYED:
@@ -2060,6 +2783,14 @@ static handler_t gw_write_request(gw_handler_ctx * const hctx, request_st * cons
         }
 
         gw_proc_connect_success(hctx->host, hctx->proc, hctx->conf.debug, r);
+        request_timing_set(r, REQ_TIMING_BACKEND);
+        if (hctx->connect_ns) {
+            if (worker_stats_metrics)
+                worker_stats_hist_add(WORKER_STATS_HIST_CONNECT,
+                                      r->timing[REQ_TIMING_BACKEND]
+                                      - hctx->connect_ns);
+            hctx->connect_ns = 0;
+        }
 
         gw_set_state(hctx, GW_STATE_PREPARE_WRITE);
         __attribute_fallthrough__
@@ -2177,6 +2908,7 @@ __attribute_cold__
 __attribute_noinline__
 static handler_t gw_backend_error(gw_handler_ctx * const hctx, request_st * const r)
 {
+    gw_proc_latency_error(hctx);
     if (hctx->backend_error) hctx->backend_error(hctx);
     http_response_backend_error(r);
     gw_connection_close(hctx, r);
@@ -2202,6 +2934,7 @@ static handler_t gw_write_error(gw_handler_ctx * const hctx, request_st * const
         }
 
         /* cleanup this request and let request handler start request again */
+        gw_proc_latency_error(hctx);
         if (hctx->reconnects++ < 5) return gw_reconnect(hctx, r);
     }
     else {
@@ -2219,6 +2952,8 @@ static handler_t gw_write_error(gw_handler_ctx * const hctx, request_st * const
          * Instead, try once to read (small) response in this theoretical race*/
         handler_t rc = gw_recv_response(hctx, r);   /*(might invalidate hctx)*/
         if (rc != HANDLER_GO_ON) return rc;         /*(unless HANDLER_GO_ON)*/
+        if (gw_backend_reuse_retry(hctx, r))
+            return gw_reconnect(hctx, r);
     }
 
     /*(r->status == 400 if hctx->create_env() failed)*/
@@ -2410,6 +3145,9 @@ static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * cons
 
     if (b != hctx->response) chunk_buffer_release(b);
 
+    if (hctx->latency_ns && r->resp_body_started)
+        gw_proc_latency_sample(hctx);
+
     gw_proc * const proc = hctx->proc;
 
     switch (rc) {
@@ -2425,6 +3163,10 @@ static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * cons
     case HANDLER_FINISHED:
         /*hctx->read_ts =*/ proc->last_used = log_monotonic_secs;
 
+        if (__builtin_expect( (!r->resp_body_started), 0)
+            && gw_backend_reuse_retry(hctx, r))
+            return gw_reconnect(hctx, r);
+
         if (hctx->gw_mode == GW_AUTHORIZER
             && (200 == r->http_status || 0 == r->http_status))
             return gw_authorizer_ok(hctx, r);
@@ -2441,6 +3183,9 @@ static handler_t gw_recv_response(gw_handler_ctx * const hctx, request_st * cons
 __attribute_cold__
 static handler_t gw_recv_response_error(gw_handler_ctx * const hctx, request_st * const r, gw_proc * const proc)
 {
+        if (gw_backend_reuse_retry(hctx, r))
+            return gw_reconnect(hctx, r);
+
         /* (optimization to detect backend process exit while processing a
          *  large number of ready events; (this block could be removed)) */
         if (proc->is_local && 1 == proc->load && proc->pid == hctx->pid
@@ -2464,6 +3209,8 @@ static handler_t gw_recv_response_error(gw_handler_ctx * const hctx, request_st
             }
         }
 
+        gw_proc_latency_error(hctx);
+
         int reconnect = 0;
         const char * const msg = (r->resp_body_started == 0)
           ? hctx->wb.bytes_out == 0
@@ -2521,6 +3268,8 @@ static handler_t gw_process_fdevent(gw_handler_ctx * const hctx, request_st * co
             } while (rc == HANDLER_GO_ON);       /*(unless HANDLER_GO_ON)*/
             r->conf.stream_response_body = flags;
             return rc; /* HANDLER_FINISHED or HANDLER_ERROR */
+        } else if (gw_backend_reuse_retry(hctx, r)) {
+            return gw_reconnect(hctx, r);
         } else {
             gw_proc *proc = hctx->proc;
             log_error(r->conf.errh, __FILE__, __LINE__,
@@ -2529,6 +3278,7 @@ static handler_t gw_process_fdevent(gw_handler_ctx * const hctx, request_st * co
               r->uri.path.ptr, BUFFER_INTLEN_PTR(&r->uri.query),
               proc->connection_name->ptr, hctx->state);
 
+            gw_proc_latency_error(hctx);
             gw_connection_close(hctx, r);
             return HANDLER_FINISHED;
         }
@@ -2825,6 +3575,7 @@ static void gw_handle_trigger_hctx_timeout(gw_handler_ctx * const hctx, const ch
         /* temporarily disable backend proc */
         gw_proc_connect_error(r, hctx->host, hctx->proc, hctx->pid,
                               ETIMEDOUT, hctx->conf.debug);
+        gw_proc_latency_error(hctx);
         /* cleanup this request and let request handler start request again */
         /* retry only once since request already waited write_timeout secs */
         if (hctx->reconnects++ < 1) {
@@ -2890,11 +3641,28 @@ static void gw_handle_trigger_host_timeouts(gw_host * const host) {
     }
 }
 
-static void gw_handle_trigger_host(gw_host * const host, log_error_st * const errh, const int debug) {
+static void gw_handle_trigger_host_idle(gw_host * const host, fdevents * const ev) {
+    /* close idle connections to backend after keep-alive-idle-timeout
+     * (or all idle connections to proc if proc is not running) */
+    const unix_time64_t mono = log_monotonic_secs;
+    const unix_time64_t ts = mono - (unix_time64_t)host->keepalive_idle_timeout;
+    for (gw_proc *proc = host->first; proc; proc = proc->next) {
+        if (proc->idle_used)
+            gw_proc_idle_close(ev, proc,
+                               proc->state == PROC_STATE_RUNNING ? ts : mono);
+    }
+}
+
+static void gw_handle_trigger_host(gw_host * const host, server * const srv, const int debug) {
+    log_error_st * const errh = srv->errh;
 
     /* check for socket timeouts on active requests to backend host */
     gw_handle_trigger_host_timeouts(host);
 
+    /* close expired idle connections to backend host */
+    if (host->keepalive_max_idle)
+        gw_handle_trigger_host_idle(host, srv->ev);
+
     /* check each child proc to detect if proc exited */
 
     gw_proc *proc;
@@ -2944,6 +3712,7 @@ static void gw_handle_trigger_host(gw_host * const host, log_error_st * const er
               proc->unixsocket ? proc->unixsocket->ptr : "", proc->pid);
         }
 
+        gw_proc_idle_close(srv->ev, proc, log_monotonic_secs);
         gw_proc_kill(host, proc);
 
         /* proc is now in unused, let next second handle next process */
@@ -2957,21 +3726,24 @@ static void gw_handle_trigger_host(gw_host * const host, log_error_st * const er
   #endif
 }
 
-static void gw_handle_trigger_exts(gw_exts * const exts, log_error_st * const errh, const int debug) {
+static void gw_handle_trigger_exts(gw_exts * const exts, server * const srv, const int debug) {
     for (uint32_t j = 0; j < exts->used; ++j) {
         gw_extension *ex = exts->exts+j;
         for (uint32_t n = 0; n < ex->used; ++n) {
-            gw_handle_trigger_host(ex->hosts[n], errh, debug);
+            gw_handle_trigger_host(ex->hosts[n], srv, debug);
         }
     }
 }
 
-static void gw_handle_trigger_exts_wkr(gw_exts *exts, log_error_st *errh) {
+static void gw_handle_trigger_exts_wkr(gw_exts *exts, server * const srv) {
+    log_error_st * const errh = srv->errh;
     for (uint32_t j = 0; j < exts->used; ++j) {
         gw_extension * const ex = exts->exts+j;
         for (uint32_t n = 0; n < ex->used; ++n) {
             gw_host * const host = ex->hosts[n];
             gw_handle_trigger_host_timeouts(host);
+            if (host->keepalive_max_idle)
+                gw_handle_trigger_host_idle(host, srv->ev);
             for (gw_proc *proc = host->first; proc; proc = proc->next) {
                 if (proc->state == PROC_STATE_OVERLOADED)
                     gw_proc_check_enable(host, proc, errh);
@@ -2983,7 +3755,6 @@ static void gw_handle_trigger_exts_wkr(gw_exts *exts, log_error_st *errh) {
 handler_t gw_handle_trigger(server *srv, void *p_d) {
     gw_plugin_data * const p = p_d;
     int wkr = (0 != srv->srvconf.max_worker && p->srv_pid != srv->pid);
-    log_error_st * const errh = srv->errh;
     int global_debug = 0;
 
     if (NULL == p->cvlist) return HANDLER_GO_ON;
@@ -3012,8 +3783,8 @@ handler_t gw_handle_trigger(server *srv, void *p_d) {
          * (unable to use p->defaults.debug since gw_plugin_config
          *  might be part of a larger plugin_config) */
         wkr
-          ? gw_handle_trigger_exts_wkr(conf->exts, errh)
-          : gw_handle_trigger_exts(conf->exts, errh, debug);
+          ? gw_handle_trigger_exts_wkr(conf->exts, srv)
+          : gw_handle_trigger_exts(conf->exts, srv, debug);
     }
 
     return HANDLER_GO_ON;
@@ -27,6 +27,9 @@ typedef struct gw_proc {
     unix_time64_t last_used; /* see idle_timeout */
     int *stats_load;
     int *stats_connected;
+    int *stats_latency;
+    uint32_t ewma_us; /* peak-EWMA response latency (usec) (see balance) */
+    unix_time64_t ewma_ts; /* time of last latency sample */
     pid_t pid;   /* PID of the spawned process (0 if not spawned locally) */
     int is_local;
     uint32_t id; /* id will be between 1 and max_procs */
@@ -40,6 +43,15 @@ typedef struct gw_proc {
     buffer *connection_name;
     buffer *unixsocket; /* config.socket + "-" + id */
     unsigned short port;  /* config.port + pno */
+    unsigned short cant_mpx; /* (FastCGI) proc rejected multiplexed request
+                              * (FCGI_CANT_MPX_CONN); one request at a time */
+
+    /* idle (keep-alive) connections to proc; most recently used last */
+    uint32_t idle_used;
+    struct gw_idle_conn {
+        struct fdnode_st *fdn;
+        unix_time64_t ts; /* time connection became idle */
+    } *idle;
 } gw_proc;
 
 struct gw_handler_ctx;  /* declaration */
@@ -118,6 +130,29 @@ typedef struct {
     unsigned short connect_timeout;
     struct gw_handler_ctx *hctxs;
 
+    /*
+     * max idle (keep-alive) connections kept open to each proc for reuse
+     * by subsequent requests (0 disables keep-alive to backend), and
+     * time after which idle connection is closed
+     *
+     */
+    unsigned short keepalive_max_idle;
+    unsigned short keepalive_idle_timeout;
+
+    /*
+     * max concurrent requests multiplexed on each connection to proc
+     * (FastCGI FCGI_MPXS_CONNS) (0 disables multiplexing)
+     *
+     */
+    unsigned short multiplex;
+
+    /*
+     * relative share of keys mapped to host on consistent hash ring
+     * (balance "hash" and "sticky")
+     *
+     */
+    unsigned short weight;
+
     /*
      * some gw processes get a little bit larger
      * than wanted. max_requests_per_proc kills a
@@ -249,6 +284,14 @@ typedef struct {
     gw_host **hosts;
     uint32_t used;
     uint32_t size;
+
+    /* consistent hash ring of host virtual nodes sorted by hash
+     * (balance "hash" and "sticky"; built on first use) */
+    struct gw_ring_point {
+        uint32_t hash;
+        uint32_t ndx;  /* index into hosts[] */
+    } *ring;
+    uint32_t ring_used;
 } gw_extension;
 
 typedef struct {
@@ -321,6 +364,7 @@ typedef struct gw_handler_ctx {
 
     pid_t     pid;
     int       reconnects; /* number of reconnect attempts */
+    int       reused;     /* connection reused from proc idle pool */
 
     int       request_id;
     int       send_content_body;
@@ -333,12 +377,17 @@ typedef struct gw_handler_ctx {
     gw_plugin_data *plugin_data; /* dumb pointer */
     unix_time64_t read_ts;
     unix_time64_t write_ts;
+    uint64_t connect_ns;         /* (set if request_timing) */
+    uint64_t latency_ns;         /* (set if latency-aware balance) */
     handler_t(*stdin_append)(struct gw_handler_ctx *hctx);
     handler_t(*create_env)(struct gw_handler_ctx *hctx);
     struct gw_handler_ctx *prev;
     struct gw_handler_ctx *next;
     void(*backend_error)(struct gw_handler_ctx *hctx);
     void(*handler_ctx_free)(void *hctx);
+    struct gw_mpx *mpx;  /* shared connection if request is multiplexed */
+    struct gw_handler_ctx *mpx_prev;
+    struct gw_handler_ctx *mpx_next;
 } gw_handler_ctx;
 
 
@@ -373,6 +422,97 @@ handler_t gw_handle_waitpid_cb(server *srv, void *p_d, pid_t pid, int status);
 
 void gw_set_transparent(gw_handler_ctx *hctx);
 
+/* (for modules managing their own connections to backend procs,
+ *  e.g. mod_proxy multiplexing requests on HTTP/2 connections)
+ * gw_proc_acquire() selects least loaded running proc for hctx->host and
+ * sets hctx->proc (released in gw_handle_request_reset()); returns 0 if
+ * no proc is running
+ * gw_proc_latency_sample() records backend response latency for
+ * latency-aware balancing once response headers have been received
+ * (call if hctx->latency_ns && r->resp_body_started)
+ * gw_proc_latency_error() records timeout or error before response headers
+ * were received as a peak latency sample (no-op if !hctx->latency_ns)
+ * gw_host_reacquire() releases hctx->proc and hctx->host and selects host
+ * again (e.g. to retry request after connection error); returns 0 and sets
+ * r->http_status = 503 if all hosts are down */
+int gw_proc_acquire(gw_handler_ctx *hctx);
+int gw_host_reacquire(gw_handler_ctx *hctx, request_st *r);
+void gw_proc_latency_sample(gw_handler_ctx *hctx);
+__attribute_cold__
+void gw_proc_latency_error(gw_handler_ctx *hctx);
+int gw_establish_connection(request_st *r, gw_host *host, gw_proc *proc, pid_t pid, int gw_fd, int debug);
+void gw_proc_connect_success(gw_host *host, gw_proc *proc, int debug, request_st *r);
+__attribute_cold__
+void gw_proc_connect_error(request_st *r, gw_host *host, gw_proc *proc, pid_t pid, int errnum, int debug);
+
 int gw_upgrade_policy (request_st *r, int auth_mode, int upgrade);
 
+/* connection to backend proc shared by concurrent requests multiplexed on the
+ * connection (e.g. mod_proxy HTTP/2 streams, mod_fastcgi request ids)
+ * (first member of module connection struct of size ops->sz; module handles
+ *  protocol framing in gw_mpx_ops callbacks) */
+struct gw_mpx_ops;
+
+typedef struct gw_mpx {
+    struct gw_mpx *next;
+    gw_handler_ctx *reqs;  /* requests on connection (linked via mpx_next) */
+    const struct gw_mpx_ops *ops;
+    gw_host *host;
+    gw_proc *proc;
+    server *srv;
+    fdnode *fdn;
+    int fd;
+    int debug;
+    uint32_t nreqs;
+    uint8_t connected;
+    uint8_t closing;    /* no new requests; closed once requests complete */
+    uint8_t rblocked;   /* reading paused until gw_mpx_read_resume() */
+    uint8_t wblocked;   /* request waiting for wq to drain (ops->wake()) */
+    unix_time64_t read_ts;
+    unix_time64_t write_ts;
+    unix_time64_t idle_ts;
+    buffer *rbuf;
+    chunkqueue wq;
+} gw_mpx;
+
+typedef struct gw_mpx_ops {
+    gw_mpx **list;      /* module list of connections */
+    const char *proto;  /* protocol name in log messages */
+    size_t sz;          /* size of module connection struct */
+    /* init module members of new connection (e.g. queue connection preface)*/
+    void(*init)(gw_mpx *mpx);
+    /* free module members of connection */
+    void(*free)(gw_mpx *mpx);
+    /* 1 if connection accepts another request */
+    int(*avail)(const gw_mpx *mpx);
+    /* 1 if backend is ready for requests (NULL if ready once connected) */
+    int(*ready)(const gw_mpx *mpx);
+    /* parse data read into mpx->rbuf; -1 if error
+     * (set mpx->rblocked to pause reading) */
+    int(*recv)(gw_mpx *mpx);
+    /* fail request (unlink from connection; resend request if retry) */
+    void(*fail)(gw_handler_ctx *hctx, int status, int retry);
+    /* read timeout on request; 1 if request aborted */
+    int(*read_timeout)(gw_mpx *mpx, gw_handler_ctx *hctx);
+    /* wake requests waiting for mpx->wq to drain (if mpx->wblocked) */
+    void(*wake)(gw_mpx *mpx);
+} gw_mpx_ops;
+
+/* gw_mpx_attach() attaches request to connection to hctx->proc with room for
+ * another request, or to new connection; returns NULL if connect failed
+ * gw_mpx_unlink() detaches request from connection
+ * gw_mpx_flush() writes mpx->wq to backend; returns -1 if connection was
+ * closed (and mpx is no longer valid)
+ * gw_mpx_close() fails requests on connection with status and closes it
+ * gw_mpx_handle_trigger() checks connect, idle, and write timeouts on
+ * connections, and read timeouts on requests */
+gw_mpx * gw_mpx_attach(gw_handler_ctx *hctx, request_st *r, const struct gw_mpx_ops *ops);
+void gw_mpx_unlink(gw_handler_ctx *hctx);
+int gw_mpx_flush(gw_mpx *mpx);
+void gw_mpx_read_resume(gw_mpx *mpx);
+void gw_mpx_close(gw_mpx *mpx, int status, int retry);
+void gw_mpx_handle_trigger(server *srv, const struct gw_mpx_ops *ops);
+__attribute_cold__
+void gw_mpx_free_all(const struct gw_mpx_ops *ops);
+
 #endif
@@ -20,6 +20,7 @@
 #include "reqpool.h"    /* request_reset_ex() */
 #include "request.h"
 #include "response.h"   /* http_response_reqbody_read_error() */
+#include "worker_stats.h"
 
 
 static int
@@ -35,6 +36,7 @@ h1_send_1xx_info (request_st * const r, connection * const con)
 
     written = cq->bytes_out - written;
     con->bytes_written_cur_second += written;
+    worker_stats_bytes_out_add(written);
     if (r->conf.global_bytes_per_second_cnt_ptr)
         *(r->conf.global_bytes_per_second_cnt_ptr) += written;
 
@@ -456,6 +458,7 @@ h1_recv_headers (request_st * const r, connection * const con)
             r->start_hp.tv_sec = log_epoch_secs;
             if (r->conf.high_precision_timestamps)
                 log_clock_gettime_realtime(&r->start_hp);
+            request_timing_start(r);
         }
         if (pipelined_request_start && c)
             con->read_idle_ts = log_monotonic_secs;
@@ -498,6 +501,7 @@ h1_recv_headers (request_st * const r, connection * const con)
                             hdrs, header_len, "fd:%d rqst: ", con->fd);
     http_request_headers_process(r, hdrs, hoff, con->proto_default_port);
     chunkqueue_mark_written(cq, r->rqst_header_len);
+    request_timing_set(r, REQ_TIMING_HEADERS);
 
     if (light_btst(r->rqst_htags, HTTP_HEADER_UPGRADE)
         && 0 == r->http_status
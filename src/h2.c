@@ -25,6 +25,7 @@
 #include "log.h"
 #include "request.h"
 #include "response.h"   /* http_dispatch[] http_response_omit_header() */
+#include "worker_stats.h"
 
 
 /* lowercased field-names
@@ -1871,8 +1872,10 @@ h2_recv_headers (connection * const con, uint8_t * const s, uint32_t flen)
         r->start_hp.tv_sec = log_epoch_secs;
         if (r->conf.high_precision_timestamps)
             log_clock_gettime_realtime(&r->start_hp);
+        request_timing_start(r);
 
     h2_parse_headers_frame(&h2c->decoder, &psrc, psrc+alen, r, 0); /*(headers)*/
+    request_timing_set(r, REQ_TIMING_HEADERS);
 
     if (!h2c->sent_goaway) {
         h2c->h2_cid = id;
@@ -2391,6 +2394,8 @@ h2_send_headers (request_st * const r, connection * const con)
      * but small attempt to (maybe) preserve behavior for specific configs)*/
     con->keep_alive_idle = r->conf.max_keep_alive_idle;
 
+    request_timing_set(r, REQ_TIMING_RESP_START); /*response headers queued*/
+
     /* specialized version of http_response_write_header(); send headers
      * directly to HPACK encoder, rather than double-buffering in chunkqueue */
 
@@ -3139,7 +3144,9 @@ h2_release_stream (request_st * const r, connection * const con)
 {
     if (r->http_status) {
         /* (see comment in connection_handle_response_end_state()) */
+        request_timing_set(r, REQ_TIMING_RESP_END);
         plugins_call_handle_request_done(r);
+        worker_stats_request_done(r);
 
       #if 0
         /* (fuzzy accounting for mod_accesslog, mod_rrdtool to avoid
@@ -3206,6 +3213,7 @@ h2_retire_con (request_st * const h2r, connection * const con)
             /*(optional accounting)*/
             written = cq->bytes_out - written;
             con->bytes_written_cur_second += written;
+            worker_stats_bytes_out_add(written);
             if (h2r->conf.global_bytes_per_second_cnt_ptr)
                 *(h2r->conf.global_bytes_per_second_cnt_ptr) += written;
         }
@@ -3325,6 +3333,7 @@ h2_con_upgrade_h2c (request_st * const h2r, connection * const con)
     r->keep_alive = h2r->keep_alive;
     r->tmp_buf = h2r->tmp_buf;                /* shared; same as srv->tmp_buf */
     r->start_hp = h2r->start_hp;                /* copy struct */
+    memcpy(r->timing, h2r->timing, sizeof(r->timing));
 
     /* Note: HTTP/1.1 101 Switching Protocols is not immediately written to
      * the network here.  As this is called from cleartext Upgrade: h2c,
@@ -3389,6 +3398,14 @@ h2_send_goaway_delayed (connection * const con)
 
 #include "plugin.h"     /* const plugin * const p = r->handler_module; */
 
+#ifdef HAVE_CHUNK_FILE_READAHEAD
+static void
+h2_readahead_cb (void * const ctx)
+{
+    joblist_append((connection *)ctx);
+}
+#endif
+
 static int
 h2_process_streams (connection * const con,
                     handler_t(*http_response_loop)(request_st *),
@@ -3495,8 +3512,16 @@ h2_process_streams (connection * const con,
                     max_bytes -= (off_t)dlen;
                     if (!chunkqueue_is_empty(&r->write_queue)) {
                         /*(do not resched (spin) if swin empty window)*/
-                        if (dlen || r->write_queue.first->file.busy)
-                            resched |= r->write_queue.first->file.busy ? 4 : 1;
+                        /*(do not resched (spin) while async read-ahead
+                         * is pending; con rescheduled upon completion)*/
+                        if (r->write_queue.first->file.busy) {
+                            if (!chunkqueue_readahead_wait(&r->write_queue,
+                                                           h2_readahead_cb,
+                                                           con))
+                                resched |= 4;
+                        }
+                        else if (dlen)
+                            resched |= 1;
                         continue;
                     }
                 }
@@ -397,8 +397,15 @@ handler_t http_response_reqbody_read_error (request_st * const r, int http_statu
 
 
 void http_response_send_file (request_st * const r, const buffer * const path, stat_cache_entry *sce) {
+	/* small files might be sent from contents cached in memory */
+	const buffer *mem = NULL;
+	if (NULL == sce) /*(e.g. X-Sendfile)*/
+		sce = stat_cache_get_entry(path);
 	if (__builtin_expect( (NULL == sce), 0)
-	    || (__builtin_expect( (sce->fd < 0), 0) && 0 != sce->st.st_size)) {
+	    || (0 != sce->st.st_size
+	        && NULL == (mem = stat_cache_entry_mem(sce, r->conf.follow_symlink))
+	        && __builtin_expect(
+	             (stat_cache_entry_open(sce, r->conf.follow_symlink) < 0), 0))) {
 		sce = stat_cache_get_entry_open(path, r->conf.follow_symlink);
 		if (NULL == sce) {
 			r->http_status = (errno == ENOENT) ? 404 : 403;
@@ -486,7 +493,10 @@ void http_response_send_file (request_st * const r, const buffer * const path, s
 	 * the HEAD request will drop it afterwards again
 	 */
 
-	if (0 == sce->st.st_size || 0 == http_chunk_append_file_ref(r, sce)) {
+	if (0 == sce->st.st_size
+	    || (mem
+	        ? 0 == http_chunk_append_mem(r, BUF_PTR_LEN(mem))
+	        : 0 == http_chunk_append_file_ref(r, sce))) {
 		r->http_status = 200;
 		r->resp_body_finished = 1;
 		/*(Transfer-Encoding should not have been set at this point)*/
@@ -861,6 +871,22 @@ static int http_response_append_splice(request_st * const r, http_response_opts
     }
     return 0; /* not handled */
 }
+
+static int http_response_splice_pipe_ok(const request_st * const r, const http_response_opts * const opts) {
+    /* splice() response body from backend socket into PIPE_CHUNK only if
+     * r->write_queue is written as-is to client socket: response_start hooks
+     * have run (and have not modified (e.g. mod_deflate) the response body),
+     * Content-Length (not chunked), cleartext HTTP/1.x (not h2, not TLS) */
+    return r->resp_header_len
+        && r->resp_body_scratchpad > 0
+        && !r->resp_decode_chunked
+        && !r->resp_send_chunked
+        && NULL == opts->parse
+        && opts->fdfmt == S_IFSOCK
+        && r->http_version <= HTTP_VERSION_1_1
+        && !r->con->is_ssl_sock
+        && chunkqueue_splice_pipe_enabled();
+}
 #endif
 
 
@@ -946,6 +972,8 @@ static int http_response_process_headers(request_st * const restrict r, http_res
                 r->http_status = status;
                 opts->local_redir = 0; /*(disable; status was set)*/
                 i = 2;
+                if (s[7] == '0') /*(HTTP/1.0 backend closes connection)*/
+                    opts->keepalive = 0;
             } /* else we expected 3 digits and didn't get them */
         }
 
@@ -1034,7 +1062,14 @@ static int http_response_process_headers(request_st * const restrict r, http_res
                 continue;
             break;
           case HTTP_HEADER_CONNECTION:
-            if (opts->backend == BACKEND_PROXY) continue;
+            if (opts->backend == BACKEND_PROXY) {
+                /* backend closes connection after response */
+                if (opts->keepalive
+                    && http_header_str_contains_token(value, end - value,
+                                                      CONST_STR_LEN("close")))
+                    opts->keepalive = 0;
+                continue;
+            }
             if (r->http_version >= HTTP_VERSION_2) continue;
             /*(simplistic attempt to honor backend request to close)*/
             if (http_header_str_contains_token(value, end - value,
@@ -1107,6 +1142,15 @@ static int http_response_process_headers(request_st * const restrict r, http_res
             http_header_response_insert(r, id, k, klen, value, end - value);
     }
 
+    /* response to HEAD and 204, 304 responses have no body (RFC 9112 6.3)
+     * (do not wait for backend to close connection) */
+    if (opts->backend == BACKEND_PROXY
+        && (r->http_method == HTTP_METHOD_HEAD
+            || r->http_status == 204 || r->http_status == 304)) {
+        r->resp_body_scratchpad = 0;
+        r->resp_decode_chunked = 0;
+    }
+
     /* CGI/1.1 rev 03 - 7.2.1.2 */
     /* (proxy requires Status-Line, so never true for proxy)*/
     if (0 == r->http_status && light_btst(r->resp_htags, HTTP_HEADER_LOCATION)){
@@ -1399,6 +1443,24 @@ handler_t http_response_read(request_st * const r, http_response_opts * const op
                  * want to limit how much is buffered from backend while waiting
                  * for a complete data frame or data packet from backend. */
             }
+
+          #ifdef HAVE_SPLICE
+            /* splice() from backend socket to pipe, and later from pipe to
+             * client socket, to avoid copying response body through userspace
+             * (pipe is limited in size, but amount buffered is limited here) */
+            if (toread >= 8192 && buffer_is_blank(b)
+                && http_response_splice_pipe_ok(r, opts)) {
+                if ((off_t)toread > r->resp_body_scratchpad)
+                    toread = (unsigned int)r->resp_body_scratchpad;
+                n = chunkqueue_append_splice_sock_pipe(&r->write_queue,
+                                                       fd, toread);
+                if (n > 0) {
+                    if (0 == (r->resp_body_scratchpad -= n))
+                        r->resp_body_finished = 1;
+                    break;
+                } /*(fall through to handle traditionally)*/
+            }
+          #endif
         }
 
         if (avail < toread) {
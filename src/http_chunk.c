@@ -256,7 +256,8 @@ int http_chunk_transfer_cqlen(request_st * const r, chunkqueue * const src, cons
     if (r->resp_send_chunked)
         http_chunk_len_append(cq, len);
 
-    chunkqueue_steal(cq, src, len);
+    if (0 != chunkqueue_steal(cq, src, len))
+        return -1;
 
     if (r->resp_send_chunked)
         chunkqueue_append_mem(cq, CONST_STR_LEN("\r\n"));
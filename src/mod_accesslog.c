@@ -15,12 +15,35 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include "sys-mmap.h"
 #include "sys-unistd.h" /* <unistd.h> */
+#include "sys-wait.h"
 
+#include <errno.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS)
+#ifdef MAP_ANON
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && defined(MAP_ANONYMOUS) \
+ && defined(__ATOMIC_ACQUIRE)
+#define ACCESSLOG_RING
+#if defined(HAVE_POLL) && (defined(HAVE_SYS_POLL_H) || defined(HAVE_POLL_H))
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#include <sys/poll.h>
+#endif
+#define ACCESSLOG_RING_POLL
+#endif
+#endif
+
 #ifdef HAVE_SYSLOG_H
 # include <syslog.h>
 #endif
@@ -58,6 +81,7 @@ typedef struct {
 			FORMAT_REMOTE_HOST, /* same as FORMAT_REMOTE_ADDR */
 			FORMAT_REMOTE_USER, /* redirected to FORMAT_ENV */
 			FORMAT_TIME_USED_US,/* redirected to FORMAT_TIME_USED */
+			FORMAT_TIME_PHASE,  /* %{PHASE[:UNIT]}T; parsed from FORMAT_TIME_USED */
 			/*(parsed and replaced at startup)*/
 			FORMAT_REMOTE_IDENT,
 			FORMAT_PERCENT,
@@ -125,6 +149,9 @@ enum e_optflags_time {
 	FORMAT_FLAG_TIME_NSEC_FRAC = 0x80 /* request time nsec fraction */
 };
 
+/* FORMAT_TIME_PHASE: request phase (request_timing_t) in opt bits 8 and up */
+#define FORMAT_TIME_PHASE_SHIFT 8
+
 enum e_optflags_port {
 	FORMAT_FLAG_PORT_LOCAL     = 0x01,/* (default) */
 	FORMAT_FLAG_PORT_REMOTE    = 0x02
@@ -151,17 +178,65 @@ typedef struct {
 	fdlog_st *fdlog;
 	char use_syslog; /* syslog has global buffer */
 	uint8_t escaping;
+	uint8_t binary;
 	unsigned short syslog_level;
 
 	format_fields *parsed_format;
 } plugin_config;
 
+#ifdef ACCESSLOG_RING
+
+/* accesslog.ring-buffer
+ *
+ * Shared memory ring buffer into which workers append formatted log records
+ * (multiple producers; lock-free) and from which a dedicated writer process
+ * drains records in batched writes to log files.  Workers never block on log
+ * writes; records are dropped (and counted) if the ring buffer is full. */
+
+typedef struct {
+    uint32_t len;  /* record length | ACCESSLOG_RING_COMMIT once written */
+    uint32_t idx;  /* index into p->ring_logs[] (or ACCESSLOG_RING_SKIP) */
+} accesslog_ring_rec;
+
+#define ACCESSLOG_RING_COMMIT 0x80000000u
+#define ACCESSLOG_RING_SKIP   0xFFFFFFFFu
+#define ACCESSLOG_RING_RECSZ(len) \
+        ((sizeof(accesslog_ring_rec) + (len) + 7) & ~(uint32_t)7)
+
+typedef struct {
+    uint64_t head;    /* (producers) reserved through offset */
+    char pad0[56];    /* (separate cache lines for producers and writer) */
+    uint64_t tail;    /* (writer) consumed through offset */
+    uint32_t cycle;   /* incremented to have writer reopen log files */
+    uint32_t shutdown;/* set when server parent no longer uses ring */
+    uint32_t refs;    /* count of producer processes */
+    uint32_t crashed; /* incremented when a producer process is killed */
+    uint32_t waiting; /* set while writer waits for wakeup on empty ring */
+    char pad1[36];
+    char data[];      /* ring data; size is power of 2 */
+} accesslog_ring;
+
+#endif
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
     plugin_config conf;
 
     format_fields *default_format;/* allocated if default format */
+
+  #ifdef ACCESSLOG_RING
+    accesslog_ring *ring;
+    uint32_t ring_sz;
+    uint32_t ring_nlogs;
+    fdlog_st **ring_logs;       /* log files written via ring buffer */
+    pid_t ring_pid;             /* writer process */
+    pid_t srv_pid;              /* process which created ring and writer */
+    int ring_fds[2];            /* writer wakeup pipe (or -1) */
+    int ring_ref;               /* process is a producer (counted in refs) */
+    uint64_t ring_dropped;      /* (per-process) */
+    uint64_t ring_dropped_logged;
+  #endif
 } plugin_data;
 
 typedef void(esc_fn_t)(buffer * restrict b, const char * restrict s, size_t len);
@@ -281,6 +356,363 @@ static void mod_accesslog_free_format_fields(format_fields * const ff) {
     free(ff);
 }
 
+#ifdef ACCESSLOG_RING
+
+static void
+accesslog_ring_wakeup (const plugin_data * const p)
+{
+    /* wake writer if waiting on empty ring (or to notice cycle/shutdown) */
+    accesslog_ring * const ring = p->ring;
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST)
+        && __atomic_exchange_n(&ring->waiting, 0, __ATOMIC_ACQ_REL)
+        && -1 != p->ring_fds[1]) {
+        const char c = 0;
+        ssize_t wr;
+        do { wr = write(p->ring_fds[1], &c, 1); } while (-1 == wr && errno == EINTR);
+        /*(ignore EAGAIN; pipe not empty so writer will wake)*/
+    }
+}
+
+
+static void
+accesslog_ring_append (plugin_data * const p, const uint32_t idx,
+                       const char * const s, const uint32_t len)
+{
+    accesslog_ring * const ring = p->ring;
+    const uint32_t sz = p->ring_sz;
+    const uint32_t recsz = ACCESSLOG_RING_RECSZ(len);
+    uint64_t h = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t pad;
+    do {
+        const uint32_t off = (uint32_t)h & (sz-1);
+        pad = (off + recsz > sz) ? sz - off : 0; /*(skip to wrap at end)*/
+        if (recsz > (sz >> 2)
+            || h + pad + recsz
+               - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > sz) {
+            /* ring buffer full; drop record rather than block */
+            ++p->ring_dropped;
+            plugin_stats_inc("accesslog.ring.dropped");
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&ring->head, &h, h + pad + recsz,
+                                          1, __ATOMIC_SEQ_CST,
+                                          __ATOMIC_RELAXED));
+
+    accesslog_ring_rec *rec;
+    if (pad) {
+        rec = (accesslog_ring_rec *)(void *)(ring->data + (h & (sz-1)));
+        rec->idx = ACCESSLOG_RING_SKIP;
+        __atomic_store_n(&rec->len,
+                         (pad - sizeof(*rec)) | ACCESSLOG_RING_COMMIT,
+                         __ATOMIC_RELEASE);
+        h += pad;
+    }
+    rec = (accesslog_ring_rec *)(void *)(ring->data + (h & (sz-1)));
+    rec->idx = idx;
+    memcpy(rec+1, s, len);
+    __atomic_store_n(&rec->len, len | ACCESSLOG_RING_COMMIT, __ATOMIC_RELEASE);
+
+    /*(seq_cst head update above pairs with writer setting ring->waiting
+     * before checking head; either writer sees record or producer wakes it)*/
+    accesslog_ring_wakeup(p);
+}
+
+
+static void
+accesslog_ring_release (accesslog_ring * const ring, const uint32_t sz,
+                        const uint64_t start, const uint64_t t)
+{
+    /* zero consumed ring data (record len must be 0 until written by
+     * producer), then release space to producers */
+    const uint32_t off = (uint32_t)start & (sz-1);
+    const uint32_t n = (uint32_t)(t - start);
+    if (off + n <= sz)
+        memset(ring->data + off, 0, n);
+    else {
+        memset(ring->data + off, 0, sz - off);
+        memset(ring->data, 0, n - (sz - off));
+    }
+    __atomic_store_n(&ring->tail, t, __ATOMIC_RELEASE);
+}
+
+
+static int
+accesslog_ring_drain (plugin_data * const p, log_error_st * const errh)
+{
+    accesslog_ring * const ring = p->ring;
+    const uint32_t sz = p->ring_sz;
+    const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    const uint64_t start = ring->tail;
+    uint64_t t = start;
+    while (t != head) {
+        const accesslog_ring_rec * const rec =
+          (accesslog_ring_rec *)(void *)(ring->data + (t & (sz-1)));
+        uint32_t len = __atomic_load_n(&rec->len, __ATOMIC_ACQUIRE);
+        if (!(len & ACCESSLOG_RING_COMMIT))
+            break; /* record reserved, but not yet written */
+        len &= ~ACCESSLOG_RING_COMMIT;
+        if (rec->idx < p->ring_nlogs) {
+            fdlog_st * const fdlog = p->ring_logs[rec->idx];
+            buffer * const b = &fdlog->b;
+            buffer_append_string_len(b, (const char *)(rec+1), len);
+            if (buffer_clen(b) >= 65536) {
+                if (-1 == write_all(fdlog->fd, BUF_PTR_LEN(b)))
+                    log_perror(errh, __FILE__, __LINE__,
+                      "error flushing log %s", fdlog->fn);
+                buffer_clear(b); /*(clear buffer, even on error)*/
+            }
+        }
+        t += ACCESSLOG_RING_RECSZ(len);
+    }
+    if (t == start) return 0;
+
+    /* write batch, then release space to producers */
+    fdlog_files_flush(errh, 0);
+    accesslog_ring_release(ring, sz, start, t);
+    return 1;
+}
+
+
+__attribute_cold__
+static void
+accesslog_ring_close_listen_fds (server * const srv)
+{
+    /* close listen sockets (including SO_REUSEPORT sockets for workers)
+     * in writer process, which does not accept connections */
+    for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+        const server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+        for (uint32_t j = 0; j < srv_socket->wkr_nfds; ++j)
+            close(srv_socket->wkr_fds[j]);
+        if (-1 != srv_socket->fd)
+            close(srv_socket->fd);
+    }
+    /* inherited sockets not matched to config (else fd closed above) */
+    for (uint32_t i = 0; i < srv->srv_sockets_inherited.used; ++i) {
+        const server_socket * const srv_socket =
+          srv->srv_sockets_inherited.ptr[i];
+        if (-1 != srv_socket->fd && srv_socket->sidx == (unsigned short)~0u)
+            close(srv_socket->fd);
+    }
+}
+
+
+__attribute_cold__
+static void
+accesslog_ring_wait (const plugin_data * const p, const uint32_t cycle)
+{
+    /* block until producer appends record to empty ring, or until parent
+     * cycles logs or shuts down; wake at least every sec to check parent.
+     * Without wakeup pipe, back off exponentially (10ms up to 1 sec) */
+    accesslog_ring * const ring = p->ring;
+    __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail
+        && __atomic_load_n(&ring->cycle, __ATOMIC_SEQ_CST) == cycle
+        && !__atomic_load_n(&ring->shutdown, __ATOMIC_SEQ_CST)) {
+      #ifdef ACCESSLOG_RING_POLL
+        if (-1 != p->ring_fds[0]) {
+            struct pollfd pfd = { p->ring_fds[0], POLLIN, 0 };
+            if (poll(&pfd, 1, 1000) > 0) {
+                char buf[64];
+                while (read(p->ring_fds[0], buf, sizeof(buf)) > 0) ;
+            }
+        }
+        else
+      #endif
+        {
+            static uint32_t backoff = 10;
+            const uint64_t t = ring->tail;
+            struct timespec ts = { backoff / 1000,
+                                   (long)(backoff % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+            backoff = (t == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))
+              ? (backoff < 500 ? backoff << 1 : 1000)
+              : 10;
+        }
+    }
+    __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+}
+
+
+__attribute_cold__
+__attribute_noreturn__
+static void
+accesslog_ring_writer (server * const srv, plugin_data * const p)
+{
+    /* writer process; (forked from server before workers are started) */
+    accesslog_ring_close_listen_fds(srv);
+
+    /* server signals shutdown via ring; log files cycled via ring->cycle */
+  #ifdef HAVE_SIGACTION
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = SIG_IGN;
+    sigaction(SIGINT,  &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    sigaction(SIGHUP,  &act, NULL);
+    sigaction(SIGUSR1, &act, NULL);
+    sigaction(SIGALRM, &act, NULL);
+    act.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &act, NULL);
+  #elif defined(HAVE_SIGNAL)
+    signal(SIGINT,  SIG_IGN);
+    signal(SIGTERM, SIG_IGN);
+    signal(SIGHUP,  SIG_IGN);
+    signal(SIGUSR1, SIG_IGN);
+    signal(SIGALRM, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+  #endif
+
+    accesslog_ring * const ring = p->ring;
+    log_error_st * const errh = srv->errh;
+    const pid_t ppid = getppid();
+    uint32_t cycle = __atomic_load_n(&ring->cycle, __ATOMIC_ACQUIRE);
+    uint32_t crashed = __atomic_load_n(&ring->crashed, __ATOMIC_ACQUIRE);
+    uint64_t stalled_tail = ring->tail;
+    uint64_t skip_head = 0;
+    uint32_t idle = 0;  /* 10ms intervals waiting on uncommitted record */
+    uint32_t waits = 0; /* waits (up to 1 sec each) on empty ring */
+    struct timespec ts = { 0, 10000000 }; /* 10ms */
+    for (;;) {
+        const uint32_t c = __atomic_load_n(&ring->cycle, __ATOMIC_ACQUIRE);
+        if (cycle != c) {
+            cycle = c;
+            fdlog_files_cycle(errh); /* reopen log files */
+        }
+
+        if (accesslog_ring_drain(p, errh)) {
+            idle = 0;
+            waits = 0;
+            continue;
+        }
+
+        ++idle;
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail) {
+            /* producer killed between reserving and writing record leaves
+             * record which is never committed.  Skip only if stalled and a
+             * producer has been killed (reported by server parent), and only
+             * after waiting for live producers to finish writing records
+             * reserved before the skip point (since data is zeroed) */
+            if (stalled_tail != ring->tail) {
+                stalled_tail = ring->tail;
+                skip_head = 0;
+                idle = 0;
+            }
+            else if (idle < 100) /* 1 sec */
+                ;
+            else if (0 == skip_head) {
+                const uint32_t k =
+                  __atomic_load_n(&ring->crashed, __ATOMIC_ACQUIRE);
+                if (crashed != k) {
+                    crashed = k;
+                    skip_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+                    idle = 0;
+                }
+            }
+            else {
+                log_error(errh, __FILE__, __LINE__,
+                  "accesslog ring buffer stalled by killed worker; "
+                  "skipping %llu bytes of records",
+                  (unsigned long long)(skip_head - ring->tail));
+                accesslog_ring_release(ring, p->ring_sz, ring->tail, skip_head);
+                stalled_tail = skip_head;
+                skip_head = 0;
+                idle = 0;
+            }
+        }
+        else {
+            /* ring empty; any killed producer left no uncommitted record */
+            crashed = __atomic_load_n(&ring->crashed, __ATOMIC_ACQUIRE);
+            idle = 0;
+            if (__atomic_load_n(&ring->shutdown, __ATOMIC_ACQUIRE)
+                && (0 == __atomic_load_n(&ring->refs, __ATOMIC_ACQUIRE)
+                    || waits >= 60)) /*(60 sec backstop if worker crash)*/
+                break;
+            if (getppid() != ppid)
+                break;
+            ++waits;
+            accesslog_ring_wait(p, cycle);
+            continue;
+        }
+
+        nanosleep(&ts, NULL);
+    }
+    fdlog_files_flush(errh, 0);
+    _exit(0);
+}
+
+
+__attribute_cold__
+static int
+accesslog_ring_init (server * const srv, plugin_data * const p, const uint32_t kb)
+{
+    uint32_t sz = 65536;
+    while (sz < kb * 1024 && sz < 0x40000000u) sz <<= 1;
+    accesslog_ring * const ring =
+      mmap(NULL, sizeof(accesslog_ring) + sz, PROT_READ|PROT_WRITE,
+           MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == ring) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "mmap() accesslog.ring-buffer");
+        return 0;
+    }
+    /*(anonymous mapping is zero-filled)*/
+    p->ring = ring;
+    p->ring_sz = sz;
+
+    /* writer wakeup pipe (non-blocking; producers never block on write) */
+    p->ring_fds[0] = p->ring_fds[1] = -1;
+  #ifdef ACCESSLOG_RING_POLL
+    if (0 != fdevent_pipe_cloexec(p->ring_fds, 4096))
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "pipe() accesslog.ring-buffer writer wakeup; polling instead");
+    else if (0 != fdevent_fcntl_set_nb(p->ring_fds[0])
+             || 0 != fdevent_fcntl_set_nb(p->ring_fds[1])) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "fcntl() accesslog.ring-buffer writer wakeup; polling instead");
+        close(p->ring_fds[0]);
+        close(p->ring_fds[1]);
+        p->ring_fds[0] = p->ring_fds[1] = -1;
+    }
+  #endif
+
+    /* flush buffered log data before forking writer */
+    fdlog_files_flush(srv->errh, 0);
+
+    const pid_t pid = fork();
+    if (0 == pid)
+        accesslog_ring_writer(srv, p);
+    if (-1 == pid) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "fork() accesslog.ring-buffer writer");
+        return 0;
+    }
+    p->ring_pid = pid;
+    p->srv_pid = srv->pid;
+    return 1;
+}
+
+
+__attribute_cold__
+static void
+accesslog_ring_free (plugin_data * const p)
+{
+    accesslog_ring * const ring = p->ring;
+    if (NULL == ring) return;
+    /* (producers have no buffered data; records appended to ring) */
+    if (p->ring_ref)
+        __atomic_sub_fetch(&ring->refs, 1, __ATOMIC_RELEASE);
+    if (p->srv_pid == getpid()) /* writer exits after producers exit */
+        __atomic_store_n(&ring->shutdown, 1, __ATOMIC_SEQ_CST);
+    accesslog_ring_wakeup(p);
+    munmap(ring, sizeof(accesslog_ring) + p->ring_sz);
+    if (-1 != p->ring_fds[0]) close(p->ring_fds[0]);
+    if (-1 != p->ring_fds[1]) close(p->ring_fds[1]);
+    free(p->ring_logs);
+}
+
+#endif /* ACCESSLOG_RING */
+
+
 FREE_FUNC(mod_accesslog_free) {
     plugin_data * const p = p_d;
     if (NULL == p->cvlist) return;
@@ -305,6 +737,10 @@ FREE_FUNC(mod_accesslog_free) {
     if (NULL != p->default_format) {
         mod_accesslog_free_format_fields(p->default_format);
     }
+
+  #ifdef ACCESSLOG_RING
+    accesslog_ring_free(p);
+  #endif
 }
 
 static void mod_accesslog_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
@@ -329,6 +765,11 @@ static void mod_accesslog_merge_config_cpv(plugin_config * const pconf, const co
         if (cpv->vtype != T_CONFIG_LOCAL) break;
         pconf->escaping = (int)cpv->v.u;
         break;
+      case 5: /* accesslog.ring-buffer */ /* T_CONFIG_SCOPE_SERVER */
+        break;
+      case 6: /* accesslog.binary */
+        pconf->binary = (uint8_t)cpv->v.u;
+        break;
       default:/* should not happen */
         return;
     }
@@ -367,6 +808,12 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
      ,{ CONST_STR_LEN("accesslog.escaping"),
         T_CONFIG_STRING,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("accesslog.ring-buffer"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("accesslog.binary"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -379,6 +826,7 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     int uses_syslog = 0;
+    uint32_t ring_kb = 0;
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
         config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
         int use_syslog = 0;
@@ -434,6 +882,13 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
                   : BS_ESCAPE_DEFAULT;
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
+              case 5: /* accesslog.ring-buffer */ /* T_CONFIG_SCOPE_SERVER */
+                ring_kb = cpv->v.u;
+                break;
+              case 6: /* accesslog.binary */
+                if (cpv->v.u) /*(usec request start time)*/
+                    srv->srvconf.high_precision_timestamps = 1;
+                break;
               default:/* should not happen */
                 break;
             }
@@ -463,6 +918,32 @@ SETDEFAULTS_FUNC(mod_accesslog_set_defaults) {
     UNUSED(uses_syslog);
   #endif
 
+    if (ring_kb && !srv->srvconf.preflight_check) {
+      #ifdef ACCESSLOG_RING
+        /* log files (not pipes or syslog) are written via ring buffer */
+        for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+            config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+            for (; -1 != cpv->k_id; ++cpv) {
+                if (0 != cpv->k_id || NULL == cpv->v.v) continue;
+                fdlog_st * const fdlog = cpv->v.v;
+                if (fdlog->mode != FDLOG_FILE) continue;
+                uint32_t j = 0;
+                while (j < p->ring_nlogs && p->ring_logs[j] != fdlog) ++j;
+                if (j < p->ring_nlogs) continue;
+                if (!(p->ring_nlogs & 3))
+                    ck_realloc_u32((void **)&p->ring_logs, p->ring_nlogs,
+                                   4, sizeof(*p->ring_logs));
+                p->ring_logs[p->ring_nlogs++] = fdlog;
+            }
+        }
+        if (p->ring_nlogs && !accesslog_ring_init(srv, p, ring_kb))
+            return HANDLER_ERROR;
+      #else
+        log_warn(srv->errh, __FILE__, __LINE__,
+          "accesslog.ring-buffer is not supported on this platform; ignored");
+      #endif
+    }
+
     /* initialize p->defaults from global config context */
     if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
         const config_plugin_value_t *cpv = p->cvlist + p->cvlist->v.u2[0];
@@ -539,8 +1020,38 @@ static format_fields * mod_accesslog_process_format(const char * const format, c
 					f->field = FORMAT_TIME_USED;
 					srv->srvconf.high_precision_timestamps = 1;
 				} else if (FORMAT_TIME_USED == f->field) {
-					const char * const ptr = fstr->ptr;
-					if (buffer_is_blank(fstr)
+					const char *ptr = fstr->ptr;
+					/* %{PHASE[:UNIT]}T elapsed time from request start to phase */
+					for (int i = REQ_TIMING_HEADERS; i < REQ_TIMING_MAX; ++i) {
+						const char * const name = request_timing_names[i];
+						const size_t nlen = strlen(name);
+						if (0 != strncmp(ptr, name, nlen)
+						    || (ptr[nlen] != ':' && ptr[nlen] != '\0'))
+							continue;
+						f->field = FORMAT_TIME_PHASE;
+						f->opt |= i << FORMAT_TIME_PHASE_SHIFT;
+						ptr += nlen + (ptr[nlen] == ':');
+						if (*ptr == '\0') ptr = "us"; /*(default unit)*/
+						request_timing = 1;
+						break;
+					}
+					if (f->field == FORMAT_TIME_PHASE) {
+						if (0 == strcmp(ptr, "s")
+						    || 0 == strcmp(ptr, "sec")) f->opt |= FORMAT_FLAG_TIME_SEC;
+						else if (0 == strcmp(ptr, "ms")
+						      || 0 == strcmp(ptr, "msec")) f->opt |= FORMAT_FLAG_TIME_MSEC;
+						else if (0 == strcmp(ptr, "us")
+						      || 0 == strcmp(ptr, "usec")) f->opt |= FORMAT_FLAG_TIME_USEC;
+						else if (0 == strcmp(ptr, "ns")
+						      || 0 == strcmp(ptr, "nsec")) f->opt |= FORMAT_FLAG_TIME_NSEC;
+						else {
+							log_error(srv->errh, __FILE__, __LINE__,
+								"invalid time unit in %%{PHASE:UNIT}T: %s", format);
+							mod_accesslog_free_format_fields(parsed_format);
+							return NULL;
+						}
+					}
+					else if (buffer_is_blank(fstr)
 					      || 0 == strcmp(ptr, "s")
 					      || 0 == strcmp(ptr, "sec"))  f->opt |= FORMAT_FLAG_TIME_SEC;
 					else if (0 == strcmp(ptr, "ms")
@@ -607,12 +1118,75 @@ static format_fields * mod_accesslog_process_format(const char * const format, c
 }
 
 TRIGGER_FUNC(log_access_periodic_flush) {
-    UNUSED(p_d);
     /* flush buffered access logs every 4 seconds */
     if (0 == (log_monotonic_secs & 3)) fdlog_files_flush(srv->errh, 0);
+  #ifdef ACCESSLOG_RING
+    plugin_data * const p = p_d;
+    if (p->ring_dropped != p->ring_dropped_logged
+        && 0 == (log_monotonic_secs % 60)) {
+        log_error(srv->errh, __FILE__, __LINE__,
+          "accesslog ring buffer full; %llu records dropped "
+          "(consider increasing accesslog.ring-buffer)",
+          (unsigned long long)(p->ring_dropped - p->ring_dropped_logged));
+        p->ring_dropped_logged = p->ring_dropped;
+    }
+  #else
+    UNUSED(p_d);
+  #endif
     return HANDLER_GO_ON;
 }
 
+#ifdef ACCESSLOG_RING
+
+SIGHUP_FUNC(log_access_cycle) {
+    plugin_data * const p = p_d;
+    UNUSED(srv);
+    /* notify ring writer process to reopen log files */
+    if (p->ring) {
+        __atomic_add_fetch(&p->ring->cycle, 1, __ATOMIC_SEQ_CST);
+        accesslog_ring_wakeup(p);
+    }
+    return HANDLER_GO_ON;
+}
+
+__attribute_cold__
+SERVER_FUNC(log_access_worker_init) {
+    plugin_data * const p = p_d;
+    UNUSED(srv);
+    if (p->ring && !p->ring_ref) {
+        p->ring_ref = 1;
+        __atomic_add_fetch(&p->ring->refs, 1, __ATOMIC_RELEASE);
+    }
+    return HANDLER_GO_ON;
+}
+
+__attribute_cold__
+static handler_t log_access_waitpid_cb(server *srv, void *p_d, pid_t pid, int status) {
+    plugin_data * const p = p_d;
+    if (NULL == p->ring || srv->pid != p->srv_pid)
+        return HANDLER_GO_ON;
+    if (pid != p->ring_pid) {
+        /* notify writer if (possible) producer killed, e.g. worker crash,
+         * since a record reserved by the producer might never be written */
+        if (WIFSIGNALED(status))
+            __atomic_add_fetch(&p->ring->crashed, 1, __ATOMIC_RELEASE);
+        return HANDLER_GO_ON;
+    }
+    /* restart writer; records remain in ring buffer */
+    log_error(srv->errh, __FILE__, __LINE__,
+      "accesslog ring buffer writer exited (status %d); restarting", status);
+    const pid_t wpid = fork();
+    if (0 == wpid)
+        accesslog_ring_writer(srv, p);
+    if (-1 == wpid)
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "fork() accesslog.ring-buffer writer");
+    p->ring_pid = wpid;
+    return HANDLER_FINISHED;
+}
+
+#endif
+
 static void
 accesslog_append_buffer (buffer * const restrict dest,
                          const buffer * const restrict b, esc_fn_t esc_fn)
@@ -765,6 +1339,23 @@ accesslog_append_time (buffer * const b, const request_st * const r,
 					buffer_append_string_buffer(b, ts_accesslog_str);
 				}
 			}
+			else if (f->field == FORMAT_TIME_PHASE) {
+				uint64_t tdiff = request_timing_elapsed(r,
+				  f->opt >> FORMAT_TIME_PHASE_SHIFT);
+				if (0 == tdiff) {
+					/* phase not reached (or timing not recorded) */
+					buffer_append_char(b, '-');
+					return 0;
+				}
+				if (f->opt & FORMAT_FLAG_TIME_SEC)
+					tdiff /= 1000000000;
+				else if (f->opt & FORMAT_FLAG_TIME_MSEC)
+					tdiff = (tdiff + 999999) / 1000000; /* ceil */
+				else if (f->opt & FORMAT_FLAG_TIME_USEC)
+					tdiff = (tdiff + 999) / 1000; /* ceil */
+				/* else (f->opt & FORMAT_FLAG_TIME_NSEC) */
+				buffer_append_int(b, (intmax_t)tdiff);
+			}
 			else { /* FORMAT_TIME_USED or FORMAT_TIME_USED_US */
 				if (f->opt & FORMAT_FLAG_TIME_SEC) {
 					buffer_append_int(b, log_epoch_secs - r->start_hp.tv_sec);
@@ -942,6 +1533,7 @@ static int log_access_record (const request_st * const r, buffer * const b, form
 			case FORMAT_TIME_USED_US:
 		  #endif
 			case FORMAT_TIME_USED:
+			case FORMAT_TIME_PHASE:
 				flush |= accesslog_append_time(b, r, f, &ts, parsed_format);
 				break;
 		  #if 0 /*(parsed and redirected at startup to FORMAT_REMOTE_ADDR)*/
@@ -998,6 +1590,112 @@ static int log_access_record (const request_st * const r, buffer * const b, form
 	return flush;
 }
 
+/* accesslog.binary record encoding (little-endian integers)
+ *
+ *   offset size
+ *     0     4   record length (bytes, including this field)
+ *     4     2   record version (1)
+ *     6     2   HTTP status
+ *     8     8   request start time (usec since epoch)
+ *    16     8   request duration (usec)
+ *    24     8   bytes in
+ *    32     8   bytes out
+ *    40     1   remote address family (4 IPv4, 6 IPv6, 0 other)
+ *    41     1   HTTP version (10, 11, 20, 30; 0 unknown)
+ *    42     2   remote port
+ *    44    16   remote address (IPv4 address in first 4 bytes)
+ *    60         strings, each (2 byte length, bytes) (not '\0'-terminated):
+ *               method, host, request-target, remote user, Referer, User-Agent
+ */
+
+#define ACCESSLOG_BINARY_VERSION 1
+#define ACCESSLOG_BINARY_HDRSZ   60
+
+static char *
+accesslog_binary_le (char * const s, uint64_t v, const uint32_t n)
+{
+    for (uint32_t i = 0; i < n; ++i, v >>= 8)
+        s[i] = (char)(v & 0xFF);
+    return s + n;
+}
+
+static void
+accesslog_binary_str (buffer * const b, const char * const s, size_t len)
+{
+    if (len > 0xFFFF) len = 0xFFFF; /*(truncate)*/
+    char * const d = buffer_extend(b, 2 + len);
+    accesslog_binary_le(d, len, 2);
+    if (len) memcpy(d+2, s, len);
+}
+
+static void
+accesslog_binary_buf (buffer * const b, const buffer * const vb)
+{
+    if (vb)
+        accesslog_binary_str(b, BUF_PTR_LEN(vb));
+    else
+        accesslog_binary_str(b, NULL, 0);
+}
+
+static void
+log_access_record_binary (const request_st * const r, buffer * const b)
+{
+    const size_t used = buffer_clen(b);
+    char *s = buffer_extend(b, ACCESSLOG_BINARY_HDRSZ);
+    unix_timespec64_t ts;
+    log_clock_gettime_realtime(&ts);
+    const uint64_t start = (uint64_t)r->start_hp.tv_sec * 1000000
+                         + (uint64_t)r->start_hp.tv_nsec / 1000;
+    const uint64_t end = (uint64_t)ts.tv_sec * 1000000
+                       + (uint64_t)ts.tv_nsec / 1000;
+    s = accesslog_binary_le(s, 0, 4); /*(record length filled in below)*/
+    s = accesslog_binary_le(s, ACCESSLOG_BINARY_VERSION, 2);
+    s = accesslog_binary_le(s, (uint64_t)r->http_status, 2);
+    s = accesslog_binary_le(s, start, 8);
+    s = accesslog_binary_le(s, end > start ? end - start : 0, 8);
+    s = accesslog_binary_le(s, (uint64_t)http_request_stats_bytes_in(r), 8);
+    s = accesslog_binary_le(s, (uint64_t)http_request_stats_bytes_out(r), 8);
+
+    const sock_addr * const addr = r->dst_addr;
+    char * const family = s;
+    *s++ = 0;
+    *s++ = (r->http_version >= HTTP_VERSION_1_0)
+      ? (char)(r->http_version < HTTP_VERSION_2
+               ? 10 + r->http_version
+               : 10 * r->http_version)
+      : 0;
+    s = accesslog_binary_le(s, sock_addr_get_port(addr), 2);
+    memset(s, 0, 16);
+    switch (sock_addr_get_family(addr)) {
+      case AF_INET:
+        *family = 4;
+        memcpy(s, &addr->ipv4.sin_addr, 4);
+        break;
+     #ifdef HAVE_IPV6
+      case AF_INET6:
+        *family = 6;
+        memcpy(s, &addr->ipv6.sin6_addr, 16);
+        break;
+     #endif
+      default:
+        break;
+    }
+
+    accesslog_binary_buf(b, http_method_buf(r->http_method));
+    accesslog_binary_buf(b, &r->uri.authority);
+    accesslog_binary_buf(b, &r->target_orig);
+    accesslog_binary_buf(b,
+      http_header_env_get(r, CONST_STR_LEN("REMOTE_USER")));
+    accesslog_binary_buf(b,
+      http_header_request_get(r, HTTP_HEADER_REFERER,
+                              CONST_STR_LEN("Referer")));
+    accesslog_binary_buf(b,
+      http_header_request_get(r, HTTP_HEADER_USER_AGENT,
+                              CONST_STR_LEN("User-Agent")));
+
+    accesslog_binary_le(b->ptr+used, buffer_clen(b) - used, 4);
+}
+
 REQUESTDONE_FUNC(log_access_write) {
     plugin_data * const p = p_d;
     mod_accesslog_patch_config(r, p);
@@ -1006,26 +1704,49 @@ REQUESTDONE_FUNC(log_access_write) {
     /* No output device, nothing to do */
     if (!p->conf.use_syslog && !fdlog) return HANDLER_GO_ON;
 
-    buffer * const b = (p->conf.use_syslog || fdlog->mode == FDLOG_PIPE)
+  #ifdef ACCESSLOG_RING
+    uint32_t ring_idx = 0;
+    if (p->ring && !p->conf.use_syslog) {
+        while (ring_idx < p->ring_nlogs && p->ring_logs[ring_idx] != fdlog)
+            ++ring_idx;
+    }
+    const int use_ring = (ring_idx < p->ring_nlogs && p->ring);
+  #else
+    const int use_ring = 0;
+  #endif
+
+    buffer * const b =
+      (p->conf.use_syslog || fdlog->mode == FDLOG_PIPE || use_ring)
       ? (buffer_clear(r->tmp_buf), r->tmp_buf)
       : &fdlog->b;
 
-    esc_fn_t * const esc_fn = !p->conf.escaping
-      ? buffer_append_bs_escaped
-      : buffer_append_bs_escaped_json;
-    const int flush =
-      log_access_record(r, b, p->conf.parsed_format, esc_fn);
+    int flush = 0;
+    if (p->conf.binary && !p->conf.use_syslog)
+        log_access_record_binary(r, b);
+    else {
+        esc_fn_t * const esc_fn = !p->conf.escaping
+          ? buffer_append_bs_escaped
+          : buffer_append_bs_escaped_json;
+        flush = log_access_record(r, b, p->conf.parsed_format, esc_fn);
+
+      #ifdef HAVE_SYSLOG_H
+        if (p->conf.use_syslog) {
+            if (!buffer_is_blank(b))
+                syslog(p->conf.syslog_level, "%s", b->ptr);
+            return HANDLER_GO_ON;
+        }
+      #endif
 
-  #ifdef HAVE_SYSLOG_H
-    if (p->conf.use_syslog) {
-        if (!buffer_is_blank(b))
-            syslog(p->conf.syslog_level, "%s", b->ptr);
+        buffer_append_char(b, '\n');
+    }
+
+  #ifdef ACCESSLOG_RING
+    if (use_ring) {
+        accesslog_ring_append(p, ring_idx, BUF_PTR_LEN(b));
         return HANDLER_GO_ON;
     }
   #endif
 
-    buffer_append_char(b, '\n');
-
     if (flush || fdlog->mode == FDLOG_PIPE || buffer_clen(b) >= 8192) {
         const ssize_t wr = write_all(fdlog->fd, BUF_PTR_LEN(b));
         buffer_clear(b); /*(clear buffer, even on error)*/
@@ -1051,6 +1772,11 @@ int mod_accesslog_plugin_init(plugin *p) {
 
 	p->handle_request_done  = log_access_write;
 	p->handle_trigger       = log_access_periodic_flush;
+  #ifdef ACCESSLOG_RING
+	p->handle_sighup        = log_access_cycle;
+	p->handle_waitpid       = log_access_waitpid_cb;
+	p->worker_init          = log_access_worker_init;
+  #endif
 
 	return 0;
 }
@@ -17,7 +17,7 @@
 #include "ck.h"
 #include "http_header.h"
 #include "log.h"
-#include "algo_splaytree.h"
+#include "algo_hashtab.h"
 #include "plugin.h"
 #include "plugin_config.h"
 
@@ -26,7 +26,7 @@
  */
 
 typedef struct {
-    splay_tree *sptree; /* data in nodes of tree are (http_auth_cache_entry *)*/
+    hashtab ht;         /* data in table is (http_auth_cache_entry *) */
     time_t max_age;
 } http_auth_cache;
 
@@ -94,19 +94,14 @@ http_auth_cache_entry_free (void *data)
 static void
 http_auth_cache_free (http_auth_cache *ac)
 {
-    splay_tree *sptree = ac->sptree;
-    while (sptree) {
-        http_auth_cache_entry_free(sptree->data);
-        sptree = splaytree_delete_splayed_node(sptree);
-    }
+    hashtab_clear(&ac->ht, http_auth_cache_entry_free);
     free(ac);
 }
 
 static http_auth_cache *
 http_auth_cache_init (const array *opts)
 {
-    http_auth_cache *ac = ck_malloc(sizeof(http_auth_cache));
-    ac->sptree = NULL;
+    http_auth_cache *ac = ck_calloc(1, sizeof(http_auth_cache));
     ac->max_age = 600; /* 10 mins */
     for (uint32_t i = 0, used = opts->used; i < used; ++i) {
         data_unset *du = opts->data[i];
@@ -118,71 +113,45 @@ http_auth_cache_init (const array *opts)
 }
 
 __attribute_pure__
-static int
+static uint32_t
 http_auth_cache_hash (const struct http_auth_require_t * const require, const char *username, const uint32_t ulen)
 {
-    /* (similar to splaytree_djbhash(), but with two strings hashed) */
+    /* (two strings hashed) */
     uint32_t h = /*(hash pointer value, which includes realm and permissions)*/
-      djbhash((char *)(intptr_t)require, sizeof(intptr_t), DJBHASH_INIT);
-    h = djbhash(username, ulen, h);
-    return (int32_t)h;
-}
-
-static http_auth_cache_entry *
-http_auth_cache_query (splay_tree ** const sptree, const int ndx)
-{
-    *sptree = splaytree_splay(*sptree, ndx);
-    return (*sptree && (*sptree)->key == ndx) ? (*sptree)->data : NULL;
+      hashtab_hash((char *)&require, sizeof(require));
+    return hashtab_hash_seed(username, ulen, h);
 }
 
 static void
-http_auth_cache_insert (splay_tree ** const sptree, const int ndx, void * const data, void(data_free_fn)(void *))
+http_auth_cache_insert (hashtab * const ht, const uint32_t ndx, void * const data, void(data_free_fn)(void *))
 {
-    /*(not necessary to re-splay (with current usage) since single-threaded
-     * and splaytree has not been modified since http_auth_cache_query())*/
-    /* *sptree = splaytree_splay(*sptree, ndx); */
-    if (NULL == *sptree || (*sptree)->key != ndx)
-        *sptree = splaytree_insert_splayed(*sptree, ndx, data);
-    else { /* collision; replace old entry */
-        data_free_fn((*sptree)->data);
-        (*sptree)->data = data;
-    }
+    void * const prev = hashtab_insert(ht, ndx, data);
+    if (prev) /* collision; replace old entry */
+        data_free_fn(prev);
 }
 
-/* walk though cache, collect expired ids, and remove them in a second loop */
-static void
-mod_auth_tag_old_entries (splay_tree * const t, int * const keys, int * const ndx, const time_t max_age, const unix_time64_t cur_ts)
+typedef struct mod_auth_age_arg {
+    unix_time64_t cur_ts;
+    time_t max_age;
+} mod_auth_age_arg;
+
+static int
+mod_auth_old_entry (void *data, void *arg)
 {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)
-        mod_auth_tag_old_entries(t->left, keys, ndx, max_age, cur_ts);
-    if (t->right)
-        mod_auth_tag_old_entries(t->right, keys, ndx, max_age, cur_ts);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-
-    const http_auth_cache_entry * const ae = t->data;
-    if (cur_ts - ae->ctime > max_age)
-        keys[(*ndx)++] = t->key;
+    http_auth_cache_entry * const ae = data;
+    const mod_auth_age_arg * const a = arg;
+    if (a->cur_ts - ae->ctime <= a->max_age)
+        return 0;
+    http_auth_cache_entry_free(ae);
+    return 1;
 }
 
 __attribute_noinline__
 static void
-mod_auth_periodic_cleanup(splay_tree **sptree_ptr, const time_t max_age, const unix_time64_t cur_ts)
+mod_auth_periodic_cleanup(hashtab * const ht, const time_t max_age, const unix_time64_t cur_ts)
 {
-    splay_tree *sptree = *sptree_ptr;
-    int max_ndx, i;
-    int keys[8192]; /* 32k size on stack */
-    do {
-        if (!sptree) break;
-        max_ndx = 0;
-        mod_auth_tag_old_entries(sptree, keys, &max_ndx, max_age, cur_ts);
-        for (i = 0; i < max_ndx; ++i) {
-            sptree = splaytree_splay_nonnull(sptree, keys[i]);
-            http_auth_cache_entry_free(sptree->data);
-            sptree = splaytree_delete_splayed_node(sptree);
-        }
-    } while (max_ndx == sizeof(keys)/sizeof(int));
-    *sptree_ptr = sptree;
+    mod_auth_age_arg a = { cur_ts, max_age };
+    hashtab_sweep(ht, mod_auth_old_entry, &a);
 }
 
 TRIGGER_FUNC(mod_auth_periodic)
@@ -202,7 +171,7 @@ TRIGGER_FUNC(mod_auth_periodic)
             if (cpv->k_id != 3) continue; /* k_id == 3 for auth.cache */
             if (cpv->vtype != T_CONFIG_LOCAL) continue;
             http_auth_cache *ac = cpv->v.v;
-            mod_auth_periodic_cleanup(&ac->sptree, ac->max_age, cur_ts);
+            mod_auth_periodic_cleanup(&ac->ht, ac->max_age, cur_ts);
         }
     }
 
@@ -822,15 +791,15 @@ mod_auth_check_basic(request_st * const r, void *p_d, const struct http_auth_req
     ulen  = (size_t)(pw - 1 - user);
 
     plugin_data * const p = p_d;
-    splay_tree ** sptree = p->conf.auth_cache
-      ? &p->conf.auth_cache->sptree
+    hashtab * const ht = p->conf.auth_cache
+      ? &p->conf.auth_cache->ht
       : NULL;
     http_auth_cache_entry *ae = NULL;
     handler_t rc = HANDLER_ERROR;
-    int ndx = -1;
-    if (sptree) {
+    uint32_t ndx = 0;
+    if (ht) {
         ndx = http_auth_cache_hash(require, user, ulen);
-        ae = http_auth_cache_query(sptree, ndx);
+        ae = hashtab_find(ht, ndx);
         if (ae && ae->require == require
             && ulen == ae->ulen && 0 == memcmp(user, ae->username, ulen))
             rc = ck_memeq_const_time(ae->pwdigest, ae->dlen, pw, pwlen)
@@ -848,10 +817,10 @@ mod_auth_check_basic(request_st * const r, void *p_d, const struct http_auth_req
     switch (rc) {
     case HANDLER_GO_ON:
         http_auth_setenv(r, user, ulen, CONST_STR_LEN("Basic"));
-        if (sptree && NULL == ae) { /*(cache (new) successful result)*/
+        if (ht && NULL == ae) { /*(cache (new) successful result)*/
             ae = http_auth_cache_entry_init(require, 0, user, ulen, user, ulen,
                                             pw, pwlen);
-            http_auth_cache_insert(sptree, ndx, ae, http_auth_cache_entry_free);
+            http_auth_cache_insert(ht, ndx, ae, http_auth_cache_entry_free);
         }
         break;
     case HANDLER_WAIT_FOR_EVENT:
@@ -1133,12 +1102,12 @@ static handler_t
 mod_auth_digest_get (request_st * const r, void *p_d, const struct http_auth_require_t * const require, const struct http_auth_backend_t * const backend, http_auth_info_t * const ai)
 {
     plugin_data * const p = p_d;
-    splay_tree **sptree = p->conf.auth_cache
-      ? &p->conf.auth_cache->sptree
+    hashtab * const ht = p->conf.auth_cache
+      ? &p->conf.auth_cache->ht
       : NULL;
     http_auth_cache_entry *ae = NULL;
     handler_t rc = HANDLER_GO_ON;
-    int ndx = -1;
+    uint32_t ndx = 0;
 
     const char *user = ai->username;
     const uint32_t ulen = ai->ulen;
@@ -1151,9 +1120,9 @@ mod_auth_digest_get (request_st * const r, void *p_d, const struct http_auth_req
         user = userbuf;
     }
 
-    if (sptree) {
+    if (ht) {
         ndx = http_auth_cache_hash(require, user, ulen);
-        ae = http_auth_cache_query(sptree, ndx);
+        ae = hashtab_find(ht, ndx);
         if (ae && ae->require == require
             && ae->dalgo == ai->dalgo
             && ae->dlen == ai->dlen
@@ -1192,11 +1161,11 @@ mod_auth_digest_get (request_st * const r, void *p_d, const struct http_auth_req
         return mod_auth_send_401_unauthorized_digest(r, require, 0);
     }
 
-    if (sptree && NULL == ae) { /*(cache digest from backend)*/
+    if (ht && NULL == ae) { /*(cache digest from backend)*/
         ae = http_auth_cache_entry_init(require, ai->dalgo, user, ulen,
                                         ai->username, ai->ulen,
                                         (char *)ai->digest, ai->dlen);
-        http_auth_cache_insert(sptree, ndx, ae, http_auth_cache_entry_free);
+        http_auth_cache_insert(ht, ndx, ae, http_auth_cache_entry_free);
     }
 
     return rc;
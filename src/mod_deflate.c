@@ -95,6 +95,18 @@
  *   create and destroy.  If this is ever changed to give away buffers, then use
  *   a unique hctx->output buffer per hctx; do not reuse p->tmp_buf across
  *   multiple requests being handled in parallel.
+ * - deflate.threads (optional) offloads compression of larger responses to a
+ *   pool of compression threads.  Each offloaded hctx gets a unique
+ *   hctx->output buffer and collects compressed output in hctx->tout (or in
+ *   the cache file), since chunkqueue and http_chunk_* are not thread-safe.
+ *   Compression threads only read chunks in hctx->in_queue (files are opened
+ *   beforehand) and settings copied into hctx (not p->conf, which is patched
+ *   per request by the event loop), and do not log; results are posted back
+ *   to the event loop via an eventfd (or pipe) registered with fdevent.
+ *   Response headers are sent while compression is in progress and the
+ *   response body is then sent with Transfer-Encoding: chunked (HTTP/1.1) or
+ *   HTTP/2 or HTTP/3 framing.  (libdeflate one-shot compression to mmap is
+ *   not used for responses offloaded to compression threads.)
  */
 #include "first.h"
 
@@ -111,8 +123,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
 
 #include "base.h"
+#include "algo_hashtab.h"
 #include "ck.h"
 #include "fdevent.h"
 #include "log.h"
@@ -122,9 +138,19 @@
 #include "http_header.h"
 #include "response.h"
 #include "stat_cache.h"
+#include "base64.h"
+#include "sys-crypto-md.h" /* USE_LIB_CRYPTO_SHA256 */
 
 #include "plugin.h"
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <signal.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#endif
+
 #if defined HAVE_ZLIB_H && defined HAVE_LIBZ
 # define USE_ZLIB
 # include <zlib.h>
@@ -157,6 +183,27 @@
 #undef HAVE_LIBDEFLATE
 #endif
 
+#if defined(HAVE_PTHREAD_H) && !defined(_WIN32) \
+ && (defined(USE_ZLIB) || defined(USE_BZ2LIB) || defined(USE_BROTLI) \
+     || defined(USE_ZSTD))
+#define MOD_DEFLATE_THREADS
+#endif
+
+/* Compression Dictionary Transport (RFC 9842): "dcz" and "dcb" encodings
+ * (zstd and brotli using a dictionary identified by its SHA-256 hash)
+ * (brotli v1.1.0 and later required for raw dictionaries) */
+#ifdef USE_LIB_CRYPTO_SHA256
+#if defined(USE_ZSTD) && ZSTD_VERSION_NUMBER >= 10000+400+0 /* v1.4.0 */
+#define MOD_DEFLATE_DICT_ZSTD
+#endif
+#if defined(USE_BROTLI) && defined(SHARED_BROTLI_MAX_COMPOUND_DICTS)
+#define MOD_DEFLATE_DICT_BROTLI
+#endif
+#if defined(MOD_DEFLATE_DICT_ZSTD) || defined(MOD_DEFLATE_DICT_BROTLI)
+#define MOD_DEFLATE_DICT
+#endif
+#endif
+
 /* request: accept-encoding */
 #define HTTP_ACCEPT_ENCODING_IDENTITY BV(0)
 #define HTTP_ACCEPT_ENCODING_GZIP     BV(1)
@@ -167,6 +214,8 @@
 #define HTTP_ACCEPT_ENCODING_X_BZIP2  BV(6)
 #define HTTP_ACCEPT_ENCODING_BR       BV(7)
 #define HTTP_ACCEPT_ENCODING_ZSTD     BV(8)
+#define HTTP_ACCEPT_ENCODING_DCB      BV(9)  /*(br with dictionary)*/
+#define HTTP_ACCEPT_ENCODING_DCZ      BV(10) /*(zstd with dictionary)*/
 
 typedef struct {
 	struct {
@@ -202,6 +251,7 @@ typedef struct {
 	uint16_t *	allowed_encodings;
 	double		max_loadavg;
 	const encparms *params;
+	const struct mod_deflate_dicts *dicts;
 } plugin_config;
 
 typedef struct {
@@ -212,7 +262,7 @@ typedef struct {
     buffer tmp_buf;
 } plugin_data;
 
-typedef struct {
+typedef struct handler_ctx {
 	union {
 	      #ifdef USE_ZLIB
 		z_stream z;
@@ -237,8 +287,232 @@ typedef struct {
 	int cache_fd;
 	char *cache_fn;
 	chunkqueue in_queue;
+	log_error_st *errh;
+	buffer *tout;             /*(compressed output from compression thread)*/
+	struct handler_ctx *next; /*(compression thread job queue)*/
+	int job;                  /*(compression thread job state)*/
+	int job_rc;
+	int sync_flush;           /*(copy of p->conf.sync_flush for request)*/
+	const struct mod_deflate_dict *dict; /*(dcz or dcb dictionary)*/
 } handler_ctx;
 
+enum { MOD_DEFLATE_JOB_NONE, MOD_DEFLATE_JOB_PENDING, MOD_DEFLATE_JOB_DONE };
+
+#ifdef MOD_DEFLATE_THREADS
+
+/* offload compression of responses larger than this to compression threads */
+#define MOD_DEFLATE_THREADS_MIN_SIZE 65536
+
+/* compression thread pool (per lighttpd process; started after fork()) */
+static struct mod_deflate_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    handler_ctx *queue;       /* pending jobs (FIFO) */
+    handler_ctx *queue_tail;
+    handler_ctx *done;        /* completed jobs */
+    pthread_t *tids;
+    uint32_t nthreads;        /* deflate.threads */
+    uint32_t started;
+    int shutdown;
+    int rfd;                  /* eventfd (rfd == wfd) or pipe */
+    int wfd;
+    fdnode *fdn;
+    fdevents *ev;
+} mod_deflate_pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    NULL, NULL, NULL, NULL, 0, 0, 0, -1, -1, NULL, NULL
+};
+
+__attribute_cold__
+static void mod_deflate_pool_stop(void);
+
+#endif
+
+#ifndef _WIN32 /* disable on _WIN32 */
+__attribute_cold__
+static void mod_deflate_cache_free(void);
+#endif
+
+/* adaptive compression level (deflate.adaptive-level)
+ *
+ * Compression levels are scaled down in steps (toward fastest level) while
+ * the worker is loaded, and scaled back up when load subsides.  Load is
+ * checked once a second: share of event loop time spent compressing
+ * responses (not including compression threads), and number of active
+ * connections relative to server.max-connections. */
+#define MOD_DEFLATE_ADAPT_STEPS      4
+#define MOD_DEFLATE_ADAPT_BUSY_HIGH  25 /* % event loop time compressing */
+#define MOD_DEFLATE_ADAPT_BUSY_LOW   10
+#define MOD_DEFLATE_ADAPT_CONNS_HIGH 75 /* % of server.max-connections */
+#define MOD_DEFLATE_ADAPT_CONNS_LOW  50
+
+static struct mod_deflate_adapt {
+    int enabled;
+    uint32_t step;            /* 0 (configured levels) .. ADAPT_STEPS */
+    uint64_t busy_ns;         /* time compressing in event loop (interval) */
+    uint64_t ts_ns;           /* start of interval */
+} mod_deflate_adapt;
+
+__attribute_unused__ /*(unused if built without compression libraries)*/
+static int mod_deflate_adapt_level (const int level, const int min) {
+    const int step = (int)mod_deflate_adapt.step;
+    return (step && level > min)
+      ? level - (level - min) * step / MOD_DEFLATE_ADAPT_STEPS
+      : level;
+}
+
+static void mod_deflate_adapt_busy (const uint64_t t0) {
+    if (t0) mod_deflate_adapt.busy_ns += request_timing_ns() - t0;
+}
+
+TRIGGER_FUNC(mod_deflate_trigger) {
+    UNUSED(p_d);
+    struct mod_deflate_adapt * const adapt = &mod_deflate_adapt;
+    if (!adapt->enabled) return HANDLER_GO_ON;
+
+    const uint64_t ts = request_timing_ns();
+    const uint64_t elapsed = ts - adapt->ts_ns;
+    const uint64_t busy = elapsed ? adapt->busy_ns * 100 / elapsed : 0;
+    const uint32_t max = srv->srvconf.max_conns;
+    const uint32_t conns = max - srv->lim_conns;
+    adapt->ts_ns = ts;
+    adapt->busy_ns = 0;
+
+    if (busy > MOD_DEFLATE_ADAPT_BUSY_HIGH
+        || conns * 100 > max * MOD_DEFLATE_ADAPT_CONNS_HIGH) {
+        if (adapt->step < MOD_DEFLATE_ADAPT_STEPS)
+            plugin_stats_set("deflate.adaptive-step",
+                             sizeof("deflate.adaptive-step")-1, ++adapt->step);
+    }
+    else if (busy < MOD_DEFLATE_ADAPT_BUSY_LOW
+             && conns * 100 < max * MOD_DEFLATE_ADAPT_CONNS_LOW) {
+        if (adapt->step)
+            plugin_stats_set("deflate.adaptive-step",
+                             sizeof("deflate.adaptive-step")-1, --adapt->step);
+    }
+
+    return HANDLER_GO_ON;
+}
+
+#ifdef MOD_DEFLATE_DICT
+
+/* dictionaries for Compression Dictionary Transport (deflate.dictionaries)
+ *
+ * Dictionary files are loaded at startup.  Each dictionary file must also be
+ * served (e.g. by mod_staticfile) so that clients can fetch it; responses
+ * serving the dictionary file are sent with Use-As-Dictionary: match="..."
+ * and clients then send Available-Dictionary: :<SHA-256>: in requests for
+ * URLs matching the pattern. */
+
+typedef struct mod_deflate_dict {
+    const buffer *fn;         /* dictionary file path */
+    const buffer *match;      /* Use-As-Dictionary match URL pattern */
+    char *data;
+    size_t len;
+    unsigned char hash[32];   /* SHA-256 */
+    char sfhash[48];          /* ":base64(SHA-256):" (sf-binary) */
+    uint32_t sflen;
+  #ifdef MOD_DEFLATE_DICT_BROTLI
+    BrotliEncoderPreparedDictionary *brpd;
+  #endif
+} mod_deflate_dict;
+
+typedef struct mod_deflate_dicts {
+    uint32_t used;
+    mod_deflate_dict d[];
+} mod_deflate_dicts;
+
+__attribute_cold__
+static void mod_deflate_dicts_free (mod_deflate_dicts * const dicts) {
+    for (uint32_t i = 0; i < dicts->used; ++i) {
+      #ifdef MOD_DEFLATE_DICT_BROTLI
+        if (dicts->d[i].brpd)
+            BrotliEncoderDestroyPreparedDictionary(dicts->d[i].brpd);
+      #endif
+        free(dicts->d[i].data);
+    }
+    free(dicts);
+}
+
+__attribute_cold__
+static mod_deflate_dicts * mod_deflate_dicts_load (const array * const a, log_error_st * const errh) {
+    mod_deflate_dicts * const dicts =
+      ck_calloc(1, sizeof(*dicts) + a->used * sizeof(mod_deflate_dict));
+    for (uint32_t i = 0; i < a->used; ++i) {
+        const data_string * const ds = (const data_string *)a->data[i];
+        if (buffer_is_blank(&ds->key) || buffer_is_blank(&ds->value)
+            || strchr(ds->key.ptr, '"') || strchr(ds->key.ptr, '\\')) {
+            log_error(errh, __FILE__, __LINE__,
+              "invalid deflate.dictionaries entry: \"%s\" => \"%s\"",
+              ds->key.ptr, ds->value.ptr);
+            mod_deflate_dicts_free(dicts);
+            return NULL;
+        }
+        mod_deflate_dict * const d = dicts->d + dicts->used;
+        off_t lim = 0;
+        d->data = fdevent_load_file(ds->value.ptr, &lim, errh, malloc, free);
+        if (NULL == d->data || 0 == lim) {
+            if (d->data)
+                log_error(errh, __FILE__, __LINE__,
+                  "empty deflate.dictionaries file: %s", ds->value.ptr);
+            free(d->data);
+            mod_deflate_dicts_free(dicts);
+            return NULL;
+        }
+        ++dicts->used;
+        d->len = (size_t)lim;
+        d->fn = &ds->value;
+        d->match = &ds->key;
+
+        SHA256_CTX ctx;
+        SHA256_Init(&ctx);
+        SHA256_Update(&ctx, d->data, d->len);
+        SHA256_Final(d->hash, &ctx);
+        d->sfhash[0] = ':';
+        d->sflen = 1 + (uint32_t)
+          li_base64_enc(d->sfhash+1, sizeof(d->sfhash)-3,
+                        d->hash, sizeof(d->hash), BASE64_STANDARD, 1);
+        d->sfhash[d->sflen++] = ':';
+        d->sfhash[d->sflen] = '\0';
+
+      #ifdef MOD_DEFLATE_DICT_BROTLI
+        /*(dcb not offered with this dictionary if prepare fails)*/
+        d->brpd = BrotliEncoderPrepareDictionary(BROTLI_SHARED_DICTIONARY_RAW,
+                                                 d->len, (uint8_t *)d->data,
+                                                 BROTLI_MAX_QUALITY,
+                                                 NULL, NULL, NULL);
+      #endif
+    }
+    return dicts;
+}
+
+static const mod_deflate_dict * mod_deflate_dict_find (request_st * const r, const mod_deflate_dicts * const dicts) {
+    const buffer * const vb =
+      http_header_request_get(r, HTTP_HEADER_OTHER,
+                              CONST_STR_LEN("Available-Dictionary"));
+    if (NULL == vb) return NULL;
+    for (uint32_t i = 0; i < dicts->used; ++i) {
+        if (buffer_eq_slen(vb, dicts->d[i].sfhash, dicts->d[i].sflen))
+            return dicts->d+i;
+    }
+    return NULL;
+}
+
+static void mod_deflate_dict_advertise (request_st * const r, const mod_deflate_dicts * const dicts) {
+    for (uint32_t i = 0; i < dicts->used; ++i) {
+        if (!buffer_is_equal(&r->physical.path, dicts->d[i].fn)) continue;
+        buffer * const vb =
+          http_header_response_set_ptr(r, HTTP_HEADER_OTHER,
+                                       CONST_STR_LEN("Use-As-Dictionary"));
+        buffer_append_str3(vb, CONST_STR_LEN("match=\""),
+                               BUF_PTR_LEN(dicts->d[i].match),
+                               CONST_STR_LEN("\""));
+        break;
+    }
+}
+
+#endif /* MOD_DEFLATE_DICT */
+
 __attribute_returns_nonnull__
 static handler_ctx *handler_ctx_init(void) {
 	handler_ctx * const hctx = ck_calloc(1, sizeof(*hctx));
@@ -254,11 +528,10 @@ static void handler_ctx_free(handler_ctx *hctx) {
 	}
 	if (-1 != hctx->cache_fd)
 		close(hctx->cache_fd);
-      #if 0
-	if (hctx->output != &p->tmp_buf) {
+	if (hctx->plugin_data && hctx->output != &hctx->plugin_data->tmp_buf) {
 		buffer_free(hctx->output);
 	}
-      #endif
+	buffer_free(hctx->tout);
 	chunkqueue_reset(&hctx->in_queue);
 	free(hctx);
 }
@@ -275,6 +548,12 @@ INIT_FUNC(mod_deflate_init) {
 
 FREE_FUNC(mod_deflate_free) {
     plugin_data *p = p_d;
+  #ifdef MOD_DEFLATE_THREADS
+    mod_deflate_pool_stop();
+  #endif
+  #ifndef _WIN32 /* disable on _WIN32 */
+    mod_deflate_cache_free();
+  #endif
     free(p->tmp_buf.ptr);
     if (NULL == p->cvlist) return;
     /* (init i to 0 if global context; to 1 to skip empty global context) */
@@ -287,6 +566,11 @@ FREE_FUNC(mod_deflate_free) {
               case 14:/* deflate.params */
                 free(cpv->v.v);
                 break;
+             #ifdef MOD_DEFLATE_DICT
+              case 17:/* deflate.dictionaries */
+                mod_deflate_dicts_free(cpv->v.v);
+                break;
+             #endif
               default:
                 break;
             }
@@ -313,6 +597,289 @@ static int mkdir_recursive (char *dir) {
 }
 #endif
 
+#ifndef _WIN32 /* disable on _WIN32 */
+
+/* index of files in deflate.cache-dir to limit total size of cached files
+ * (deflate.cache-dir-max-size)
+ *
+ * Index is per lighttpd process; cache dirs are scanned at startup and files
+ * created by other workers (server.max-worker) are added when served.
+ * Eviction is LRU, except that an entry reaching the LRU tail which has been
+ * hit since it was last at the LRU tail is moved back to the head (with hit
+ * count halved), so that frequently requested entries stay in the cache.
+ *
+ * Total size of files in cache is kept in shared memory (created before
+ * workers are forked), added to by the process creating a cache file and
+ * subtracted from by the process which succeeds in unlink() of a cache file,
+ * so that the limit applies across workers.  Each worker evicts from its own
+ * index while the total exceeds the limit. */
+
+#if defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS) && defined(__ATOMIC_ACQUIRE)
+#define MOD_DEFLATE_CACHE_SHARED
+#endif
+
+typedef struct mod_deflate_cache_entry {
+    struct mod_deflate_cache_entry *prev; /* LRU list; head is most recent */
+    struct mod_deflate_cache_entry *next;
+    off_t size;
+    uint32_t hits;
+    uint32_t hash;
+    uint32_t plen;
+    char path[];
+} mod_deflate_cache_entry;
+
+static struct mod_deflate_cache {
+    hashtab ht;
+    mod_deflate_cache_entry *head;
+    mod_deflate_cache_entry *tail;
+    off_t used; /* total size of entries in (per-process) index */
+    off_t max; /* (0 if cache size is not limited) */
+    int64_t *total; /* (shared) total size of files in cache (or NULL) */
+} mod_deflate_cache;
+
+static off_t mod_deflate_cache_total (void) {
+  #ifdef MOD_DEFLATE_CACHE_SHARED
+    if (mod_deflate_cache.total)
+        return (off_t)__atomic_load_n(mod_deflate_cache.total,__ATOMIC_RELAXED);
+  #endif
+    return mod_deflate_cache.used;
+}
+
+static void mod_deflate_cache_total_add (const off_t n) {
+  #ifdef MOD_DEFLATE_CACHE_SHARED
+    if (mod_deflate_cache.total)
+        __atomic_add_fetch(mod_deflate_cache.total, (int64_t)n,
+                           __ATOMIC_RELAXED);
+  #else
+    UNUSED(n);
+  #endif
+}
+
+static void mod_deflate_cache_lru_del (mod_deflate_cache_entry * const e) {
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    if (e->prev) e->prev->next = e->next; else dc->head = e->next;
+    if (e->next) e->next->prev = e->prev; else dc->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void mod_deflate_cache_lru_push (mod_deflate_cache_entry * const e) {
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    e->prev = NULL;
+    e->next = dc->head;
+    if (dc->head) dc->head->prev = e; else dc->tail = e;
+    dc->head = e;
+}
+
+static void mod_deflate_cache_entry_del (mod_deflate_cache_entry * const e) {
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    mod_deflate_cache_lru_del(e);
+    hashtab_remove(&dc->ht, e->hash);
+    dc->used -= e->size;
+    free(e);
+}
+
+static void mod_deflate_cache_evict (log_error_st * const errh) {
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    /*(each entry given at most one more pass per call)*/
+    for (uint32_t n = hashtab_used(&dc->ht);
+         mod_deflate_cache_total() > dc->max && dc->tail; ) {
+        mod_deflate_cache_entry * const e = dc->tail;
+        if (e->hits && n) {
+            --n;
+            e->hits >>= 1;
+            mod_deflate_cache_lru_del(e);
+            mod_deflate_cache_lru_push(e);
+            continue;
+        }
+        if (0 == unlink(e->path))
+            mod_deflate_cache_total_add(-e->size);
+        else if (errno != ENOENT) /*(ENOENT if removed by another worker)*/
+            log_perror(errh, __FILE__, __LINE__, "unlink %s", e->path);
+        stat_cache_delete_entry(e->path, e->plen);
+        mod_deflate_cache_entry_del(e);
+    }
+}
+
+static mod_deflate_cache_entry * mod_deflate_cache_find (const char * const path, const uint32_t plen, const uint32_t hash) {
+    mod_deflate_cache_entry * const e =
+      hashtab_find(&mod_deflate_cache.ht, hash);
+    return (e && e->plen == plen && 0 == memcmp(e->path, path, plen))
+      ? e
+      : NULL;
+}
+
+static mod_deflate_cache_entry * mod_deflate_cache_insert (const char * const path, const uint32_t plen, const off_t size) {
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    const uint32_t hash = hashtab_hash(path, plen);
+    mod_deflate_cache_entry *e = mod_deflate_cache_find(path, plen, hash);
+    if (NULL == e) {
+        e = ck_malloc(sizeof(*e) + plen + 1);
+        e->prev = e->next = NULL;
+        e->size = 0;
+        e->hits = 0;
+        e->hash = hash;
+        e->plen = plen;
+        memcpy(e->path, path, plen);
+        e->path[plen] = '\0';
+        mod_deflate_cache_entry * const x = hashtab_insert(&dc->ht, hash, e);
+        if (x) { /*(hash collision; untrack prior entry)*/
+            mod_deflate_cache_lru_del(x);
+            dc->used -= x->size;
+            free(x);
+        }
+    }
+    else
+        mod_deflate_cache_lru_del(e);
+    dc->used += size - e->size;
+    e->size = size;
+    mod_deflate_cache_lru_push(e);
+    return e;
+}
+
+static void mod_deflate_cache_hit (request_st * const r, const buffer * const fn, const off_t size) {
+    if (0 == mod_deflate_cache.max) return;
+    const uint32_t plen = buffer_clen(fn);
+    mod_deflate_cache_entry * const e =
+      mod_deflate_cache_find(fn->ptr, plen, hashtab_hash(fn->ptr, plen));
+    if (e) {
+        ++e->hits;
+        mod_deflate_cache_lru_del(e);
+        mod_deflate_cache_lru_push(e);
+    }
+    else { /*(e.g. created by another lighttpd worker)*/
+        mod_deflate_cache_insert(fn->ptr, plen, size);
+        mod_deflate_cache_evict(r->conf.errh);
+    }
+}
+
+static void mod_deflate_cache_add (request_st * const r, const buffer * const fn, const off_t size, const off_t prev) {
+    /* (prev: size of file replaced by rename() of new cache file, or 0) */
+    if (0 == mod_deflate_cache.max) return;
+    mod_deflate_cache_insert(fn->ptr, buffer_clen(fn), size);
+    mod_deflate_cache_total_add(size - prev);
+    mod_deflate_cache_evict(r->conf.errh);
+}
+
+static void mod_deflate_cache_free_entry (void *data) {
+    free(data);
+}
+
+__attribute_cold__
+static void mod_deflate_cache_free (void) {
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    hashtab_clear(&dc->ht, mod_deflate_cache_free_entry);
+    dc->head = dc->tail = NULL;
+    dc->used = 0;
+    dc->max = 0;
+  #ifdef MOD_DEFLATE_CACHE_SHARED
+    if (dc->total) {
+        munmap(dc->total, sizeof(*dc->total));
+        dc->total = NULL;
+    }
+  #endif
+}
+
+__attribute_cold__
+static void mod_deflate_cache_total_init (log_error_st * const errh) {
+  #ifdef MOD_DEFLATE_CACHE_SHARED
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    void * const total = mmap(NULL, sizeof(*dc->total), PROT_READ|PROT_WRITE,
+                              MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == total) {
+        log_perror(errh, __FILE__, __LINE__,
+          "mmap() deflate.cache-dir-max-size; limit will be per-worker");
+        return;
+    }
+    dc->total = total;
+    *dc->total = (int64_t)dc->used; /*(set before forking workers)*/
+  #else
+    UNUSED(errh);
+  #endif
+}
+
+typedef struct {
+    unix_time64_t mtime;
+    char *path;
+    uint32_t plen;
+    off_t size;
+} mod_deflate_cache_scan_ent;
+
+typedef struct {
+    mod_deflate_cache_scan_ent *ents;
+    uint32_t used;
+    uint32_t size;
+} mod_deflate_cache_scan_list;
+
+static int mod_deflate_cache_scan_cmp (const void *a, const void *b) {
+    const unix_time64_t x = ((const mod_deflate_cache_scan_ent *)a)->mtime;
+    const unix_time64_t y = ((const mod_deflate_cache_scan_ent *)b)->mtime;
+    return (x > y) - (x < y);
+}
+
+__attribute_cold__
+static void mod_deflate_cache_scan_dir (buffer * const b, mod_deflate_cache_scan_list * const list, log_error_st * const errh) {
+    DIR * const dir = opendir(b->ptr);
+    if (NULL == dir) {
+        log_perror(errh, __FILE__, __LINE__, "opendir %s", b->ptr);
+        return;
+    }
+    const uint32_t blen = buffer_clen(b);
+    struct dirent *dent;
+    while (NULL != (dent = readdir(dir))) {
+        const char * const name = dent->d_name;
+        if (name[0] == '.'
+            && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+        buffer_append_path_len(b, name, strlen(name));
+        struct stat st;
+        if (0 != lstat(b->ptr, &st))
+            ;
+        else if (S_ISDIR(st.st_mode))
+            mod_deflate_cache_scan_dir(b, list, errh);
+        else if (S_ISREG(st.st_mode)) {
+            if (list->used == list->size) {
+                const uint32_t x = list->size ? list->size : 1024;
+                ck_realloc_u32((void **)&list->ents, list->size, x,
+                               sizeof(*list->ents));
+                list->size += x;
+            }
+            mod_deflate_cache_scan_ent * const ent = list->ents + list->used++;
+            ent->mtime = TIME64_CAST(st.st_mtime);
+            ent->plen = buffer_clen(b);
+            ent->path = ck_malloc(ent->plen + 1);
+            memcpy(ent->path, b->ptr, ent->plen + 1);
+            ent->size = st.st_size;
+        }
+        buffer_truncate(b, blen);
+    }
+    closedir(dir);
+}
+
+__attribute_cold__
+static void mod_deflate_cache_scan (const buffer * const cache_dir, log_error_st * const errh) {
+    mod_deflate_cache_scan_list list = { NULL, 0, 0 };
+    buffer * const b = buffer_init();
+    buffer_copy_buffer(b, cache_dir);
+    mod_deflate_cache_scan_dir(b, &list, errh);
+    buffer_free(b);
+
+    /* insert oldest first so that most recently modified are LRU head */
+    if (list.used)
+        qsort(list.ents, list.used, sizeof(*list.ents),
+              mod_deflate_cache_scan_cmp);
+    for (uint32_t i = 0; i < list.used; ++i) {
+        mod_deflate_cache_scan_ent * const ent = list.ents + i;
+        mod_deflate_cache_insert(ent->path, ent->plen, ent->size);
+        free(ent->path);
+    }
+    free(list.ents);
+}
+
+#endif /* !_WIN32 */
+
 static buffer * mod_deflate_cache_file_name(request_st * const r, const buffer *cache_dir, const buffer * const etag) {
     /* XXX: future: for shorter paths into the cache, we could checksum path,
      *      and then shard it to avoid a huge single directory.
@@ -348,14 +915,27 @@ static void mod_deflate_cache_file_open (handler_ctx * const hctx, const buffer
     }
 }
 
-static int mod_deflate_cache_file_finish (request_st * const r, handler_ctx * const hctx, const buffer * const fn) {
+static int mod_deflate_cache_file_finish (request_st * const r, handler_ctx * const hctx, const buffer * const fn, const int reset) {
+  #ifndef _WIN32 /* disable on _WIN32 */
+    /*(file might have been created by another worker at the same time)*/
+    struct stat st;
+    const off_t prev = (mod_deflate_cache.max && 0 == stat(fn->ptr, &st))
+      ? st.st_size
+      : 0;
+  #endif
     if (0 != fdevent_rename(hctx->cache_fn, fn->ptr))
         return -1;
     free(hctx->cache_fn);
     hctx->cache_fn = NULL;
-    chunkqueue_reset(&r->write_queue);
+    /*(not reset if response headers might be pending in r->write_queue)*/
+    if (reset)
+        chunkqueue_reset(&r->write_queue);
     int rc = http_chunk_append_file_fd(r, fn, hctx->cache_fd, hctx->bytes_out);
     hctx->cache_fd = -1;
+  #ifndef _WIN32 /* disable on _WIN32 */
+    if (0 == rc)
+        mod_deflate_cache_add(r, fn, hctx->bytes_out, prev);
+  #endif
     return rc;
 }
 
@@ -413,6 +993,15 @@ static void mod_deflate_merge_config_cpv(plugin_config * const pconf, const conf
         if (cpv->vtype == T_CONFIG_LOCAL)
             pconf->params = cpv->v.v;
         break;
+      case 15:/* deflate.threads *//*(server-wide; see set_defaults)*/
+      case 16:/* deflate.cache-dir-max-size *//*(server-wide)*/
+        break;
+      case 17:/* deflate.dictionaries */
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->dicts = cpv->v.v;
+        break;
+      case 18:/* deflate.adaptive-level *//*(server-wide)*/
+        break;
       default:/* should not happen */
         return;
     }
@@ -641,11 +1230,13 @@ static uint16_t * mod_deflate_encodings_to_flags(const array *encodings) {
           #endif
           #ifdef USE_BROTLI /* "br" (also accepts "brotli") */
             if (NULL != strstr(ds->value.ptr, "br"))
-                x[i++] = HTTP_ACCEPT_ENCODING_BR;
+                x[i++] = HTTP_ACCEPT_ENCODING_BR
+                       | HTTP_ACCEPT_ENCODING_DCB;
           #endif
           #ifdef USE_ZSTD
             if (NULL != strstr(ds->value.ptr, "zstd"))
-                x[i++] = HTTP_ACCEPT_ENCODING_ZSTD;
+                x[i++] = HTTP_ACCEPT_ENCODING_ZSTD
+                       | HTTP_ACCEPT_ENCODING_DCZ;
           #endif
         }
         x[i] = 0; /* end of list */
@@ -656,10 +1247,12 @@ static uint16_t * mod_deflate_encodings_to_flags(const array *encodings) {
         uint16_t * const x = ck_calloc(4+1, sizeof(short));
         int i = 0;
       #ifdef USE_ZSTD
-        x[i++] = HTTP_ACCEPT_ENCODING_ZSTD;
+        x[i++] = HTTP_ACCEPT_ENCODING_ZSTD
+               | HTTP_ACCEPT_ENCODING_DCZ;
       #endif
       #ifdef USE_BROTLI
-        x[i++] = HTTP_ACCEPT_ENCODING_BR;
+        x[i++] = HTTP_ACCEPT_ENCODING_BR
+               | HTTP_ACCEPT_ENCODING_DCB;
       #endif
       #ifdef USE_ZLIB
         x[i++] = HTTP_ACCEPT_ENCODING_GZIP
@@ -722,6 +1315,18 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
      ,{ CONST_STR_LEN("deflate.params"),
         T_CONFIG_ARRAY_KVANY,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.threads"),
+        T_CONFIG_SHORT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("deflate.cache-dir-max-size"),
+        T_CONFIG_INT,
+        T_CONFIG_SCOPE_SERVER }
+     ,{ CONST_STR_LEN("deflate.dictionaries"),
+        T_CONFIG_ARRAY_KVSTRING,
+        T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("deflate.adaptive-level"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SERVER }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -731,6 +1336,17 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_deflate"))
         return HANDLER_ERROR;
 
+  #ifdef MOD_DEFLATE_THREADS
+    mod_deflate_pool.nthreads = 0;
+  #endif
+  #ifndef _WIN32 /* disable on _WIN32 */
+    mod_deflate_cache_free();
+  #endif
+    mod_deflate_adapt.enabled = 0;
+    mod_deflate_adapt.step = 0;
+    mod_deflate_adapt.busy_ns = 0;
+    mod_deflate_adapt.ts_ns = request_timing_ns();
+
     /* process and validate config directives
      * (init i to 0 if global context; to 1 to skip empty global context) */
     for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
@@ -837,6 +1453,47 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
                 cpv->v.v = mod_deflate_parse_params(cpv->v.a, srv->errh);
                 cpv->vtype = T_CONFIG_LOCAL;
                 break;
+              case 15:/* deflate.threads */
+                if (cpv->v.shrt > 64) {
+                    log_error(srv->errh, __FILE__, __LINE__,
+                      "%s must be between 0 and 64: %hu",
+                      cpk[cpv->k_id].k, cpv->v.shrt);
+                    return HANDLER_ERROR;
+                }
+               #ifdef MOD_DEFLATE_THREADS
+                mod_deflate_pool.nthreads = cpv->v.shrt;
+               #else
+                if (cpv->v.shrt)
+                    log_warn(srv->errh, __FILE__, __LINE__,
+                      "%s not supported in this build; ignored",
+                      cpk[cpv->k_id].k);
+               #endif
+                break;
+              case 16:/* deflate.cache-dir-max-size */
+               #ifndef _WIN32 /* disable on _WIN32 */
+                mod_deflate_cache.max = (off_t)cpv->v.u << 20; /*(MB)*/
+               #endif
+                break;
+              case 17:/* deflate.dictionaries */
+               #ifdef MOD_DEFLATE_DICT
+                if (cpv->v.a->used) {
+                    cpv->v.v = mod_deflate_dicts_load(cpv->v.a, srv->errh);
+                    if (NULL == cpv->v.v) return HANDLER_ERROR;
+                }
+                else
+                    cpv->v.v = NULL; /*(disable in conditional)*/
+                cpv->vtype = T_CONFIG_LOCAL;
+               #else
+                if (cpv->v.a->used)
+                    log_warn(srv->errh, __FILE__, __LINE__,
+                      "%s not supported in this build "
+                      "(requires zstd or brotli and crypto lib); ignored",
+                      cpk[cpv->k_id].k);
+               #endif
+                break;
+              case 18:/* deflate.adaptive-level */
+                mod_deflate_adapt.enabled = (int)cpv->v.u;
+                break;
               default:/* should not happen */
                 break;
             }
@@ -853,10 +1510,10 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
 
     static const uint16_t available_encodings[] = {
       #ifdef USE_ZSTD
-        HTTP_ACCEPT_ENCODING_ZSTD,
+        HTTP_ACCEPT_ENCODING_ZSTD | HTTP_ACCEPT_ENCODING_DCZ,
       #endif
       #ifdef USE_BROTLI
-        HTTP_ACCEPT_ENCODING_BR,
+        HTTP_ACCEPT_ENCODING_BR | HTTP_ACCEPT_ENCODING_DCB,
       #endif
       #ifdef USE_ZLIB
         HTTP_ACCEPT_ENCODING_GZIP,
@@ -878,6 +1535,33 @@ SETDEFAULTS_FUNC(mod_deflate_set_defaults) {
             mod_deflate_merge_config(&p->defaults, cpv);
     }
 
+  #ifndef _WIN32 /* disable on _WIN32 */
+    /* index existing files in deflate.cache-dir (each dir scanned once) */
+    if (mod_deflate_cache.max) {
+        for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+            const config_plugin_value_t *cpv = p->cvlist+p->cvlist[i].v.u2[0];
+            for (; -1 != cpv->k_id; ++cpv) {
+                if (cpv->k_id != 8 || NULL == cpv->v.b) continue;
+                int j = !p->cvlist[0].v.u2[1];
+                for (; j < i; ++j) {
+                    const config_plugin_value_t *cpvj =
+                      p->cvlist + p->cvlist[j].v.u2[0];
+                    for (; -1 != cpvj->k_id; ++cpvj) {
+                        if (cpvj->k_id == 8 && cpvj->v.b
+                            && buffer_is_equal(cpvj->v.b, cpv->v.b))
+                            break;
+                    }
+                    if (-1 != cpvj->k_id) break;
+                }
+                if (j == i) /*(not previously scanned)*/
+                    mod_deflate_cache_scan(cpv->v.b, srv->errh);
+            }
+        }
+        mod_deflate_cache_total_init(srv->errh);
+        mod_deflate_cache_evict(srv->errh);
+    }
+  #endif
+
     return HANDLER_GO_ON;
 }
 
@@ -894,9 +1578,32 @@ static int mod_deflate_cache_file_append (handler_ctx * const hctx, const char *
 
 static int stream_http_chunk_append_mem(handler_ctx * const hctx, const char * const out, size_t len) {
     if (0 == len) return 0;
-    return (-1 == hctx->cache_fd)
-      ? http_chunk_append_mem(hctx->r, out, len)
-      : mod_deflate_cache_file_append(hctx, out, len);
+    if (-1 != hctx->cache_fd)
+        return mod_deflate_cache_file_append(hctx, out, len);
+    if (hctx->tout) { /*(compression thread)*/
+        buffer_append_string_len(hctx->tout, out, len);
+        return 0;
+    }
+    return http_chunk_append_mem(hctx->r, out, len);
+}
+#endif
+
+
+#ifdef MOD_DEFLATE_DICT
+static int mod_deflate_dict_header (handler_ctx * const hctx) {
+    /* dictionary-compressed response begins with dictionary SHA-256 hash
+     * dcz: zstd skippable frame (magic 0x184D2A5E, 32 byte frame size)
+     * dcb: magic 0xFF 'D' 'C' 'B' */
+    static const char dcz[] = { 0x5e, 0x2a, 0x4d, 0x18, 0x20, 0x00, 0x00, 0x00 };
+    static const char dcb[] = { (char)0xff, 0x44, 0x43, 0x42 };
+    char hdr[sizeof(dcz) + sizeof(hctx->dict->hash)];
+    const uint32_t n = (hctx->compression_type == HTTP_ACCEPT_ENCODING_ZSTD)
+      ? sizeof(dcz)
+      : sizeof(dcb);
+    memcpy(hdr, n == sizeof(dcz) ? dcz : dcb, n);
+    memcpy(hdr+n, hctx->dict->hash, sizeof(hctx->dict->hash));
+    hctx->bytes_out += (off_t)(n + sizeof(hctx->dict->hash));
+    return stream_http_chunk_append_mem(hctx, hdr, n+sizeof(hctx->dict->hash));
 }
 #endif
 
@@ -923,7 +1630,9 @@ static int stream_deflate_init(handler_ctx *hctx) {
 	  : MAX_WBITS;
 
 	if (Z_OK != deflateInit2(z,
-				 clevel > 0 ? clevel : Z_DEFAULT_COMPRESSION,
+				 mod_deflate_adapt.step
+				  ? mod_deflate_adapt_level(clevel > 0 ? clevel : 6, 1)
+				  : clevel > 0 ? clevel : Z_DEFAULT_COMPRESSION,
 				 Z_DEFLATED,
 				 (hctx->compression_type == HTTP_ACCEPT_ENCODING_GZIP)
 				  ? (wbits | 16) /*(0x10 flags gzip header, trailer)*/
@@ -964,7 +1673,6 @@ static int stream_deflate_compress(handler_ctx * const hctx, const unsigned char
 
 static int stream_deflate_flush(handler_ctx * const hctx, int end) {
 	z_stream * const z = &(hctx->u.z);
-	const plugin_data *p = hctx->plugin_data;
 	size_t len;
 	int rc = 0;
 	int done;
@@ -980,7 +1688,7 @@ static int stream_deflate_flush(handler_ctx * const hctx, int end) {
 				return -1;
 			}
 		} else {
-			if (p->conf.sync_flush) {
+			if (hctx->sync_flush) {
 				rc = deflate(z, Z_SYNC_FLUSH);
 				if (rc != Z_OK) return -1;
 			} else if (z->avail_in > 0) {
@@ -990,7 +1698,7 @@ static int stream_deflate_flush(handler_ctx * const hctx, int end) {
 		}
 
 		len = hctx->output->size - z->avail_out;
-		if (z->avail_out == 0 || (len > 0 && (end || p->conf.sync_flush))) {
+		if (z->avail_out == 0 || (len > 0 && (end || hctx->sync_flush))) {
 			hctx->bytes_out += len;
 			if (0 != stream_http_chunk_append_mem(hctx, hctx->output->ptr, len))
 				return -1;
@@ -1008,10 +1716,10 @@ static int stream_deflate_end(handler_ctx *hctx) {
 	if (Z_OK == rc || Z_DATA_ERROR == rc) return 0;
 
 	if (z->msg != NULL) {
-		log_error(hctx->r->conf.errh, __FILE__, __LINE__,
+		log_error(hctx->errh, __FILE__, __LINE__,
 		  "deflateEnd error ret=%d, msg=%s", rc, z->msg);
 	} else {
-		log_error(hctx->r->conf.errh, __FILE__, __LINE__,
+		log_error(hctx->errh, __FILE__, __LINE__,
 		  "deflateEnd error ret=%d", rc);
 	}
 	return -1;
@@ -1079,7 +1787,6 @@ static int stream_bzip2_compress(handler_ctx * const hctx, const unsigned char *
 
 static int stream_bzip2_flush(handler_ctx * const hctx, int end) {
 	bz_stream * const bz = &(hctx->u.bz);
-	const plugin_data *p = hctx->plugin_data;
 	size_t len;
 	int rc;
 	int done;
@@ -1095,7 +1802,7 @@ static int stream_bzip2_flush(handler_ctx * const hctx, int end) {
 				return -1;
 			}
 		} else if (bz->avail_in > 0) {
-			/* p->conf.sync_flush not implemented here,
+			/* hctx->sync_flush not implemented here,
 			 * which would loop on BZ_FLUSH while BZ_FLUSH_OK
 			 * until BZ_RUN_OK returned */
 			rc = BZ2_bzCompress(bz, BZ_RUN);
@@ -1105,7 +1812,7 @@ static int stream_bzip2_flush(handler_ctx * const hctx, int end) {
 		}
 
 		len = hctx->output->size - bz->avail_out;
-		if (bz->avail_out == 0 || (len > 0 && (end || p->conf.sync_flush))) {
+		if (bz->avail_out == 0 || (len > 0 && (end || hctx->sync_flush))) {
 			hctx->bytes_out += len;
 			if (0 != stream_http_chunk_append_mem(hctx, hctx->output->ptr, len))
 				return -1;
@@ -1122,7 +1829,7 @@ static int stream_bzip2_end(handler_ctx *hctx) {
 	int rc = BZ2_bzCompressEnd(bz);
 	if (BZ_OK == rc || BZ_DATA_ERROR == rc) return 0;
 
-	log_error(hctx->r->conf.errh, __FILE__, __LINE__,
+	log_error(hctx->errh, __FILE__, __LINE__,
 	  "BZ2_bzCompressEnd error ret=%d", rc);
 	return -1;
 }
@@ -1146,7 +1853,10 @@ static int stream_br_init(handler_ctx *hctx) {
         ? (uint32_t)p->conf.compression_level
         : 5;
         /* BROTLI_DEFAULT_QUALITY is 11 and can be *very* time-consuming */
-    if (quality != BROTLI_DEFAULT_QUALITY)
+    if (mod_deflate_adapt.step)
+        BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY,
+          (uint32_t)mod_deflate_adapt_level((int)quality, 1));
+    else if (quality != BROTLI_DEFAULT_QUALITY)
         BrotliEncoderSetParameter(br, BROTLI_PARAM_QUALITY, quality);
 
     if (params && params->brotli.window != BROTLI_DEFAULT_WINDOW)
@@ -1172,6 +1882,14 @@ static int stream_br_init(handler_ctx *hctx) {
             BrotliEncoderSetParameter(br, BROTLI_PARAM_MODE, BROTLI_MODE_FONT);
     }
 
+  #ifdef MOD_DEFLATE_DICT_BROTLI
+    if (hctx->dict /*(dcb)*/
+        && !BrotliEncoderAttachPreparedDictionary(br, hctx->dict->brpd)) {
+        BrotliEncoderDestroyInstance(br);
+        return -1;
+    }
+  #endif
+
     return 0;
 }
 
@@ -1260,6 +1978,24 @@ static int stream_zstd_init(handler_ctx *hctx) {
         ZSTD_initCStream(cctx, level);
       #endif
     }
+  #if ZSTD_VERSION_NUMBER >= 10000+400+0 /* v1.4.0 */
+    if (mod_deflate_adapt.step) {
+        const int level = (params && params->zstd.clevel)
+          ? params->zstd.clevel
+          : ZSTD_CLEVEL_DEFAULT;
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                               mod_deflate_adapt_level(level, 1));
+    }
+  #endif
+  #ifdef MOD_DEFLATE_DICT_ZSTD
+    /* dcz: dictionary referenced as raw content prefix (for single frame) */
+    if (hctx->dict
+        && ZSTD_isError(ZSTD_CCtx_refPrefix(cctx, hctx->dict->data,
+                                                  hctx->dict->len))) {
+        ZSTD_freeCStream(cctx);
+        return -1;
+    }
+  #endif
     return 0;
 }
 
@@ -1481,9 +2217,10 @@ static int mod_deflate_using_libdeflate_sm (handler_ctx * const hctx, const plug
     const int clevel = (NULL != params)
       ? params->gzip.clevel
       : p->conf.compression_level;
+    /* Z_DEFAULT_COMPRESSION -1 not supported */
+    const int level = mod_deflate_adapt_level(clevel > 0 ? clevel : 6, 1);
     struct libdeflate_compressor * const compressor =
-      libdeflate_alloc_compressor(clevel > 0 ? clevel : 6);
-      /* Z_DEFAULT_COMPRESSION -1 not supported */
+      libdeflate_alloc_compressor(level);
     if (NULL == compressor)
         return 0;
 
@@ -1582,9 +2319,10 @@ static int mod_deflate_using_libdeflate (handler_ctx * const hctx, const plugin_
     const int clevel = (NULL != params)
       ? params->gzip.clevel
       : p->conf.compression_level;
+    /* Z_DEFAULT_COMPRESSION -1 not supported */
+    const int level = mod_deflate_adapt_level(clevel > 0 ? clevel : 6, 1);
     struct libdeflate_compressor * const compressor =
-      libdeflate_alloc_compressor(clevel > 0 ? clevel : 6);
-      /* Z_DEFAULT_COMPRESSION -1 not supported */
+      libdeflate_alloc_compressor(level);
     if (NULL != compressor) {
         struct mod_deflate_setjmp_params outparams = { compressor, addr, sz };
         hctx->bytes_out =
@@ -1721,18 +2459,31 @@ static off_t mod_deflate_file_chunk(request_st * const r, handler_ctx * const hc
 }
 
 
-static handler_t deflate_compress_response(request_st * const r, handler_ctx * const hctx) {
-	off_t len, max;
-	int close_stream;
-
+static int deflate_compress_in_queue(request_st * const r, handler_ctx * const hctx) {
 	/* move all chunk from write_queue into our in_queue, then adjust
 	 * counters since r->write_queue is reused for compressed output */
 	chunkqueue * const cq = &r->write_queue;
-	len = chunkqueue_length(cq);
+	const off_t len = chunkqueue_length(cq);
 	chunkqueue_remove_finished_chunks(cq);
 	chunkqueue_append_chunkqueue(&hctx->in_queue, cq);
 	cq->bytes_in  -= len;
 	cq->bytes_out -= len;
+  #ifdef MOD_DEFLATE_DICT
+	if (hctx->dict)
+		return mod_deflate_dict_header(hctx);
+  #endif
+	return 0;
+}
+
+
+static handler_t deflate_compress_response(request_st * const r, handler_ctx * const hctx) {
+	off_t len, max;
+	int close_stream;
+
+	if (0 != deflate_compress_in_queue(r, hctx)) {
+		log_error(r->conf.errh, __FILE__, __LINE__, "compress failed.");
+		return HANDLER_ERROR;
+	}
 
 	max = chunkqueue_length(&hctx->in_queue);
       #if 0
@@ -1786,12 +2537,289 @@ static handler_t deflate_compress_response(request_st * const r, handler_ctx * c
 }
 
 
-static int mod_deflate_choose_encoding (const char *value, plugin_data *p, const char **label) {
+#ifdef MOD_DEFLATE_THREADS
+
+static int mod_deflate_job_compress(handler_ctx * const hctx) {
+	/* (runs in compression thread)
+	 * (must not modify hctx->in_queue, must not log, must not use hctx->r) */
+	char *buf = NULL;
+	int rc = 0;
+	for (const chunk *c = hctx->in_queue.first; c && 0 == rc; c = c->next) {
+		switch (c->type) {
+		case MEM_CHUNK:
+			rc = mod_deflate_compress(hctx,
+			                          (unsigned char *)c->mem->ptr+c->offset,
+			                          (off_t)buffer_clen(c->mem) - c->offset);
+			break;
+		case FILE_CHUNK:
+			if (NULL == buf && NULL == (buf = malloc(2*1024*1024))) {
+				rc = -1;
+				break;
+			}
+			for (off_t n = c->offset; n < c->file.length && 0 == rc; ) {
+				const off_t len = c->file.length - n;
+				const size_t psz = (len < 2*1024*1024) ? (size_t)len : 2*1024*1024;
+				const ssize_t rd = chunk_file_pread(c->file.fd, buf, psz, n);
+				if (rd <= 0) { /*(read error or file truncated)*/
+					rc = -1;
+					break;
+				}
+				rc = mod_deflate_compress(hctx, (unsigned char *)buf, rd);
+				n += rd;
+			}
+			break;
+		default:
+			rc = -1;
+			break;
+		}
+	}
+	free(buf);
+	return 0 == rc ? mod_deflate_stream_flush(hctx, 1) : rc;
+}
+
+
+static void * mod_deflate_pool_thread(void *arg) {
+	UNUSED(arg);
+	struct mod_deflate_pool * const pool = &mod_deflate_pool;
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (NULL == pool->queue && !pool->shutdown)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		if (pool->shutdown) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		handler_ctx * const hctx = pool->queue;
+		if (NULL == (pool->queue = hctx->next))
+			pool->queue_tail = NULL;
+		pthread_mutex_unlock(&pool->lock);
+
+		hctx->job_rc = mod_deflate_job_compress(hctx);
+
+		pthread_mutex_lock(&pool->lock);
+		hctx->next = pool->done;
+		pool->done = hctx;
+		pthread_mutex_unlock(&pool->lock);
+
+		/* notify event loop (errors ignored; EAGAIN if already notified) */
+	  #ifdef HAVE_SYS_EVENTFD_H
+		const uint64_t u = 1;
+		ssize_t wr = write(pool->wfd, &u, sizeof(u));
+	  #else
+		ssize_t wr = write(pool->wfd, "", 1);
+	  #endif
+		UNUSED(wr);
+	}
+	return NULL;
+}
+
+
+static handler_t mod_deflate_pool_handle_fdevent(void *ctx, int revents) {
+	UNUSED(ctx);
+	UNUSED(revents);
+	struct mod_deflate_pool * const pool = &mod_deflate_pool;
+	char buf[64];
+	while (read(pool->rfd, buf, sizeof(buf)) > 0) ;
+
+	pthread_mutex_lock(&pool->lock);
+	handler_ctx *hctx = pool->done;
+	pool->done = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	for (handler_ctx *next; hctx; hctx = next) {
+		next = hctx->next;
+		hctx->next = NULL;
+		hctx->job = MOD_DEFLATE_JOB_DONE;
+		if (hctx->r)
+			joblist_append(hctx->r->con);
+		else { /* request was reset while compressing */
+			mod_deflate_stream_end(hctx);
+			handler_ctx_free(hctx);
+		}
+	}
+	return HANDLER_FINISHED;
+}
+
+
+__attribute_cold__
+static void mod_deflate_pool_stop(void) {
+	struct mod_deflate_pool * const pool = &mod_deflate_pool;
+	if (NULL == pool->fdn) return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (uint32_t i = 0; i < pool->started; ++i)
+		pthread_join(pool->tids[i], NULL);
+	free(pool->tids);
+	pool->tids = NULL;
+	pool->started = 0;
+	pool->shutdown = 0;
+
+	fdevent_fdnode_event_del(pool->ev, pool->fdn);
+	fdevent_unregister(pool->ev, pool->fdn);
+	pool->fdn = NULL;
+	pool->ev = NULL;
+	if (pool->wfd != pool->rfd)
+		close(pool->wfd);
+	close(pool->rfd);
+	pool->rfd = pool->wfd = -1;
+
+	/* jobs not started are marked failed; all jobs are complete */
+	for (handler_ctx *hctx = pool->queue; hctx; hctx = hctx->next)
+		hctx->job_rc = -1;
+	if (pool->queue_tail) {
+		pool->queue_tail->next = pool->done;
+		pool->done = pool->queue;
+	}
+	pool->queue = pool->queue_tail = NULL;
+	for (handler_ctx *hctx = pool->done, *next; hctx; hctx = next) {
+		next = hctx->next;
+		hctx->next = NULL;
+		hctx->job = MOD_DEFLATE_JOB_DONE;
+		if (NULL == hctx->r) {
+			mod_deflate_stream_end(hctx);
+			handler_ctx_free(hctx);
+		}
+	}
+	pool->done = NULL;
+}
+
+
+__attribute_cold__
+__attribute_noinline__
+static int mod_deflate_pool_start(server * const srv) {
+	struct mod_deflate_pool * const pool = &mod_deflate_pool;
+	if (pool->fdn) return 0;
+
+	/* (started lazily upon first use so that threads are created in each
+	 *  lighttpd worker process after fork(); not in parent) */
+  #ifdef HAVE_SYS_EVENTFD_H
+	pool->rfd = pool->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (-1 == pool->rfd) {
+		log_perror(srv->errh, __FILE__, __LINE__, "eventfd()");
+		pool->nthreads = 0;
+		return -1;
+	}
+  #else
+	int fds[2];
+	if (0 != fdevent_pipe_cloexec(fds, 4096)
+	    || 0 != fdevent_fcntl_set_nb(fds[0])
+	    || 0 != fdevent_fcntl_set_nb(fds[1])) {
+		log_perror(srv->errh, __FILE__, __LINE__, "pipe()");
+		pool->nthreads = 0;
+		return -1;
+	}
+	pool->rfd = fds[0];
+	pool->wfd = fds[1];
+  #endif
+	pool->ev = srv->ev;
+	pool->fdn = fdevent_register(pool->ev, pool->rfd,
+	                             mod_deflate_pool_handle_fdevent, NULL);
+	fdevent_fdnode_event_set(pool->ev, pool->fdn, FDEVENT_IN);
+
+	/* block signals in compression threads; signals handled by main thread */
+	sigset_t sigs, osigs;
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_SETMASK, &sigs, &osigs);
+	pool->tids = ck_calloc(pool->nthreads, sizeof(pthread_t));
+	for (; pool->started < pool->nthreads; ++pool->started) {
+		int rc = pthread_create(pool->tids + pool->started, NULL,
+		                        mod_deflate_pool_thread, NULL);
+		if (0 != rc) {
+			errno = rc;
+			log_perror(srv->errh, __FILE__, __LINE__, "pthread_create()");
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &osigs, NULL);
+
+	if (0 == pool->started) {
+		mod_deflate_pool_stop();
+		pool->nthreads = 0;
+		return -1;
+	}
+	return 0;
+}
+
+
+static handler_t mod_deflate_pool_submit(request_st * const r, handler_ctx * const hctx) {
+	if (0 != deflate_compress_in_queue(r, hctx))
+		return HANDLER_ERROR;
+
+	/* open files (compression threads only read from open files) */
+	for (chunk *c = hctx->in_queue.first; c; c = c->next) {
+		if (c->type == FILE_CHUNK && -1 == c->file.fd
+		    && -1 == (c->file.fd = fdevent_open_cloexec(c->mem->ptr, r->conf.follow_symlink, O_RDONLY, 0))) {
+			log_perror(r->conf.errh, __FILE__, __LINE__,
+			  "open failed %s", c->mem->ptr);
+			return HANDLER_ERROR;
+		}
+	}
+
+	/* send response headers now and then response body from
+	 * mod_deflate_handle_subrequest() when compression is complete */
+	r->resp_body_finished = 0;
+	r->handler_module = hctx->plugin_data->self;
+	hctx->job = MOD_DEFLATE_JOB_PENDING;
+
+	struct mod_deflate_pool * const pool = &mod_deflate_pool;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->queue_tail)
+		pool->queue_tail->next = hctx;
+	else
+		pool->queue = hctx;
+	pool->queue_tail = hctx;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+	return HANDLER_GO_ON;
+}
+
+
+SUBREQUEST_FUNC(mod_deflate_handle_subrequest) {
+	plugin_data * const p = p_d;
+	handler_ctx * const hctx = r->plugin_ctx[p->id];
+	if (NULL == hctx) return HANDLER_ERROR; /*(should not happen)*/
+	if (hctx->job != MOD_DEFLATE_JOB_DONE) return HANDLER_WAIT_FOR_EVENT;
+
+	r->plugin_ctx[p->id] = NULL;
+	handler_t rc = HANDLER_FINISHED;
+	if (0 != hctx->job_rc) {
+		log_error(r->conf.errh, __FILE__, __LINE__,
+		  "compress failed %s", r->target.ptr);
+		rc = HANDLER_ERROR;
+	}
+	else if (-1 != hctx->cache_fd) {
+		/*(cache file name is temp file name without ".pid" suffix)*/
+		buffer * const tb = r->tmp_buf;
+		buffer_copy_string_len(tb, hctx->cache_fn,
+		                       (size_t)(strrchr(hctx->cache_fn, '.')
+		                                - hctx->cache_fn));
+		if (0 != mod_deflate_cache_file_finish(r, hctx, tb, 0))
+			rc = HANDLER_ERROR;
+	}
+	else if (0 != http_chunk_append_buffer(r, hctx->tout))
+		rc = HANDLER_ERROR;
+
+	if (HANDLER_FINISHED == rc) {
+		mod_deflate_note_ratio(r, hctx->bytes_out, hctx->bytes_in);
+		http_response_backend_done(r);
+	}
+	if (deflate_compress_cleanup(r, hctx) < 0) return HANDLER_ERROR;
+	return rc;
+}
+
+#endif /* MOD_DEFLATE_THREADS */
+
+
+static int mod_deflate_choose_encoding (const char *value, plugin_data *p, const struct mod_deflate_dict * const dict, const char **label) {
 	/* get client side support encodings */
 	int accept_encoding = 0;
       #if !defined(USE_ZLIB) && !defined(USE_BZ2LIB) && !defined(USE_BROTLI) \
        && !defined(USE_ZSTD)
 	UNUSED(value);
+	UNUSED(dict);
 	UNUSED(label);
       #else
         for (; *value; ++value) {
@@ -1801,6 +2829,18 @@ static int mod_deflate_choose_encoding (const char *value, plugin_data *p, const
             while (*value!=' ' && *value!=',' && *value!=';' && *value!='\0')
                 ++value;
             switch (value - v) {
+             #ifdef MOD_DEFLATE_DICT
+              case 3:
+               #ifdef MOD_DEFLATE_DICT_BROTLI
+                if (0 == memcmp(v, "dcb", 3))
+                    accept_encoding |= HTTP_ACCEPT_ENCODING_DCB;
+               #endif
+               #ifdef MOD_DEFLATE_DICT_ZSTD
+                if (0 == memcmp(v, "dcz", 3))
+                    accept_encoding |= HTTP_ACCEPT_ENCODING_DCZ;
+               #endif
+                break;
+             #endif
               case 2:
                #ifdef USE_BROTLI
                 if (0 == memcmp(v, "br", 2))
@@ -1858,6 +2898,18 @@ static int mod_deflate_choose_encoding (const char *value, plugin_data *p, const
             }
             if (*value == '\0') break;
         }
+       #ifdef MOD_DEFLATE_DICT
+        /* dictionary-compressed encodings only if client has dictionary */
+        if (NULL == dict)
+            accept_encoding &=
+              ~(HTTP_ACCEPT_ENCODING_DCB | HTTP_ACCEPT_ENCODING_DCZ);
+        #ifdef MOD_DEFLATE_DICT_BROTLI
+        else if (NULL == dict->brpd)
+            accept_encoding &= ~HTTP_ACCEPT_ENCODING_DCB;
+        #endif
+       #else
+        UNUSED(dict);
+       #endif
       #endif
 
 	/* select best matching encoding */
@@ -1865,6 +2917,18 @@ static int mod_deflate_choose_encoding (const char *value, plugin_data *p, const
 	if (NULL == x) return 0;
 	while (*x && !(*x & accept_encoding)) ++x;
 	accept_encoding &= *x;
+#ifdef MOD_DEFLATE_DICT_ZSTD
+	if (accept_encoding & HTTP_ACCEPT_ENCODING_DCZ) {
+		*label = "dcz";
+		return HTTP_ACCEPT_ENCODING_DCZ;
+	} else
+#endif
+#ifdef MOD_DEFLATE_DICT_BROTLI
+	if (accept_encoding & HTTP_ACCEPT_ENCODING_DCB) {
+		*label = "dcb";
+		return HTTP_ACCEPT_ENCODING_DCB;
+	} else
+#endif
 #ifdef USE_ZSTD
 	if (accept_encoding & HTTP_ACCEPT_ENCODING_ZSTD) {
 		*label = "zstd";
@@ -1941,6 +3005,16 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 
 	mod_deflate_patch_config(r, p);
 
+  #ifdef MOD_DEFLATE_DICT
+	const mod_deflate_dict *dict = NULL;
+	if (p->conf.dicts) {
+		mod_deflate_dict_advertise(r, p->conf.dicts);
+		dict = mod_deflate_dict_find(r, p->conf.dicts);
+	}
+  #else
+	const struct mod_deflate_dict * const dict = NULL;
+  #endif
+
 	/* check if deflate configured for any mimetypes */
 	if (NULL == p->conf.mimetypes) return HANDLER_GO_ON;
 
@@ -1958,7 +3032,7 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	if (NULL == vbro) return HANDLER_GO_ON;
 
 	/* find matching encodings */
-	compression_type = mod_deflate_choose_encoding(vbro->ptr, p, &label);
+	compression_type = mod_deflate_choose_encoding(vbro->ptr, p, dict, &label);
 	if (!compression_type) return HANDLER_GO_ON;
 
 	/* Check mimetype in response header "Content-Type" */
@@ -1981,6 +3055,15 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 					    CONST_STR_LEN("Vary"),
 					    CONST_STR_LEN("Accept-Encoding"));
 	}
+  #ifdef MOD_DEFLATE_DICT
+	/* Vary: Available-Dictionary (response might be dictionary-compressed) */
+	if (p->conf.dicts) {
+		vb = http_header_response_get(r, HTTP_HEADER_VARY, CONST_STR_LEN("Vary"));
+		if (!http_header_str_contains_token(BUF_PTR_LEN(vb),
+		                                    CONST_STR_LEN("Available-Dictionary")))
+			buffer_append_string_len(vb, CONST_STR_LEN(",Available-Dictionary"));
+	}
+  #endif
 
 	/* check ETag as is done in http_response_handle_cachable()
 	 * (slightly imperfect (close enough?) match of ETag "000000" to "000000-gzip") */
@@ -2055,6 +3138,7 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	 * must be whole file, not partial content
 	 * must not be HTTP status 206 Partial Content
 	 * must not have Cache-Control 'private' or 'no-store'
+	 * must not be dictionary-compressed (dcz or dcb)
 	 * Note: small files (< 32k (see http_chunk.c)) will have been read into
 	 *       memory (if streaming HTTP/1.1 chunked response) and will end up
 	 *       getting stream-compressed rather than cached on disk as compressed
@@ -2063,6 +3147,8 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	buffer *tb = NULL;
 	if (p->conf.cache_dir
 	    && !had_vary
+	    && !(compression_type
+	         & (HTTP_ACCEPT_ENCODING_DCB | HTTP_ACCEPT_ENCODING_DCZ))
 	    && etaglen > 2
 	    && r->resp_body_finished
 	    && r->write_queue.first == r->write_queue.last
@@ -2087,6 +3173,7 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 			if (light_btst(r->resp_htags, HTTP_HEADER_CONTENT_LENGTH))
 				http_header_response_unset(r, HTTP_HEADER_CONTENT_LENGTH,
 				                           CONST_STR_LEN("Content-Length"));
+			mod_deflate_cache_hit(r, tb, sce->st.st_size);
 			mod_deflate_note_ratio(r, sce->st.st_size, len);
 			return HANDLER_GO_ON;
 		}
@@ -2095,6 +3182,9 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		sce = stat_cache_get_entry(r->write_queue.first->mem);
 		if (NULL == sce || sce->st.st_size != len)
 			tb = NULL;
+		else if (mod_deflate_adapt.step)
+			/*(do not cache file compressed at reduced level under load)*/
+			tb = NULL;
 		else if (0 != mkdir_for_file(tb->ptr))
 			tb = NULL;
 	}
@@ -2106,13 +3196,44 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	   && 0 == p->conf.output_buffer_size);
 	hctx = handler_ctx_init();
 	hctx->plugin_data = p;
+  #ifdef MOD_DEFLATE_DICT
+	if (compression_type & (HTTP_ACCEPT_ENCODING_DCB|HTTP_ACCEPT_ENCODING_DCZ)){
+		hctx->dict = dict;
+		compression_type = (compression_type == HTTP_ACCEPT_ENCODING_DCZ)
+		  ? HTTP_ACCEPT_ENCODING_ZSTD
+		  : HTTP_ACCEPT_ENCODING_BR;
+	}
+  #endif
 	hctx->compression_type = compression_type;
 	hctx->r = r;
-	/* setup output buffer */
-	buffer_clear(&p->tmp_buf);
-	hctx->output = &p->tmp_buf;
+	hctx->errh = r->conf.errh;
+	/*(compression threads must not read p->conf, which changes per request)*/
+	hctx->sync_flush = p->conf.sync_flush;
+  #ifdef MOD_DEFLATE_THREADS
+	/* offload compression of larger responses to compression threads
+	 * (not HTTP/1.0 since response length is not known in advance) */
+	const int async = (mod_deflate_pool.nthreads
+	                   && len > MOD_DEFLATE_THREADS_MIN_SIZE
+	                   && r->http_version > HTTP_VERSION_1_0
+	                   && 0 == mod_deflate_pool_start(r->con->srv));
+	if (async) {
+		/* setup unique output buffer for use by compression thread */
+		hctx->output = buffer_init();
+		buffer_string_prepare_copy(hctx->output, p->tmp_buf.size-1);
+	}
+	else
+  #endif
+	{
+		/* setup output buffer */
+		buffer_clear(&p->tmp_buf);
+		hctx->output = &p->tmp_buf;
+	}
 	/* open cache file if caching compressed file */
 	if (tb) mod_deflate_cache_file_open(hctx, tb);
+  #ifdef MOD_DEFLATE_THREADS
+	if (async && -1 == hctx->cache_fd)
+		hctx->tout = buffer_init();
+  #endif
 
   #ifdef HAVE_LIBDEFLATE
 	chunk * const c = r->write_queue.first; /*(invalid after compression)*/
@@ -2121,7 +3242,12 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	/* optimization to compress single file in one-shot to writeable mmap */
 	/*(future: might extend to other compression types)*/
 	/*(chunkqueue_chunk_file_view() current min size for mmap is 128k)*/
+	/*(not if offloaded to compression threads; one-shot would block the
+	 * event loop, and SIGBUS handling with sys_setjmp is not thread-safe)*/
 	if (len > 131072 /* XXX: TBD what should min size be for optimization?*/
+	  #ifdef MOD_DEFLATE_THREADS
+	    && !async
+	  #endif
 	    && (hctx->compression_type == HTTP_ACCEPT_ENCODING_GZIP
 	        || hctx->compression_type == HTTP_ACCEPT_ENCODING_DEFLATE)
 	    && c == r->write_queue.last
@@ -2130,8 +3256,11 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	    && chunk_file_view_dlen(c->file.view, c->offset) >= len) { /*(cfv)*/
 		rc = HANDLER_GO_ON;
 		hctx->bytes_in = len;
-		if (mod_deflate_using_libdeflate(hctx, p)) {
-			if (NULL == tb || 0 == mod_deflate_cache_file_finish(r, hctx, tb))
+		const uint64_t t0 = mod_deflate_adapt.enabled ? request_timing_ns() : 0;
+		const int done = mod_deflate_using_libdeflate(hctx, p);
+		mod_deflate_adapt_busy(t0);
+		if (done) {
+			if (NULL == tb || 0 == mod_deflate_cache_file_finish(r, hctx, tb, 1))
 				mod_deflate_note_ratio(r, hctx->bytes_out, hctx->bytes_in);
 			else
 				rc = HANDLER_ERROR;
@@ -2151,8 +3280,11 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		/*(skip if FILE_CHUNK; not worth mmap/munmap overhead on small file)*/
 		rc = HANDLER_GO_ON;
 		hctx->bytes_in = len;
-		if (mod_deflate_using_libdeflate_sm(hctx, p)) {
-			if (NULL == tb || 0 == mod_deflate_cache_file_finish(r, hctx, tb))
+		const uint64_t t0 = mod_deflate_adapt.enabled ? request_timing_ns() : 0;
+		const int done = mod_deflate_using_libdeflate_sm(hctx, p);
+		mod_deflate_adapt_busy(t0);
+		if (done) {
+			if (NULL == tb || 0 == mod_deflate_cache_file_finish(r, hctx, tb, 1))
 				mod_deflate_note_ratio(r, hctx->bytes_out, hctx->bytes_in);
 			else
 				rc = HANDLER_ERROR;
@@ -2189,7 +3321,19 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 	}
 	r->plugin_ctx[p->id] = hctx;
 
+  #ifdef MOD_DEFLATE_THREADS
+	if (async) {
+		rc = mod_deflate_pool_submit(r, hctx);
+		if (HANDLER_GO_ON == rc) return HANDLER_GO_ON;
+		r->plugin_ctx[p->id] = NULL;
+		deflate_compress_cleanup(r, hctx);
+		return rc;
+	}
+  #endif
+
+	const uint64_t t0 = mod_deflate_adapt.enabled ? request_timing_ns() : 0;
 	rc = deflate_compress_response(r, hctx);
+	mod_deflate_adapt_busy(t0);
 	if (HANDLER_GO_ON == rc) return HANDLER_GO_ON;
 	if (HANDLER_FINISHED == rc) {
 	  #ifdef __COVERITY__
@@ -2197,7 +3341,7 @@ REQUEST_FUNC(mod_deflate_handle_response_start) {
 		force_assert(-1 == hctx->cache_fd || NULL != tb);
 	  #endif
 		if (-1 == hctx->cache_fd
-		    || 0 == mod_deflate_cache_file_finish(r, hctx, tb)) {
+		    || 0 == mod_deflate_cache_file_finish(r, hctx, tb, 1)) {
 			mod_deflate_note_ratio(r, hctx->bytes_out, hctx->bytes_in);
 			rc = HANDLER_GO_ON;
 		}
@@ -2215,6 +3359,13 @@ static handler_t mod_deflate_cleanup(request_st * const r, void *p_d) {
 
 	if (NULL != hctx) {
 		r->plugin_ctx[p->id] = NULL;
+	  #ifdef MOD_DEFLATE_THREADS
+		if (hctx->job == MOD_DEFLATE_JOB_PENDING) {
+			/* detach; hctx freed when compression thread completes job */
+			hctx->r = NULL;
+			return HANDLER_GO_ON;
+		}
+	  #endif
 		deflate_compress_cleanup(r, hctx);
 	}
 
@@ -2234,6 +3385,10 @@ int mod_deflate_plugin_init(plugin *p) {
 	p->set_defaults	= mod_deflate_set_defaults;
 	p->handle_request_reset = mod_deflate_cleanup;
 	p->handle_response_start	= mod_deflate_handle_response_start;
+	p->handle_trigger	= mod_deflate_trigger;
+  #ifdef MOD_DEFLATE_THREADS
+	p->handle_subrequest	= mod_deflate_handle_subrequest;
+  #endif
 
 	return 0;
 }
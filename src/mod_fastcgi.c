@@ -1,15 +1,21 @@
 #include "first.h"
 
 #include <sys/types.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "sys-socket.h"
+#include "sys-unistd.h" /* <unistd.h> */
+
 #include "gw_backend.h"
 typedef gw_plugin_config plugin_config;
 typedef gw_plugin_data   plugin_data;
 typedef gw_handler_ctx   handler_ctx;
 
+#include "base.h"
 #include "buffer.h"
+#include "chunk.h"
 #include "fdevent.h"
 #include "http_cgi.h"
 #include "http_chunk.h"
@@ -28,6 +34,39 @@ typedef gw_handler_ctx   handler_ctx;
 #error "mismatched defines: (GW_FILTER != FCGI_FILTER)"
 #endif
 
+/* request multiplexed on shared connection to backend proc
+ * (fastcgi.server host option "multiplex") */
+typedef struct fcgi_mpx_hctx {
+	gw_handler_ctx gw;    /* (on connection gw.mpx) */
+	uint16_t err;      /* HTTP status if request failed */
+	uint8_t on;        /* request is multiplexed */
+	uint8_t retry;     /* resend request */
+	uint8_t recv;      /* records received from backend for request */
+} fcgi_mpx_hctx;
+
+/* connection to backend proc (FCGI_MPXS_CONNS) shared by concurrent requests,
+ * each with a distinct request id */
+typedef struct fcgi_mpx {
+	gw_mpx gw;            /* (gw.reqs incl. requests awaiting id) */
+	fcgi_mpx_hctx **ids;  /* requests by request id */
+	uint32_t nids;        /* request ids in use (incl. aborted requests) */
+	uint32_t max_ids;
+	uint8_t completed;    /* backend completed request(s) on connection */
+} fcgi_mpx;
+
+static gw_mpx *fcgi_mpx_list;
+
+/* ids[] placeholder for aborted request until backend sends FCGI_END_REQUEST */
+static fcgi_mpx_hctx fcgi_mpx_aborted;
+
+static void fcgi_mpx_free_all(void);
+
+
+FREE_FUNC(mod_fastcgi_free) {
+    fcgi_mpx_free_all();
+    gw_free(p_d);
+}
+
 static void mod_fastcgi_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* fastcgi.server */
@@ -245,8 +284,11 @@ static handler_t fcgi_create_env(handler_ctx *hctx) {
 
 	/* send FCGI_BEGIN_REQUEST */
 
-	if (hctx->request_id == 0) {
-		hctx->request_id = 1; /* always use id 1 as we don't use multiplexing */
+	const int mpx = ((fcgi_mpx_hctx *)hctx)->on;
+	if (mpx) {
+		/* (request id assigned in fcgi_mpx_req_open()) */
+	} else if (hctx->request_id == 0) {
+		hctx->request_id = 1; /* always use id 1 if not multiplexing */
 	} else {
 		log_error(r->conf.errh, __FILE__, __LINE__,
 		  "fcgi-request is already in use: %d", hctx->request_id);
@@ -256,7 +298,9 @@ static handler_t fcgi_create_env(handler_ctx *hctx) {
 	fcgi_header(&(beginRecord.header), FCGI_BEGIN_REQUEST, request_id, sizeof(beginRecord.body), 0);
 	beginRecord.body.roleB0 = hctx->gw_mode;
 	beginRecord.body.roleB1 = 0;
-	beginRecord.body.flags = 0;
+	/* keep connection open after request if keep-alive to backend enabled */
+	hctx->opts.keepalive = (0 != host->keepalive_max_idle || mpx);
+	beginRecord.body.flags = hctx->opts.keepalive ? FCGI_KEEP_CONN : 0;
 	memset(beginRecord.body.reserved, 0, sizeof(beginRecord.body.reserved));
 	fcgi_header(&header, FCGI_PARAMS, request_id, 0, 0); /*(set aside space to fill in later)*/
 	buffer_append_str2(b, (const char *)&beginRecord, sizeof(beginRecord),
@@ -493,6 +537,378 @@ static handler_t fcgi_response_headers(request_st * const r, struct http_respons
     return HANDLER_GO_ON;
 }
 
+/*
+ * FastCGI request multiplexing
+ *
+ * With fastcgi.server host option "multiplex" => <n>, requests are sent on
+ * connections to backend proc shared by up to <n> concurrent requests, each
+ * with a distinct request id (FCGI_MPXS_CONNS).  Backend is trusted to
+ * multiplex as configured; a request rejected with FCGI_CANT_MPX_CONN is
+ * retried and that proc is then sent one request at a time per connection.
+ * Requests which fail to connect, or are rejected, are retried after
+ * selecting host and proc again.
+ * (FCGI_GET_VALUES is not sent; e.g. PHP-FPM closes connection after reply)
+ * (requests to FastCGI authorizers, requests with Upgrade, and requests with
+ *  a request body are not multiplexed; request body is consumed as it is
+ *  sent, so request could not be resent if rejected by backend)
+ */
+
+#define FCGI_MPX_RB_MAX 262144 /* max records buffered for request */
+
+static void fcgi_mpx_record (fcgi_mpx * const mpx, const int type, const int request_id, const char * const data, const uint32_t len)
+{
+    FCGI_Header header;
+    fcgi_header(&header, type, request_id, (int)len, 0);
+    chunkqueue_append_mem(&mpx->gw.wq, (const char *)&header, sizeof(header));
+    if (len)
+        chunkqueue_append_mem(&mpx->gw.wq, data, len);
+}
+
+
+static void fcgi_mpx_read_resume (gw_mpx * const mpx)
+{
+    /* resume reading if no request is over limit of buffered records */
+    for (const gw_handler_ctx *gw = mpx->reqs; gw; gw = gw->mpx_next) {
+        if (chunkqueue_length(gw->rb) > FCGI_MPX_RB_MAX) return;
+    }
+    gw_mpx_read_resume(mpx);
+}
+
+
+static void fcgi_mpx_req_unlink (fcgi_mpx_hctx * const hctx, const int abort)
+{
+    fcgi_mpx * const mpx = (fcgi_mpx *)hctx->gw.mpx;
+    const int id = hctx->gw.request_id;
+    if (id > 0 && mpx->ids[id] == hctx) {
+        if (abort) {
+            /* request id remains in use until backend sends FCGI_END_REQUEST*/
+            fcgi_mpx_record(mpx, FCGI_ABORT_REQUEST, id, NULL, 0);
+            mpx->ids[id] = &fcgi_mpx_aborted;
+        }
+        else {
+            mpx->ids[id] = NULL;
+            --mpx->nids;
+        }
+    }
+    gw_mpx_unlink(&hctx->gw);
+    if (mpx->gw.rblocked)
+        fcgi_mpx_read_resume(&mpx->gw);
+}
+
+
+static void fcgi_mpx_req_fail (fcgi_mpx_hctx * const hctx, const int status, const int retry)
+{
+    /* resend request if nothing received from backend
+     * (multiplexed requests do not have a request body) */
+    fcgi_mpx_req_unlink(hctx, 0);
+    /* (retry == 2 if backend closed connection after completing requests;
+     *  not counted since backend made progress, e.g. backend not multiplexing
+     *  requests and closing connection after each request) */
+    if (retry != 2 && status > 500)
+        gw_proc_latency_error(&hctx->gw);
+    if (retry && !hctx->recv
+        && (retry == 2 || hctx->gw.reconnects++ < 5))
+        hctx->retry = 1;
+    else
+        hctx->err = (uint16_t)status;
+    joblist_append(hctx->gw.con);
+}
+
+
+static void fcgi_mpx_close_fail (gw_handler_ctx * const gw, const int status, const int retry)
+{
+    /* (gw_mpx_ops fail callback when connection is closed) */
+    const fcgi_mpx * const mpx = (fcgi_mpx *)gw->mpx;
+    fcgi_mpx_req_fail((fcgi_mpx_hctx *)gw, status,
+                      retry && mpx->completed ? 2 : retry);
+}
+
+
+__attribute_cold__
+static void fcgi_mpx_cant_mpx (fcgi_mpx * const mpx)
+{
+    /* (recorded on proc; applies to all connections to proc) */
+    if (mpx->gw.proc->cant_mpx) return;
+    mpx->gw.proc->cant_mpx = 1;
+    log_error(mpx->gw.srv->errh, __FILE__, __LINE__,
+      "FastCGI backend does not multiplex requests (FCGI_CANT_MPX_CONN); "
+      "sending one request at a time per connection: %s",
+      mpx->gw.proc->connection_name->ptr);
+}
+
+
+static void fcgi_mpx_recv_record (fcgi_mpx * const mpx, const unsigned char * const h, const uint32_t rlen)
+{
+    const int type = h[1];
+    const uint32_t id = ((uint32_t)h[2] << 8) | h[3];
+    const uint32_t clen = ((uint32_t)h[4] << 8) | h[5];
+
+    if (0 == id) return; /* ignore management record */
+
+    fcgi_mpx_hctx * const hctx = id <= mpx->max_ids ? mpx->ids[id] : NULL;
+    if (NULL == hctx) return; /* ignore record for unknown request id */
+    if (hctx == &fcgi_mpx_aborted) {
+        if (type == FCGI_END_REQUEST) {
+            mpx->ids[id] = NULL;
+            --mpx->nids;
+        }
+        return;
+    }
+
+    if (type == FCGI_END_REQUEST && !hctx->recv
+        && clen >= sizeof(FCGI_EndRequestBody)) {
+        const FCGI_EndRequestBody * const body =
+          (const FCGI_EndRequestBody *)(h + sizeof(FCGI_Header));
+        if (body->protocolStatus == FCGI_CANT_MPX_CONN) {
+            /* backend rejected request; resend with one request at a time */
+            fcgi_mpx_cant_mpx(mpx);
+            hctx->gw.latency_ns = 0; /*(not a backend latency error)*/
+            fcgi_mpx_req_fail(hctx, 503, 1);
+            return;
+        }
+        if (body->protocolStatus == FCGI_OVERLOADED) {
+            fcgi_mpx_req_fail(hctx, 503, 0); /* Service Unavailable */
+            return;
+        }
+    }
+
+    /* (parsed with fcgi_recv_parse_loop() when request is next handled) */
+    chunkqueue * const rb = hctx->gw.rb;
+    chunkqueue_append_mem(rb, (const char *)h, rlen);
+    hctx->recv = 1;
+    hctx->gw.read_ts = log_monotonic_secs;
+    if (type == FCGI_END_REQUEST) {
+        fcgi_mpx_req_unlink(hctx, 0); /* request id no longer in use */
+        mpx->completed = 1;
+    }
+    else if (chunkqueue_length(rb) > FCGI_MPX_RB_MAX)
+        mpx->gw.rblocked = 1;/*request not consuming response; pause reading*/
+    joblist_append(hctx->gw.con);
+}
+
+
+static int fcgi_mpx_recv_records (gw_mpx * const gwmpx)
+{
+    /* (gw_mpx_ops recv callback) */
+    fcgi_mpx * const mpx = (fcgi_mpx *)gwmpx;
+    buffer * const b = gwmpx->rbuf;
+    const uint32_t blen = buffer_clen(b);
+    uint32_t off = 0;
+    while (blen - off >= sizeof(FCGI_Header)) {
+        const unsigned char * const h = (unsigned char *)b->ptr + off;
+        if (h[0] != FCGI_VERSION_1) {
+            log_error(gwmpx->srv->errh, __FILE__, __LINE__,
+              "FastCGI: invalid record version %d from backend: %s",
+              h[0], gwmpx->proc->connection_name->ptr);
+            return -1;
+        }
+        const uint32_t rlen = sizeof(FCGI_Header)
+                            + (((uint32_t)h[4] << 8) | h[5]) + h[6];
+        if (blen - off < rlen) break;
+        fcgi_mpx_recv_record(mpx, h, rlen);
+        off += rlen;
+    }
+    if (off) {
+        memmove(b->ptr, b->ptr+off, blen - off);
+        buffer_truncate(b, blen - off);
+    }
+    return 0;
+}
+
+
+static void fcgi_mpx_init (gw_mpx * const gwmpx)
+{
+    fcgi_mpx * const mpx = (fcgi_mpx *)gwmpx;
+    mpx->max_ids = gwmpx->host->multiplex;
+    mpx->ids = ck_calloc(mpx->max_ids + 1, sizeof(*mpx->ids));
+}
+
+
+static void fcgi_mpx_free (gw_mpx * const gwmpx)
+{
+    free(((fcgi_mpx *)gwmpx)->ids);
+}
+
+
+static int fcgi_mpx_avail (const gw_mpx * const gwmpx)
+{
+    const uint32_t max_reqs =
+      gwmpx->proc->cant_mpx ? 1 : gwmpx->host->multiplex;
+    return ((const fcgi_mpx *)gwmpx)->nids < max_reqs;
+}
+
+
+static int fcgi_mpx_read_timeout (gw_mpx * const gwmpx, gw_handler_ctx * const gw)
+{
+    if (0 == gw->request_id) return 0;
+    log_error(gw->r->conf.errh, __FILE__, __LINE__,
+      "read timeout on FastCGI request %d: %s (fd: %d)",
+      gw->request_id, gwmpx->proc->connection_name->ptr, gwmpx->fd);
+    fcgi_mpx_hctx * const hctx = (fcgi_mpx_hctx *)gw;
+    fcgi_mpx_req_unlink(hctx, 1);
+    gw_proc_latency_error(gw);
+    hctx->err = 504; /* Gateway Timeout */
+    joblist_append(gw->con);
+    return 1;
+}
+
+
+static const gw_mpx_ops fcgi_mpx_ops = {
+  &fcgi_mpx_list
+ ,"FastCGI"
+ ,sizeof(fcgi_mpx)
+ ,fcgi_mpx_init
+ ,fcgi_mpx_free
+ ,fcgi_mpx_avail
+ ,NULL
+ ,fcgi_mpx_recv_records
+ ,fcgi_mpx_close_fail
+ ,fcgi_mpx_read_timeout
+ ,NULL
+};
+
+
+static void fcgi_mpx_free_all (void)
+{
+    gw_mpx_free_all(&fcgi_mpx_ops);
+}
+
+
+static handler_t fcgi_mpx_req_open (fcgi_mpx_hctx * const hctx, request_st * const r)
+{
+    gw_handler_ctx * const gw = &hctx->gw;
+    if (NULL == gw->proc && !gw_proc_acquire(gw)) {
+        /* all children are dead */
+        hctx->err = 503; /* Service Unavailable */
+        return HANDLER_GO_ON;
+    }
+
+    if (!gw_mpx_attach(gw, r, &fcgi_mpx_ops)) {
+        /* (e.g. connect() failed; proc disabled in gw_proc_connect_error()) */
+        if (gw->reconnects++ < 5)
+            hctx->retry = 1;
+        else
+            hctx->err = 503; /* Service Unavailable */
+        return HANDLER_GO_ON;
+    }
+    fcgi_mpx * const mpx = (fcgi_mpx *)gw->mpx;
+
+    uint32_t id = 1;
+    while (id <= mpx->max_ids && NULL != mpx->ids[id]) ++id;
+    if (id > mpx->max_ids) { /*(should not happen)*/
+        fcgi_mpx_req_unlink(hctx, 0);
+        hctx->err = 503; /* Service Unavailable */
+        return HANDLER_GO_ON;
+    }
+    mpx->ids[id] = hctx;
+    ++mpx->nids;
+    gw->request_id = (int)id;
+    gw->read_ts = gw->proc->last_used = log_monotonic_secs;
+
+    const handler_t rc = gw->create_env(gw);
+    if (HANDLER_GO_ON != rc) {
+        /*(r->http_status = 400 if fcgi_create_env() failed)*/
+        fcgi_mpx_req_unlink(hctx, 0);
+        gw_mpx_flush(&mpx->gw);
+        return rc;
+    }
+    /* move request records (incl. end of FCGI_STDIN) to connection */
+    chunkqueue_steal(&mpx->gw.wq, &gw->wb, chunkqueue_length(&gw->wb));
+    gw_mpx_flush(&mpx->gw);
+    return HANDLER_GO_ON;
+}
+
+
+static void fcgi_mpx_req_detach (void * const gwhctx)
+{
+    /* (hctx->gw.handler_ctx_free callback) */
+    fcgi_mpx_hctx * const hctx = gwhctx;
+    gw_mpx * const mpx = hctx->gw.mpx;
+    if (NULL == mpx) return;
+    fcgi_mpx_req_unlink(hctx, 1);
+    gw_mpx_flush(mpx);
+}
+
+
+static handler_t fcgi_mpx_req_error (fcgi_mpx_hctx * const hctx, request_st * const r)
+{
+    if (!r->resp_body_started)
+        r->http_status = hctx->err;
+    http_response_backend_error(r);
+    gw_handle_request_reset(r, hctx->gw.plugin_data);
+    return HANDLER_FINISHED;
+}
+
+
+static handler_t fcgi_mpx_handle_subrequest (fcgi_mpx_hctx * const hctx, request_st * const r)
+{
+    gw_handler_ctx * const gw = &hctx->gw;
+    if (hctx->err) return fcgi_mpx_req_error(hctx, r);
+
+    if (hctx->retry) {
+        /* resend request; select host and proc again since retry follows
+         * connection error or request rejected by backend */
+        hctx->retry = 0;
+        hctx->recv = 0;
+        gw->request_id = 0;
+        gw->wb_reqlen = 0;
+        chunkqueue_reset(&gw->wb);
+        chunkqueue_reset(gw->rb);
+        if (gw->response) buffer_clear(gw->response);
+        if (!gw_host_reacquire(gw, r))
+            return HANDLER_FINISHED; /*(r->http_status = 503)*/
+    }
+
+    if (0 == gw->request_id) {
+        const handler_t rc = fcgi_mpx_req_open(hctx, r);
+        if (rc != HANDLER_GO_ON) return rc;
+    }
+
+    if (hctx->err) return fcgi_mpx_req_error(hctx, r);
+    if (hctx->retry) {
+        joblist_append(gw->con);
+        return HANDLER_WAIT_FOR_EVENT;
+    }
+
+    /* response */
+    chunkqueue * const rb = gw->rb;
+    if (chunkqueue_is_empty(rb)) return HANDLER_WAIT_FOR_EVENT;
+    if ((r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)
+        && r->resp_body_started
+        && chunkqueue_length(&r->write_queue) > 65536 - 4096)
+        return HANDLER_WAIT_FOR_EVENT;
+    const handler_t rc = fcgi_recv_parse_loop(r, gw);
+    if (gw->latency_ns && r->resp_body_started)
+        gw_proc_latency_sample(gw);
+    if (HANDLER_FINISHED == rc) {
+        gw_handle_request_reset(r, gw->plugin_data);
+        return HANDLER_FINISHED;
+    }
+    if (NULL != gw->mpx && gw->mpx->rblocked)
+        fcgi_mpx_read_resume(gw->mpx);
+
+    return HANDLER_WAIT_FOR_EVENT;
+}
+
+
+static handler_t fcgi_handle_subrequest (request_st * const r, void * const p_d)
+{
+    plugin_data * const p = p_d;
+    fcgi_mpx_hctx * const hctx = r->plugin_ctx[p->id];
+    return (NULL != hctx && hctx->on)
+      ? fcgi_mpx_handle_subrequest(hctx, r)
+      : gw_handle_subrequest(r, p_d);
+}
+
+
+static handler_t fcgi_handle_trigger (server * const srv, void * const p_d)
+{
+    const handler_t rc = gw_handle_trigger(srv, p_d);
+    if (NULL != fcgi_mpx_list) gw_mpx_handle_trigger(srv, &fcgi_mpx_ops);
+    return rc;
+}
+
+
 static handler_t fcgi_check_extension(request_st * const r, void *p_d, int uri_path_handler) {
 	plugin_data *p = p_d;
 	handler_t rc;
@@ -502,7 +918,7 @@ static handler_t fcgi_check_extension(request_st * const r, void *p_d, int uri_p
 	mod_fastcgi_patch_config(r, p);
 	if (NULL == p->conf.exts) return HANDLER_GO_ON;
 
-	rc = gw_check_extension(r, p, uri_path_handler, 0);
+	rc = gw_check_extension(r, p, uri_path_handler, sizeof(fcgi_mpx_hctx));
 	if (HANDLER_GO_ON != rc) return rc;
 
 	if (r->handler_module == p->self) {
@@ -520,6 +936,12 @@ static handler_t fcgi_check_extension(request_st * const r, void *p_d, int uri_p
 		else {
 			chunkqueue_reset(hctx->rb);
 		}
+		if (hctx->host->multiplex && 0 == r->reqbody_length
+		    && hctx->gw_mode == GW_RESPONDER && !hctx->opts.upgrade) {
+			/* send request on connection shared with other requests */
+			((fcgi_mpx_hctx *)hctx)->on = 1;
+			hctx->handler_ctx_free = fcgi_mpx_req_detach;
+		}
 	}
 
 	return HANDLER_GO_ON;
@@ -544,13 +966,13 @@ int mod_fastcgi_plugin_init(plugin *p) {
 	p->name         = "fastcgi";
 
 	p->init         = gw_init;
-	p->cleanup      = gw_free;
+	p->cleanup      = mod_fastcgi_free;
 	p->set_defaults = mod_fastcgi_set_defaults;
 	p->handle_request_reset    = gw_handle_request_reset;
 	p->handle_uri_clean        = fcgi_check_extension_1;
 	p->handle_subrequest_start = fcgi_check_extension_2;
-	p->handle_subrequest       = gw_handle_subrequest;
-	p->handle_trigger          = gw_handle_trigger;
+	p->handle_subrequest       = fcgi_handle_subrequest;
+	p->handle_trigger          = fcgi_handle_trigger;
 	p->handle_waitpid          = gw_handle_waitpid_cb;
 
 	return 0;
@@ -1774,6 +1774,20 @@ magnet_req_item_get (lua_State *L)
     const char * const k = luaL_checklstring(L, 2, &klen);
     request_st * const r = **(request_st ***)lua_touserdata(L, 1);
     switch (klen) {
+      case 6:
+        if (0 == memcmp(k, "timing", 6)) {
+            /* nsec elapsed from request start to each phase reached
+             * (empty unless request timing enabled) */
+            lua_createtable(L, 0, REQ_TIMING_MAX-1);
+            for (int i = REQ_TIMING_HEADERS; i < REQ_TIMING_MAX; ++i) {
+                const uint64_t ns = request_timing_elapsed(r, i);
+                if (!ns) continue;
+                lua_pushinteger(L, (lua_Integer)ns);
+                lua_setfield(L, -2, request_timing_names[i]);
+            }
+            return 1;
+        }
+        break;
       case 8:
         if (0 == memcmp(k, "bytes_in", 8)) {
             lua_pushinteger(L, (lua_Integer)http_request_stats_bytes_in(r));
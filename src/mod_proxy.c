@@ -1,13 +1,19 @@
 #include "first.h"
 
+#include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "sys-socket.h"
+#include "sys-unistd.h" /* <unistd.h> */
+
 #include "gw_backend.h"
 #include "base.h"
 #include "array.h"
 #include "buffer.h"
+#include "chunk.h"
 #include "fdevent.h"
+#include "h2.h"
 #include "http_kv.h"
 #include "http_header.h"
 #include "log.h"
@@ -27,6 +33,7 @@ typedef struct http_header_remap_opts {
     const array *hosts_request;
     const array *hosts_response;
     int force_http10;
+    int force_http2;
     int https_remap;
     int upgrade;
     int connect_method;
@@ -61,11 +68,45 @@ typedef struct {
 
 static int proxy_check_extforward;
 
-typedef struct {
+typedef struct handler_ctx {
 	gw_handler_ctx gw;
 	plugin_config conf;
+	/* HTTP/2 stream to backend (proxy.header "force-http2")
+	 * (on connection gw.mpx) */
+	uint32_t h2id;         /* 0 if waiting for backend SETTINGS */
+	int32_t h2swin;       /* stream send window */
+	int32_t h2rwin;       /* stream recv window */
+	uint16_t h2err;       /* HTTP status if stream failed */
+	uint8_t h2;
+	uint8_t h2retry;      /* resend request on new stream */
+	uint8_t h2hdrs;       /* response headers: 1 received, 2 processed */
+	uint8_t h2eos_sent;
+	uint8_t h2eos_recv;
 } handler_ctx;
 
+/* cleartext HTTP/2 (h2c, prior knowledge) connection to backend proc;
+ * requests are multiplexed as streams on shared connections */
+typedef struct proxy_h2c {
+	gw_mpx gw;            /* (gw.closing set if GOAWAY) */
+	uint32_t next_id;
+	uint32_t goaway_id;
+	int32_t swin;         /* connection send window */
+	int32_t rwin;         /* connection recv window */
+	uint32_t s_max_concurrent_streams;
+	int32_t s_initial_window_size;
+	uint32_t s_max_frame_size;
+	uint32_t cont_id;     /* stream id of HEADERS awaiting CONTINUATION */
+	uint8_t cont_flags;
+	uint8_t settings;     /* backend SETTINGS received */
+	buffer *hbuf;         /* header block fragments */
+	struct lshpack_enc encoder;
+	struct lshpack_dec decoder;
+} proxy_h2c;
+
+static gw_mpx *proxy_h2c_list;
+
+static void proxy_h2c_free_all(void);
+
 
 INIT_FUNC(mod_proxy_init) {
     return ck_calloc(1, sizeof(plugin_data));
@@ -94,6 +135,7 @@ static void mod_proxy_free_config(plugin_data * const p)
 FREE_FUNC(mod_proxy_free) {
     plugin_data * const p = p_d;
     mod_proxy_free_config(p);
+    proxy_h2c_free_all();
     gw_free(p);
 }
 
@@ -218,6 +260,17 @@ static http_header_remap_opts * mod_proxy_parse_header_opts(server *srv, const a
             header.force_http10 = val;
             continue;
         }
+        else if (buffer_eq_slen(&da->key, CONST_STR_LEN("force-http2"))) {
+            int val = config_plugin_value_to_bool((data_unset *)da, 2);
+            if (2 == val) {
+                log_error(srv->errh, __FILE__, __LINE__,
+                  "unexpected value for proxy.header; "
+                  "expected \"force-http2\" => \"enable\" or \"disable\"");
+                return NULL;
+            }
+            header.force_http2 = val;
+            continue;
+        }
         else if (buffer_eq_slen(&da->key, CONST_STR_LEN("upgrade"))) {
             int val = config_plugin_value_to_bool((data_unset *)da, 2);
             if (2 == val) {
@@ -860,6 +913,11 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 	                            ? " HTTP/1.1" : " HTTP/1.0",
 	                            sizeof(" HTTP/1.1")-1);
 
+	/* keep-alive connection to backend if enabled (requires HTTP/1.1) */
+	int keepalive = (0 != hctx->gw.host->keepalive_max_idle
+	                 && !hctx->conf.header.force_http10
+	                 && !r->h2_connect_ext);
+
 	if (hctx->conf.replace_http_host && !buffer_is_blank(hctx->gw.host->id)) {
 		if (hctx->gw.conf.debug > 1) {
 			log_error(r->conf.errh, __FILE__, __LINE__,
@@ -877,6 +935,7 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 	} else {
 		/* no Host header available; must send HTTP/1.0 request */
 		b->ptr[b->used-2] = '0'; /*(overwrite end of request line)*/
+		keepalive = 0;
 	}
 
 	if (hctx->gw.gw_mode == GW_AUTHORIZER) {
@@ -996,10 +1055,16 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 		http_header_remap_uri(b, buffer_clen(b) - vlen, &hctx->conf.header, 1);
 	}
 
+	if (upgrade) keepalive = 0; /*(connection might become tunnel)*/
+	hctx->gw.opts.keepalive = (uint8_t)keepalive;
+
 	if (connhdr && !hctx->conf.header.force_http10 && r->http_version >= HTTP_VERSION_1_1
 	    && !buffer_eq_icase_slen(connhdr, CONST_STR_LEN("close"))) {
-		/* mod_proxy always sends Connection: close to backend */
-		buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: close"));
+		/* mod_proxy sends Connection: close to backend unless keep-alive */
+		if (keepalive)
+			buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: keep-alive"));
+		else
+			buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: close"));
 		/* (future: might be pedantic and also check Connection header for each
 		 * token using http_header_str_contains_token() */
 		if (te)
@@ -1026,7 +1091,9 @@ static handler_t proxy_create_env(gw_handler_ctx *gwhctx) {
 		                              "\r\nUpgrade: websocket"
 		                              "\r\nConnection: close, upgrade\r\n\r\n"));
 	}
-	else    /* mod_proxy always sends Connection: close to backend */
+	else if (keepalive)
+		buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: keep-alive\r\n\r\n"));
+	else    /* mod_proxy sends Connection: close to backend unless keep-alive */
 		buffer_append_string_len(b, CONST_STR_LEN("\r\nConnection: close\r\n\r\n"));
 
 	hctx->gw.wb_reqlen = buffer_clen(b);
@@ -1095,6 +1162,944 @@ static handler_t proxy_response_headers(request_st * const r, struct http_respon
     return HANDLER_GO_ON;
 }
 
+/*
+ * HTTP/2 (h2c) upstream
+ *
+ * With proxy.header "force-http2", requests are sent to backend as streams
+ * multiplexed on cleartext HTTP/2 connections (prior knowledge, RFC 9113
+ * Section 3.3), shared by concurrent requests to the same backend proc.
+ * (requests with Upgrade and CONNECT requests are sent using HTTP/1.1)
+ */
+
+#define PROXY_H2_STREAM_WINDOW 262144   /* SETTINGS_INITIAL_WINDOW_SIZE */
+#define PROXY_H2_CONN_WINDOW   16777216
+
+static void proxy_h2c_frame (proxy_h2c * const h2c, const int type, const int flags, const uint32_t id, const char * const data, const uint32_t len)
+{
+    const char hdr[9] = {
+      (char)(len >> 16), (char)(len >> 8), (char)len
+     ,(char)type
+     ,(char)flags
+     ,(char)((id >> 24) & 0x7f), (char)(id >> 16), (char)(id >> 8), (char)id
+    };
+    chunkqueue_append_mem(&h2c->gw.wq, hdr, sizeof(hdr));
+    if (data && len) /*(data is NULL if caller appends DATA frame payload)*/
+        chunkqueue_append_mem(&h2c->gw.wq, data, len);
+}
+
+
+static void proxy_h2c_send_u32 (proxy_h2c * const h2c, const int type, const uint32_t id, const uint32_t v)
+{
+    /* RST_STREAM or WINDOW_UPDATE */
+    const char payload[4] = {
+      (char)(v >> 24), (char)(v >> 16), (char)(v >> 8), (char)v
+    };
+    proxy_h2c_frame(h2c, type, 0, id, payload, sizeof(payload));
+}
+
+
+__attribute_cold__
+static int proxy_h2c_goaway (proxy_h2c * const h2c, const uint32_t e)
+{
+    /* connection error; caller closes connection */
+    const char payload[8] = {
+      0, 0, 0, 0, /* last stream id (no streams initiated by backend) */
+      (char)(e >> 24), (char)(e >> 16), (char)(e >> 8), (char)e
+    };
+    proxy_h2c_frame(h2c, H2_FTYPE_GOAWAY, 0, 0, payload, sizeof(payload));
+    log_error(h2c->gw.srv->errh, __FILE__, __LINE__,
+      "HTTP/2 connection error %u from backend: %s",
+      e, h2c->gw.proc->connection_name->ptr);
+    h2c->gw.closing = 1;
+    if (h2c->gw.connected)
+        h2c->gw.srv->network_backend_write(h2c->gw.fd, &h2c->gw.wq, MAX_WRITE_LIMIT,
+                                        h2c->gw.srv->errh);
+    return -1;
+}
+
+
+static handler_ctx * proxy_h2c_stream_find (const proxy_h2c * const h2c, const uint32_t id)
+{
+    gw_handler_ctx *gw = h2c->gw.reqs;
+    while (gw && ((handler_ctx *)gw)->h2id != id) gw = gw->mpx_next;
+    return (handler_ctx *)gw;
+}
+
+
+static void proxy_h2c_stream_wake (gw_mpx * const mpx)
+{
+    /* wake streams waiting to send request body */
+    for (gw_handler_ctx *gw = mpx->reqs; gw; gw = gw->mpx_next) {
+        if (!((handler_ctx *)gw)->h2eos_sent) joblist_append(gw->con);
+    }
+}
+
+
+static void proxy_h2_stream_fail (handler_ctx * const hctx, const int status, const int retry)
+{
+    /* resend request on new stream if request was not yet sent, or if
+     * nothing received from backend and no request body (request body
+     * has already been consumed) */
+    request_st * const r = hctx->gw.r;
+    gw_mpx_unlink(&hctx->gw);
+    if (status > 500) /*(not 500 local error)*/
+        gw_proc_latency_error(&hctx->gw);
+    if (retry && (0 == hctx->h2id
+                  || (0 == hctx->h2hdrs && chunkqueue_is_empty(hctx->gw.rb)
+                      && 0 == r->reqbody_length))
+        && hctx->gw.reconnects++ < 5)
+        hctx->h2retry = 1;
+    else
+        hctx->h2err = (uint16_t)status;
+    joblist_append(hctx->gw.con);
+}
+
+
+static void proxy_h2_stream_reset (proxy_h2c * const h2c, handler_ctx * const hctx, const uint32_t e, const int status)
+{
+    if (hctx->h2id)
+        proxy_h2c_send_u32(h2c, H2_FTYPE_RST_STREAM, hctx->h2id, e);
+    proxy_h2_stream_fail(hctx, status, 0);
+}
+
+
+static int proxy_h2c_recv_settings (proxy_h2c * const h2c, const uint8_t flags, const uint32_t id, const unsigned char *p, const uint32_t len)
+{
+    if (0 != id)
+        return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+    if (flags & H2_FLAG_ACK)
+        return 0 == len ? 0 : proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+    if (len % 6)
+        return proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+
+    for (const unsigned char * const end = p + len; p < end; p += 6) {
+        const uint32_t v = ((uint32_t)p[2] << 24) | ((uint32_t)p[3] << 16)
+                         | ((uint32_t)p[4] <<  8) |  (uint32_t)p[5];
+        switch (((uint32_t)p[0] << 8) | p[1]) {
+          case H2_SETTINGS_HEADER_TABLE_SIZE:
+            lshpack_enc_set_max_capacity(&h2c->encoder, v);
+            break;
+          case H2_SETTINGS_MAX_CONCURRENT_STREAMS:
+            h2c->s_max_concurrent_streams = v;
+            break;
+          case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+            if (v > INT32_MAX)
+                return proxy_h2c_goaway(h2c, H2_E_FLOW_CONTROL_ERROR);
+            if ((int32_t)v != h2c->s_initial_window_size) {
+                const int32_t diff = (int32_t)v - h2c->s_initial_window_size;
+                h2c->s_initial_window_size = (int32_t)v;
+                for (gw_handler_ctx *gw = h2c->gw.reqs; gw; gw = gw->mpx_next)
+                    ((handler_ctx *)gw)->h2swin += diff;
+                if (diff > 0) proxy_h2c_stream_wake(&h2c->gw);
+            }
+            break;
+          case H2_SETTINGS_MAX_FRAME_SIZE:
+            if (v < 16384 || v > 16777215)
+                return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+            h2c->s_max_frame_size = v;
+            break;
+          default: /* ignore unknown or unused settings */
+            break;
+        }
+    }
+
+    proxy_h2c_frame(h2c, H2_FTYPE_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+    if (!h2c->settings) {
+        /* start streams waiting for backend SETTINGS */
+        h2c->settings = 1;
+        for (gw_handler_ctx *gw = h2c->gw.reqs; gw; gw = gw->mpx_next) {
+            if (0 == ((handler_ctx *)gw)->h2id) joblist_append(gw->con);
+        }
+    }
+    return 0;
+}
+
+
+static int proxy_h2c_recv_headers (proxy_h2c * const h2c, const uint32_t id, const uint8_t flags, const unsigned char *p, const uint32_t len)
+{
+    /* header block must be decoded even if stream has been reset,
+     * in order to keep HPACK decoder state in sync with backend */
+    handler_ctx * const hctx = proxy_h2c_stream_find(h2c, id);
+    buffer * const hb =
+      (NULL != hctx && 0 == hctx->h2hdrs) ? hctx->gw.response : NULL;
+    buffer * const tb = h2c->gw.srv->tmp_buf;
+    buffer_string_prepare_copy(tb, 65535);
+    const lsxpack_strlen_t tbsz = (tb->size <= LSXPACK_MAX_STRLEN)
+      ? tb->size
+      : LSXPACK_MAX_STRLEN;
+    const unsigned char *src = p;
+    const unsigned char * const endp = p + len;
+    int status = 0;
+    int malformed = 0;
+    if (hb) buffer_clear(hb);
+
+    while (src < endp) {
+        lsxpack_header_t lsx;
+        memset(&lsx, 0, sizeof(lsxpack_header_t));
+        lsx.buf = tb->ptr;
+        lsx.val_len = tbsz;
+        if (LSHPACK_OK != lshpack_dec_decode(&h2c->decoder, &src, endp, &lsx)
+            || 0 == lsx.name_len)
+            return proxy_h2c_goaway(h2c, H2_E_COMPRESSION_ERROR);
+        if (NULL == hb || malformed) continue;
+
+        const char * const k = lsx.buf + lsx.name_offset;
+        const char * const v = lsx.buf + lsx.val_offset;
+        const uint32_t klen = lsx.name_len;
+        const uint32_t vlen = lsx.val_len;
+        if (k[0] == ':') {
+            if (klen == 7 && 0 == memcmp(k, ":status", 7) && 0 == status
+                && vlen == 3 && light_isdigit(v[0])
+                && light_isdigit(v[1]) && light_isdigit(v[2])) {
+                status = (v[0]-'0')*100 + (v[1]-'0')*10 + (v[2]-'0');
+                buffer_append_str3(hb, CONST_STR_LEN("HTTP/1.1 "), v, 3,
+                                       CONST_STR_LEN("\r\n"));
+            }
+            else
+                malformed = 1;
+            continue;
+        }
+        if (0 == status || NULL != memchr(v, '\n', vlen)
+                        || NULL != memchr(v, '\r', vlen)) {
+            malformed = 1;
+            continue;
+        }
+        /* (connection-specific header fields are not used in HTTP/2) */
+        if (klen == 17 && 0 == memcmp(k, "transfer-encoding", 17))
+            continue;
+        buffer_append_str3(hb, k, klen, CONST_STR_LEN(": "), v, vlen);
+        buffer_append_string_len(hb, CONST_STR_LEN("\r\n"));
+    }
+
+    if (NULL == hctx) return 0;
+
+    if (hb) {
+        if (malformed || 0 == status) {
+            log_error(hctx->gw.r->conf.errh, __FILE__, __LINE__,
+              "malformed HTTP/2 response headers from backend: %s",
+              h2c->gw.proc->connection_name->ptr);
+            proxy_h2_stream_reset(h2c, hctx, H2_E_PROTOCOL_ERROR, 502);
+            return 0;
+        }
+        if (status < 200) { /* ignore 1xx intermediate responses */
+            buffer_clear(hb);
+            return 0;
+        }
+        buffer_append_string_len(hb, CONST_STR_LEN("\r\n"));
+        hctx->h2hdrs = 1;
+    }
+    /* (else response trailers; discarded) */
+
+    if (flags & H2_FLAG_END_STREAM)
+        hctx->h2eos_recv = 1;
+    hctx->gw.read_ts = log_monotonic_secs;
+    joblist_append(hctx->gw.con);
+    return 0;
+}
+
+
+static int proxy_h2c_recv_data (proxy_h2c * const h2c, const uint8_t flags, const uint32_t id, const unsigned char *p, uint32_t len)
+{
+    if (0 == id)
+        return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+
+    /* flow control counts entire frame payload, including padding */
+    const uint32_t flen = len;
+    h2c->rwin -= (int32_t)flen;
+    if (h2c->rwin < 0)
+        return proxy_h2c_goaway(h2c, H2_E_FLOW_CONTROL_ERROR);
+    if (h2c->rwin < PROXY_H2_CONN_WINDOW/2) {
+        proxy_h2c_send_u32(h2c, H2_FTYPE_WINDOW_UPDATE, 0,
+                           (uint32_t)(PROXY_H2_CONN_WINDOW - h2c->rwin));
+        h2c->rwin = PROXY_H2_CONN_WINDOW;
+    }
+
+    if (flags & H2_FLAG_PADDED) {
+        if (0 == len || p[0] >= len)
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        len -= 1 + p[0];
+        ++p;
+    }
+
+    handler_ctx * const hctx = proxy_h2c_stream_find(h2c, id);
+    if (NULL == hctx) return 0; /* stream reset; discard */
+    if (0 == hctx->h2hdrs || hctx->h2eos_recv) {
+        proxy_h2_stream_reset(h2c, hctx, H2_E_PROTOCOL_ERROR, 502);
+        return 0;
+    }
+    hctx->h2rwin -= (int32_t)flen;
+    if (hctx->h2rwin < 0) {
+        proxy_h2_stream_reset(h2c, hctx, H2_E_FLOW_CONTROL_ERROR, 502);
+        return 0;
+    }
+
+    if (len)
+        chunkqueue_append_mem(hctx->gw.rb, (const char *)p, len);
+    if (flags & H2_FLAG_END_STREAM)
+        hctx->h2eos_recv = 1;
+    hctx->gw.read_ts = log_monotonic_secs;
+    joblist_append(hctx->gw.con);
+    return 0;
+}
+
+
+static int proxy_h2c_recv_frame (proxy_h2c * const h2c, const uint8_t type, const uint8_t flags, const uint32_t id, const unsigned char *p, uint32_t len)
+{
+    handler_ctx *hctx;
+    uint32_t v;
+    switch (type) {
+      case H2_FTYPE_DATA:
+        return proxy_h2c_recv_data(h2c, flags, id, p, len);
+      case H2_FTYPE_HEADERS:
+        if (0 == id)
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        if (flags & H2_FLAG_PADDED) {
+            if (0 == len || p[0] >= len)
+                return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+            len -= 1 + p[0];
+            ++p;
+        }
+        if (flags & H2_FLAG_PRIORITY) {
+            if (len < 5)
+                return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+            len -= 5;
+            p += 5;
+        }
+        if (!(flags & H2_FLAG_END_HEADERS)) {
+            buffer_copy_string_len(h2c->hbuf, (const char *)p, len);
+            h2c->cont_id = id;
+            h2c->cont_flags = flags;
+            return 0;
+        }
+        return proxy_h2c_recv_headers(h2c, id, flags, p, len);
+      case H2_FTYPE_CONTINUATION:
+        if (0 == h2c->cont_id)
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        buffer_append_string_len(h2c->hbuf, (const char *)p, len);
+        if (buffer_clen(h2c->hbuf) > 262144)
+            return proxy_h2c_goaway(h2c, H2_E_ENHANCE_YOUR_CALM);
+        if (flags & H2_FLAG_END_HEADERS) {
+            h2c->cont_id = 0;
+            const int rc = proxy_h2c_recv_headers(h2c, id, h2c->cont_flags,
+                                          (unsigned char *)h2c->hbuf->ptr,
+                                          buffer_clen(h2c->hbuf));
+            buffer_clear(h2c->hbuf);
+            return rc;
+        }
+        return 0;
+      case H2_FTYPE_RST_STREAM:
+        if (0 == id)
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        if (4 != len)
+            return proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+        hctx = proxy_h2c_stream_find(h2c, id);
+        if (NULL == hctx) return 0;
+        v = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+          | ((uint32_t)p[2] <<  8) |  (uint32_t)p[3];
+        if (v == H2_E_NO_ERROR && hctx->h2eos_recv) {
+            /* complete response received; backend does not want (rest of)
+             * request body */
+            hctx->h2eos_sent = 1;
+            gw_mpx_unlink(&hctx->gw);
+            joblist_append(hctx->gw.con);
+        }
+        else
+            proxy_h2_stream_fail(hctx, 502, v == H2_E_REFUSED_STREAM);
+        return 0;
+      case H2_FTYPE_SETTINGS:
+        return proxy_h2c_recv_settings(h2c, flags, id, p, len);
+      case H2_FTYPE_PUSH_PROMISE: /* SETTINGS_ENABLE_PUSH 0 */
+        return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+      case H2_FTYPE_PING:
+        if (0 != id)
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        if (8 != len)
+            return proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+        if (!(flags & H2_FLAG_ACK))
+            proxy_h2c_frame(h2c, H2_FTYPE_PING, H2_FLAG_ACK, 0,
+                            (const char *)p, len);
+        return 0;
+      case H2_FTYPE_GOAWAY:
+        if (0 != id)
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        if (len < 8)
+            return proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+        h2c->gw.closing = 1;
+        h2c->goaway_id = ((uint32_t)(p[0] & 0x7f) << 24)
+                       | ((uint32_t)p[1] << 16)
+                       | ((uint32_t)p[2] <<  8) | (uint32_t)p[3];
+        /* streams not processed by backend may be retried on new connection */
+        for (gw_handler_ctx *gw = h2c->gw.reqs, *next; gw; gw = next) {
+            next = gw->mpx_next;
+            hctx = (handler_ctx *)gw;
+            if (hctx->h2id > h2c->goaway_id || 0 == hctx->h2id)
+                proxy_h2_stream_fail(hctx, 503, 1);
+        }
+        return 0;
+      case H2_FTYPE_WINDOW_UPDATE:
+        if (4 != len)
+            return proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+        v = ((uint32_t)(p[0] & 0x7f) << 24) | ((uint32_t)p[1] << 16)
+          | ((uint32_t)p[2] <<  8) | (uint32_t)p[3];
+        if (0 == id) {
+            if (0 == v || (int64_t)h2c->swin + v > INT32_MAX)
+                return proxy_h2c_goaway(h2c, H2_E_FLOW_CONTROL_ERROR);
+            h2c->swin += (int32_t)v;
+            proxy_h2c_stream_wake(&h2c->gw);
+            return 0;
+        }
+        hctx = proxy_h2c_stream_find(h2c, id);
+        if (NULL == hctx) return 0;
+        if (0 == v || (int64_t)hctx->h2swin + v > INT32_MAX) {
+            proxy_h2_stream_reset(h2c, hctx, H2_E_FLOW_CONTROL_ERROR, 502);
+            return 0;
+        }
+        hctx->h2swin += (int32_t)v;
+        if (!hctx->h2eos_sent) joblist_append(hctx->gw.con);
+        return 0;
+      default: /* ignore PRIORITY, PRIORITY_UPDATE, unknown frame types */
+        return 0;
+    }
+}
+
+
+static int proxy_h2c_recv_frames (gw_mpx * const mpx)
+{
+    /* (gw_mpx_ops recv callback) */
+    proxy_h2c * const h2c = (proxy_h2c *)mpx;
+    buffer * const b = mpx->rbuf;
+    const uint32_t blen = buffer_clen(b);
+    uint32_t off = 0;
+    while (blen - off >= 9) {
+        const unsigned char * const f = (unsigned char *)b->ptr + off;
+        const uint32_t flen =
+          ((uint32_t)f[0] << 16) | ((uint32_t)f[1] << 8) | f[2];
+        if (flen > 16384) /*(SETTINGS_MAX_FRAME_SIZE default)*/
+            return proxy_h2c_goaway(h2c, H2_E_FRAME_SIZE_ERROR);
+        if (blen - off < 9 + flen) break;
+        const uint32_t id = ((uint32_t)(f[5] & 0x7f) << 24)
+                          | ((uint32_t)f[6] << 16)
+                          | ((uint32_t)f[7] <<  8) | f[8];
+        if (h2c->cont_id
+            && (f[3] != H2_FTYPE_CONTINUATION || id != h2c->cont_id))
+            return proxy_h2c_goaway(h2c, H2_E_PROTOCOL_ERROR);
+        if (0 != proxy_h2c_recv_frame(h2c, f[3], f[4], id, f+9, flen))
+            return -1;
+        off += 9 + flen;
+    }
+    if (off) {
+        memmove(b->ptr, b->ptr+off, blen - off);
+        buffer_truncate(b, blen - off);
+    }
+    return 0;
+}
+
+
+static void proxy_h2c_init (gw_mpx * const mpx)
+{
+    static const char h2preface[] = {
+      /* connection preface */
+      'P','R','I',' ','*',' ','H','T','T','P','/','2','.','0','\r','\n'
+     ,'\r','\n','S','M','\r','\n','\r','\n'
+      /* SETTINGS */
+     ,0x00, 0x00, 0x0c        /* frame length */ /* 2 * (6 bytes per setting) */
+     ,H2_FTYPE_SETTINGS       /* frame type */
+     ,0x00                    /* frame flags */
+     ,0x00, 0x00, 0x00, 0x00  /* stream identifier */
+     ,0x00, H2_SETTINGS_ENABLE_PUSH
+     ,0x00, 0x00, 0x00, 0x00  /* 0 */
+     ,0x00, H2_SETTINGS_INITIAL_WINDOW_SIZE /*(PROXY_H2_STREAM_WINDOW)*/
+     ,0x00, 0x04, 0x00, 0x00  /* 262144 */
+      /* WINDOW_UPDATE */
+     ,0x00, 0x00, 0x04        /* frame length */
+     ,H2_FTYPE_WINDOW_UPDATE  /* frame type */
+     ,0x00                    /* frame flags */
+     ,0x00, 0x00, 0x00, 0x00  /* stream identifier */
+     ,0x00, (char)0xff, 0x00, 0x01 /* (PROXY_H2_CONN_WINDOW - 65535) */
+    };
+
+    proxy_h2c * const h2c = (proxy_h2c *)mpx;
+    h2c->next_id = 1;
+    h2c->swin = 65535;
+    h2c->rwin = PROXY_H2_CONN_WINDOW;
+    h2c->s_max_concurrent_streams = 100;
+    h2c->s_initial_window_size = 65535;
+    h2c->s_max_frame_size = 16384;
+    h2c->hbuf = chunk_buffer_acquire();
+    lshpack_dec_init(&h2c->decoder);
+    lshpack_enc_init(&h2c->encoder);
+    lshpack_enc_use_hist(&h2c->encoder, 1);
+    chunkqueue_append_mem(&mpx->wq, h2preface, sizeof(h2preface));
+}
+
+
+static void proxy_h2c_free (gw_mpx * const mpx)
+{
+    proxy_h2c * const h2c = (proxy_h2c *)mpx;
+    chunk_buffer_release(h2c->hbuf);
+    lshpack_enc_cleanup(&h2c->encoder);
+    lshpack_dec_cleanup(&h2c->decoder);
+}
+
+
+static int proxy_h2c_avail (const gw_mpx * const mpx)
+{
+    const proxy_h2c * const h2c = (const proxy_h2c *)mpx;
+    return (!h2c->settings || mpx->nreqs < h2c->s_max_concurrent_streams)
+        && h2c->next_id <= 0x7fffffff;
+}
+
+
+static int proxy_h2c_ready (const gw_mpx * const mpx)
+{
+    /* no requests until SETTINGS (connection preface) from backend */
+    return ((const proxy_h2c *)mpx)->settings;
+}
+
+
+static void proxy_h2c_stream_fail (gw_handler_ctx * const gw, const int status, const int retry)
+{
+    proxy_h2_stream_fail((handler_ctx *)gw, status, retry);
+}
+
+
+static int proxy_h2c_read_timeout (gw_mpx * const mpx, gw_handler_ctx * const gw)
+{
+    handler_ctx * const hctx = (handler_ctx *)gw;
+    if (hctx->h2eos_recv) return 0;
+    log_error(gw->r->conf.errh, __FILE__, __LINE__,
+      "read timeout on HTTP/2 stream %u: %s (fd: %d)",
+      hctx->h2id, mpx->proc->connection_name->ptr, mpx->fd);
+    proxy_h2_stream_reset((proxy_h2c *)mpx, hctx, H2_E_CANCEL, 504);
+    return 1;
+}
+
+
+static const gw_mpx_ops proxy_h2c_ops = {
+  &proxy_h2c_list
+ ,"HTTP/2"
+ ,sizeof(proxy_h2c)
+ ,proxy_h2c_init
+ ,proxy_h2c_free
+ ,proxy_h2c_avail
+ ,proxy_h2c_ready
+ ,proxy_h2c_recv_frames
+ ,proxy_h2c_stream_fail
+ ,proxy_h2c_read_timeout
+ ,proxy_h2c_stream_wake
+};
+
+
+static void proxy_h2c_free_all (void)
+{
+    gw_mpx_free_all(&proxy_h2c_ops);
+}
+
+
+static int proxy_h2_hpack_encode (proxy_h2c * const h2c, buffer * const hb, buffer * const tb, const char * const k, const uint32_t klen, const char * const v, const uint32_t vlen)
+{
+    if (klen + vlen > LSXPACK_MAX_STRLEN) return -1;
+    char * const s = buffer_string_prepare_copy(tb, klen + vlen);
+    for (uint32_t i = 0; i < klen; ++i) /*(field names are lowercase in h2)*/
+        s[i] = light_isupper(k[i]) ? (k[i] | 0x20) : k[i];
+    memcpy(s + klen, v, vlen);
+
+    lsxpack_header_t lsx;
+    memset(&lsx, 0, sizeof(lsxpack_header_t));
+    lsx.buf = s;
+    lsx.name_offset = 0;
+    lsx.name_len = klen;
+    lsx.val_offset = klen;
+    lsx.val_len = vlen;
+
+    const size_t sz = klen + vlen + 32;
+    unsigned char * const dst =
+      (unsigned char *)buffer_string_prepare_append(hb, sz);
+    unsigned char * const end =
+      lshpack_enc_encode(&h2c->encoder, dst, dst + sz, &lsx);
+    if (end == dst) return -1;
+    buffer_commit(hb, (size_t)(end - dst));
+    return 0;
+}
+
+
+static int proxy_h2_send_headers (handler_ctx * const hctx, request_st * const r, proxy_h2c * const h2c)
+{
+    const int remap_headers = (NULL != hctx->conf.header.urlpaths
+                               || NULL != hctx->conf.header.hosts_request);
+    buffer * const tb = r->tmp_buf;
+    buffer * const vb = chunk_buffer_acquire();
+    buffer * const hb = chunk_buffer_acquire();
+    int rc = 0;
+
+    /* "Forwarded" and legacy X- headers (once; not again if resent) */
+    if (0 == hctx->gw.reconnects)
+        proxy_set_Forwarded(r->con, r, hctx->conf.forwarded);
+
+    if (r->reqbody_length > 0
+        || (0 == r->reqbody_length
+            && !http_method_get_or_head(r->http_method))) {
+        /* set Content-Length if client sent Transfer-Encoding: chunked
+         * and not streaming to backend (request body has been fully received) */
+        if (NULL == http_header_request_get(r, HTTP_HEADER_CONTENT_LENGTH,
+                                            CONST_STR_LEN("Content-Length")))
+            buffer_append_int(
+              http_header_request_set_ptr(r, HTTP_HEADER_CONTENT_LENGTH,
+                                          CONST_STR_LEN("Content-Length")),
+              r->reqbody_length);
+    }
+
+    /* pseudo-header fields */
+    const buffer * const m = http_method_buf(r->http_method);
+    rc |= proxy_h2_hpack_encode(h2c, hb, tb, CONST_STR_LEN(":method"),
+                                BUF_PTR_LEN(m));
+    rc |= proxy_h2_hpack_encode(h2c, hb, tb, CONST_STR_LEN(":scheme"),
+                                CONST_STR_LEN("http"));
+    const buffer *authority = NULL;
+    if (hctx->conf.replace_http_host && !buffer_is_blank(hctx->gw.host->id))
+        authority = hctx->gw.host->id;
+    else if (r->http_host && !buffer_is_unset(r->http_host)) {
+        authority = r->http_host;
+        if (remap_headers) {
+            buffer_copy_buffer(vb, r->http_host);
+            http_header_remap_host(vb, 0, &hctx->conf.header, 1,
+                                   buffer_clen(vb));
+            authority = vb;
+        }
+    }
+    if (authority)
+        rc |= proxy_h2_hpack_encode(h2c, hb, tb, CONST_STR_LEN(":authority"),
+                                    BUF_PTR_LEN(authority));
+    buffer_copy_buffer(vb, &r->target);
+    if (remap_headers)
+        http_header_remap_uri(vb, 0, &hctx->conf.header, 1);
+    rc |= proxy_h2_hpack_encode(h2c, hb, tb, CONST_STR_LEN(":path"),
+                                BUF_PTR_LEN(vb));
+
+    /* request header */
+    for (uint32_t i = 0, used = r->rqst_headers.used; i < used; ++i) {
+        const data_string * const ds = (data_string *)r->rqst_headers.data[i];
+        const buffer *v = &ds->value;
+        switch (ds->ext) {
+          default:
+            break;
+          case HTTP_HEADER_HOST:       /*(sent as :authority)*/
+          case HTTP_HEADER_CONNECTION: /*(connection-specific header fields)*/
+          case HTTP_HEADER_UPGRADE:
+          case HTTP_HEADER_TRANSFER_ENCODING:
+          case HTTP_HEADER_HTTP2_SETTINGS:
+          case HTTP_HEADER_SET_COOKIE: /*(response header only)*/
+            continue;
+          case HTTP_HEADER_TE:
+            /* ignore if not exactly "trailers" */
+            if (!buffer_eq_icase_slen(v, CONST_STR_LEN("trailers"))) continue;
+            break;
+          case HTTP_HEADER_CONTENT_LOCATION:
+            if (remap_headers) {
+                buffer_copy_buffer(vb, v);
+                http_header_remap_uri(vb, 0, &hctx->conf.header, 1);
+                v = vb;
+            }
+            break;
+          case HTTP_HEADER_OTHER:
+            if (buffer_eq_icase_slen(&ds->key, CONST_STR_LEN("Keep-Alive"))
+                || buffer_eq_icase_slen(&ds->key,
+                                        CONST_STR_LEN("Proxy-Connection"))
+                /* Do not emit HTTP_PROXY in environment.
+                 * See also https://httpoxy.org/ */
+                || buffer_eq_icase_slen(&ds->key, CONST_STR_LEN("Proxy")))
+                continue;
+            if (remap_headers /* "Destination" is WebDAV request header */
+                && buffer_eq_icase_slen(&ds->key,CONST_STR_LEN("Destination"))){
+                buffer_copy_buffer(vb, v);
+                http_header_remap_uri(vb, 0, &hctx->conf.header, 1);
+                v = vb;
+            }
+            break;
+        }
+
+        const uint32_t klen = buffer_clen(&ds->key);
+        const uint32_t vlen = buffer_clen(v);
+        if (0 == klen || 0 == vlen) continue;
+        rc |= proxy_h2_hpack_encode(h2c, hb, tb, ds->key.ptr, klen,
+                                    v->ptr, vlen);
+    }
+
+    if (0 == rc) {
+        /* HEADERS (and CONTINUATION frames, if needed) */
+        const int eos = (0 == r->reqbody_length);
+        const char *s = hb->ptr;
+        uint32_t hlen = buffer_clen(hb);
+        int type = H2_FTYPE_HEADERS;
+        int flags = eos ? H2_FLAG_END_STREAM : 0;
+        do {
+            const uint32_t n = hlen < h2c->s_max_frame_size
+              ? hlen
+              : h2c->s_max_frame_size;
+            hlen -= n;
+            proxy_h2c_frame(h2c, type, flags|(0==hlen ? H2_FLAG_END_HEADERS:0),
+                            hctx->h2id, s, n);
+            s += n;
+            type = H2_FTYPE_CONTINUATION;
+            flags = 0;
+        } while (hlen);
+        hctx->h2eos_sent = (uint8_t)eos;
+    }
+
+    chunk_buffer_release(hb);
+    chunk_buffer_release(vb);
+    return rc;
+}
+
+
+static void proxy_h2_send_reqbody (handler_ctx * const hctx, request_st * const r)
+{
+    proxy_h2c * const h2c = (proxy_h2c *)hctx->gw.mpx;
+    chunkqueue * const cq = &r->reqbody_queue;
+    do {
+        if (chunkqueue_length(&h2c->gw.wq) > 65536) {
+            h2c->gw.wblocked = 1;
+            break;
+        }
+        const off_t rem = chunkqueue_length(cq);
+        const int eos = (r->reqbody_length >= 0
+                         && cq->bytes_in == (off_t)r->reqbody_length);
+        if (0 == rem && !eos) break;
+        off_t len = rem;
+        if (len > (off_t)h2c->s_max_frame_size)
+            len = (off_t)h2c->s_max_frame_size;
+        if (len > hctx->h2swin) len = hctx->h2swin > 0 ? hctx->h2swin : 0;
+        if (len > h2c->swin)    len = h2c->swin > 0 ? h2c->swin : 0;
+        if (0 == len && 0 != rem) break; /* flow control window exhausted */
+        const int flags = (eos && len == rem) ? H2_FLAG_END_STREAM : 0;
+        proxy_h2c_frame(h2c, H2_FTYPE_DATA, flags, hctx->h2id,
+                        NULL, (uint32_t)len);
+        if (len) {
+            chunkqueue_steal(&h2c->gw.wq, cq, len);
+            hctx->h2swin -= (int32_t)len;
+            h2c->swin -= (int32_t)len;
+        }
+        if (flags) hctx->h2eos_sent = 1;
+    } while (!hctx->h2eos_sent);
+
+    if (!hctx->h2eos_sent && chunkqueue_length(cq) < 65536 - 16384
+        && !(r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_POLLIN)) {
+        r->conf.stream_request_body |= FDEVENT_STREAM_REQUEST_POLLIN;
+        if (r->http_version <= HTTP_VERSION_1_1)
+            r->con->is_readable = 1; /*trigger optimistic client rd*/
+    }
+}
+
+
+static uint32_t proxy_h2c_nactive (const proxy_h2c * const h2c)
+{
+    uint32_t n = 0;
+    for (const gw_handler_ctx *gw = h2c->gw.reqs; gw; gw = gw->mpx_next) {
+        if (((const handler_ctx *)gw)->h2id) ++n;
+    }
+    return n;
+}
+
+
+static void proxy_h2_stream_open (handler_ctx * const hctx, request_st * const r)
+{
+    gw_handler_ctx * const gw = &hctx->gw;
+    if (NULL == gw->proc && !gw_proc_acquire(gw)) {
+        /* all children are dead */
+        hctx->h2err = 503; /* Service Unavailable */
+        return;
+    }
+    if (NULL == gw->rb) gw->rb = chunkqueue_init(NULL);
+
+    /* Streams wait for SETTINGS from backend before HEADERS are sent, since
+     * SETTINGS_MAX_CONCURRENT_STREAMS is not known until then, and a backend
+     * might stop reading frames (including WINDOW_UPDATE) rather than refuse
+     * streams in excess of the limit */
+    if (NULL == gw->mpx && !gw_mpx_attach(gw, r, &proxy_h2c_ops)) {
+        hctx->h2err = 503; /* Service Unavailable */
+        return;
+    }
+    proxy_h2c *h2c = (proxy_h2c *)gw->mpx;
+    if (!h2c->settings) return;
+    if (h2c->gw.closing
+        || proxy_h2c_nactive(h2c) >= h2c->s_max_concurrent_streams) {
+        /* move to another connection */
+        gw_mpx_unlink(gw);
+        gw_mpx_flush(&h2c->gw);
+        if (!gw_mpx_attach(gw, r, &proxy_h2c_ops)) {
+            hctx->h2err = 503; /* Service Unavailable */
+            return;
+        }
+        h2c = (proxy_h2c *)gw->mpx;
+        if (!h2c->settings) return;
+    }
+
+    hctx->h2id = h2c->next_id;
+    h2c->next_id += 2;
+    hctx->h2swin = h2c->s_initial_window_size;
+    hctx->h2rwin = PROXY_H2_STREAM_WINDOW;
+    gw->read_ts = gw->proc->last_used = log_monotonic_secs;
+
+    if (0 != proxy_h2_send_headers(hctx, r, h2c)) {
+        /* (HPACK encoder state no longer in sync with backend decoder) */
+        log_error(r->conf.errh, __FILE__, __LINE__,
+          "failed to encode HTTP/2 request headers for %s", r->uri.path.ptr);
+        h2c->gw.closing = 1;
+        proxy_h2_stream_fail(hctx, 500, 0);
+        gw_mpx_flush(&h2c->gw);
+        return;
+    }
+    if (!hctx->h2eos_sent)
+        proxy_h2_send_reqbody(hctx, r);
+    gw_mpx_flush(&h2c->gw);
+
+    plugin_stats_inc("proxy.requests");
+}
+
+
+static void proxy_h2_stream_detach (void * const gwhctx)
+{
+    /* (hctx->gw.handler_ctx_free callback) */
+    handler_ctx * const hctx = gwhctx;
+    proxy_h2c * const h2c = (proxy_h2c *)hctx->gw.mpx;
+    if (NULL == h2c) return;
+    if (hctx->h2id && (!hctx->h2eos_sent || !hctx->h2eos_recv))
+        proxy_h2c_send_u32(h2c, H2_FTYPE_RST_STREAM, hctx->h2id, H2_E_CANCEL);
+    gw_mpx_unlink(&hctx->gw);
+    gw_mpx_flush(&h2c->gw);
+}
+
+
+static handler_t proxy_h2_stream_error (handler_ctx * const hctx, request_st * const r)
+{
+    if (!r->resp_body_started)
+        r->http_status = hctx->h2err;
+    http_response_backend_error(r);
+    gw_handle_request_reset(r, hctx->gw.plugin_data);
+    return HANDLER_FINISHED;
+}
+
+
+static handler_t proxy_h2_handle_subrequest (handler_ctx * const hctx, request_st * const r)
+{
+    if (hctx->h2err) return proxy_h2_stream_error(hctx, r);
+
+    /* request body */
+    if (!hctx->h2eos_sent) {
+        /* leave excess data in r->reqbody_queue, which is
+         * buffered to disk if too large and backend can not keep up */
+        if ((r->conf.stream_request_body & FDEVENT_STREAM_REQUEST_BUFMIN)
+            && chunkqueue_length(&r->reqbody_queue) > 65536 - 4096)
+            r->conf.stream_request_body &= ~FDEVENT_STREAM_REQUEST_POLLIN;
+        else {
+            const handler_t rc = r->con->reqbody_read(r);
+            if (rc == HANDLER_WAIT_FOR_EVENT) {
+                /* not streaming request body; wait for complete body */
+                if (0 == hctx->h2id) return rc;
+            }
+            else if (rc != HANDLER_GO_ON)
+                return rc;
+        }
+    }
+
+    if (hctx->h2retry) {
+        /* resend request on new stream; select host and proc again since
+         * retry follows connection error, GOAWAY, or refused stream */
+        hctx->h2retry = 0;
+        hctx->h2id = 0;
+        hctx->h2eos_sent = 0;
+        hctx->h2eos_recv = 0;
+        hctx->h2hdrs = 0;
+        buffer_clear(hctx->gw.response);
+        if (!gw_host_reacquire(&hctx->gw, r))
+            return HANDLER_FINISHED; /*(r->http_status = 503)*/
+    }
+
+    if (0 == hctx->h2id)
+        proxy_h2_stream_open(hctx, r);
+    else if (!hctx->h2eos_sent && NULL != hctx->gw.mpx) {
+        proxy_h2_send_reqbody(hctx, r);
+        gw_mpx_flush(hctx->gw.mpx);
+    }
+
+    if (hctx->h2err) return proxy_h2_stream_error(hctx, r);
+    if (hctx->h2retry) {
+        joblist_append(hctx->gw.con);
+        return HANDLER_WAIT_FOR_EVENT;
+    }
+
+    /* response */
+    if (1 == hctx->h2hdrs) {
+        hctx->h2hdrs = 2;
+        if (hctx->gw.latency_ns)
+            gw_proc_latency_sample(&hctx->gw);
+        const handler_t rc =
+          http_response_parse_headers(r, &hctx->gw.opts, hctx->gw.response);
+        if (rc != HANDLER_GO_ON) {
+            if (rc == HANDLER_FINISHED) {
+                gw_handle_request_reset(r, hctx->gw.plugin_data);
+                return HANDLER_FINISHED;
+            }
+            hctx->h2err = 502; /* Bad Gateway */
+            return proxy_h2_stream_error(hctx, r);
+        }
+    }
+    if (2 != hctx->h2hdrs) return HANDLER_WAIT_FOR_EVENT;
+
+    chunkqueue * const rb = hctx->gw.rb;
+    off_t len = chunkqueue_length(rb);
+    if (len && (r->conf.stream_response_body & FDEVENT_STREAM_RESPONSE_BUFMIN)){
+        const off_t wqlen = chunkqueue_length(&r->write_queue);
+        len = (wqlen < 65536 - 4096)
+          ? (len < 65536 - 4096 - wqlen ? len : 65536 - 4096 - wqlen)
+          : 0;
+    }
+    if (len && 0 != http_response_transfer_cqlen(r, rb, (size_t)len)) {
+        hctx->h2err = 502; /* Bad Gateway */
+        return proxy_h2_stream_error(hctx, r);
+    }
+
+    if (hctx->h2eos_recv) {
+        if (chunkqueue_is_empty(rb)) {
+            gw_handle_request_reset(r, hctx->gw.plugin_data);
+            return HANDLER_FINISHED;
+        }
+    }
+    else if (NULL != hctx->gw.mpx) {
+        /* replenish stream window as response is sent to client */
+        const int64_t incr = (int64_t)PROXY_H2_STREAM_WINDOW
+                           - chunkqueue_length(rb) - hctx->h2rwin;
+        if (incr >= 16384) {
+            hctx->h2rwin += (int32_t)incr;
+            proxy_h2c_send_u32((proxy_h2c *)hctx->gw.mpx,
+                               H2_FTYPE_WINDOW_UPDATE, hctx->h2id,
+                               (uint32_t)incr);
+            gw_mpx_flush(hctx->gw.mpx);
+        }
+    }
+
+    return HANDLER_WAIT_FOR_EVENT;
+}
+
+
+static handler_t mod_proxy_handle_subrequest (request_st * const r, void * const p_d)
+{
+    plugin_data * const p = p_d;
+    handler_ctx * const hctx = r->plugin_ctx[p->id];
+    return (NULL != hctx && hctx->h2)
+      ? proxy_h2_handle_subrequest(hctx, r)
+      : gw_handle_subrequest(r, p_d);
+}
+
+
+static handler_t mod_proxy_handle_trigger (server * const srv, void * const p_d)
+{
+    const handler_t rc = gw_handle_trigger(srv, p_d);
+    if (NULL != proxy_h2c_list) gw_mpx_handle_trigger(srv, &proxy_h2c_ops);
+    return rc;
+}
+
+
 static handler_t mod_proxy_check_extension(request_st * const r, void *p_d) {
 	plugin_data *p = p_d;
 	handler_t rc;
@@ -1126,6 +2131,16 @@ static handler_t mod_proxy_check_extension(request_st * const r, void *p_d) {
 			  buffer_is_equal_string(&r->uri.scheme, CONST_STR_LEN("https"));
 		}
 
+		if (hctx->conf.header.force_http2
+		    && !hctx->conf.header.force_http10
+		    && r->http_method != HTTP_METHOD_CONNECT
+		    && !light_btst(r->rqst_htags, HTTP_HEADER_UPGRADE)) {
+			/* send request as stream on HTTP/2 connection to backend */
+			hctx->h2 = 1;
+			hctx->gw.opts.upgrade = 0;
+			hctx->gw.handler_ctx_free = proxy_h2_stream_detach;
+		}
+
 		if (r->http_method == HTTP_METHOD_CONNECT) {
 			/*(note: not requiring HTTP/1.1 due to too many non-compliant
 			 * clients such as 'openssl s_client')*/
@@ -1162,8 +2177,8 @@ int mod_proxy_plugin_init(plugin *p) {
 	p->set_defaults = mod_proxy_set_defaults;
 	p->handle_request_reset    = gw_handle_request_reset;
 	p->handle_uri_clean        = mod_proxy_check_extension;
-	p->handle_subrequest       = gw_handle_subrequest;
-	p->handle_trigger          = gw_handle_trigger;
+	p->handle_subrequest       = mod_proxy_handle_subrequest;
+	p->handle_trigger          = mod_proxy_handle_trigger;
 	p->handle_waitpid          = gw_handle_waitpid_cb;
 
 	return 0;
@@ -1,8 +1,13 @@
 #include "first.h"
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "base.h"
 #include "log.h"
 #include "array.h"
 #include "buffer.h"
+#include "http_header.h"
 
 #include "plugin.h"
 
@@ -12,10 +17,24 @@
 
 typedef struct {
 	const array *exclude_ext;
+	const unsigned char *precompressed; /* list of encodings; 0-terminated */
 	unsigned short etags_used;
 	unsigned short disable_pathinfo;
 } plugin_config;
 
+/* precompressed file encodings (index 0 is unused; list terminator) */
+static const struct {
+    const char *name;
+    uint32_t nlen;
+    const char *ext;
+    uint32_t elen;
+} mod_staticfile_encodings[] = {
+    { "",     0, "",     0 }
+   ,{ "br",   2, ".br",  3 }
+   ,{ "zstd", 4, ".zst", 4 }
+   ,{ "gzip", 4, ".gz",  3 }
+};
+
 typedef struct {
     PLUGIN_DATA;
     plugin_config defaults;
@@ -26,6 +45,25 @@ INIT_FUNC(mod_staticfile_init) {
     return ck_calloc(1, sizeof(plugin_data));
 }
 
+FREE_FUNC(mod_staticfile_free) {
+    plugin_data * const p = p_d;
+    if (NULL == p->cvlist) return;
+    /* (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1], used = p->nconfig; i < used; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            if (cpv->vtype != T_CONFIG_LOCAL || NULL == cpv->v.v) continue;
+            switch (cpv->k_id) {
+              case 3: /* static-file.precompressed */
+                free(cpv->v.v);
+                break;
+              default:
+                break;
+            }
+        }
+    }
+}
+
 static void mod_staticfile_merge_config_cpv(plugin_config * const pconf, const config_plugin_value_t * const cpv) {
     switch (cpv->k_id) { /* index into static config_plugin_keys_t cpk[] */
       case 0: /* static-file.exclude-extensions */
@@ -37,6 +75,10 @@ static void mod_staticfile_merge_config_cpv(plugin_config * const pconf, const c
       case 2: /* static-file.disable-pathinfo */
         pconf->disable_pathinfo = cpv->v.u;
         break;
+      case 3: /* static-file.precompressed */
+        if (cpv->vtype == T_CONFIG_LOCAL)
+            pconf->precompressed = cpv->v.v;
+        break;
       default:/* should not happen */
         return;
     }
@@ -69,6 +111,9 @@ SETDEFAULTS_FUNC(mod_staticfile_set_defaults) {
      ,{ CONST_STR_LEN("static-file.disable-pathinfo"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("static-file.precompressed"),
+        T_CONFIG_ARRAY_VLIST,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -78,6 +123,44 @@ SETDEFAULTS_FUNC(mod_staticfile_set_defaults) {
     if (!config_plugin_values_init(srv, p, cpk, "mod_staticfile"))
         return HANDLER_ERROR;
 
+    /* process and validate config directives
+     * (init i to 0 if global context; to 1 to skip empty global context) */
+    for (int i = !p->cvlist[0].v.u2[1]; i < p->nconfig; ++i) {
+        config_plugin_value_t *cpv = p->cvlist + p->cvlist[i].v.u2[0];
+        for (; -1 != cpv->k_id; ++cpv) {
+            switch (cpv->k_id) {
+              case 3: /* static-file.precompressed */
+                if (0 == cpv->v.a->used) { cpv->v.v = NULL; break; }
+                else {
+                    const array * const a = cpv->v.a;
+                    unsigned char * const x = ck_calloc(a->used+1, 1);
+                    for (uint32_t j = 0; j < a->used; ++j) {
+                        const buffer * const v = &((data_string *)a->data[j])->value;
+                        uint32_t e = sizeof(mod_staticfile_encodings)
+                                   / sizeof(*mod_staticfile_encodings);
+                        while (--e && !buffer_eq_slen(v,
+                                        mod_staticfile_encodings[e].name,
+                                        mod_staticfile_encodings[e].nlen)) ;
+                        if (0 == e) {
+                            log_error(srv->errh, __FILE__, __LINE__,
+                              "unrecognized encoding for %s: %s "
+                              "(expecting \"br\", \"zstd\", or \"gzip\")",
+                              cpk[cpv->k_id].k, v->ptr);
+                            free(x);
+                            return HANDLER_ERROR;
+                        }
+                        x[j] = (unsigned char)e;
+                    }
+                    cpv->v.v = x;
+                    cpv->vtype = T_CONFIG_LOCAL;
+                }
+                break;
+              default:/* should not happen */
+                break;
+            }
+        }
+    }
+
     /* initialize p->defaults from global config context */
     p->defaults.etags_used = 1; /* etags enabled */
     if (p->nconfig > 0 && p->cvlist->v.u2[1]) {
@@ -100,6 +183,122 @@ mod_staticfile_not_handled(request_st * const r, const char * const msg)
     return HANDLER_GO_ON;
 }
 
+__attribute_pure__
+static int
+mod_staticfile_accept_encoding (const buffer * const vb, const char * const name, const uint32_t nlen)
+{
+    /* check if encoding is listed in Accept-Encoding (and not with q=0) */
+    for (const char *s = vb->ptr; *s; ) {
+        while (*s == ' ' || *s == '\t' || *s == ',') ++s;
+        const char * const v = s;
+        while (*s!=' ' && *s!='\t' && *s!=',' && *s!=';' && *s!='\0') ++s;
+        const int match = ((uint32_t)(s - v) == nlen
+                           && buffer_eq_icase_ssn(v, name, nlen));
+        int q0 = 0;
+        while (*s == ' ' || *s == '\t') ++s;
+        if (*s == ';') {
+            do { ++s; } while (*s == ' ' || *s == '\t');
+            if ((*s == 'q' || *s == 'Q') && s[1] == '=' && s[2] == '0') {
+                s += 3;
+                if (*s == '.') do { ++s; } while (*s == '0');
+                q0 = (*s == ' ' || *s == '\t' || *s == ',' || *s == '\0');
+            }
+            while (*s != ',' && *s != '\0') ++s;
+        }
+        if (match) return !q0;
+    }
+    return 0;
+}
+
+static handler_t
+mod_staticfile_precompressed (request_st * const r, const plugin_config * const pconf, stat_cache_entry * const sce)
+{
+    /* response varies by Accept-Encoding if precompressed files might exist */
+    buffer * const vary =
+      http_header_response_get(r, HTTP_HEADER_VARY, CONST_STR_LEN("Vary"));
+    if (NULL == vary)
+        http_header_response_set(r, HTTP_HEADER_VARY, CONST_STR_LEN("Vary"),
+                                 CONST_STR_LEN("Accept-Encoding"));
+    else if (!http_header_str_contains_token(BUF_PTR_LEN(vary),
+                                             CONST_STR_LEN("Accept-Encoding")))
+        buffer_append_string_len(vary, CONST_STR_LEN(",Accept-Encoding"));
+
+    const buffer * const vb =
+      http_header_request_get(r, HTTP_HEADER_ACCEPT_ENCODING,
+                              CONST_STR_LEN("Accept-Encoding"));
+    if (NULL == vb) return HANDLER_GO_ON;
+
+    /* select first configured encoding accepted by client for which a
+     * precompressed file exists and is not older than the original file */
+    buffer * const fn = r->tmp_buf;
+    stat_cache_entry *csce = NULL;
+    uint32_t e;
+    for (const unsigned char *x = pconf->precompressed; (e = *x); ++x) {
+        if (!mod_staticfile_accept_encoding(vb, mod_staticfile_encodings[e].name,
+                                                mod_staticfile_encodings[e].nlen))
+            continue;
+        buffer_copy_string_len(fn, BUF_PTR_LEN(&r->physical.path));
+        buffer_append_string_len(fn, mod_staticfile_encodings[e].ext,
+                                     mod_staticfile_encodings[e].elen);
+        csce = stat_cache_get_entry(fn);
+        if (csce && S_ISREG(csce->st.st_mode)
+            && csce->st.st_mtime >= sce->st.st_mtime)
+            break;
+        csce = NULL;
+    }
+    if (NULL == csce) return HANDLER_GO_ON;
+
+    /* Content-Type of original file; ETag of precompressed file with
+     * encoding appended (as does mod_deflate) */
+    const buffer *content_type = NULL;
+    if (!light_btst(r->resp_htags, HTTP_HEADER_CONTENT_TYPE)) {
+        content_type = stat_cache_content_type_get(sce, r);
+        if (NULL == content_type || buffer_is_blank(content_type))
+            return HANDLER_GO_ON; /*(send original file as octet-stream)*/
+        http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
+                                 CONST_STR_LEN("Content-Type"),
+                                 BUF_PTR_LEN(content_type));
+    }
+    int etag_set = 0;
+    if (r->conf.etag_flags && !light_btst(r->resp_htags, HTTP_HEADER_ETAG)) {
+        const buffer * const etag = stat_cache_etag_get(csce, r->conf.etag_flags);
+        if (etag && buffer_clen(etag) > 1) {
+            buffer * const vetag =
+              http_header_response_set_ptr(r, HTTP_HEADER_ETAG,
+                                           CONST_STR_LEN("ETag"));
+            buffer_append_str3(vetag, etag->ptr, buffer_clen(etag)-1,
+                                      CONST_STR_LEN("-"),
+                                      mod_staticfile_encodings[e].name,
+                                      mod_staticfile_encodings[e].nlen);
+            buffer_append_char(vetag, '"');
+            etag_set = 1;
+        }
+    }
+
+    http_response_send_file(r, fn, csce);
+
+    if (r->http_status < 400) {
+        http_header_response_set(r, HTTP_HEADER_CONTENT_ENCODING,
+                                 CONST_STR_LEN("Content-Encoding"),
+                                 mod_staticfile_encodings[e].name,
+                                 mod_staticfile_encodings[e].nlen);
+        return HANDLER_FINISHED;
+    }
+
+    /* (unexpected) error sending precompressed file; send original file */
+    r->http_status = 0;
+    http_response_body_clear(r, 0);
+    if (content_type)
+        http_header_response_unset(r, HTTP_HEADER_CONTENT_TYPE,
+                                   CONST_STR_LEN("Content-Type"));
+    if (etag_set)
+        http_header_response_unset(r, HTTP_HEADER_ETAG,
+                                   CONST_STR_LEN("ETag"));
+    http_header_response_unset(r, HTTP_HEADER_LAST_MODIFIED,
+                               CONST_STR_LEN("Last-Modified"));
+    return HANDLER_GO_ON;
+}
+
 static handler_t
 mod_staticfile_process (request_st * const r, plugin_config * const pconf)
 {
@@ -120,6 +319,22 @@ mod_staticfile_process (request_st * const r, plugin_config * const pconf)
     if (r->tmp_sce && !buffer_is_equal(&r->tmp_sce->name, &r->physical.path))
         r->tmp_sce = NULL;
 
+    if (pconf->precompressed) {
+        stat_cache_entry * const sce = r->tmp_sce
+          ? r->tmp_sce
+          : stat_cache_get_entry(&r->physical.path);
+        if (sce && S_ISREG(sce->st.st_mode)) {
+            /*(hold reference; sce might be replaced in stat_cache upon hash
+             * collision with precompressed file path)*/
+            stat_cache_entry_refchg(sce, 1);
+            const handler_t rc = mod_staticfile_precompressed(r, pconf, sce);
+            stat_cache_entry_refchg(sce, -1);
+            if (HANDLER_FINISHED == rc)
+                return HANDLER_FINISHED;
+        }
+        r->tmp_sce = NULL;
+    }
+
     http_response_send_file(r, &r->physical.path, r->tmp_sce);
 
     return HANDLER_FINISHED;
@@ -146,6 +361,7 @@ int mod_staticfile_plugin_init(plugin *p) {
 	p->name        = "staticfile";
 
 	p->init        = mod_staticfile_init;
+	p->cleanup     = mod_staticfile_free;
 	p->handle_subrequest_start = mod_staticfile_subrequest;
 	p->set_defaults  = mod_staticfile_set_defaults;
 
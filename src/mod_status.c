@@ -7,11 +7,13 @@
 #include "log.h"
 
 #include "plugin.h"
+#include "worker_stats.h"
 
 #include <sys/types.h>
 #include "sys-time.h"
 
 #include <fcntl.h>
+#include <stddef.h>     /* offsetof() */
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -20,6 +22,7 @@ typedef struct {
     const buffer *config_url;
     const buffer *status_url;
     const buffer *statistics_url;
+    const buffer *metrics_url;
 
     int sort;
 } plugin_config;
@@ -29,10 +32,9 @@ typedef struct {
 	plugin_config defaults;
 	plugin_config conf;
 
-	off_t bytes_written_1s;
-	off_t requests_1s;
-	off_t abs_traffic_out;
-	off_t abs_requests;
+	worker_stats ws;     /* totals for all workers */
+	uint64_t trigger_traffic_out;
+	uint64_t trigger_requests;
 
 	off_t traffic_out_5s[5];
 	off_t requests_5s[5];
@@ -57,6 +59,9 @@ static void mod_status_merge_config_cpv(plugin_config * const pconf, const confi
       case 3: /* status.enable-sort */
         pconf->sort = (int)cpv->v.u;
         break;
+      case 4: /* status.metrics-url */
+        pconf->metrics_url = cpv->v.b;
+        break;
       default:/* should not happen */
         return;
     }
@@ -91,6 +96,9 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
      ,{ CONST_STR_LEN("status.enable-sort"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_CONNECTION }
+     ,{ CONST_STR_LEN("status.metrics-url"),
+        T_CONFIG_STRING,
+        T_CONFIG_SCOPE_CONNECTION }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -114,6 +122,14 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
                 break;
               case 3: /* status.enable-sort */
                 break;
+              case 4: /* status.metrics-url */
+                if (buffer_is_blank(cpv->v.b))
+                    cpv->v.b = NULL;
+                else { /* enable latency histograms and per-vhost stats */
+                    worker_stats_metrics = 1;
+                    request_timing = 1;
+                }
+                break;
               default:/* should not happen */
                 break;
             }
@@ -441,20 +457,35 @@ static handler_t mod_status_handle_server_status_html(server *srv, request_st *
 	buffer_append_string_len(b, CONST_STR_LEN("</td></tr>\n"
 	                                          "<tr><th colspan=\"2\">absolute (since start)</th></tr>\n"
 	                                          "<tr><td>Requests</td><td class=\"string\">"));
-	avg = (double)p->abs_requests;
+	avg = (double)p->ws.requests;
 	mod_status_get_multiplier(b, avg, 1000);
 	buffer_append_string_len(b, CONST_STR_LEN("req</td></tr>\n"
 	                                          "<tr><td>Traffic</td><td class=\"string\">"));
-	avg = (double)p->abs_traffic_out;
+	avg = (double)p->ws.bytes_out;
 	mod_status_get_multiplier(b, avg, 1024);
 	buffer_append_string_len(b, CONST_STR_LEN("byte</td></tr>\n"
+	                                          "<tr><td>File fd cache</td><td class=\"string\">"));
+	const uint64_t fd_lookups = p->ws.fd_cache_hits + p->ws.fd_cache_misses;
+	buffer_append_int(b, fd_lookups
+	                     ? (intmax_t)(p->ws.fd_cache_hits * 100 / fd_lookups)
+	                     : 0);
+	buffer_append_string_len(b, CONST_STR_LEN("% hits ("));
+	buffer_append_int(b, p->ws.fd_cache_open);
+	buffer_append_string_len(b, CONST_STR_LEN(" open)</td></tr>\n"
+	                                          "<tr><td>File memory cache</td><td class=\"string\">"));
+	avg = (double)p->ws.mem_cache_hits;
+	mod_status_get_multiplier(b, avg, 1000);
+	buffer_append_string_len(b, CONST_STR_LEN("hits ("));
+	avg = (double)p->ws.mem_cache_bytes;
+	mod_status_get_multiplier(b, avg, 1024);
+	buffer_append_string_len(b, CONST_STR_LEN("byte)</td></tr>\n"
 	                                          "<tr><th colspan=\"2\">average (since start)</th></tr>\n"
 	                                          "<tr><td>Requests</td><td class=\"string\">"));
-	avg = (double)p->abs_requests / (cur_ts - srv->startup_ts);
+	avg = (double)p->ws.requests / (cur_ts - srv->startup_ts);
 	mod_status_get_multiplier(b, avg, 1000);
 	buffer_append_string_len(b, CONST_STR_LEN("req/s</td></tr>\n"
 	                                          "<tr><td>Traffic</td><td class=\"string\">"));
-	avg = (double)p->abs_traffic_out / (cur_ts - srv->startup_ts);
+	avg = (double)p->ws.bytes_out / (cur_ts - srv->startup_ts);
 	mod_status_get_multiplier(b, avg, 1024);
 	buffer_append_string_len(b, CONST_STR_LEN("byte/s</td></tr>\n"
 	                                          "<tr><th colspan=\"2\">average (5s sliding average)</th></tr>\n"));
@@ -554,19 +585,34 @@ static handler_t mod_status_handle_server_status_text(server *srv, request_st *
 
 	/* output total number of requests */
 	buffer_append_string_len(b, CONST_STR_LEN("Total Accesses: "));
-	buffer_append_int(b, (intmax_t)p->abs_requests);
+	buffer_append_int(b, (intmax_t)p->ws.requests);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nTotal kBytes: "));
-	buffer_append_int(b, (intmax_t)(p->abs_traffic_out / 1024));
+	buffer_append_int(b, (intmax_t)(p->ws.bytes_out / 1024));
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nUptime: "));
 	buffer_append_int(b, log_epoch_secs - srv->startup_ts);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nBusyServers: "));
-	buffer_append_int(b, srv->srvconf.max_conns - srv->lim_conns);
+	buffer_append_int(b, p->ws.conns_active);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nIdleServers: "));
-	buffer_append_int(b, srv->lim_conns); /*(could omit)*/
+	buffer_append_int(b, p->ws.conns_idle); /*(could omit)*/
+
+	buffer_append_string_len(b, CONST_STR_LEN("\nFdCacheHits: "));
+	buffer_append_int(b, (intmax_t)p->ws.fd_cache_hits);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\nFdCacheMisses: "));
+	buffer_append_int(b, (intmax_t)p->ws.fd_cache_misses);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\nFdCacheOpen: "));
+	buffer_append_int(b, p->ws.fd_cache_open);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\nMemCacheHits: "));
+	buffer_append_int(b, (intmax_t)p->ws.mem_cache_hits);
+
+	buffer_append_string_len(b, CONST_STR_LEN("\nMemCacheBytes: "));
+	buffer_append_int(b, (intmax_t)p->ws.mem_cache_bytes);
 
 	buffer_append_string_len(b, CONST_STR_LEN("\nScoreboard: "));
 	char *s = buffer_extend(b, srv->srvconf.max_conns+1);
@@ -605,19 +651,34 @@ static handler_t mod_status_handle_server_status_json(server *srv, request_st *
 	}
 
 	buffer_append_string_len(b, CONST_STR_LEN("{\n\t\"RequestsTotal\": "));
-	buffer_append_int(b, (intmax_t)p->abs_requests);
+	buffer_append_int(b, (intmax_t)p->ws.requests);
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"TrafficTotal\": "));
-	buffer_append_int(b, (intmax_t)(p->abs_traffic_out / 1024));
+	buffer_append_int(b, (intmax_t)(p->ws.bytes_out / 1024));
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"Uptime\": "));
 	buffer_append_int(b, log_epoch_secs - srv->startup_ts);
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"BusyServers\": "));
-	buffer_append_int(b, srv->srvconf.max_conns - srv->lim_conns);
+	buffer_append_int(b, p->ws.conns_active);
 
 	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"IdleServers\": "));
-	buffer_append_int(b, srv->lim_conns); /*(could omit)*/
+	buffer_append_int(b, p->ws.conns_idle); /*(could omit)*/
+
+	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"FdCacheHits\": "));
+	buffer_append_int(b, (intmax_t)p->ws.fd_cache_hits);
+
+	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"FdCacheMisses\": "));
+	buffer_append_int(b, (intmax_t)p->ws.fd_cache_misses);
+
+	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"FdCacheOpen\": "));
+	buffer_append_int(b, p->ws.fd_cache_open);
+
+	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"MemCacheHits\": "));
+	buffer_append_int(b, (intmax_t)p->ws.mem_cache_hits);
+
+	buffer_append_string_len(b, CONST_STR_LEN(",\n\t\"MemCacheBytes\": "));
+	buffer_append_int(b, (intmax_t)p->ws.mem_cache_bytes);
 	buffer_append_string_len(b, CONST_STR_LEN(",\n"));
 
 	avg = p->requests_5s[0]
@@ -657,8 +718,10 @@ static handler_t mod_status_handle_server_statistics(request_st * const r) {
 	                         CONST_STR_LEN("Content-Type"),
 	                         CONST_STR_LEN("text/plain"));
 
-	const array * const st = &plugin_stats;
-	if (0 == st->used) {
+	/* sum of plugin_stats for all workers */
+	array st = { NULL, NULL, 0, 0 };
+	worker_stats_plugin_stats(&st);
+	if (0 == st.used) {
 		/* we have nothing to send */
 		r->http_status = 204;
 		r->resp_body_finished = 1;
@@ -666,13 +729,14 @@ static handler_t mod_status_handle_server_statistics(request_st * const r) {
 	}
 
 	buffer * const b = chunkqueue_append_buffer_open(&r->write_queue);
-	for (uint32_t i = 0; i < st->used; ++i) {
-		buffer_append_str2(b, BUF_PTR_LEN(&st->sorted[i]->key),
+	for (uint32_t i = 0; i < st.used; ++i) {
+		buffer_append_str2(b, BUF_PTR_LEN(&st.sorted[i]->key),
 		                      CONST_STR_LEN(": "));
-		buffer_append_int(b, ((data_integer *)st->sorted[i])->value);
+		buffer_append_int(b, ((data_integer *)st.sorted[i])->value);
 		buffer_append_char(b, '\n');
 	}
 	chunkqueue_append_buffer_commit(&r->write_queue);
+	array_free_data(&st);
 
 	r->http_status = 200;
 	r->resp_body_finished = 1;
@@ -681,8 +745,20 @@ static handler_t mod_status_handle_server_statistics(request_st * const r) {
 }
 
 
+static void mod_status_worker_stats(const server * const srv, plugin_data * const p) {
+	/* totals for all workers
+	 * (connection counts of other workers are updated once per second) */
+	worker_stats_sum(&p->ws);
+	p->ws.conns_active += (uint32_t)(srv->srvconf.max_conns - srv->lim_conns)
+	                    - worker_stats_self->conns_active;
+	p->ws.conns_idle   += (uint32_t)srv->lim_conns
+	                    - worker_stats_self->conns_idle;
+}
+
+
 static handler_t mod_status_handle_server_status(request_st * const r, plugin_data * const p) {
 	server * const srv = r->con->srv;
+	mod_status_worker_stats(srv, p);
 	if (buffer_is_equal_string(&r->uri.query, CONST_STR_LEN("auto"))) {
 		mod_status_handle_server_status_text(srv, r, p);
 	} else if (buffer_clen(&r->uri.query) >= sizeof("json")-1
@@ -699,6 +775,272 @@ static handler_t mod_status_handle_server_status(request_st * const r, plugin_da
 }
 
 
+static void mod_status_metrics_type(buffer * const b, const char * const name, const size_t nlen, const char * const type, const size_t tlen) {
+	buffer_append_str3(b, CONST_STR_LEN("# TYPE "), name, nlen,
+	                      CONST_STR_LEN(" "));
+	buffer_append_str2(b, type, tlen, CONST_STR_LEN("\n"));
+}
+
+
+static void mod_status_metrics_label(buffer * const b, const char * const k, const size_t klen, const char * const v, const size_t vlen) {
+	/* label value escaping: backslash, double-quote, line feed */
+	buffer_append_str2(b, k, klen, CONST_STR_LEN("=\""));
+	size_t j = 0;
+	for (size_t i = 0; i < vlen; ++i) {
+		const char *e;
+		switch (v[i]) {
+		  case '\\': e = "\\\\"; break;
+		  case '"':  e = "\\\""; break;
+		  case '\n': e = "\\n";  break;
+		  default:   continue;
+		}
+		buffer_append_str2(b, v+j, i-j, e, 2);
+		j = i+1;
+	}
+	buffer_append_string_len(b, v+j, vlen-j);
+	buffer_append_char(b, '"');
+}
+
+
+static void mod_status_metrics_seconds(buffer * const b, const uint64_t us) {
+	/* seconds with (up to) 6 decimal places; trailing zeros omitted */
+	buffer_append_int(b, (intmax_t)(us / 1000000));
+	uint32_t frac = (uint32_t)(us % 1000000);
+	if (0 == frac) return;
+	char d[8];
+	int n = 7;
+	d[0] = '.';
+	for (int i = 6; i > 0; --i, frac /= 10) d[i] = '0' + (frac % 10);
+	while (d[n-1] == '0') --n;
+	buffer_append_string_len(b, d, n);
+}
+
+
+static void mod_status_metrics_value(buffer * const b, const uint64_t v) {
+	buffer_append_char(b, ' ');
+	buffer_append_int(b, (intmax_t)v);
+	buffer_append_char(b, '\n');
+}
+
+
+static void mod_status_metrics_status(buffer * const b, const char * const name, const size_t nlen, const char * const label, const worker_stats_vhost * const vh, const uint64_t * const status) {
+	static const char codes[][6] = { "other","1xx","2xx","3xx","4xx","5xx" };
+	for (uint32_t i = 0; i < 6; ++i) {
+		buffer_append_str2(b, name, nlen, CONST_STR_LEN("{"));
+		if (vh) {
+			mod_status_metrics_label(b, label, strlen(label),
+			                         vh->name, vh->nlen);
+			buffer_append_char(b, ',');
+		}
+		mod_status_metrics_label(b, CONST_STR_LEN("code"),
+		                         codes[i], strlen(codes[i]));
+		buffer_append_char(b, '}');
+		mod_status_metrics_value(b, status[i]);
+	}
+}
+
+
+static void mod_status_metrics_hist(buffer * const b, const char * const name, const size_t nlen, const worker_stats_hist * const hist) {
+	mod_status_metrics_type(b, name, nlen, CONST_STR_LEN("histogram"));
+	uint64_t count = 0;
+	for (int i = 0; i < WORKER_STATS_HIST_BUCKETS; ++i) {
+		count += hist->count[i];
+		buffer_append_str2(b, name, nlen, CONST_STR_LEN("_bucket{le=\""));
+		if (i < WORKER_STATS_HIST_BUCKETS-1)
+			mod_status_metrics_seconds(b, worker_stats_hist_bounds[i]);
+		else
+			buffer_append_string_len(b, CONST_STR_LEN("+Inf"));
+		buffer_append_string_len(b, CONST_STR_LEN("\"}"));
+		mod_status_metrics_value(b, count);
+	}
+	buffer_append_str2(b, name, nlen, CONST_STR_LEN("_sum "));
+	mod_status_metrics_seconds(b, hist->sum_us);
+	buffer_append_char(b, '\n');
+	buffer_append_str2(b, name, nlen, CONST_STR_LEN("_count"));
+	mod_status_metrics_value(b, count);
+}
+
+
+static handler_t mod_status_handle_server_metrics(request_st * const r, plugin_data * const p) {
+	/* Prometheus text exposition format (version 0.0.4) */
+	server * const srv = r->con->srv;
+	mod_status_worker_stats(srv, p);
+	const worker_stats * const ws = &p->ws;
+
+	buffer * const b = chunkqueue_append_buffer_open(&r->write_queue);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_uptime_seconds"),
+	                           CONST_STR_LEN("gauge"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_uptime_seconds"));
+	mod_status_metrics_value(b, (uint64_t)(log_epoch_secs-srv->startup_ts));
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_workers"),
+	                           CONST_STR_LEN("gauge"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_workers"));
+	mod_status_metrics_value(b, worker_stats_nworkers());
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_connections_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_connections_total"));
+	mod_status_metrics_value(b, ws->conns);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_connections_active"),
+	                           CONST_STR_LEN("gauge"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_connections_active"));
+	mod_status_metrics_value(b, ws->conns_active);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_requests_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_requests_total"));
+	mod_status_metrics_value(b, ws->requests);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_responses_total"),
+	                           CONST_STR_LEN("counter"));
+	mod_status_metrics_status(b, CONST_STR_LEN("lighttpd_responses_total"),
+	                          NULL, NULL, ws->status);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_received_bytes_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_received_bytes_total"));
+	mod_status_metrics_value(b, ws->bytes_in);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_sent_bytes_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_sent_bytes_total"));
+	mod_status_metrics_value(b, ws->bytes_out);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_fd_cache_hits_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_fd_cache_hits_total"));
+	mod_status_metrics_value(b, ws->fd_cache_hits);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_fd_cache_misses_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_fd_cache_misses_total"));
+	mod_status_metrics_value(b, ws->fd_cache_misses);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_fd_cache_open"),
+	                           CONST_STR_LEN("gauge"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_fd_cache_open"));
+	mod_status_metrics_value(b, ws->fd_cache_open);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_mem_cache_hits_total"),
+	                           CONST_STR_LEN("counter"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_mem_cache_hits_total"));
+	mod_status_metrics_value(b, ws->mem_cache_hits);
+
+	mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_mem_cache_bytes"),
+	                           CONST_STR_LEN("gauge"));
+	buffer_append_string_len(b, CONST_STR_LEN("lighttpd_mem_cache_bytes"));
+	mod_status_metrics_value(b, ws->mem_cache_bytes);
+
+	mod_status_metrics_hist(b, CONST_STR_LEN("lighttpd_request_duration_seconds"),
+	                        ws->hist + WORKER_STATS_HIST_REQUEST);
+	mod_status_metrics_hist(b, CONST_STR_LEN("lighttpd_time_to_first_byte_seconds"),
+	                        ws->hist + WORKER_STATS_HIST_TTFB);
+	mod_status_metrics_hist(b, CONST_STR_LEN("lighttpd_backend_connect_duration_seconds"),
+	                        ws->hist + WORKER_STATS_HIST_CONNECT);
+
+	worker_stats_vhost *vhosts;
+	const uint32_t nvhosts = worker_stats_vhosts_sum(&vhosts);
+	static const struct {
+		const char *name;
+		uint32_t nlen;
+		uint32_t offset;
+	} vmetrics[] = {
+	  { CONST_STR_LEN("lighttpd_vhost_requests_total"),
+	    offsetof(worker_stats_vhost, requests) }
+	 ,{ CONST_STR_LEN("lighttpd_vhost_received_bytes_total"),
+	    offsetof(worker_stats_vhost, bytes_in) }
+	 ,{ CONST_STR_LEN("lighttpd_vhost_sent_bytes_total"),
+	    offsetof(worker_stats_vhost, bytes_out) }
+	};
+	for (uint32_t m = 0; nvhosts && m < sizeof(vmetrics)/sizeof(*vmetrics); ++m) {
+		mod_status_metrics_type(b, vmetrics[m].name, vmetrics[m].nlen,
+		                           CONST_STR_LEN("counter"));
+		for (uint32_t i = 0; i < nvhosts; ++i) {
+			buffer_append_str2(b, vmetrics[m].name, vmetrics[m].nlen,
+			                      CONST_STR_LEN("{"));
+			mod_status_metrics_label(b, CONST_STR_LEN("vhost"),
+			                         vhosts[i].name, vhosts[i].nlen);
+			buffer_append_char(b, '}');
+			mod_status_metrics_value(b, *(const uint64_t *)(const void *)
+			  ((const char *)(vhosts+i) + vmetrics[m].offset));
+		}
+	}
+	if (nvhosts)
+		mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_vhost_responses_total"),
+		                           CONST_STR_LEN("counter"));
+	for (uint32_t i = 0; i < nvhosts; ++i)
+		mod_status_metrics_status(b, CONST_STR_LEN("lighttpd_vhost_responses_total"),
+		                          "vhost", vhosts+i, vhosts[i].status);
+	free(vhosts);
+
+	/* per-backend (gw_proc) stats for mod_fastcgi, mod_proxy, mod_scgi, ... */
+	worker_stats_backend *backends;
+	const uint32_t nbackends = worker_stats_backends_sum(&backends);
+	static const struct {
+		const char *name;
+		uint32_t nlen;
+		uint32_t offset;
+	} bmetrics[] = {
+	  { CONST_STR_LEN("lighttpd_backend_requests_total"),
+	    offsetof(worker_stats_backend, requests) }
+	 ,{ CONST_STR_LEN("lighttpd_backend_received_bytes_total"),
+	    offsetof(worker_stats_backend, bytes_in) }
+	 ,{ CONST_STR_LEN("lighttpd_backend_sent_bytes_total"),
+	    offsetof(worker_stats_backend, bytes_out) }
+	};
+	for (uint32_t m = 0; nbackends && m < sizeof(bmetrics)/sizeof(*bmetrics); ++m) {
+		mod_status_metrics_type(b, bmetrics[m].name, bmetrics[m].nlen,
+		                           CONST_STR_LEN("counter"));
+		for (uint32_t i = 0; i < nbackends; ++i) {
+			buffer_append_str2(b, bmetrics[m].name, bmetrics[m].nlen,
+			                      CONST_STR_LEN("{"));
+			mod_status_metrics_label(b, CONST_STR_LEN("backend"),
+			                         backends[i].name, backends[i].nlen);
+			buffer_append_char(b, '}');
+			mod_status_metrics_value(b, *(const uint64_t *)(const void *)
+			  ((const char *)(backends+i) + bmetrics[m].offset));
+		}
+	}
+	if (nbackends)
+		mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_backend_responses_total"),
+		                           CONST_STR_LEN("counter"));
+	for (uint32_t i = 0; i < nbackends; ++i)
+		mod_status_metrics_status(b, CONST_STR_LEN("lighttpd_backend_responses_total"),
+		                          "backend", backends+i, backends[i].status);
+	free(backends);
+
+	/* plugin_stats, e.g. gw.backend.<host>.<proc>.connected (per backend) */
+	array st = { NULL, NULL, 0, 0 };
+	worker_stats_plugin_stats(&st);
+	if (st.used)
+		mod_status_metrics_type(b, CONST_STR_LEN("lighttpd_plugin_stats"),
+		                           CONST_STR_LEN("gauge"));
+	for (uint32_t i = 0; i < st.used; ++i) {
+		buffer_append_string_len(b, CONST_STR_LEN("lighttpd_plugin_stats{"));
+		mod_status_metrics_label(b, CONST_STR_LEN("name"),
+		                         BUF_PTR_LEN(&st.sorted[i]->key));
+		buffer_append_char(b, '}');
+		buffer_append_char(b, ' ');
+		buffer_append_int(b, ((data_integer *)st.sorted[i])->value);
+		buffer_append_char(b, '\n');
+	}
+	array_free_data(&st);
+
+	chunkqueue_append_buffer_commit(&r->write_queue);
+	http_header_response_set(r, HTTP_HEADER_CONTENT_TYPE,
+	                         CONST_STR_LEN("Content-Type"),
+	                         CONST_STR_LEN("text/plain; version=0.0.4; charset=utf-8"));
+
+	r->http_status = 200;
+	r->resp_body_finished = 1;
+
+	return HANDLER_FINISHED;
+}
+
+
 static void mod_status_row_append(buffer *b, const char *k, size_t klen, const char *v, size_t vlen)
 {
     struct const_iovec iov[] = {
@@ -808,6 +1150,9 @@ static handler_t mod_status_handler(request_st * const r, void *p_d) {
 	} else if (p->conf.statistics_url &&
 	    buffer_is_equal(p->conf.statistics_url, &r->uri.path)) {
 		return mod_status_handle_server_statistics(r);
+	} else if (p->conf.metrics_url &&
+	    buffer_is_equal(p->conf.metrics_url, &r->uri.path)) {
+		return mod_status_handle_server_metrics(r, p);
 	}
 
 	return HANDLER_GO_ON;
@@ -815,32 +1160,23 @@ static handler_t mod_status_handler(request_st * const r, void *p_d) {
 
 TRIGGER_FUNC(mod_status_trigger) {
     plugin_data * const p = p_d;
-
-    /* check all connections */
-    for (const connection *c = srv->conns; c; c = c->next)
-        p->bytes_written_1s += c->bytes_written_cur_second;
-
-    /* used in calculating sliding average */
-    p->traffic_out_5s[p->ndx_5s] = p->bytes_written_1s;
-    p->requests_5s   [p->ndx_5s] = p->requests_1s;
+    UNUSED(srv);
+
+    /* totals for all workers */
+    worker_stats ws;
+    worker_stats_sum(&ws);
+
+    /* used in calculating sliding average
+     * (skip initial totals, e.g. from prior instance of restarted worker) */
+    const int init = (0 == (p->trigger_traffic_out | p->trigger_requests));
+    p->traffic_out_5s[p->ndx_5s] =
+      init ? 0 : (off_t)(ws.bytes_out - p->trigger_traffic_out);
+    p->requests_5s   [p->ndx_5s] =
+      init ? 0 : (off_t)(ws.requests - p->trigger_requests);
     if (++p->ndx_5s == 5) p->ndx_5s = 0;
 
-    p->abs_traffic_out += p->bytes_written_1s;
-    p->abs_requests += p->requests_1s;
-
-    p->bytes_written_1s = 0;
-    p->requests_1s = 0;
-
-    return HANDLER_GO_ON;
-}
-
-REQUESTDONE_FUNC(mod_status_account) {
-    plugin_data * const p = p_d;
-    const connection * const con = r->con;
-
-    ++p->requests_1s;
-    if (r == &con->request) /*(HTTP/1.x or only HTTP/2 stream 0)*/
-        p->bytes_written_1s += con->bytes_written_cur_second;
+    p->trigger_traffic_out = ws.bytes_out;
+    p->trigger_requests = ws.requests;
 
     return HANDLER_GO_ON;
 }
@@ -858,7 +1194,6 @@ int mod_status_plugin_init(plugin *p) {
 
 	p->handle_uri_clean    = mod_status_handler;
 	p->handle_trigger      = mod_status_trigger;
-	p->handle_request_done = mod_status_account;
 
 	return 0;
 }
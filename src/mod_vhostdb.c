@@ -15,14 +15,14 @@
 #include "plugin_config.h"
 #include "log.h"
 #include "stat_cache.h"
-#include "algo_splaytree.h"
+#include "algo_hashtab.h"
 
 /**
  * vhostdb framework
  */
 
 typedef struct {
-    splay_tree *sptree; /* data in nodes of tree are (vhostdb_cache_entry *) */
+    hashtab ht;         /* data in table is (vhostdb_cache_entry *) */
     time_t max_age;
 } vhostdb_cache;
 
@@ -63,7 +63,7 @@ vhostdb_cache_entry_init (const buffer * const server_name, const buffer * const
 }
 
 static void
-vhostdb_cache_entry_free (vhostdb_cache_entry *ve)
+vhostdb_cache_entry_free (void *ve)
 {
     free(ve);
 }
@@ -71,19 +71,14 @@ vhostdb_cache_entry_free (vhostdb_cache_entry *ve)
 static void
 vhostdb_cache_free (vhostdb_cache *vc)
 {
-    splay_tree *sptree = vc->sptree;
-    while (sptree) {
-        vhostdb_cache_entry_free(sptree->data);
-        sptree = splaytree_delete_splayed_node(sptree);
-    }
+    hashtab_clear(&vc->ht, vhostdb_cache_entry_free);
     free(vc);
 }
 
 static vhostdb_cache *
 vhostdb_cache_init (const array *opts)
 {
-    vhostdb_cache *vc = ck_malloc(sizeof(vhostdb_cache));
-    vc->sptree = NULL;
+    vhostdb_cache *vc = ck_calloc(1, sizeof(vhostdb_cache));
     vc->max_age = 600; /* 10 mins */
     for (uint32_t i = 0, used = opts->used; i < used; ++i) {
         data_unset *du = opts->data[i];
@@ -97,11 +92,9 @@ vhostdb_cache_init (const array *opts)
 static vhostdb_cache_entry *
 mod_vhostdb_cache_query (request_st * const r, plugin_data * const p)
 {
-    const int ndx = splaytree_djbhash(BUF_PTR_LEN(&r->uri.authority));
-    splay_tree ** const sptree = &p->conf.vhostdb_cache->sptree;
-    *sptree = splaytree_splay(*sptree, ndx);
+    const uint32_t ndx = hashtab_hash(BUF_PTR_LEN(&r->uri.authority));
     vhostdb_cache_entry * const ve =
-      (*sptree && (*sptree)->key == ndx) ? (*sptree)->data : NULL;
+      hashtab_find(&p->conf.vhostdb_cache->ht, ndx);
 
     return ve
         && buffer_is_equal_string(&r->uri.authority, ve->server_name, ve->slen)
@@ -112,17 +105,10 @@ mod_vhostdb_cache_query (request_st * const r, plugin_data * const p)
 static void
 mod_vhostdb_cache_insert (request_st * const r, plugin_data * const p, vhostdb_cache_entry * const ve)
 {
-    const int ndx = splaytree_djbhash(BUF_PTR_LEN(&r->uri.authority));
-    splay_tree ** const sptree = &p->conf.vhostdb_cache->sptree;
-    /*(not necessary to re-splay (with current usage) since single-threaded
-     * and splaytree has not been modified since mod_vhostdb_cache_query())*/
-    /* *sptree = splaytree_splay(*sptree, ndx); */
-    if (NULL == *sptree || (*sptree)->key != ndx)
-        *sptree = splaytree_insert_splayed(*sptree, ndx, ve);
-    else { /* collision; replace old entry */
-        vhostdb_cache_entry_free((*sptree)->data);
-        (*sptree)->data = ve;
-    }
+    const uint32_t ndx = hashtab_hash(BUF_PTR_LEN(&r->uri.authority));
+    void * const prev = hashtab_insert(&p->conf.vhostdb_cache->ht, ndx, ve);
+    if (prev) /* collision; replace old entry */
+        vhostdb_cache_entry_free(prev);
 }
 
 INIT_FUNC(mod_vhostdb_init) {
@@ -316,40 +302,28 @@ REQUEST_FUNC(mod_vhostdb_handle_docroot) {
     return mod_vhostdb_found(r, ve); /* HANDLER_GO_ON */
 }
 
-/* walk though cache, collect expired ids, and remove them in a second loop */
-static void
-mod_vhostdb_tag_old_entries (splay_tree * const t, int * const keys, int * const ndx, const time_t max_age, const unix_time64_t cur_ts)
+typedef struct mod_vhostdb_age_arg {
+    unix_time64_t cur_ts;
+    time_t max_age;
+} mod_vhostdb_age_arg;
+
+static int
+mod_vhostdb_old_entry (void *data, void *arg)
 {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)
-        mod_vhostdb_tag_old_entries(t->left, keys, ndx, max_age, cur_ts);
-    if (t->right)
-        mod_vhostdb_tag_old_entries(t->right, keys, ndx, max_age, cur_ts);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-
-    const vhostdb_cache_entry * const ve = t->data;
-    if (cur_ts - ve->ctime > max_age)
-        keys[(*ndx)++] = t->key;
+    const vhostdb_cache_entry * const ve = data;
+    const mod_vhostdb_age_arg * const a = arg;
+    if (a->cur_ts - ve->ctime <= a->max_age)
+        return 0;
+    vhostdb_cache_entry_free(data);
+    return 1;
 }
 
 __attribute_noinline__
 static void
-mod_vhostdb_periodic_cleanup(splay_tree **sptree_ptr, const time_t max_age, const unix_time64_t cur_ts)
+mod_vhostdb_periodic_cleanup(hashtab * const ht, const time_t max_age, const unix_time64_t cur_ts)
 {
-    splay_tree *sptree = *sptree_ptr;
-    int max_ndx, i;
-    int keys[8192]; /* 32k size on stack */
-    do {
-        if (!sptree) break;
-        max_ndx = 0;
-        mod_vhostdb_tag_old_entries(sptree, keys, &max_ndx, max_age, cur_ts);
-        for (i = 0; i < max_ndx; ++i) {
-            sptree = splaytree_splay_nonnull(sptree, keys[i]);
-            vhostdb_cache_entry_free(sptree->data);
-            sptree = splaytree_delete_splayed_node(sptree);
-        }
-    } while (max_ndx == sizeof(keys)/sizeof(int));
-    *sptree_ptr = sptree;
+    mod_vhostdb_age_arg a = { cur_ts, max_age };
+    hashtab_sweep(ht, mod_vhostdb_old_entry, &a);
 }
 
 TRIGGER_FUNC(mod_vhostdb_periodic)
@@ -369,7 +343,7 @@ TRIGGER_FUNC(mod_vhostdb_periodic)
             if (cpv->k_id != 1) continue; /* k_id == 1 for vhostdb.cache */
             if (cpv->vtype != T_CONFIG_LOCAL) continue;
             vhostdb_cache *vc = cpv->v.v;
-            mod_vhostdb_periodic_cleanup(&vc->sptree, vc->max_age, cur_ts);
+            mod_vhostdb_periodic_cleanup(&vc->ht, vc->max_age, cur_ts);
         }
     }
 
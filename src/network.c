@@ -32,6 +32,18 @@
 
 static int network_mptcp = 0;
 
+/* SO_REUSEPORT on Linux (3.9+) and SO_REUSEPORT_LB on FreeBSD (12+) balance
+ * new connections between listen sockets bound to the same address */
+#if defined(SO_REUSEPORT_LB)
+#define NETWORK_SO_REUSEPORT SO_REUSEPORT_LB
+#elif defined(SO_REUSEPORT) && (defined(__linux__) || defined(__DragonFly__))
+#define NETWORK_SO_REUSEPORT SO_REUSEPORT
+#endif
+
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#endif
+
 void
 network_accept_tcp_nagle_disable (const int fd)
 {
@@ -309,6 +321,7 @@ typedef struct {
     unsigned char defer_accept;
     int8_t v4mapped;
     int8_t ip_transparent;
+    unsigned char reuseport;
     const buffer *socket_perms;
     const buffer *bsd_accept_filter;
 } network_socket_config;
@@ -348,6 +361,9 @@ static void network_merge_config_cpv(network_socket_config * const pconf, const
       case 8: /* server.ip-transparent */
         pconf->ip_transparent = (0 != cpv->v.u);
         break;
+      case 9: /* server.reuseport */
+        pconf->reuseport = (0 != cpv->v.u);
+        break;
       default:/* should not happen */
         return;
     }
@@ -385,6 +401,139 @@ static void network_srv_socket_init_token (server_socket * const srv_socket, con
         srv_socket->srv_token_colon = network_srv_token_colon(srv_token);
 }
 
+#ifdef NETWORK_SO_REUSEPORT
+
+__attribute_cold__
+static int network_server_socket_reuseport(server * const srv, const server_socket * const srv_socket, const network_socket_config * const s, const socklen_t addr_len) {
+	/* create additional listen socket with the same address and socket
+	 * options as srv_socket (which must already be listening) */
+	const int family = sock_addr_get_family(&srv_socket->addr);
+	int opt;
+	socklen_t optlen = sizeof(opt);
+	int proto = IPPROTO_TCP;
+  #ifdef SO_PROTOCOL /* (e.g. IPPROTO_MPTCP) */
+	if (0 == getsockopt(srv_socket->fd, SOL_SOCKET, SO_PROTOCOL, &opt, &optlen))
+		proto = opt;
+  #endif
+	const int fd = fdevent_socket_nb_cloexec(family, SOCK_STREAM, proto);
+	if (-1 == fd) {
+		log_serror(srv->errh, __FILE__, __LINE__, "socket()");
+		return -1;
+	}
+	srv->cur_fds = fd;
+
+  #ifdef HAVE_IPV6
+	optlen = sizeof(opt);
+	if (AF_INET6 == family
+	    && 0 == getsockopt(srv_socket->fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, &optlen))
+		(void)setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
+  #endif
+  #if defined(__linux__) && defined(IP_TRANSPARENT)
+	if (s->ip_transparent) {
+		opt = 1;
+		if (AF_INET == family)
+			(void)setsockopt(fd, IPPROTO_IP, IP_TRANSPARENT, &opt, sizeof(opt));
+	  #if defined(HAVE_IPV6) && defined(IPV6_TRANSPARENT)
+		else if (AF_INET6 == family)
+			(void)setsockopt(fd, IPPROTO_IPV6, IPV6_TRANSPARENT, &opt, sizeof(opt));
+	  #endif
+	}
+  #endif
+
+	opt = 1;
+	if (fdevent_set_so_reuseaddr(fd, 1) < 0
+	    || -1 == setsockopt(fd, SOL_SOCKET, NETWORK_SO_REUSEPORT, &opt, sizeof(opt))
+	    || fdevent_set_tcp_nodelay(fd, 1) < 0) {
+		log_serror(srv->errh, __FILE__, __LINE__, "setsockopt()");
+		fdio_close_socket(fd);
+		return -1;
+	}
+
+	if (0 != bind(fd, (struct sockaddr *) &(srv_socket->addr), addr_len)) {
+		log_serror(srv->errh, __FILE__, __LINE__,
+		  "bind() %s", srv_socket->srv_token->ptr);
+		fdio_close_socket(fd);
+		return -1;
+	}
+
+	if (-1 == listen(fd, s->listen_backlog)) {
+		log_serror(srv->errh, __FILE__, __LINE__, "listen()");
+		fdio_close_socket(fd);
+		return -1;
+	}
+
+  #ifdef TCP_DEFER_ACCEPT
+	if (!s->ssl_enabled && s->defer_accept) {
+		opt = s->defer_accept;
+		(void)setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opt, sizeof(opt));
+	}
+  #endif
+
+	return fd;
+}
+
+__attribute_cold__
+static int network_server_init_reuseport(server * const srv, server_socket * const srv_socket, const network_socket_config * const s, const socklen_t addr_len) {
+	/* server.reuseport: one listen socket per worker so that the kernel
+	 * balances new connections between workers (instead of waking all
+	 * workers listening on the same socket).  Sockets are created here,
+	 * prior to dropping privileges; srv_socket->fd is used by first worker.
+	 * The parent process keeps all listen sockets open, so connections
+	 * queued on a socket are accepted by the replacement if a worker exits.
+	 * (If server.max-worker is later increased with graceful restart,
+	 *  additional workers share the existing listen sockets) */
+	const uint32_t n = (uint32_t)srv->srvconf.max_worker - 1;
+	if (0 == n || NULL != srv_socket->wkr_fds) return 0;
+	srv_socket->wkr_fds = ck_malloc(n * sizeof(*srv_socket->wkr_fds));
+	for (uint32_t i = 0; i < n; ++i) {
+		const int fd = network_server_socket_reuseport(srv, srv_socket, s, addr_len);
+		if (-1 == fd) return -1;
+		srv_socket->wkr_fds[srv_socket->wkr_nfds++] = fd;
+	}
+
+  #if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+	if (config_feature_bool(srv, "server.reuseport-cpu", 0)) {
+		/* steer new connection to listen socket (worker) by index of CPU
+		 * handling the connection, modulo number of listen sockets
+		 * (most effective when workers are pinned to CPUs) */
+		struct sock_filter code[] = {
+		  { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+		  { BPF_ALU | BPF_MOD | BPF_K, 0, 0, n + 1 },
+		  { BPF_RET | BPF_A,           0, 0, 0 }
+		};
+		struct sock_fprog prog = { sizeof(code)/sizeof(*code), code };
+		if (-1 == setsockopt(srv_socket->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)))
+			log_serror(srv->errh, __FILE__, __LINE__,
+			  "setsockopt(SO_ATTACH_REUSEPORT_CBPF)");
+	}
+  #endif
+
+	return 0;
+}
+
+#endif /* NETWORK_SO_REUSEPORT */
+
+void network_socket_worker(server *srv, int wkr) {
+	/* select listen socket for worker and close listen sockets of others
+	 * (wkr is index of worker; 0 if not using workers) */
+	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
+		server_socket * const srv_socket = srv->srv_sockets.ptr[i];
+		if (NULL == srv_socket->wkr_fds) continue;
+		const uint32_t n = (uint32_t)wkr % (srv_socket->wkr_nfds + 1);
+		for (uint32_t j = 0; j < srv_socket->wkr_nfds; ++j) {
+			if (j + 1 != n)
+				fdio_close_socket(srv_socket->wkr_fds[j]);
+		}
+		if (n) {
+			fdio_close_socket(srv_socket->fd);
+			srv_socket->fd = srv_socket->wkr_fds[n-1];
+		}
+		free(srv_socket->wkr_fds);
+		srv_socket->wkr_fds = NULL;
+		srv_socket->wkr_nfds = 0;
+	}
+}
+
 static int network_server_init(server *srv, const network_socket_config *s, buffer *host_token, size_t sidx, int stdin_fd) {
 	server_socket *srv_socket;
 	const char *host;
@@ -628,6 +777,22 @@ static int network_server_init(server *srv, const network_socket_config *s, buff
 		return -1;
 	}
 
+  #ifdef NETWORK_SO_REUSEPORT
+	const int reuseport = (s->reuseport && family != AF_UNIX
+	                       && -1 == stdin_fd && srv->srvconf.max_worker);
+	if (reuseport) {
+		int opt = 1;
+		if (-1 == setsockopt(srv_socket->fd, SOL_SOCKET, NETWORK_SO_REUSEPORT, &opt, sizeof(opt))) {
+			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(SO_REUSEPORT)");
+			return -1;
+		}
+	}
+  #else
+	if (s->reuseport)
+		log_warn(srv->errh, __FILE__, __LINE__,
+		  "server.reuseport not supported on this platform; ignored");
+  #endif
+
 	if (family != AF_UNIX) {
 		if (fdevent_set_tcp_nodelay(srv_socket->fd, 1) < 0) {
 			log_serror(srv->errh, __FILE__, __LINE__, "setsockopt(TCP_NODELAY)");
@@ -663,6 +828,11 @@ static int network_server_init(server *srv, const network_socket_config *s, buff
 		return -1;
 	}
 
+  #ifdef NETWORK_SO_REUSEPORT
+	if (reuseport && 0 != network_server_init_reuseport(srv, srv_socket, s, addr_len))
+		return -1;
+  #endif
+
 	if (s->ssl_enabled) {
 	}
 #ifdef TCP_DEFER_ACCEPT
@@ -703,6 +873,9 @@ int network_close(server *srv) {
 			network_unregister_sock(srv, srv_socket);
 			fdio_close_socket(srv_socket->fd);
 		}
+		for (uint32_t j = 0; j < srv_socket->wkr_nfds; ++j)
+			fdio_close_socket(srv_socket->wkr_fds[j]);
+		free(srv_socket->wkr_fds);
 
 		buffer_free(srv_socket->srv_token);
 
@@ -847,6 +1020,9 @@ int network_init(server *srv, int stdin_fd) {
      ,{ CONST_STR_LEN("server.ip-transparent"),
         T_CONFIG_BOOL,
         T_CONFIG_SCOPE_SOCKET }
+     ,{ CONST_STR_LEN("server.reuseport"),
+        T_CONFIG_BOOL,
+        T_CONFIG_SCOPE_SOCKET }
      ,{ NULL, 0,
         T_CONFIG_UNSET,
         T_CONFIG_SCOPE_UNSET }
@@ -1011,8 +1187,14 @@ int network_register_fdevents(server *srv) {
 		return -1;
 	}
 
+	network_write_register_fdevents(srv);
+
 	if (srv->sockets_disabled) return 0; /* lighttpd -1 (one-shot mode) */
 
+	/*(close additional server.reuseport listen sockets if not using workers;
+	 * no-op in workers, where network_socket_worker() was already called)*/
+	network_socket_worker(srv, 0);
+
 	/* register fdevents after reset */
 	for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
 		server_socket *srv_socket = srv->srv_sockets.ptr[i];
@@ -5,6 +5,7 @@
 #include "base.h"
 #include "ck.h"
 #include "log.h"
+#include "plugin_config.h" /* config_feature_bool() */
 
 #include <sys/types.h>
 #include "sys-socket.h"
@@ -12,6 +13,9 @@
 
 #include <errno.h>
 #include <string.h>
+#ifdef HAVE_SPLICE
+#include <fcntl.h>      /* splice() */
+#endif
 
 
 /* on linux 2.4.x you get either sendfile or LFS */
@@ -69,6 +73,11 @@
 #endif
 */
 
+#if defined(NETWORK_WRITE_USE_LINUX_SENDFILE) \
+ && defined(HAVE_CHUNK_FILE_READAHEAD)
+# define NETWORK_WRITE_USE_IO_URING
+#endif
+
 #if defined HAVE_SYS_UIO_H && defined HAVE_WRITEV
 # define NETWORK_WRITE_USE_WRITEV
 #endif
@@ -309,6 +318,23 @@ static int network_writev_mem_chunks(const int fd, chunkqueue * const cq, off_t
 
 
 
+#ifdef HAVE_SPLICE
+/* next chunk must be PIPE_CHUNK. splice() from pipe to socket */
+static int network_write_pipe_chunk(const int fd, chunkqueue * const cq, off_t * const p_max_bytes, log_error_st * const errh) {
+    chunk* const c = cq->first;
+    off_t toSend = c->file.length - c->offset;
+    if (toSend > *p_max_bytes) toSend = *p_max_bytes;
+    if (toSend <= 0) return network_remove_finished_chunks(cq, toSend);
+
+    ssize_t wr = splice(c->file.fd, NULL, fd, NULL, (size_t)toSend,
+                        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    return network_write_accounting(fd, cq, p_max_bytes, errh, wr, toSend);
+}
+#endif
+
+
+
+
 #if defined(NETWORK_WRITE_USE_SENDFILE)
 
 #if defined(NETWORK_WRITE_USE_LINUX_SENDFILE) \
@@ -570,6 +596,11 @@ static int network_write_chunkqueue_writev(const int fd, chunkqueue * const cq,
             rc = network_write_file_chunk_no_mmap(fd, cq, &max_bytes, errh);
           #endif
             break;
+        case PIPE_CHUNK:
+          #ifdef HAVE_SPLICE
+            rc = network_write_pipe_chunk(fd, cq, &max_bytes, errh);
+          #endif
+            break;
         }
 
         if (__builtin_expect( (0 != rc), 0)) return (-3 == rc) ? 0 : rc;
@@ -605,6 +636,11 @@ static int network_write_chunkqueue_sendfile(const int fd, chunkqueue * const cq
             rc = network_write_file_chunk_no_mmap(fd, cq, &max_bytes, errh);
           #endif
             break;
+        case PIPE_CHUNK:
+          #ifdef HAVE_SPLICE
+            rc = network_write_pipe_chunk(fd, cq, &max_bytes, errh);
+          #endif
+            break;
         }
       #endif
 
@@ -615,12 +651,68 @@ static int network_write_chunkqueue_sendfile(const int fd, chunkqueue * const cq
 }
 #endif
 
+#if defined(NETWORK_WRITE_USE_IO_URING)
+static int network_write_file_chunk_readahead(const int fd, chunkqueue * const cq, off_t * const p_max_bytes, log_error_st * const errh) {
+    chunk * const c = cq->first;
+    if (c->file.fd < 0 && 0 != chunk_open_file_chunk(c, errh)) return -1;
+    /* yield if file data not in page cache; read asynchronously into cache
+     * (connection is resumed when read completes) instead of blocking
+     * server process in sendfile() */
+    if (chunk_file_readahead(c, *p_max_bytes)) return -3;
+    return network_write_file_chunk_sendfile(fd, cq, p_max_bytes, errh);
+}
+
+static int network_write_chunkqueue_uring(const int fd, chunkqueue * const cq, off_t max_bytes, log_error_st * const errh) {
+    while (NULL != cq->first) {
+        int rc = -1;
+
+        switch (cq->first->type) {
+        case MEM_CHUNK:
+            /*(non-blocking socket; writev() does not block on disk I/O)*/
+            rc = network_writev_mem_chunks(fd, cq, &max_bytes, errh);
+            break;
+        case FILE_CHUNK:
+            rc = network_write_file_chunk_readahead(fd, cq, &max_bytes, errh);
+            break;
+        case PIPE_CHUNK:
+          #ifdef HAVE_SPLICE
+            rc = network_write_pipe_chunk(fd, cq, &max_bytes, errh);
+          #endif
+            break;
+        }
+
+        if (__builtin_expect( (0 != rc), 0)) return (-3 == rc) ? 0 : rc;
+    }
+
+    return 0;
+}
+#endif
+
+static int network_write_uring;
+
+__attribute_cold__
+void network_write_register_fdevents(server *srv) {
+    /* async read-ahead of file data into page cache; enabled by default with
+     * server.network-backend = "io_uring", but also usable by other network
+     * backends and TLS modules which read file data with preadv2 RWF_NOWAIT*/
+  #ifdef HAVE_CHUNK_FILE_READAHEAD
+    if (config_feature_bool(srv, "chunkqueue.aio", network_write_uring)
+        && 0 != chunkqueue_internal_aio(srv->ev, 1)) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "io_uring setup failed; file reads might block");
+    }
+  #else
+    UNUSED(srv);
+  #endif
+}
+
 int network_write_init(server *srv) {
     typedef enum {
         NETWORK_BACKEND_UNSET,
         NETWORK_BACKEND_WRITE,
         NETWORK_BACKEND_WRITEV,
         NETWORK_BACKEND_SENDFILE,
+        NETWORK_BACKEND_IO_URING,
     } network_backend_t;
 
     network_backend_t backend;
@@ -634,6 +726,8 @@ int network_write_init(server *srv) {
         { NETWORK_BACKEND_SENDFILE, "linux-sendfile" },
         { NETWORK_BACKEND_SENDFILE, "freebsd-sendfile" },
         { NETWORK_BACKEND_SENDFILE, "solaris-sendfilev" },
+        { NETWORK_BACKEND_IO_URING, "io_uring" },
+        { NETWORK_BACKEND_IO_URING, "linux-io_uring" },
         { NETWORK_BACKEND_WRITEV,   "writev" },
         { NETWORK_BACKEND_WRITE,    "write" },
         { NETWORK_BACKEND_UNSET,    NULL }
@@ -658,7 +752,18 @@ int network_write_init(server *srv) {
         }
     }
 
+    network_write_uring = 0;
     switch(backend) {
+    case NETWORK_BACKEND_IO_URING:
+      #if defined(NETWORK_WRITE_USE_IO_URING)
+        srv->network_backend_write = network_write_chunkqueue_uring;
+        network_write_uring = 1;
+        break;
+      #else
+        log_error(srv->errh, __FILE__, __LINE__,
+          "server.network-backend \"io_uring\" not available");
+        __attribute_fallthrough__
+      #endif
     case NETWORK_BACKEND_SENDFILE:
       #if defined(NETWORK_WRITE_USE_SENDFILE)
         srv->network_backend_write = network_write_chunkqueue_sendfile;
@@ -698,6 +803,11 @@ const char * network_write_show_handlers(void) {
      #else
       "\t- solaris-sendfilev\n"
      #endif
+     #if defined NETWORK_WRITE_USE_IO_URING
+      "\t+ io_uring\n"
+     #else
+      "\t- io_uring\n"
+     #endif
      #if defined NETWORK_WRITE_USE_WRITEV
       "\t+ writev\n"
      #else
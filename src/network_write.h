@@ -6,6 +6,9 @@
 __attribute_cold__
 int network_write_init(server *srv);
 
+__attribute_cold__
+void network_write_register_fdevents(server *srv);
+
 __attribute_cold__
 __attribute_const__
 __attribute_returns_nonnull__
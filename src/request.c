@@ -20,6 +20,30 @@
 #include <string.h>
 
 
+int request_timing;
+
+const char * const request_timing_names[REQ_TIMING_MAX] = {
+  "start"
+ ,"headers"
+ ,"handler"
+ ,"backend"
+ ,"firstbyte"
+ ,"lastbyte"
+};
+
+uint64_t
+request_timing_ns (void)
+{
+    unix_timespec64_t ts;
+  #if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    log_clock_gettime(CLOCK_MONOTONIC, &ts);
+  #else
+    log_clock_gettime_realtime(&ts);
+  #endif
+    return (uint64_t)ts.tv_sec * 1000000000uLL + (uint64_t)ts.tv_nsec;
+}
+
+
 __attribute_cold__
 __attribute_noinline__
 void
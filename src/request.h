@@ -121,6 +121,18 @@ typedef enum {
     CON_STATE_CLOSE
 } request_state_t;
 
+/* request phase timestamps (monotonic nsec; recorded if request_timing) */
+/* NB: must sync with request_timing_names[] */
+typedef enum {
+    REQ_TIMING_START,       /* first byte of request received */
+    REQ_TIMING_HEADERS,     /* request headers parsed */
+    REQ_TIMING_HANDLER,     /* handler selected */
+    REQ_TIMING_BACKEND,     /* backend connected */
+    REQ_TIMING_RESP_START,  /* first response byte written */
+    REQ_TIMING_RESP_END,    /* last response byte written */
+    REQ_TIMING_MAX
+} request_timing_t;
+
 struct request_st {
     request_state_t state; /*(modules should not modify request state)*/
     int http_status;
@@ -198,6 +210,7 @@ struct request_st {
     response_dechunk *gw_dechunk;
 
     unix_timespec64_t start_hp;
+    uint64_t timing[REQ_TIMING_MAX]; /* (set if request_timing enabled) */
 
     int error_handler_saved_status; /* error-handler */
     http_method_t error_handler_saved_method; /* error-handler */
@@ -304,6 +317,29 @@ typedef struct hxcon {
    ((r)->write_queue.bytes_out          \
     - ((r)->http_version > HTTP_VERSION_1_1 ? 0 : (r)->x.h1.bytes_written_ckpt))
 
+/* record request phase timestamps (enabled at startup, before forking) */
+extern int request_timing;
+extern const char * const request_timing_names[REQ_TIMING_MAX];
+
+uint64_t request_timing_ns (void);
+
+#define request_timing_set(r, phase) \
+  do { if (request_timing) (r)->timing[(phase)] = request_timing_ns(); \
+  } while (0)
+
+#define request_timing_start(r)                                     \
+  do { if (request_timing) {                                        \
+         memset((r)->timing, 0, sizeof((r)->timing));               \
+         (r)->timing[REQ_TIMING_START] = request_timing_ns(); }     \
+  } while (0)
+
+/* nsec elapsed from request start until phase (0 if phase not reached) */
+#define request_timing_elapsed(r, phase)                             \
+  ((r)->timing[(phase)] > (r)->timing[REQ_TIMING_START]              \
+   && (r)->timing[REQ_TIMING_START]                                  \
+   ? (r)->timing[(phase)] - (r)->timing[REQ_TIMING_START]            \
+   : 0)
+
 __attribute_pure__
 const char * http_request_state_short (request_state_t state);
 
@@ -397,7 +397,10 @@ http_response_prepare (request_st * const r)
 			}
 	}
 
-	if (NULL != r->handler_module) return HANDLER_GO_ON;
+	if (NULL != r->handler_module) {
+		request_timing_set(r, REQ_TIMING_HANDLER);
+		return HANDLER_GO_ON;
+	}
 
 		/* check if r->physical.path exists in the filesystem */
 		rc = http_response_physical_path_check(r);
@@ -417,6 +420,7 @@ http_response_prepare (request_st * const r)
 
 		/* request handler selection */
 		rc = plugins_call_handle_subrequest_start(r);
+		request_timing_set(r, REQ_TIMING_HANDLER);
 		if (HANDLER_GO_ON != rc) return rc;
 
 		if (NULL != r->handler_module) return HANDLER_GO_ON;
@@ -18,6 +18,7 @@
 #include "network_write.h"  /* network_write_show_handlers() */
 #include "reqpool.h"        /* request_pool_init() request_pool_free() */
 #include "response.h"       /* http_dispatch[] strftime_cache_reset() */
+#include "worker_stats.h"
 
 #ifdef HAVE_VERSIONSTAMP_H
 # include "versionstamp.h"
@@ -47,6 +48,15 @@ static const buffer default_server_tag =
 
 #include <stdio.h>
 
+#ifdef __linux__
+#include <sched.h>      /* sched_setaffinity() */
+#include <dirent.h>
+#include <sys/syscall.h>
+#ifdef CPU_SETSIZE
+#define SERVER_CPU_AFFINITY
+#endif
+#endif
+
 #ifdef HAVE_GETOPT_H
 # include <getopt.h>
 #else
@@ -1090,6 +1100,9 @@ static void server_sockets_close (server *srv) {
     if (3 == srv->sockets_disabled) return;
     for (uint32_t i = 0; i < srv->srv_sockets.used; ++i) {
         server_socket *srv_socket = srv->srv_sockets.ptr[i];
+        for (uint32_t j = 0; j < srv_socket->wkr_nfds; ++j)
+            fdio_close_socket(srv_socket->wkr_fds[j]);
+        srv_socket->wkr_nfds = 0;
         if (-1 == srv_socket->fd) continue;
         if (2 != srv->sockets_disabled) network_unregister_sock(srv,srv_socket);
         fdio_close_socket(srv_socket->fd);
@@ -1318,6 +1331,158 @@ static void server_load_check (server *srv) {
         server_sockets_disable(srv);
 }
 
+#ifdef SERVER_CPU_AFFINITY
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+static struct server_cpu_affinity_set {
+    cpu_set_t cpus;
+    int node;     /* NUMA node of all CPUs in set; -1 if none or mixed */
+} *server_cpu_sets;
+static uint32_t server_cpu_nsets;
+
+__attribute_cold__
+static int server_cpu_affinity_node (const int cpu) {
+    /* /sys/devices/system/cpu/cpuN/nodeM -> ../../node/nodeM */
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR * const dir = opendir(path);
+    if (NULL == dir) return -1;
+    int node = -1;
+    for (struct dirent *ep; (ep = readdir(dir)); ) {
+        if (0 == strncmp(ep->d_name, "node", 4)
+            && light_isdigit(ep->d_name[4])) {
+            node = (int)strtol(ep->d_name+4, NULL, 10);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+__attribute_cold__
+static int server_cpu_affinity_parse (cpu_set_t * const cpus, const char *s) {
+    /* CPU list, e.g. "0", "2-3", "0-3,8-11" */
+    CPU_ZERO(cpus);
+    do {
+        char *e;
+        if (!light_isdigit(*s)) return -1;
+        unsigned long lo = strtoul(s, &e, 10), hi = lo;
+        if (*e == '-') {
+            if (!light_isdigit(e[1])) return -1;
+            hi = strtoul(e+1, &e, 10);
+        }
+        if (lo > hi || hi >= CPU_SETSIZE) return -1;
+        for (; lo <= hi; ++lo) CPU_SET((int)lo, cpus);
+        s = e;
+    } while (*s++ == ','); /*(digit required after ',')*/
+    return (s[-1] == '\0') ? 0 : -1;
+}
+
+__attribute_cold__
+static int server_cpu_affinity_init (server * const srv) {
+    free(server_cpu_sets);
+    server_cpu_sets = NULL;
+    server_cpu_nsets = 0;
+
+    const array * const a = srv->srvconf.cpu_affinity;
+    if (NULL == a) return 0;
+    struct server_cpu_affinity_set *sets;
+
+    if (1 == a->used
+        && buffer_eq_slen(&((data_string *)a->data[0])->value,
+                          CONST_STR_LEN("auto"))) {
+        /* pin each worker to a single CPU from the CPUs available at start */
+        cpu_set_t avail;
+        if (0 != sched_getaffinity(0, sizeof(avail), &avail)) {
+            log_perror(srv->errh, __FILE__, __LINE__, "sched_getaffinity()");
+            return -1;
+        }
+        const uint32_t n = (uint32_t)CPU_COUNT(&avail);
+        if (0 == n) return 0;
+        sets = ck_calloc(n, sizeof(*sets));
+        for (int cpu = 0; server_cpu_nsets < n && cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &avail)) continue;
+            CPU_ZERO(&sets[server_cpu_nsets].cpus);
+            CPU_SET(cpu, &sets[server_cpu_nsets].cpus);
+            ++server_cpu_nsets;
+        }
+    }
+    else {
+        sets = ck_calloc(a->used, sizeof(*sets));
+        for (uint32_t i = 0; i < a->used; ++i) {
+            const buffer * const b = &((data_string *)a->data[i])->value;
+            if (0 != server_cpu_affinity_parse(&sets[i].cpus, b->ptr)) {
+                log_error(srv->errh, __FILE__, __LINE__,
+                  "server.cpu-affinity: invalid CPU list: \"%s\"", b->ptr);
+                free(sets);
+                return -1;
+            }
+        }
+        server_cpu_nsets = a->used;
+    }
+    server_cpu_sets = sets;
+
+    /* prefer memory from the NUMA node local to the pinned CPUs */
+    for (uint32_t i = 0; i < server_cpu_nsets; ++i) {
+        int node = -1;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &sets[i].cpus)) continue;
+            const int cnode = server_cpu_affinity_node(cpu);
+            if (node == -1)
+                node = cnode;
+            else if (node != cnode) {
+                node = -1;
+                break;
+            }
+            if (node == -1) break;
+        }
+        sets[i].node = node;
+    }
+
+    return 0;
+}
+
+__attribute_cold__
+static void server_cpu_affinity_set (server * const srv, const int wkr) {
+    if (0 == server_cpu_nsets) return;
+    const struct server_cpu_affinity_set * const set =
+      server_cpu_sets + (uint32_t)wkr % server_cpu_nsets;
+    if (0 != sched_setaffinity(0, sizeof(set->cpus), &set->cpus)) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "sched_setaffinity() worker %d", wkr);
+        return;
+    }
+  #ifdef SYS_set_mempolicy
+    unsigned long nodemask[1024 / (sizeof(unsigned long) * 8)];
+    const unsigned int bits = sizeof(unsigned long) * 8;
+    if (set->node < 0 || (unsigned int)set->node >= sizeof(nodemask) * 8)
+        return;
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[set->node / bits] |= 1UL << (set->node % bits);
+    if (0 != syscall(SYS_set_mempolicy, MPOL_PREFERRED,
+                     nodemask, sizeof(nodemask) * 8))
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "set_mempolicy() worker %d node %d", wkr, set->node);
+  #endif
+}
+
+#else
+
+__attribute_cold__
+static int server_cpu_affinity_init (server * const srv) {
+    if (srv->srvconf.cpu_affinity)
+        log_warn(srv->errh, __FILE__, __LINE__,
+          "server.cpu-affinity not supported on this platform; ignored");
+    return 0;
+}
+
+#define server_cpu_affinity_set(srv, wkr) do { } while (0)
+
+#endif /* SERVER_CPU_AFFINITY */
+
 #ifdef HAVE_FORK
 __attribute_noinline__
 static int server_main_setup_workers (server * const srv, const int npids) {
@@ -1330,21 +1495,21 @@ static int server_main_setup_workers (server * const srv, const int npids) {
     server_graceful_signal_prev_generation();
     while (!child && !srv_shutdown && !graceful_shutdown) {
         if (num_childs > 0) {
+            int n = 0; /* worker index */
+            while (-1 != pids[n]) ++n; /*(num_childs > 0 if free slot)*/
             switch ((pid = fork())) {
               case -1:
                 return -1;
               case 0:
                 child = 1;
                 alarm(0);
+                network_socket_worker(srv, n);
+                worker_stats_worker(n);
+                server_cpu_affinity_set(srv, n);
                 break;
               default:
                 num_childs--;
-                for (int n = 0; n < npids; ++n) {
-                    if (-1 == pids[n]) {
-                        pids[n] = pid;
-                        break;
-                    }
-                }
+                pids[n] = pid;
                 break;
             }
         }
@@ -1978,6 +2143,10 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 		return -1;
 	}
 
+	if (0 != server_cpu_affinity_init(srv)) {
+		return -1;
+	}
+
 	if (srv->srvconf.preflight_check) {
 		/*printf("Preflight OK");*//*(stdout reopened to /dev/null)*/
 		return 0;
@@ -2001,6 +2170,7 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	}
 
 	/* start watcher and workers */
+	worker_stats_init(srv, srv->srvconf.max_worker);
 	if (srv->srvconf.max_worker > 0) {
 		int rc = server_main_setup_workers(srv, srv->srvconf.max_worker);
 		if (rc != 1) /* 1 for worker; 0 for worker parent done; -1 for error */
@@ -2008,6 +2178,9 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	}
 #endif
 
+	if (0 == srv->srvconf.max_worker)
+		server_cpu_affinity_set(srv, 0);
+
 	srv->max_fds = (int)srv->srvconf.max_fds;
         if (srv->max_fds < 32) /*(sanity check; not expected)*/
             srv->max_fds = 32; /*(server load checks will fail if too low)*/
@@ -2050,6 +2223,19 @@ static int server_main_setup (server * const srv, int argc, char **argv) {
 	}
 
 	chunkqueue_internal_pipes(config_feature_bool(srv, "chunkqueue.splice", 1));
+	chunkqueue_pipechunk_cur_fds(&srv->cur_fds);
+
+	/* bound fds held open in stat_cache (default: max-fds/8, 16 sec ttl) */
+	stat_cache_fdcache_limits(srv->srvconf.stat_cache_max_fds
+	                            ? srv->srvconf.stat_cache_max_fds
+	                            : (uint32_t)srv->max_fds / 8,
+	                          srv->srvconf.stat_cache_fd_ttl
+	                            ? srv->srvconf.stat_cache_fd_ttl
+	                            : 16);
+	stat_cache_memcache_limits(srv->srvconf.stat_cache_mem_max_file,
+	                           srv->srvconf.stat_cache_mem_max
+	                             ? srv->srvconf.stat_cache_mem_max
+	                             : 16384);
 
 	/* might fail if user is using fam (not gamin) and famd isn't running */
 	if (!stat_cache_init(srv->ev, srv->errh)) {
@@ -2117,6 +2303,7 @@ static void server_handle_sighup (server * const srv) {
 __attribute_noinline__
 static void server_handle_sigalrm (server * const srv, unix_time64_t mono_ts, unix_time64_t last_active_ts) {
 
+				worker_stats_publish(srv);
 				plugins_call_handle_trigger(srv);
 
 				log_monotonic_secs = mono_ts;
@@ -2380,6 +2567,14 @@ int server_main (int argc, char ** argv) {
 
         /* clean-up */
         chunkqueue_internal_pipes(0);
+        chunkqueue_pipechunk_cur_fds(NULL);
+        chunkqueue_internal_aio(srv->ev, 0);
+        worker_stats_free();
+      #ifdef SERVER_CPU_AFFINITY
+        free(server_cpu_sets);
+        server_cpu_sets = NULL;
+        server_cpu_nsets = 0;
+      #endif
         server_pid_file_remove(srv);
         config_log_error_close(srv);
       #ifdef _WIN32
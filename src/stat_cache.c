@@ -2,13 +2,16 @@
 
 #include "stat_cache.h"
 
+#include "sys-mmap.h"
 #include "sys-stat.h"
 #include "sys-unistd.h" /* <unistd.h> */
 
 #include "log.h"
 #include "fdevent.h"
 #include "http_etag.h"
-#include "algo_splaytree.h"
+#include "algo_hashtab.h"
+#include "chunk.h"      /* chunk_file_pread() */
+#include "worker_stats.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -25,10 +28,22 @@
 # include <sys/extattr.h>
 #endif
 
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS)
+#ifdef MAP_ANON
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && defined(MAP_ANONYMOUS) \
+ && defined(__ATOMIC_ACQUIRE)
+#define STAT_CACHE_SHARED
+#include <signal.h>     /* kill() */
+#endif
+
 /*
  * stat-cache
  *
- * - a splay-tree is used as we can use the caching effect of it
+ * - entries are indexed by hash of path in an open addressing hash table
  */
 
 enum {
@@ -41,32 +56,247 @@ enum {
 
 struct stat_cache_fam;  /* declaration */
 
+struct stat_cache_shared; /* declaration */
+
 typedef struct stat_cache {
 	int stat_cache_engine;
-	splay_tree *files; /* nodes of tree are (stat_cache_entry *) */
+	hashtab files;     /* data in table is (stat_cache_entry *) */
 	struct stat_cache_fam *scf;
+	stat_cache_entry *fd_head; /* LRU list of entries holding open fd */
+	stat_cache_entry *fd_tail;
+	uint32_t fd_count;
+	uint32_t fd_max;
+	uint32_t fd_ttl;
+	off_t mem_file_max; /* max size of file contents cached in memory */
+	off_t mem_max;      /* max total size of file contents cached in memory */
+	off_t mem_used;
+  #ifdef STAT_CACHE_SHARED
+	struct stat_cache_shared *shm;
+	int shm_owner;     /* this process monitors dirs on behalf of all */
+	fdevents *ev;
+	log_error_st *errh;
+  #endif
 } stat_cache;
 
 static stat_cache sc;
 
 
+#ifdef STAT_CACHE_SHARED
+
+/* server.stat-cache-engine = "shared"
+ *
+ * stat() results are published to a hash table in shared memory created
+ * before forking workers (server.max-worker), so that a path stat()ed by
+ * one worker need not be stat()ed again by other workers.  Each entry is
+ * protected by a seqlock: writers take the entry by moving gen from even to
+ * odd (and skip the entry if busy; never block), readers are lock-free and
+ * retry (or miss) if gen changed while reading.
+ *
+ * A single worker (the owner) monitors directories (inotify/kqueue/FAM) on
+ * behalf of all workers and marks entries which it monitors.  Monitored
+ * entries are trusted by other workers for up to 16 seconds (as with "fam"),
+ * and are removed by the owner upon change notification.  Unmonitored
+ * entries are trusted only within the same second (as with "simple").
+ * If the owner exits, another worker takes over monitoring. */
+
+#define STAT_CACHE_SHARED_ENTRIES 8192  /* (must be power of 2) */
+#define STAT_CACHE_SHARED_PROBE   8
+
+typedef struct stat_cache_shared_entry {
+    uint32_t gen;       /* seqlock (odd while writing) */
+    uint32_t hash;
+    uint32_t nlen;      /* 0 if entry is empty */
+    uint32_t monitored;
+    unix_time64_t stat_ts;
+    struct stat st;
+    char name[256];
+} stat_cache_shared_entry;
+
+typedef struct stat_cache_shared {
+    int32_t owner;      /* pid of monitoring worker (or 0) */
+    uint32_t scan;      /* (owner) next entry to check in periodic scan */
+    stat_cache_shared_entry e[STAT_CACHE_SHARED_ENTRIES];
+} stat_cache_shared;
+
+__attribute_cold__
+static int stat_cache_shared_init (log_error_st * const errh)
+{
+    if (sc.shm) return 1;
+    void * const shm = mmap(NULL, sizeof(stat_cache_shared),
+                            PROT_READ|PROT_WRITE,
+                            MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == shm) {
+        log_perror(errh, __FILE__, __LINE__, "mmap() shared stat cache");
+        return 0;
+    }
+    /*(anonymous mapping is zero-filled)*/
+    sc.shm = shm;
+    return 1;
+}
+
+static stat_cache_shared_entry *
+stat_cache_shared_lock (stat_cache_shared_entry * const e, uint32_t * const gen)
+{
+    uint32_t g = __atomic_load_n(&e->gen, __ATOMIC_RELAXED);
+    if ((g & 1)
+        || !__atomic_compare_exchange_n(&e->gen, &g, g+1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return NULL; /* busy; skip */
+    *gen = g+2;
+    return e;
+}
+
+static stat_cache_shared_entry *
+stat_cache_shared_lock_wait (stat_cache_shared_entry * const e, uint32_t * const gen)
+{
+    /* writers hold entry only to copy struct stat; (bounded spin in case
+     * a writer process was killed while holding the entry) */
+    for (int i = 0; i < 65536; ++i) {
+        if (stat_cache_shared_lock(e, gen)) return e;
+    }
+    return NULL;
+}
+
+static void
+stat_cache_shared_unlock (stat_cache_shared_entry * const e, const uint32_t gen)
+{
+    __atomic_store_n(&e->gen, gen, __ATOMIC_RELEASE);
+}
+
+static int
+stat_cache_shared_get (const char * const name, const uint32_t len, struct stat * const st)
+{
+    if (len >= sizeof(((stat_cache_shared_entry *)0)->name)) return 0;
+    const uint32_t h = hashtab_hash(name, len);
+    const unix_time64_t cur_ts = log_monotonic_secs;
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_PROBE; ++i) {
+        const stat_cache_shared_entry * const e =
+          sc.shm->e + ((h + i) & (STAT_CACHE_SHARED_ENTRIES-1));
+        const uint32_t g = __atomic_load_n(&e->gen, __ATOMIC_ACQUIRE);
+        if ((g & 1) || e->hash != h || e->nlen != len
+            || 0 != memcmp(e->name, name, len))
+            continue;
+        const unix_time64_t stat_ts = e->stat_ts;
+        const uint32_t monitored = e->monitored;
+        *st = e->st;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (g != __atomic_load_n(&e->gen, __ATOMIC_RELAXED))
+            return 0; /* modified while reading */
+        return cur_ts == stat_ts || (monitored && cur_ts - stat_ts < 16);
+    }
+    return 0;
+}
+
+static void
+stat_cache_shared_put (const char * const name, const uint32_t len, const struct stat * const st, const unix_time64_t stat_ts, const int monitored)
+{
+    if (len >= sizeof(((stat_cache_shared_entry *)0)->name)) return;
+    const uint32_t h = hashtab_hash(name, len);
+    /* replace matching entry, else empty entry, else least recent entry
+     * (unlocked reads to choose entry; entry is rewritten after locking) */
+    stat_cache_shared_entry *e = NULL;
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_PROBE; ++i) {
+        stat_cache_shared_entry * const x =
+          sc.shm->e + ((h + i) & (STAT_CACHE_SHARED_ENTRIES-1));
+        if (x->hash == h && x->nlen == len && 0 == memcmp(x->name, name, len)){
+            e = x;
+            break;
+        }
+        if (NULL == e || (0 != e->nlen
+                          && (0 == x->nlen || x->stat_ts < e->stat_ts)))
+            e = x;
+    }
+    uint32_t gen;
+    if (NULL == stat_cache_shared_lock(e, &gen)) return;
+    e->hash = h;
+    e->nlen = len;
+    e->monitored = (uint32_t)monitored;
+    e->stat_ts = stat_ts;
+    e->st = *st;
+    memcpy(e->name, name, len);
+    stat_cache_shared_unlock(e, gen);
+}
+
+static void
+stat_cache_shared_invalidate (const char * const name, const uint32_t len)
+{
+    if (len >= sizeof(((stat_cache_shared_entry *)0)->name)) return;
+    const uint32_t h = hashtab_hash(name, len);
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_PROBE; ++i) {
+        stat_cache_shared_entry * const e =
+          sc.shm->e + ((h + i) & (STAT_CACHE_SHARED_ENTRIES-1));
+        if (e->hash != h || e->nlen != len || 0 != memcmp(e->name,name,len))
+            continue;
+        uint32_t gen;
+        if (NULL == stat_cache_shared_lock_wait(e, &gen)) continue;
+        if (e->hash == h && e->nlen == len)
+            e->nlen = 0;
+        stat_cache_shared_unlock(e, gen);
+    }
+}
+
 __attribute_noinline__
-static void * stat_cache_sptree_ndx(splay_tree ** const sptree,
-                                    int * const ndxp,
-                                    const char * const name,
-                                    uint32_t len)
+static void
+stat_cache_shared_invalidate_dir (const char * const name, const uint32_t len)
 {
-    const int ndx = splaytree_djbhash(name, len);
-    if (ndxp) *ndxp = ndx;
-    *sptree = splaytree_splay(*sptree, ndx);
-    return (*sptree && (*sptree)->key == ndx) ? (*sptree)->data : NULL;
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_ENTRIES; ++i) {
+        stat_cache_shared_entry * const e = sc.shm->e + i;
+        if (e->nlen <= len || e->name[len] != '/'
+            || 0 != memcmp(e->name, name, len))
+            continue;
+        uint32_t gen;
+        if (NULL == stat_cache_shared_lock_wait(e, &gen)) continue;
+        if (e->nlen > len && e->name[len] == '/')
+            e->nlen = 0;
+        stat_cache_shared_unlock(e, gen);
+    }
+}
+
+__attribute_cold__
+static void
+stat_cache_shared_unmonitor (void)
+{
+    /* entries marked monitored by a prior owner are no longer monitored */
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_ENTRIES; ++i) {
+        stat_cache_shared_entry * const e = sc.shm->e + i;
+        if (!e->monitored) continue;
+        uint32_t gen;
+        if (NULL == stat_cache_shared_lock_wait(e, &gen)) continue;
+        e->monitored = 0;
+        stat_cache_shared_unlock(e, gen);
+    }
 }
 
-static void * stat_cache_sptree_find(splay_tree ** const sptree,
+#endif /* STAT_CACHE_SHARED */
+
+
+static void * stat_cache_hashtab_ndx(const hashtab * const ht,
+                                     uint32_t * const ndxp,
                                      const char * const name,
                                      uint32_t len)
 {
-    return stat_cache_sptree_ndx(sptree, NULL, name, len);
+    const uint32_t ndx = hashtab_hash(name, len);
+    if (ndxp) *ndxp = ndx;
+    return hashtab_find(ht, ndx);
+}
+
+static void * stat_cache_hashtab_find(const hashtab * const ht,
+                                      const char * const name,
+                                      uint32_t len)
+{
+    return stat_cache_hashtab_ndx(ht, NULL, name, len);
+}
+
+typedef struct stat_cache_path_arg {
+    const char *name;
+    size_t len;
+} stat_cache_path_arg;
+
+static int stat_cache_path_in_dir(const buffer * const b, const stat_cache_path_arg * const d)
+{
+    const size_t blen = buffer_clen(b);
+    return blen > d->len && b->ptr[d->len] == '/'
+        && 0 == memcmp(b->ptr, d->name, d->len);
 }
 
 
@@ -130,7 +360,7 @@ static void * stat_cache_sptree_find(splay_tree ** const sptree,
  *
  * Internal note: lighttpd walks the caches to prune trees in stat_cache when an
  * event is received for a directory (or symlink to a directory) which has been
- * deleted or renamed.  The splaytree data structure is suboptimal for frequent
+ * deleted or renamed.  Walking the hash tables is suboptimal for frequent
  * changes of large directories trees where there have been a large number of
  * different files recently accessed and part of the stat_cache.
  */
@@ -230,9 +460,9 @@ typedef struct fam_dir_entry {
 } fam_dir_entry;
 
 typedef struct stat_cache_fam {
-	splay_tree *dirs; /* indexed by path; node data is fam_dir_entry */
+	hashtab dirs;     /* indexed by path; data is fam_dir_entry */
   #ifdef HAVE_SYS_INOTIFY_H
-	splay_tree *wds;  /* indexed by inotify watch descriptor */
+	hashtab wds;      /* indexed by inotify watch descriptor */
   #elif defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
   #else
 	FAMConnection fam;
@@ -256,8 +486,9 @@ static fam_dir_entry * fam_dir_entry_init(const char *name, size_t len)
     return fam_dir;
 }
 
-static void fam_dir_entry_free(fam_dir_entry *fam_dir)
+static void fam_dir_entry_free(void *data)
 {
+    fam_dir_entry * const fam_dir = data;
     if (!fam_dir) return;
     /*(fam_dir->fam_parent might be invalid pointer here; ignore)*/
     free(fam_dir->name.ptr);
@@ -277,81 +508,73 @@ static void fam_dir_invalidate_node(fam_dir_entry *fam_dir)
     }
 }
 
-/*
- * walk though splay_tree and collect contents of dir tree.
- * remove tagged entries in a second loop
- */
+#if defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
+typedef struct fam_dir_cleanup_kq {
+    int n;
+    struct kevent kevl[512]; /* 32k size on stack to batch kevent EV_DELETE */
+} fam_dir_cleanup_kq;
 
-static void fam_dir_tag_refcnt(splay_tree *t, int *keys, int *ndx)
+static void fam_dir_cleanup_kevents(stat_cache_fam * const scf, fam_dir_cleanup_kq * const kq)
 {
-    if (*ndx == 512) return; /*(must match num array entries in keys[])*/
-    if (t->left)  fam_dir_tag_refcnt(t->left,  keys, ndx);
-    if (t->right) fam_dir_tag_refcnt(t->right, keys, ndx);
-    if (*ndx == 512) return; /*(must match num array entries in keys[])*/
+    /* batch process: kevent() to submit EV_DELETE, then close dir fds */
+    if (0 == kq->n) return;
+    struct timespec t0 = { 0, 0 };
+    kevent(scf->fd, kq->kevl, kq->n, NULL, 0, &t0);
+    for (int i = 0; i < kq->n; ++i)
+        close((int)kq->kevl[i].ident);
+    kq->n = 0;
+}
+#endif
 
-    fam_dir_entry * const fam_dir = t->data;
-    if (0 == fam_dir->refcnt) {
-        fam_dir_invalidate_node(fam_dir);
-        keys[(*ndx)++] = t->key;
-    }
+static int fam_dir_cleanup_fn(void *data, void *arg)
+{
+    fam_dir_entry * const fam_dir = data;
+    if (0 != fam_dir->refcnt) return 0;
+    fam_dir_invalidate_node(fam_dir);
+    stat_cache_fam * const scf = sc.scf;
+  #ifdef HAVE_SYS_INOTIFY_H
+    hashtab_remove(&scf->wds, (uint32_t)fam_dir->req);
+    UNUSED(arg);
+  #elif defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
+    /* batch process kevent removal; defer cancel */
+    fam_dir_cleanup_kq * const kq = arg;
+    EV_SET(kq->kevl+kq->n, fam_dir->req, EVFILT_VNODE, EV_DELETE, 0, 0, 0);
+    fam_dir->req = -1; /*(make FAMCancelMonitor() a no-op)*/
+    if (++kq->n == (int)(sizeof(kq->kevl)/sizeof(*kq->kevl)))
+        fam_dir_cleanup_kevents(scf, kq);
+  #else
+    UNUSED(arg);
+  #endif
+    FAMCancelMonitor(&scf->fam, &fam_dir->req);
+    fam_dir_entry_free(fam_dir);
+    return 1;
 }
 
 __attribute_noinline__
 static void fam_dir_periodic_cleanup(void) {
     stat_cache_fam * const scf = sc.scf;
-    int max_ndx, i;
-    int keys[512]; /* 2k size on stack */
   #if defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
-    struct kevent kevl[512]; /* 32k size on stack to batch kevent EV_DELETE */
+    fam_dir_cleanup_kq kq;
+    kq.n = 0;
+    hashtab_sweep(&scf->dirs, fam_dir_cleanup_fn, &kq);
+    fam_dir_cleanup_kevents(scf, &kq);
+  #else
+    hashtab_sweep(&scf->dirs, fam_dir_cleanup_fn, NULL);
   #endif
-    do {
-        if (!scf->dirs) break;
-        max_ndx = 0;
-        fam_dir_tag_refcnt(scf->dirs, keys, &max_ndx);
-        for (i = 0; i < max_ndx; ++i) {
-            {
-                scf->dirs = splaytree_splay_nonnull(scf->dirs, keys[i]);
-                fam_dir_entry *fam_dir = scf->dirs->data;
-                scf->dirs = splaytree_delete_splayed_node(scf->dirs);
-              #ifdef HAVE_SYS_INOTIFY_H
-                scf->wds = splaytree_delete(scf->wds, fam_dir->req);
-              #elif defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
-                /* batch process kevent removal; defer cancel */
-                EV_SET(kevl+i, fam_dir->req, EVFILT_VNODE, EV_DELETE, 0, 0, 0);
-                fam_dir->req = -1; /*(make FAMCancelMonitor() a no-op)*/
-              #endif
-                FAMCancelMonitor(&scf->fam, &fam_dir->req);
-                fam_dir_entry_free(fam_dir);
-            }
-        }
-      #if defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
-        /* batch process: kevent() to submit EV_DELETE, then close dir fds */
-        if (0 == max_ndx) break;
-        struct timespec t0 = { 0, 0 };
-        kevent(scf->fd, kevl, max_ndx, NULL, 0, &t0);
-        for (i = 0; i < max_ndx; ++i)
-            close((int)kevl[i].ident);
-      #endif
-    } while (max_ndx == sizeof(keys)/sizeof(int));
 }
 
-static void fam_dir_invalidate_tree(splay_tree *t, const char *name, size_t len)
+static int fam_dir_invalidate_fn(void *data, void *arg)
 {
-  #ifdef __clang_analyzer__
-    force_assert(name);
-  #endif
-    /*force_assert(t);*/
-    if (t->left)  fam_dir_invalidate_tree(t->left,  name, len);
-    if (t->right) fam_dir_invalidate_tree(t->right, name, len);
-
-    fam_dir_entry * const fam_dir = t->data;
-  #ifdef __clang_analyzer__
-    force_assert(fam_dir);
-  #endif
-    const buffer * const b = &fam_dir->name;
-    size_t blen = buffer_clen(b);
-    if (blen > len && b->ptr[len] == '/' && 0 == memcmp(b->ptr, name, len))
+    fam_dir_entry * const fam_dir = data;
+    if (stat_cache_path_in_dir(&fam_dir->name, arg))
         fam_dir_invalidate_node(fam_dir);
+    return 0;
+}
+
+static void fam_dir_invalidate_tree(stat_cache_fam * const scf, const char *name, size_t len)
+{
+    stat_cache_path_arg d = { name, len };
+    hashtab_sweep(&scf->dirs, fam_dir_invalidate_fn, &d);
 }
 
 /* declarations */
@@ -391,11 +614,8 @@ static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
             }
             /* ignore events which may have been pending for
              * paths recently cancelled via FAMCancelMonitor() */
-            scf->wds = splaytree_splay(scf->wds, in->wd);
-            if (!scf->wds || scf->wds->key != in->wd)
-                continue;
-            fam_dir_entry *fam_dir = scf->wds->data;
-            if (NULL == fam_dir)        /*(should not happen)*/
+            fam_dir_entry *fam_dir = hashtab_find(&scf->wds, (uint32_t)in->wd);
+            if (NULL == fam_dir)
                 continue;
             if (fam_dir->req != in->wd) /*(should not happen)*/
                 continue;
@@ -425,11 +645,10 @@ static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
             const struct kevent * const kev = kevl+i;
             /* ignore events which may have been pending for
              * paths recently cancelled via FAMCancelMonitor() */
-            int ndx = (int)(intptr_t)kev->udata;
-            scf->dirs = splaytree_splay(scf->dirs, ndx);
-            if (!scf->dirs || scf->dirs->key != ndx)
+            const uint32_t ndx = (uint32_t)(uintptr_t)kev->udata;
+            fam_dir_entry *fam_dir = hashtab_find(&scf->dirs, ndx);
+            if (NULL == fam_dir)
                 continue;
-            fam_dir_entry *fam_dir = scf->dirs->data;
             if (fam_dir->req != (int)kev->ident)
                 continue;
             /*(specific to use here in stat_cache.c)*/
@@ -452,18 +671,17 @@ static void stat_cache_handle_fdevent_in(stat_cache_fam *scf)
         }
     } while (n == sizeof(kevl)/sizeof(*kevl));
   #else
-    for (int i = 0, ndx; i || (i = FAMPending(&scf->fam)) > 0; --i) {
+    for (int i = 0; i || (i = FAMPending(&scf->fam)) > 0; --i) {
         FAMEvent fe;
         if (FAMNextEvent(&scf->fam, &fe) < 0) break;
 
         /* ignore events which may have been pending for
          * paths recently cancelled via FAMCancelMonitor() */
-        ndx = (int)(intptr_t)fe.userdata;
-        scf->dirs = splaytree_splay(scf->dirs, ndx);
-        if (!scf->dirs || scf->dirs->key != ndx) {
+        const uint32_t ndx = (uint32_t)(uintptr_t)fe.userdata;
+        fam_dir_entry *fam_dir = hashtab_find(&scf->dirs, ndx);
+        if (NULL == fam_dir) {
             continue;
         }
-        fam_dir_entry *fam_dir = scf->dirs->data;
         if (FAMREQUEST_GETREQNUM(&fam_dir->req)
             != FAMREQUEST_GETREQNUM(&fe.fr)) {
             continue;
@@ -508,7 +726,7 @@ static void stat_cache_handle_fdevent_fn(stat_cache_fam * const scf, fam_dir_ent
                 stat_cache_invalidate_entry(BUF_PTR_LEN(n));
 
                 fam_link = /*(check if might be symlink to monitored dir)*/
-                stat_cache_sptree_find(&scf->dirs, BUF_PTR_LEN(n));
+                stat_cache_hashtab_find(&scf->dirs, BUF_PTR_LEN(n));
                 if (fam_link && !buffer_is_equal(&fam_link->name, n))
                     fam_link = NULL;
 
@@ -536,9 +754,7 @@ static void stat_cache_handle_fdevent_fn(stat_cache_fam * const scf, fam_dir_ent
         case FAMMoved:
             stat_cache_delete_tree(BUF_PTR_LEN(&fam_dir->name));
             fam_dir_invalidate_node(fam_dir);
-            if (scf->dirs)
-                fam_dir_invalidate_tree(scf->dirs,
-                                        BUF_PTR_LEN(&fam_dir->name));
+            fam_dir_invalidate_tree(scf, BUF_PTR_LEN(&fam_dir->name));
             fam_dir_periodic_cleanup();
             break;
         default:
@@ -637,19 +853,14 @@ static void stat_cache_free_fam(stat_cache_fam *scf) {
 	if (NULL == scf) return;
 
       #ifdef HAVE_SYS_INOTIFY_H
-	while (scf->wds) {
-		scf->wds = splaytree_delete_splayed_node(scf->wds);
-	}
+	hashtab_clear(&scf->wds, NULL);
       #elif defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE
 	/*(quicker cleanup to close kqueue() before cancel per entry)*/
 	close(scf->fd);
 	scf->fd = -1;
       #endif
-	while (scf->dirs) {
-		/*(skip entry invalidation and FAMCancelMonitor())*/
-		fam_dir_entry_free((fam_dir_entry *)scf->dirs->data);
-		scf->dirs = splaytree_delete_splayed_node(scf->dirs);
-	}
+	/*(skip entry invalidation and FAMCancelMonitor())*/
+	hashtab_clear(&scf->dirs, fam_dir_entry_free);
 
 	if (-1 != scf->fd) {
 		/*scf->fdn already cleaned up in fdevent_free()*/
@@ -676,9 +887,9 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
         while (fn[--dirlen] != '/') ;
         if (0 == dirlen) dirlen = 1; /*(should not happen for file)*/
     }
-    int dir_ndx;
+    uint32_t dir_ndx;
     fam_dir_entry *fam_dir =
-      stat_cache_sptree_ndx(&scf->dirs, &dir_ndx, fn, dirlen);
+      stat_cache_hashtab_ndx(&scf->dirs, &dir_ndx, fn, dirlen);
 
     if (NULL != fam_dir) {
         if (!buffer_eq_slen(&fam_dir->name, fn, dirlen)) {
@@ -716,27 +927,25 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
          * not being monitored occurs (e.g. rename of unmonitored parent dir)*/
         if (st->st_dev != fam_dir->st_dev || st->st_ino != fam_dir->st_ino) {
             ck_lnk = 1;
-            /*(modifies scf->dirs but no need to re-splay for dir_ndx since
-             * fam_dir is not NULL and so splaytree_insert not called below)*/
-            if (scf->dirs) fam_dir_invalidate_tree(scf->dirs, fn, dirlen);
+            fam_dir_invalidate_tree(scf, fn, dirlen);
             if (!fn_is_dir) /*(if dir, caller is updating stat_cache_entry)*/
                 stat_cache_update_entry(fn, dirlen, st, NULL);
             /*(must not delete tree since caller is holding a valid node)*/
             stat_cache_invalidate_dir_tree(fn, dirlen);
           #ifdef HAVE_SYS_INOTIFY_H
-            scf->wds = splaytree_delete(scf->wds, fam_dir->req);
+            hashtab_remove(&scf->wds, (uint32_t)fam_dir->req);
           #endif
             if (0 != FAMCancelMonitor(&scf->fam, &fam_dir->req)
                 || 0 != FAMMonitorDirectory(&scf->fam, fam_dir->name.ptr,
                                             &fam_dir->req,
-                                            (void *)(intptr_t)dir_ndx)) {
+                                            (void *)(uintptr_t)dir_ndx)) {
                 fam_dir->stat_ts = 0; /* invalidate */
                 return NULL;
             }
             fam_dir->st_dev = st->st_dev;
             fam_dir->st_ino = st->st_ino;
           #ifdef HAVE_SYS_INOTIFY_H
-            scf->wds = splaytree_insert_splayed(scf->wds,fam_dir->req,fam_dir);
+            hashtab_insert(&scf->wds, (uint32_t)fam_dir->req, fam_dir);
           #endif
         }
         fam_dir->stat_ts = cur_ts;
@@ -746,7 +955,7 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
         fam_dir = fam_dir_entry_init(fn, dirlen);
 
         if (0 != FAMMonitorDirectory(&scf->fam,fam_dir->name.ptr,&fam_dir->req,
-                                     (void *)(intptr_t)dir_ndx)) {
+                                     (void *)(uintptr_t)dir_ndx)) {
           #if defined(HAVE_SYS_INOTIFY_H) \
            || (defined HAVE_SYS_EVENT_H && defined HAVE_KQUEUE)
             log_perror(scf->errh, __FILE__, __LINE__,
@@ -761,9 +970,9 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
             return NULL;
         }
 
-        scf->dirs = splaytree_insert_splayed(scf->dirs, dir_ndx, fam_dir);
+        hashtab_insert(&scf->dirs, dir_ndx, fam_dir);
       #ifdef HAVE_SYS_INOTIFY_H
-        scf->wds = splaytree_insert(scf->wds, fam_dir->req, fam_dir);
+        hashtab_insert(&scf->wds, (uint32_t)fam_dir->req, fam_dir);
       #endif
         fam_dir->stat_ts= cur_ts;
         fam_dir->st_dev = st->st_dev;
@@ -797,6 +1006,95 @@ static fam_dir_entry * fam_dir_monitor(stat_cache_fam *scf, char *fn, uint32_t d
 #endif
 
 
+/* fd cache
+ *
+ * stat_cache_entry may hold an open fd (sce->fd) for sending the file in
+ * responses (refcnt incremented by each response chunk referencing it).
+ * Entries holding an fd are kept in an LRU list, bounded by
+ * server.stat-cache-max-fds.  Entries holding an fd remain in stat_cache
+ * until the fd is unused for server.stat-cache-fd-ttl seconds, so that
+ * frequently requested files are not reopened (though the file is still
+ * revalidated with stat() as configured by server.stat-cache-engine).
+ * An fd is not closed while in use by a response (sce->refcnt > 1). */
+
+static void stat_cache_fd_link(stat_cache_entry * const sce) {
+    sce->fd_prev = NULL;
+    sce->fd_next = sc.fd_head;
+    if (sc.fd_head)
+        sc.fd_head->fd_prev = sce;
+    else
+        sc.fd_tail = sce;
+    sc.fd_head = sce;
+    worker_stats_self->fd_cache_open = ++sc.fd_count;
+}
+
+static void stat_cache_fd_unlink(stat_cache_entry * const sce) {
+    if (sce->fd_prev)
+        sce->fd_prev->fd_next = sce->fd_next;
+    else if (sc.fd_head == sce)
+        sc.fd_head = sce->fd_next;
+    else
+        return; /* not in list */
+    if (sce->fd_next)
+        sce->fd_next->fd_prev = sce->fd_prev;
+    else
+        sc.fd_tail = sce->fd_prev;
+    sce->fd_prev = sce->fd_next = NULL;
+    worker_stats_self->fd_cache_open = --sc.fd_count;
+}
+
+static void stat_cache_fd_close(stat_cache_entry * const sce) {
+    stat_cache_fd_unlink(sce);
+    close(sce->fd);
+    sce->fd = -1;
+}
+
+__attribute_noinline__
+static void stat_cache_fd_prune(const unix_time64_t cur_ts) {
+    /* close least recently used fds if over limit or if unused for ttl
+     * (skip fds in use by responses; limit work done per call;
+     *  do not close most recently used fd, which caller might be using) */
+    stat_cache_entry *sce = sc.fd_tail;
+    for (int n = 0; n < 32 && sce && sce != sc.fd_head; ++n) {
+        stat_cache_entry * const prev = sce->fd_prev;
+        if (sc.fd_count <= sc.fd_max && cur_ts - sce->fd_ts < sc.fd_ttl)
+            break;
+        if (1 == sce->refcnt)
+            stat_cache_fd_close(sce);
+        sce = prev;
+    }
+}
+
+void stat_cache_fdcache_limits (uint32_t max_fds, uint32_t ttl) {
+    sc.fd_max = max_fds;
+    sc.fd_ttl = ttl;
+}
+
+
+/* memory cache
+ *
+ * Contents of small files (<= server.stat-cache-mem-max-file bytes) may be
+ * kept in memory with the stat_cache_entry (sce->mem), bounded in total by
+ * server.stat-cache-mem-max, so that responses can be sent from memory
+ * without open(), fstat(), and sendfile().  Contents are discarded along with
+ * the fd and ETag when stat() of the file changes, and so are invalidated by
+ * the same events (and revalidated on the same schedule) as stat_cache.
+ * As with cached fds, entries holding contents are kept in stat_cache until
+ * unused for server.stat-cache-fd-ttl seconds. */
+
+void stat_cache_memcache_limits (uint32_t max_file, uint32_t max_kb) {
+    sc.mem_file_max = (off_t)max_file;
+    sc.mem_max = (off_t)max_kb << 10;
+}
+
+static void stat_cache_mem_release(stat_cache_entry * const sce) {
+    if (NULL == sce->mem) return;
+    sc.mem_used -= (off_t)buffer_clen(sce->mem);
+    worker_stats_self->mem_cache_bytes = (uint64_t)sc.mem_used;
+    buffer_free(sce->mem);
+    sce->mem = NULL;
+}
+
 __attribute_malloc__
 __attribute_noinline__
 __attribute_returns_nonnull__
@@ -811,6 +1109,10 @@ static void stat_cache_entry_free(void *data) {
     stat_cache_entry *sce = data;
     if (!sce) return;
 
+    /*(entry removed from stat_cache; remove from fd cache LRU, even if fd
+     * remains open until refcnt reaches zero, when in use by responses)*/
+    stat_cache_fd_unlink(sce);
+
     if (--sce->refcnt) return;
 
   #ifdef HAVE_FAM_H
@@ -823,6 +1125,7 @@ static void stat_cache_entry_free(void *data) {
     free(sce->etag.ptr);
     if (sce->content_type.size) free(sce->content_type.ptr);
     if (sce->fd >= 0) close(sce->fd);
+    stat_cache_mem_release(sce);
 
     free(sce);
 }
@@ -836,12 +1139,6 @@ void stat_cache_entry_refchg(void *data, int mod) {
         sce->refcnt += mod;
 }
 
-__attribute_nonnull__()
-static splay_tree * stat_cache_sptree_node_free(splay_tree *sptree) {
-    stat_cache_entry_free(sptree->data);
-    return splaytree_delete_splayed_node(sptree);
-}
-
 #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
 
 static const char *attrname = "Content-Type";
@@ -878,7 +1175,99 @@ static int stat_cache_attr_get(const char *name) {
 
 #endif
 
+#ifdef STAT_CACHE_SHARED
+
+/* claim monitoring of dirs on behalf of all workers if no owner (or if owner
+ * exited); returns 1 if claimed, 0 if not, -1 if failed to init monitoring */
+__attribute_cold__
+static int stat_cache_shared_claim (void)
+{
+  #ifdef HAVE_FAM_H
+    int32_t owner = __atomic_load_n(&sc.shm->owner, __ATOMIC_ACQUIRE);
+    if (0 != owner && (0 == kill((pid_t)owner, 0) || errno != ESRCH))
+        return 0;
+    if (!__atomic_compare_exchange_n(&sc.shm->owner, &owner,
+                                     (int32_t)getpid(), 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return 0;
+    if (0 != owner) /* prior owner exited without releasing entries */
+        stat_cache_shared_unmonitor();
+    sc.scf = stat_cache_init_fam(sc.ev, sc.errh);
+    if (NULL == sc.scf) {
+        __atomic_store_n(&sc.shm->owner, 0, __ATOMIC_RELEASE);
+        sc.shm_owner = -1; /*(do not retry)*/
+        return -1;
+    }
+    sc.shm_owner = 1;
+    sc.stat_cache_engine = STAT_CACHE_ENGINE_FAM;
+    return 1;
+  #else
+    return 0;
+  #endif
+}
+
+__attribute_cold__
+static void stat_cache_shared_release (void)
+{
+    if (sc.shm_owner > 0) {
+        stat_cache_shared_unmonitor();
+        __atomic_store_n(&sc.shm->owner, 0, __ATOMIC_RELEASE);
+    }
+    sc.shm_owner = 0;
+}
+
+__attribute_cold__
+__attribute_noinline__
+static void stat_cache_shared_periodic (void)
+{
+  #ifdef HAVE_FAM_H
+    if (0 == sc.shm_owner) {
+        /* take over monitoring if owner exited (check every 4 seconds) */
+        if (!(log_monotonic_secs & 0x3))
+            stat_cache_shared_claim();
+        return;
+    }
+    if (sc.shm_owner < 0) return;
+
+    /* monitor paths recently stat()ed by other workers, and publish entries
+     * as monitored so that other workers need not stat() for 16 seconds
+     * (scan a portion of table each second; limit stat() per scan) */
+    buffer * const b = buffer_init();
+    const unix_time64_t cur_ts = log_monotonic_secs;
+    uint32_t i = sc.shm->scan;
+    for (uint32_t n = 0, m = 0; n < 1024 && m < 64; ++n, ++i) {
+        stat_cache_shared_entry * const e =
+          sc.shm->e + (i & (STAT_CACHE_SHARED_ENTRIES-1));
+        const uint32_t g = __atomic_load_n(&e->gen, __ATOMIC_ACQUIRE);
+        const uint32_t len = e->nlen;
+        if ((g & 1) || 0 == len || len >= sizeof(e->name) || e->monitored
+            || cur_ts - e->stat_ts > 1)
+            continue;
+        buffer_copy_string_len(b, e->name, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (g != __atomic_load_n(&e->gen, __ATOMIC_RELAXED) || b->ptr[0] != '/')
+            continue;
+        ++m;
+        const stat_cache_entry * const sce = stat_cache_get_entry(b);
+        if (sce && sce->fam_dir)
+            stat_cache_shared_put(BUF_PTR_LEN(b), &sce->st, sce->stat_ts, 1);
+    }
+    sc.shm->scan = i;
+    buffer_free(b);
+  #endif
+}
+
+#endif /* STAT_CACHE_SHARED */
+
 int stat_cache_init(fdevents *ev, log_error_st *errh) {
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) {
+        sc.ev = ev;
+        sc.errh = errh;
+        return (stat_cache_shared_claim() >= 0);
+    }
+  #endif
+
   #ifdef HAVE_FAM_H
     if (sc.stat_cache_engine == STAT_CACHE_ENGINE_FAM) {
         sc.scf = stat_cache_init_fam(ev, errh);
@@ -893,11 +1282,17 @@ int stat_cache_init(fdevents *ev, log_error_st *errh) {
 }
 
 void stat_cache_free(void) {
-    splay_tree *sptree = sc.files;
-    while (sptree) {
-        sptree = stat_cache_sptree_node_free(sptree);
+    hashtab_clear(&sc.files, stat_cache_entry_free);
+
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) {
+        stat_cache_shared_release();
+        munmap(sc.shm, sizeof(stat_cache_shared));
+        sc.shm = NULL;
     }
-    sc.files = NULL;
+    sc.ev = NULL;
+    sc.errh = NULL;
+  #endif
 
   #ifdef HAVE_FAM_H
     stat_cache_free_fam(sc.scf);
@@ -936,6 +1331,15 @@ int stat_cache_choose_engine (const buffer *stat_cache_string, log_error_st *err
 #ifdef HAVE_FAM_H
     else if (buffer_eq_slen(stat_cache_string, CONST_STR_LEN("fam")))
         sc.stat_cache_engine = STAT_CACHE_ENGINE_FAM;
+#endif
+#ifdef STAT_CACHE_SHARED
+    else if (buffer_eq_slen(stat_cache_string, CONST_STR_LEN("shared"))) {
+        /* (shared memory must be created before forking workers) */
+        if (!stat_cache_shared_init(errh))
+            return -1;
+        /*(set to STAT_CACHE_ENGINE_FAM in worker monitoring dirs)*/
+        sc.stat_cache_engine = STAT_CACHE_ENGINE_SIMPLE;
+    }
 #endif
     else if (buffer_eq_slen(stat_cache_string, CONST_STR_LEN("disable"))
              || buffer_eq_slen(stat_cache_string, CONST_STR_LEN("none")))
@@ -950,6 +1354,9 @@ int stat_cache_choose_engine (const buffer *stat_cache_string, log_error_st *err
 #endif
 #ifdef HAVE_FAM_H
           " \"fam\","
+#endif
+#ifdef STAT_CACHE_SHARED
+          " \"shared\","
 #endif
           " but not: %s";
         log_error(errh, __FILE__, __LINE__, fmt, stat_cache_string->ptr);
@@ -1112,9 +1519,12 @@ void stat_cache_update_entry(const char *name, uint32_t len,
     if (sc.stat_cache_engine == STAT_CACHE_ENGINE_NONE) return;
     if (__builtin_expect( (0 == len), 0)) return; /*(should not happen)*/
     if (name[len-1] == '/') { if (0 == --len) len = 1; }
-    splay_tree **sptree = &sc.files;
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) stat_cache_shared_invalidate(name, len);
+  #endif
+    uint32_t ndx;
     stat_cache_entry *sce =
-      stat_cache_sptree_find(sptree, name, len);
+      stat_cache_hashtab_ndx(&sc.files, &ndx, name, len);
     if (sce && buffer_is_equal_string(&sce->name, name, len)) {
         if (!stat_cache_stat_eq(&sce->st, st)) {
             /* etagb might be NULL to clear etag (invalidate) */
@@ -1126,12 +1536,13 @@ void stat_cache_update_entry(const char *name, uint32_t len,
           #endif
             if (sce->fd >= 0) {
                 if (1 == sce->refcnt) {
-                    close(sce->fd);
-                    sce->fd = -1;
+                    stat_cache_fd_close(sce);
                 }
                 else {
+                    stat_cache_fd_unlink(sce);
                     --sce->refcnt; /* stat_cache_entry_free(sce); */
-                    (*sptree)->data = sce = stat_cache_entry_init();
+                    sce = stat_cache_entry_init();
+                    hashtab_insert(&sc.files, ndx, sce);
                     buffer_copy_string_len(&sce->name, name, len);
                 }
             }
@@ -1146,17 +1557,23 @@ void stat_cache_delete_entry(const char *name, uint32_t len)
     if (sc.stat_cache_engine == STAT_CACHE_ENGINE_NONE) return;
     if (__builtin_expect( (0 == len), 0)) return; /*(should not happen)*/
     if (name[len-1] == '/') { if (0 == --len) len = 1; }
-    splay_tree **sptree = &sc.files;
-    stat_cache_entry *sce = stat_cache_sptree_find(sptree, name, len);
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) stat_cache_shared_invalidate(name, len);
+  #endif
+    uint32_t ndx;
+    stat_cache_entry *sce = stat_cache_hashtab_ndx(&sc.files, &ndx, name, len);
     if (sce && buffer_is_equal_string(&sce->name, name, len)) {
-        *sptree = stat_cache_sptree_node_free(*sptree);
+        hashtab_remove(&sc.files, ndx);
+        stat_cache_entry_free(sce);
     }
 }
 
 void stat_cache_invalidate_entry(const char *name, uint32_t len)
 {
-    splay_tree **sptree = &sc.files;
-    stat_cache_entry *sce = stat_cache_sptree_find(sptree, name, len);
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) stat_cache_shared_invalidate(name, len);
+  #endif
+    stat_cache_entry *sce = stat_cache_hashtab_find(&sc.files, name, len);
     if (sce && buffer_is_equal_string(&sce->name, name, len)) {
         sce->stat_ts = 0;
       #ifdef HAVE_FAM_H
@@ -1170,71 +1587,50 @@ void stat_cache_invalidate_entry(const char *name, uint32_t len)
 
 #ifdef HAVE_FAM_H
 
-static void stat_cache_invalidate_dir_tree_walk(splay_tree *t,
-                                                const char *name, size_t len)
+static int stat_cache_invalidate_dir_tree_fn(void *data, void *arg)
 {
-    if (t->left)  stat_cache_invalidate_dir_tree_walk(t->left,  name, len);
-    if (t->right) stat_cache_invalidate_dir_tree_walk(t->right, name, len);
-
-    const buffer * const b = &((stat_cache_entry *)t->data)->name;
-    const size_t blen = buffer_clen(b);
-    if (blen > len && b->ptr[len] == '/' && 0 == memcmp(b->ptr, name, len)) {
-        stat_cache_entry *sce = t->data;
+    stat_cache_entry * const sce = data;
+    if (stat_cache_path_in_dir(&sce->name, arg)) {
         sce->stat_ts = 0;
         if (sce->fam_dir != NULL) {
             --((fam_dir_entry *)sce->fam_dir)->refcnt;
             sce->fam_dir = NULL;
         }
     }
+    return 0;
 }
 
 static void stat_cache_invalidate_dir_tree(const char *name, size_t len)
 {
-    splay_tree * const sptree = sc.files;
-    if (sptree) stat_cache_invalidate_dir_tree_walk(sptree, name, len);
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) stat_cache_shared_invalidate_dir(name, (uint32_t)len);
+  #endif
+    stat_cache_path_arg d = { name, len };
+    hashtab_sweep(&sc.files, stat_cache_invalidate_dir_tree_fn, &d);
 }
 
 #endif
 
-/*
- * walk though splay_tree and collect contents of dir tree.
- * remove tagged entries in a second loop
- */
-
-static void stat_cache_tag_dir_tree(splay_tree *t, const char *name, size_t len,
-                                    int *keys, int *ndx)
+static int stat_cache_prune_dir_tree_fn(void *data, void *arg)
 {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)  stat_cache_tag_dir_tree(t->left,  name, len, keys, ndx);
-    if (t->right) stat_cache_tag_dir_tree(t->right, name, len, keys, ndx);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-
-    const buffer * const b = &((stat_cache_entry *)t->data)->name;
-    const size_t blen = buffer_clen(b);
-    if (blen > len && b->ptr[len] == '/' && 0 == memcmp(b->ptr, name, len))
-        keys[(*ndx)++] = t->key;
+    stat_cache_entry * const sce = data;
+    if (!stat_cache_path_in_dir(&sce->name, arg)) return 0;
+    stat_cache_entry_free(sce);
+    return 1;
 }
 
 __attribute_noinline__
 static void stat_cache_prune_dir_tree(const char *name, size_t len)
 {
-    splay_tree *sptree = sc.files;
-    int max_ndx, i;
-    int keys[8192]; /* 32k size on stack */
-    do {
-        if (!sptree) break;
-        max_ndx = 0;
-        stat_cache_tag_dir_tree(sptree, name, len, keys, &max_ndx);
-        for (i = 0; i < max_ndx; ++i) {
-            sptree = splaytree_splay_nonnull(sptree, keys[i]);
-            sptree = stat_cache_sptree_node_free(sptree);
-        }
-    } while (max_ndx == sizeof(keys)/sizeof(int));
-    sc.files = sptree;
+    stat_cache_path_arg d = { name, len };
+    hashtab_sweep(&sc.files, stat_cache_prune_dir_tree_fn, &d);
 }
 
 static void stat_cache_delete_tree(const char *name, uint32_t len)
 {
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm) stat_cache_shared_invalidate_dir(name, len);
+  #endif
     stat_cache_delete_entry(name, len);
     stat_cache_prune_dir_tree(name, len);
 }
@@ -1246,11 +1642,11 @@ void stat_cache_delete_dir(const char *name, uint32_t len)
     stat_cache_delete_tree(name, len);
   #ifdef HAVE_FAM_H
     if (sc.stat_cache_engine == STAT_CACHE_ENGINE_FAM) {
-        splay_tree **sptree = &sc.scf->dirs;
-        fam_dir_entry *fam_dir = stat_cache_sptree_find(sptree, name, len);
+        fam_dir_entry *fam_dir =
+          stat_cache_hashtab_find(&sc.scf->dirs, name, len);
         if (fam_dir && buffer_eq_slen(&fam_dir->name, name, len))
             fam_dir_invalidate_node(fam_dir);
-        if (*sptree) fam_dir_invalidate_tree(*sptree, name, len);
+        fam_dir_invalidate_tree(sc.scf, name, len);
         fam_dir_periodic_cleanup();
     }
   #endif
@@ -1258,7 +1654,7 @@ void stat_cache_delete_dir(const char *name, uint32_t len)
 
 __attribute_cold__
 __attribute_noinline__
-static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, uint32_t len, stat_cache_entry *sce, const int file_ndx, const int refresh) {
+static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, uint32_t len, stat_cache_entry *sce, const uint32_t file_ndx, const int refresh) {
 
   #ifndef _WIN32
     /* sanity check; should not happen; should not be called with rel paths */
@@ -1270,17 +1666,25 @@ static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, ui
 
     /* use full path w/ stat(), even w/ trailing '/' ('len' may be shorter) */
     struct stat st;
+  #ifdef STAT_CACHE_SHARED
+    /* check for fresh stat() result published by another worker */
+    const int shared = (sc.shm && 0 == sc.shm_owner)
+      && stat_cache_shared_get(name->ptr, len, &st);
+    if (!shared && -1 == stat(name->ptr, &st))
+        return NULL;
+  #else
     if (-1 == stat(name->ptr, &st))
         return NULL;
+  #endif
 
     if (NULL == sce || !stat_cache_stat_eq(&sce->st, &st)) {
         if (NULL != sce && sce->fd >= 0) {
             /* close fd when refresh needed */
             if (1 == sce->refcnt) {
-                close(sce->fd);
-                sce->fd = -1;
+                stat_cache_fd_close(sce);
             }
             else {
+                stat_cache_fd_unlink(sce);
                 --sce->refcnt; /* stat_cache_entry_free(sce); */
                 sce = NULL;
             }
@@ -1290,22 +1694,18 @@ static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, ui
             sce = stat_cache_entry_init();
             buffer_copy_string_len(&sce->name, name->ptr, len);
 
-            /* sptree already splayed to file_ndx in stat_cache_get_entry() */
-            splay_tree * const sptree = sc.files;
-            if (NULL != sptree && sptree->key == file_ndx) {
-                if (refresh < 0) { /* hash collision: replace old entry */
-                    stat_cache_entry_free(sptree->data);
-                } /* else prior sce refcnt was > 1 and decremented above */
-                sptree->data = sce;
-            }
-            else
-                sc.files = splaytree_insert_splayed(sptree, file_ndx, sce);
+            stat_cache_entry * const prev =
+              hashtab_insert(&sc.files, file_ndx, sce);
+            if (prev && refresh < 0) /* hash collision: replace old entry */
+                stat_cache_entry_free(prev);
+            /* else prior sce refcnt was > 1 and decremented above */
         }
         else {
             buffer_clear(&sce->etag);
           #if defined(HAVE_XATTR) || defined(HAVE_EXTATTR)
             buffer_clear(&sce->content_type);
           #endif
+            stat_cache_mem_release(sce);
         }
 
         sce->st = st; /*(copy prior to calling fam_dir_monitor())*/
@@ -1324,6 +1724,16 @@ static stat_cache_entry * stat_cache_refresh_entry(const buffer * const name, ui
     }
 
     sce->stat_ts = log_monotonic_secs;
+  #ifdef STAT_CACHE_SHARED
+    if (sc.shm && !shared) {
+      #ifdef HAVE_FAM_H
+        const int monitored = (sc.shm_owner > 0 && NULL != sce->fam_dir);
+      #else
+        const int monitored = 0;
+      #endif
+        stat_cache_shared_put(name->ptr, len, &st, sce->stat_ts, monitored);
+    }
+  #endif
     return sce;
 }
 
@@ -1339,9 +1749,9 @@ stat_cache_entry * stat_cache_get_entry(const buffer * const name) {
      * e.g. without repeated '/' */
 
     /* check if stat cache entry exists, matches name, and is fresh */
-    int file_ndx;
+    uint32_t file_ndx;
     stat_cache_entry *sce =
-      stat_cache_sptree_ndx(&sc.files, &file_ndx, name->ptr, len);
+      stat_cache_hashtab_ndx(&sc.files, &file_ndx, name->ptr, len);
     int refresh = -1;/* -1 stat cache entry does not exist, or hash collision */
     if (NULL != sce) {
         /* check if the name is the same; we might have a hash collision */
@@ -1380,14 +1790,77 @@ stat_cache_entry * stat_cache_get_entry(const buffer * const name) {
     return sce;
 }
 
-stat_cache_entry * stat_cache_get_entry_open(const buffer * const name, const int symlinks) {
-    stat_cache_entry * const sce = stat_cache_get_entry(name);
-    if (NULL == sce) return NULL;
-    if (sce->fd >= 0) return sce;
+int stat_cache_entry_open(stat_cache_entry * const sce, const int symlinks) {
+    if (sce->fd >= 0) {
+        ++worker_stats_self->fd_cache_hits;
+        sce->fd_ts = log_monotonic_secs;
+        if (sc.fd_head != sce) {
+            stat_cache_fd_unlink(sce);
+            stat_cache_fd_link(sce);
+        }
+        return sce->fd;
+    }
     if (sce->st.st_size > 0) {
-        sce->fd = stat_cache_open_rdonly_fstat(name, &sce->st, symlinks);
+        ++worker_stats_self->fd_cache_misses;
+        sce->fd = stat_cache_open_rdonly_fstat(&sce->name, &sce->st, symlinks);
         buffer_clear(&sce->etag);
+        stat_cache_mem_release(sce);
+        if (sce->fd >= 0) {
+            sce->fd_ts = log_monotonic_secs;
+            stat_cache_fd_link(sce);
+            if (sc.fd_count > sc.fd_max)
+                stat_cache_fd_prune(log_monotonic_secs);
+        }
     }
+    return sce->fd;
+}
+
+const buffer * stat_cache_entry_mem(stat_cache_entry * const sce, const int symlinks) {
+    if (sce->mem) {
+        ++worker_stats_self->mem_cache_hits;
+        sce->fd_ts = log_monotonic_secs;
+        return sce->mem;
+    }
+    if (sce->st.st_size > sc.mem_file_max
+        || sce->st.st_size > sc.mem_max - sc.mem_used
+        || 0 == sce->st.st_size
+        || !S_ISREG(sce->st.st_mode))
+        return NULL;
+
+    /* (open() and fstat() revalidate sce->st, which might change) */
+    if (stat_cache_entry_open(sce, symlinks) < 0) return NULL;
+    const off_t sz = sce->st.st_size;
+    if (sz > sc.mem_file_max || sz > sc.mem_max - sc.mem_used || 0 == sz)
+        return NULL;
+
+    buffer * const b = buffer_init();
+    char * const ptr = buffer_extend(b, (size_t)sz);
+    off_t off = 0;
+    do {
+        const ssize_t rd =
+          chunk_file_pread(sce->fd, ptr+off, (size_t)(sz - off), off);
+        if (rd <= 0) {
+            if (-1 == rd && errno == EINTR) continue;
+            buffer_free(b); /* error or file truncated; send from fd */
+            return NULL;
+        }
+        off += rd;
+    } while (off < sz);
+
+    sce->mem = b;
+    sce->fd_ts = log_monotonic_secs;
+    sc.mem_used += sz;
+    worker_stats_self->mem_cache_bytes = (uint64_t)sc.mem_used;
+    /* fd not needed while contents are in memory (unless in use) */
+    if (1 == sce->refcnt)
+        stat_cache_fd_close(sce);
+    return b;
+}
+
+stat_cache_entry * stat_cache_get_entry_open(const buffer * const name, const int symlinks) {
+    stat_cache_entry * const sce = stat_cache_get_entry(name);
+    if (NULL == sce) return NULL;
+    stat_cache_entry_open(sce, symlinks);
     return sce; /* (note: sce->fd might still be -1 if open() failed) */
 }
 
@@ -1474,38 +1947,38 @@ int stat_cache_open_rdonly_fstat (const buffer *name, struct stat *st, int symli
  * and remove them in a second loop
  */
 
-static void stat_cache_tag_old_entries(splay_tree * const t, int * const keys, int * const ndx, const time_t max_age, const unix_time64_t cur_ts) {
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
-    if (t->left)
-        stat_cache_tag_old_entries(t->left, keys, ndx, max_age, cur_ts);
-    if (t->right)
-        stat_cache_tag_old_entries(t->right, keys, ndx, max_age, cur_ts);
-    if (*ndx == 8192) return; /*(must match num array entries in keys[])*/
+typedef struct stat_cache_age_arg {
+    unix_time64_t cur_ts;
+    time_t max_age;
+} stat_cache_age_arg;
 
-    const stat_cache_entry * const sce = t->data;
-    if (cur_ts - sce->stat_ts > max_age)
-        keys[(*ndx)++] = t->key;
+static int stat_cache_old_entry_fn(void *data, void *arg) {
+    stat_cache_entry * const sce = data;
+    const stat_cache_age_arg * const a = arg;
+    if (a->cur_ts - sce->stat_ts > a->max_age
+        && ((sce->fd < 0 && NULL == sce->mem)
+            || a->cur_ts - sce->fd_ts >= sc.fd_ttl)) {
+        stat_cache_entry_free(sce);
+        return 1;
+    }
+    return 0;
 }
 
 static void stat_cache_periodic_cleanup(const time_t max_age, const unix_time64_t cur_ts) {
-    splay_tree *sptree = sc.files;
-    int max_ndx, i;
-    int keys[8192]; /* 32k size on stack */
-    do {
-        if (!sptree) break;
-        max_ndx = 0;
-        stat_cache_tag_old_entries(sptree, keys, &max_ndx, max_age, cur_ts);
-        for (i = 0; i < max_ndx; ++i) {
-            sptree = splaytree_splay_nonnull(sptree, keys[i]);
-            sptree = stat_cache_sptree_node_free(sptree);
-        }
-    } while (max_ndx == sizeof(keys)/sizeof(int));
-    sc.files = sptree;
+    stat_cache_age_arg a = { cur_ts, max_age };
+    hashtab_sweep(&sc.files, stat_cache_old_entry_fn, &a);
 }
 
 void stat_cache_trigger_cleanup(void) {
 	time_t max_age = 2;
 
+      #ifdef STAT_CACHE_SHARED
+	if (sc.shm) stat_cache_shared_periodic();
+      #endif
+
+	if (sc.fd_tail && log_monotonic_secs - sc.fd_tail->fd_ts >= sc.fd_ttl)
+		stat_cache_fd_prune(log_monotonic_secs);
+
       #ifdef HAVE_FAM_H
 	if (STAT_CACHE_ENGINE_FAM == sc.stat_cache_engine) {
 		if (log_monotonic_secs & 0x1F) return;
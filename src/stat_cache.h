@@ -22,6 +22,10 @@ typedef struct stat_cache_entry {
     buffer etag;
     buffer content_type;
     struct stat st;
+    struct stat_cache_entry *fd_prev; /* LRU list of entries with fd >= 0 */
+    struct stat_cache_entry *fd_next;
+    unix_time64_t fd_ts;              /* last use of fd or mem */
+    buffer *mem;                      /* file contents (if small, cached) */
 } stat_cache_entry;
 
 __attribute_cold__
@@ -40,6 +44,12 @@ void stat_cache_entry_refchg(void *data, int mod);
 __attribute_cold__
 void stat_cache_xattrname (const char *name);
 
+__attribute_cold__
+void stat_cache_fdcache_limits (uint32_t max_fds, uint32_t ttl);
+
+__attribute_cold__
+void stat_cache_memcache_limits (uint32_t max_file, uint32_t max_kb);
+
 __attribute_pure__
 const buffer * stat_cache_mimetype_by_ext(const array *mimetypes, const char *name, uint32_t nlen);
 
@@ -58,6 +68,14 @@ void stat_cache_delete_dir(const char *name, uint32_t len);
 void stat_cache_invalidate_entry(const char *name, uint32_t len);
 stat_cache_entry * stat_cache_get_entry(const buffer *name);
 stat_cache_entry * stat_cache_get_entry_open(const buffer *name, int symlinks);
+
+/* open fd in (current) sce, if not already open; returns sce->fd
+ * (sce->fd is -1 if open() failed or if file is empty) */
+int stat_cache_entry_open(stat_cache_entry *sce, int symlinks);
+
+/* contents of (current) sce, if small file and memory cache enabled;
+ * reads file into memory if not already cached; returns NULL if not cached */
+const buffer * stat_cache_entry_mem(stat_cache_entry *sce, int symlinks);
 const stat_cache_st * stat_cache_path_stat(const buffer *name);
 int stat_cache_path_isdir(const buffer *name);
 
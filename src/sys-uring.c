@@ -0,0 +1,141 @@
+/*
+ * sys-uring - minimal wrapper for Linux io_uring rings (without liburing)
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+#include "sys-uring.h"
+
+#ifdef HAVE_SYS_URING
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+int
+sys_uring_enter (const sys_uring * const ring, const uint32_t to_submit, const uint32_t min_complete, const uint32_t flags, void * const arg, const size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, ring->fd, to_submit,
+                        min_complete, flags, arg, argsz);
+}
+
+uint32_t
+sys_uring_sq_flush (sys_uring * const ring)
+{
+    __atomic_store_n(ring->sq_ktail, ring->sq_tail, __ATOMIC_RELEASE);
+    return ring->sq_tail - __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+}
+
+int
+sys_uring_submit (sys_uring * const ring)
+{
+    const uint32_t n = sys_uring_sq_flush(ring);
+    return n ? sys_uring_enter(ring, n, 0, 0, NULL, 0) : 0;
+}
+
+struct io_uring_sqe *
+sys_uring_get_sqe (sys_uring * const ring)
+{
+    if (ring->sq_tail - __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE)
+        == ring->sq_entries) {
+        /* SQ full; submit queued entries before queuing more */
+        if (sys_uring_submit(ring) <= 0) {
+            if (0 == errno) errno = EAGAIN;
+            return NULL;
+        }
+    }
+    struct io_uring_sqe * const sqe =
+      ring->sqes + (ring->sq_tail++ & ring->sq_mask);
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void
+sys_uring_free (sys_uring * const ring)
+{
+    if (ring->sqes && (void *)ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_sz);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED
+        && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_sz);
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+        munmap(ring->sq_ring, ring->sq_ring_sz);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+int
+sys_uring_init (sys_uring * const ring, const uint32_t entries, const uint32_t cq_entries)
+{
+    memset(ring, 0, sizeof(*ring));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP;
+    if (cq_entries) {
+        p.flags |= IORING_SETUP_CQSIZE;
+        p.cq_entries = cq_entries;
+    }
+    /*(io_uring_setup() sets O_CLOEXEC on ring fd)*/
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (-1 == ring->fd) return -1;
+    ring->features = p.features;
+
+    if (!(p.features & IORING_FEAT_NODROP)
+        || !(p.features & IORING_FEAT_EXT_ARG)) {
+        sys_uring_free(ring);
+        errno = ENOSYS;
+        return -1;
+    }
+
+    ring->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_sz = p.cq_off.cqes
+                     + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_sz    = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->sq_ring_sz < ring->cq_ring_sz)
+            ring->sq_ring_sz = ring->cq_ring_sz;
+        ring->cq_ring_sz = ring->sq_ring_sz;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_sz, PROT_READ|PROT_WRITE,
+                         MAP_SHARED|MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP)
+      ? ring->sq_ring
+      : mmap(NULL, ring->cq_ring_sz, PROT_READ|PROT_WRITE,
+             MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_sz, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (MAP_FAILED == ring->sq_ring || MAP_FAILED == ring->cq_ring
+        || MAP_FAILED == (void *)ring->sqes) {
+        const int errnum = errno;
+        sys_uring_free(ring);
+        errno = errnum;
+        return -1;
+    }
+
+    char * const sq = ring->sq_ring;
+    char * const cq = ring->cq_ring;
+    ring->sq_khead   = (uint32_t *)(sq + p.sq_off.head);
+    ring->sq_ktail   = (uint32_t *)(sq + p.sq_off.tail);
+    ring->sq_mask    = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    ring->sq_entries = *(uint32_t *)(sq + p.sq_off.ring_entries);
+    ring->sq_tail    = *ring->sq_ktail;
+    ring->cq_khead   = (uint32_t *)(cq + p.cq_off.head);
+    ring->cq_ktail   = (uint32_t *)(cq + p.cq_off.tail);
+    ring->cq_mask    = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    ring->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    /* SQEs are always queued in order; fill SQ index array once */
+    uint32_t * const sq_array = (uint32_t *)(sq + p.sq_off.array);
+    for (uint32_t i = 0; i < ring->sq_entries; ++i)
+        sq_array[i] = i;
+
+    return 0;
+}
+
+#endif /* HAVE_SYS_URING */
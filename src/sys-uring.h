@@ -0,0 +1,74 @@
+/*
+ * sys-uring - minimal wrapper for Linux io_uring rings (without liburing)
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#ifndef LI_SYS_URING_H
+#define LI_SYS_URING_H
+#include "first.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__linux__)
+#include <linux/io_uring.h>
+#ifdef IORING_FEAT_EXT_ARG /* Linux kernel 5.11+ headers */
+#define HAVE_SYS_URING
+#endif
+#endif
+
+#ifdef HAVE_SYS_URING
+
+typedef struct sys_uring {
+    int fd;
+    uint32_t features;
+    uint32_t *sq_khead;
+    uint32_t *sq_ktail;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_tail;
+    struct io_uring_sqe *sqes;
+    uint32_t *cq_khead;
+    uint32_t *cq_ktail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_sz;
+    size_t cq_ring_sz;
+    size_t sqes_sz;
+} sys_uring;
+
+/* returns 0 on success, -1 on error (with errno set)
+ * (requires kernel features IORING_FEAT_NODROP and IORING_FEAT_EXT_ARG
+ *  (Linux kernel 5.11+); fails with errno ENOSYS if not available) */
+__attribute_cold__
+int sys_uring_init (sys_uring *ring, uint32_t entries, uint32_t cq_entries);
+
+__attribute_cold__
+void sys_uring_free (sys_uring *ring);
+
+int sys_uring_enter (const sys_uring *ring, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t argsz);
+
+/* make queued SQEs visible to kernel; return count not yet submitted */
+uint32_t sys_uring_sq_flush (sys_uring *ring);
+
+/* submit queued SQEs (without waiting for completions) */
+int sys_uring_submit (sys_uring *ring);
+
+/* returns zeroed SQE, submitting queued SQEs first if SQ is full;
+ * returns NULL (with errno set) if SQ full and unable to submit */
+struct io_uring_sqe * sys_uring_get_sqe (sys_uring *ring);
+
+static inline uint32_t sys_uring_cq_tail (const sys_uring *ring);
+static inline uint32_t sys_uring_cq_tail (const sys_uring *ring)
+{
+    return __atomic_load_n(ring->cq_ktail, __ATOMIC_ACQUIRE);
+}
+
+static inline void sys_uring_cq_advance (sys_uring *ring, uint32_t head);
+static inline void sys_uring_cq_advance (sys_uring *ring, uint32_t head)
+{
+    __atomic_store_n(ring->cq_khead, head, __ATOMIC_RELEASE);
+}
+
+#endif /* HAVE_SYS_URING */
+
+#endif /* LI_SYS_URING_H */
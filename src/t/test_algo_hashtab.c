@@ -0,0 +1,91 @@
+#include "first.h"
+
+#include <stdio.h>
+
+#include "algo_hashtab.c"
+
+#define NKEYS 20000
+
+static uint32_t keys[NKEYS];
+static int vals[NKEYS];
+static int nfreed;
+
+static int test_algo_hashtab_sweep_odd (void *data, void *arg) {
+	UNUSED(arg);
+	return (*(int *)data & 1);
+}
+
+static void test_algo_hashtab_free (void *data) {
+	UNUSED(data);
+	++nfreed;
+}
+
+static void test_algo_hashtab_basic (void) {
+	hashtab ht = { NULL, 0, 0, NULL, 0, 0, 0 };
+
+	ck_assert(NULL == hashtab_find(&ht, 0));
+	ck_assert(NULL == hashtab_remove(&ht, 0));
+	ck_assert(0 == hashtab_used(&ht));
+
+	char k[16];
+	for (int i = 0; i < NKEYS; ++i) {
+		const int n = snprintf(k, sizeof(k), "/k/%d", i);
+		keys[i] = hashtab_hash(k, (uint32_t)n);
+		vals[i] = i;
+		/*(skip (unlikely) hash collisions in test keys)*/
+		if (hashtab_find(&ht, keys[i])) { vals[i] = -1; continue; }
+		ck_assert(NULL == hashtab_insert(&ht, keys[i], vals+i));
+		/* all entries must remain reachable during incremental resize */
+		if (0 == (i & 0x3ff))
+			for (int j = 0; j <= i; ++j)
+				ck_assert(vals[j] < 0
+				          || vals+j == hashtab_find(&ht, keys[j]));
+	}
+	uint32_t used = 0;
+	for (int i = 0; i < NKEYS; ++i) {
+		if (vals[i] < 0) continue;
+		++used;
+		ck_assert(vals+i == hashtab_find(&ht, keys[i]));
+	}
+	ck_assert(used == hashtab_used(&ht));
+
+	/* replace returns prior data */
+	ck_assert(vals+0 == hashtab_insert(&ht, keys[0], vals+0));
+	ck_assert(used == hashtab_used(&ht));
+
+	/* remove every third entry */
+	for (int i = 0; i < NKEYS; i += 3) {
+		if (vals[i] < 0) continue;
+		ck_assert(vals+i == hashtab_remove(&ht, keys[i]));
+		ck_assert(NULL == hashtab_remove(&ht, keys[i]));
+		--used;
+	}
+	ck_assert(used == hashtab_used(&ht));
+	for (int i = 0; i < NKEYS; ++i) {
+		if (vals[i] < 0) continue;
+		ck_assert((i % 3 ? vals+i : NULL) == hashtab_find(&ht, keys[i]));
+	}
+
+	/* sweep removes odd values */
+	hashtab_sweep(&ht, test_algo_hashtab_sweep_odd, NULL);
+	used = 0;
+	for (int i = 0; i < NKEYS; ++i) {
+		if (vals[i] < 0) continue;
+		const int expect = (i % 3) && !(i & 1);
+		used += expect;
+		ck_assert((expect ? vals+i : NULL) == hashtab_find(&ht, keys[i]));
+	}
+	ck_assert(used == hashtab_used(&ht));
+
+	nfreed = 0;
+	hashtab_clear(&ht, test_algo_hashtab_free);
+	ck_assert((int)used == nfreed);
+	ck_assert(0 == hashtab_used(&ht));
+	ck_assert(NULL == hashtab_find(&ht, keys[2]));
+}
+
+void test_algo_hashtab (void);
+void test_algo_hashtab (void)
+{
+	test_algo_hashtab_basic();
+}
@@ -0,0 +1,294 @@
+#include "first.h"
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gw_backend.c"
+
+static int test_gw_stats[64];
+static int test_gw_stats_used;
+
+static gw_host * test_gw_host_init (const uint32_t nprocs)
+{
+    gw_host * const host = ck_calloc(1, sizeof(gw_host));
+    host->weight = 1;
+    host->stats_load = test_gw_stats + test_gw_stats_used++;
+    host->stats_global_active = test_gw_stats + test_gw_stats_used++;
+    for (uint32_t i = 0; i < nprocs; ++i) {
+        gw_proc * const proc = ck_calloc(1, sizeof(gw_proc));
+        proc->state = PROC_STATE_RUNNING;
+        proc->stats_load = test_gw_stats + test_gw_stats_used++;
+        proc->stats_latency = test_gw_stats + test_gw_stats_used++;
+        proc->next = host->first;
+        host->first = proc;
+        ++host->active_procs;
+    }
+    assert(test_gw_stats_used <= (int)(sizeof(test_gw_stats)/sizeof(int)));
+    return host;
+}
+
+static void test_gw_host_free (gw_host * const host)
+{
+    for (gw_proc *proc = host->first, *next; proc; proc = next) {
+        next = proc->next;
+        free(proc);
+    }
+    free(host);
+}
+
+static void test_gw_backend_latency_ewma (void)
+{
+    gw_host * const host = test_gw_host_init(1);
+    gw_proc * const proc = host->first;
+    proc->ewma_ts = log_monotonic_secs;
+
+    /* higher sample replaces average (peak) */
+    gw_proc_latency_update(proc, 8000);
+    assert(8000 == proc->ewma_us);
+    assert(8000 == *proc->stats_latency);
+
+    /* lower sample decays average with weight 1/8 */
+    gw_proc_latency_update(proc, 0);
+    assert(7000 == proc->ewma_us);
+    gw_proc_latency_update(proc, 7000);
+    assert(7000 == proc->ewma_us);
+    gw_proc_latency_update(proc, 20000);
+    assert(20000 == proc->ewma_us);
+
+    /* average halves every GW_EWMA_DECAY_SECS without samples */
+    proc->ewma_us = 8000;
+    proc->ewma_ts = log_monotonic_secs - (GW_EWMA_DECAY_SECS-1);
+    assert(8000 == gw_proc_ewma(proc));
+    proc->ewma_ts = log_monotonic_secs - GW_EWMA_DECAY_SECS;
+    assert(4000 == gw_proc_ewma(proc));
+    proc->ewma_ts = log_monotonic_secs - GW_EWMA_DECAY_SECS*3;
+    assert(1000 == gw_proc_ewma(proc));
+    proc->ewma_ts = log_monotonic_secs - GW_EWMA_DECAY_SECS*32;
+    assert(0 == gw_proc_ewma(proc));
+    /* sample after idle period decays from decayed average */
+    proc->ewma_ts = log_monotonic_secs - GW_EWMA_DECAY_SECS;
+    gw_proc_latency_update(proc, 0);
+    assert(3500 == proc->ewma_us);
+    assert(log_monotonic_secs == proc->ewma_ts);
+
+    /* timeout or error is recorded as peak sample of at least read_timeout */
+    gw_handler_ctx hctx;
+    memset(&hctx, 0, sizeof(hctx));
+    hctx.host = host;
+    hctx.proc = proc;
+    gw_proc_latency_error(&hctx); /*(no-op; latency not being measured)*/
+    assert(3500 == proc->ewma_us);
+    host->read_timeout = 2;
+    hctx.latency_ns = request_timing_ns();
+    gw_proc_latency_error(&hctx);
+    assert(0 == hctx.latency_ns);
+    assert(2000000 == proc->ewma_us);
+    host->read_timeout = 0;
+    hctx.latency_ns = request_timing_ns() - 5000000000uLL; /* 5s ago */
+    gw_proc_latency_error(&hctx);
+    assert(proc->ewma_us >= 5000000);
+
+    /* response headers received; sample is time since proc acquired */
+    proc->ewma_us = 0;
+    hctx.latency_ns = request_timing_ns() - 3000000; /* 3ms ago */
+    gw_proc_latency_sample(&hctx);
+    assert(0 == hctx.latency_ns);
+    assert(proc->ewma_us >= 3000 && proc->ewma_us < 3000000);
+
+    test_gw_host_free(host);
+}
+
+static void test_gw_backend_latency_balance (void)
+{
+    request_st r;
+    connection con;
+    server srv;
+    memset(&r, 0, sizeof(request_st));
+    memset(&con, 0, sizeof(connection));
+    memset(&srv, 0, sizeof(server));
+    r.con = &con;
+    con.srv = &srv;
+    srv.srvconf.max_worker = 1; /*(skip adaptive spawning if all down)*/
+    r.conf.errh = fdlog_init(NULL, -1, FDLOG_FD);
+    r.conf.errh->fd = -1; /* (disable) */
+
+    gw_host *hosts[3];
+    for (int i = 0; i < 3; ++i) {
+        hosts[i] = test_gw_host_init(2);
+        hosts[i]->first->ewma_ts = hosts[i]->first->next->ewma_ts =
+          log_monotonic_secs;
+    }
+    gw_extension ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.hosts = hosts;
+    ext.used = 3;
+
+    /* host cost is lowest latency of its running procs weighted by load */
+    hosts[0]->first->ewma_us = 1000;  hosts[0]->first->next->ewma_us = 9999;
+    hosts[1]->first->ewma_us = 2000;  hosts[1]->first->next->ewma_us = 9999;
+    hosts[2]->first->ewma_us = 3000;  hosts[2]->first->next->ewma_us = 9999;
+    assert(gw_host_cost(hosts[0]) < gw_host_cost(hosts[1]));
+    hosts[0]->load = 2;
+    assert(gw_host_cost(hosts[0]) > gw_host_cost(hosts[1]));
+    hosts[0]->load = 0;
+    hosts[0]->first->state = PROC_STATE_OVERLOADED;
+    assert(gw_host_cost(hosts[0]) > gw_host_cost(hosts[2]));
+    hosts[0]->first->state = PROC_STATE_RUNNING;
+
+    assert(hosts[0]
+           == gw_host_get(&r, &ext, GW_BALANCE_LEAST_LATENCY, 0));
+
+    /* power of two choices: host with highest cost is never chosen and
+     * others are chosen when compared with it or with each other */
+    int counts[3] = { 0, 0, 0 };
+    for (int i = 0; i < 300; ++i) {
+        gw_host * const host = gw_host_get(&r, &ext, GW_BALANCE_P2C, 0);
+        for (int k = 0; k < 3; ++k) {
+            if (host == hosts[k]) ++counts[k];
+        }
+    }
+    assert(0 == counts[2]);
+    assert(counts[0] > counts[1] && counts[1] > 0);
+
+    /* host which is down is not chosen, even if lowest cost */
+    hosts[0]->active_procs = 0;
+    for (int i = 0; i < 100; ++i)
+        assert(hosts[0] != gw_host_get(&r, &ext, GW_BALANCE_P2C, 0));
+    hosts[1]->active_procs = 0;
+    for (int i = 0; i < 100; ++i)
+        assert(hosts[2] == gw_host_get(&r, &ext, GW_BALANCE_P2C, 0));
+    hosts[2]->active_procs = 0;
+    assert(NULL == gw_host_get(&r, &ext, GW_BALANCE_P2C, 0));
+    assert(503 == r.http_status);
+
+    /* slow response (error sample) moves requests to other host */
+    hosts[0]->active_procs = hosts[1]->active_procs = 2;
+    gw_handler_ctx hctx;
+    memset(&hctx, 0, sizeof(hctx));
+    hctx.host = hosts[0];
+    hctx.proc = hosts[0]->first;
+    hosts[0]->first->next->state = PROC_STATE_DIED;
+    hosts[0]->read_timeout = 1;
+    hctx.latency_ns = request_timing_ns();
+    gw_proc_latency_error(&hctx);
+    assert(1000000 == hosts[0]->first->ewma_us);
+    assert(hosts[1]
+           == gw_host_get(&r, &ext, GW_BALANCE_LEAST_LATENCY, 0));
+
+    for (int i = 0; i < 3; ++i) test_gw_host_free(hosts[i]);
+    fdlog_free(r.conf.errh);
+}
+
+static void test_gw_backend_ring (void)
+{
+    request_st r;
+    memset(&r, 0, sizeof(request_st));
+
+    gw_host *hosts[3];
+    static const char * const names[] = { "a:80", "b:80", "c:80" };
+    for (int i = 0; i < 3; ++i) {
+        hosts[i] = test_gw_host_init(1);
+        hosts[i]->gw_hash = gw_hash(names[i], 4, DJBHASH_INIT);
+    }
+    hosts[2]->weight = 2;
+    gw_extension ext;
+    memset(&ext, 0, sizeof(ext));
+    ext.hosts = hosts;
+    ext.used = 3;
+
+    /* ring is built on first use by balance "hash" or "sticky" */
+    assert(NULL != gw_host_get(&r, &ext, GW_BALANCE_LEAST_CONNECTION, 0));
+    assert(NULL == ext.ring);
+    buffer_copy_string_len(&r.uri.path, CONST_STR_LEN("/index.html"));
+    assert(NULL != gw_host_get(&r, &ext, GW_BALANCE_HASH, 0));
+    assert(NULL != ext.ring);
+    assert(4 * GW_RING_VNODES == ext.ring_used);
+    const struct gw_ring_point * const ring = ext.ring;
+    const uint32_t n = ext.ring_used;
+    for (uint32_t i = 1; i < n; ++i)
+        assert(ring[i-1].hash <= ring[i].hash);
+
+    /* keys are spread across hosts in proportion to weight */
+    enum { NKEYS = 40000 };
+    uint8_t *map = ck_malloc(NKEYS);
+    int counts[3] = { 0, 0, 0 };
+    for (uint32_t i = 0; i < NKEYS; ++i) {
+        const int ndx = gw_ring_get(&ext, gw_ring_mix(i));
+        assert(ndx >= 0 && ndx < 3);
+        map[i] = (uint8_t)ndx;
+        ++counts[ndx];
+    }
+    assert(counts[0] > NKEYS/5 && counts[0] < NKEYS*3/10);
+    assert(counts[1] > NKEYS/5 && counts[1] < NKEYS*3/10);
+    assert(counts[2] > NKEYS*2/5 && counts[2] < NKEYS*3/5);
+
+    /* keys of host which is down move to other hosts; other keys stay */
+    hosts[1]->active_procs = 0;
+    int moved[3] = { 0, 0, 0 };
+    for (uint32_t i = 0; i < NKEYS; ++i) {
+        const int ndx = gw_ring_get(&ext, gw_ring_mix(i));
+        assert(ndx != 1);
+        if (map[i] != 1)
+            assert(ndx == map[i]);
+        else
+            ++moved[ndx];
+    }
+    assert(moved[0] > 0 && moved[2] > 0);
+    assert(moved[0] + moved[2] == counts[1]);
+    hosts[1]->active_procs = 1;
+    free(map);
+
+    /* key after last point wraps around to first point on ring */
+    const uint32_t last = ring[n-1].hash;
+    if (last < UINT32_MAX) {
+        assert((int)ring[0].ndx == gw_ring_get(&ext, last + 1));
+        assert((int)ring[0].ndx == gw_ring_get(&ext, UINT32_MAX));
+    }
+    assert((int)ring[n-1].ndx == gw_ring_get(&ext, last));
+    assert((int)ring[0].ndx == gw_ring_get(&ext, 0));
+    /* ... and past points of host which is down, to next host on ring */
+    hosts[ring[0].ndx]->active_procs = 0;
+    uint32_t i = 0;
+    while (ring[i].ndx == ring[0].ndx) ++i;
+    assert((int)ring[i].ndx == gw_ring_get(&ext, UINT32_MAX));
+    hosts[ring[0].ndx]->active_procs = 1;
+
+    /* all hosts down */
+    for (int k = 0; k < 3; ++k) hosts[k]->active_procs = 0;
+    assert(-1 == gw_ring_get(&ext, 0));
+
+    free(r.uri.path.ptr);
+    free(ext.ring);
+    for (int k = 0; k < 3; ++k) test_gw_host_free(hosts[k]);
+}
+
+int main (void)
+{
+    log_monotonic_secs = 1000;
+    test_gw_backend_latency_ewma();
+    test_gw_backend_latency_balance();
+    test_gw_backend_ring();
+    return 0;
+}
+
+
+#if defined(LIGHTTPD_STATIC)
+
+#include "base_decls.h" /*(plugin *)*/
+
+/* For static builds, plugin.c contains references to module init funcs,
+ * so create stubs for module init funcs */
+#define PLUGIN_INIT_EXPAND(x) \
+        int x ## _plugin_init(plugin *p); \
+        int x ## _plugin_init(plugin *p) { UNUSED(p); return 0; }
+#define PLUGIN_INIT(x) \
+        PLUGIN_INIT_EXPAND(x)
+
+#include "plugin-static.h"
+
+#undef PLUGIN_INIT
+#undef PLUGIN_INIT_EXPAND
+
+#endif /* LIGHTTPD_STATIC */
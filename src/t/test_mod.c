@@ -6,7 +6,9 @@
 #include "chunk.h"
 
 void test_mod_access (void);
+void test_mod_accesslog (void);
 void test_mod_alias (void);
+void test_mod_deflate (void);
 void test_mod_evhost (void);
 void test_mod_expire (void);
 void test_mod_indexfile (void);
@@ -19,7 +21,9 @@ int main(void) {
     chunkqueue_set_tempdirs_default(NULL, 0);
 
     test_mod_access();
+    test_mod_accesslog();
     test_mod_alias();
+    test_mod_deflate();
     test_mod_evhost();
     test_mod_expire();
     test_mod_indexfile();
@@ -41,7 +45,9 @@ int main(void) {
  * symbols will be missing from test_mod, so create stubs for module
  * init funcs, but rename to skip those included in test_mod.c tests. */
 #define mod_access         mod_access_dup
+#define mod_accesslog      mod_accesslog_dup
 #define mod_alias          mod_alias_dup
+#define mod_deflate        mod_deflate_dup
 #define mod_evhost         mod_evhost_dup
 #define mod_expire         mod_expire_dup
 #define mod_indexfile      mod_indexfile_dup
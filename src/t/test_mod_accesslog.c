@@ -0,0 +1,272 @@
+#include "first.h"
+
+#undef NDEBUG
+#include <sys/types.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mod_accesslog.c"
+#include "fdevent.h"
+
+static uint64_t test_mod_accesslog_le (const char *s, uint32_t n)
+{
+    uint64_t v = 0;
+    while (n--) v = (v << 8) | (unsigned char)s[n];
+    return v;
+}
+
+static const char * test_mod_accesslog_binary_str (const char *s, const char *str, size_t len)
+{
+    assert(len == test_mod_accesslog_le(s, 2));
+    assert(0 == memcmp(s+2, str, len));
+    return s + 2 + len;
+}
+
+static void test_mod_accesslog_binary (void)
+{
+    request_st r;
+    memset(&r, 0, sizeof(request_st));
+    r.http_method = HTTP_METHOD_GET;
+    r.http_version = HTTP_VERSION_1_1;
+    r.http_status = 206;
+    r.read_queue.bytes_out = 1000;
+    r.x.h1.bytes_read_ckpt = 400;
+    r.write_queue.bytes_out = 5000;
+    r.x.h1.bytes_written_ckpt = 1000;
+    log_clock_gettime_realtime(&r.start_hp);
+    r.start_hp.tv_sec -= 2;
+    sock_addr addr;
+    assert(1 == sock_addr_inet_pton(&addr, "192.0.2.1", AF_INET, 8080));
+    r.dst_addr = &addr;
+    buffer_copy_string_len(&r.uri.authority, CONST_STR_LEN("www.example.org"));
+    buffer_copy_string_len(&r.target_orig, CONST_STR_LEN("/index.html?x=1"));
+    /* strings are length-prefixed and are not escaped */
+    http_header_request_set(&r, HTTP_HEADER_USER_AGENT,
+                            CONST_STR_LEN("User-Agent"),
+                            CONST_STR_LEN("agent \"1\"\n"));
+
+    buffer * const b = buffer_init();
+    buffer_copy_string_len(b, CONST_STR_LEN("prev"));/*(records are appended)*/
+    log_access_record_binary(&r, b);
+    const char *s = b->ptr + 4;
+    const uint32_t len = (uint32_t)test_mod_accesslog_le(s, 4);
+    assert(len == buffer_clen(b) - 4);
+    assert(ACCESSLOG_BINARY_VERSION == test_mod_accesslog_le(s+4, 2));
+    assert(206 == test_mod_accesslog_le(s+6, 2));
+    const uint64_t start = (uint64_t)r.start_hp.tv_sec * 1000000
+                         + (uint64_t)r.start_hp.tv_nsec / 1000;
+    assert(start == test_mod_accesslog_le(s+8, 8));
+    const uint64_t usecs = test_mod_accesslog_le(s+16, 8);
+    assert(usecs >= 2000000 && usecs < 60000000);
+    assert(600 == test_mod_accesslog_le(s+24, 8));
+    assert(4000 == test_mod_accesslog_le(s+32, 8));
+    assert(4 == s[40]);   /* address family */
+    assert(11 == s[41]);  /* HTTP/1.1 */
+    assert(8080 == test_mod_accesslog_le(s+42, 2));
+    assert(0 == memcmp(s+44, "\xc0\x00\x02\x01", 4));
+    for (int i = 4; i < 16; ++i) assert(0 == s[44+i]);
+    s += ACCESSLOG_BINARY_HDRSZ;
+    s = test_mod_accesslog_binary_str(s, CONST_STR_LEN("GET"));
+    s = test_mod_accesslog_binary_str(s, CONST_STR_LEN("www.example.org"));
+    s = test_mod_accesslog_binary_str(s, CONST_STR_LEN("/index.html?x=1"));
+    s = test_mod_accesslog_binary_str(s, "", 0); /* REMOTE_USER */
+    s = test_mod_accesslog_binary_str(s, "", 0); /* Referer */
+    s = test_mod_accesslog_binary_str(s, CONST_STR_LEN("agent \"1\"\n"));
+    assert(s == b->ptr + buffer_clen(b));
+
+  #ifdef HAVE_IPV6
+    buffer_clear(b);
+    assert(1 == sock_addr_inet_pton(&addr, "2001:db8::1", AF_INET6, 443));
+    r.http_version = HTTP_VERSION_2;
+    log_access_record_binary(&r, b);
+    s = b->ptr;
+    assert(6 == s[40]);
+    assert(20 == s[41]);  /* HTTP/2 */
+    assert(443 == test_mod_accesslog_le(s+42, 2));
+    assert(0 == memcmp(s+44, "\x20\x01\x0d\xb8", 4));
+    assert(1 == s[59]);
+    /* HTTP/2 request byte counts are not offset by connection checkpoints */
+    assert(1000 == test_mod_accesslog_le(s+24, 8));
+    assert(5000 == test_mod_accesslog_le(s+32, 8));
+  #endif
+
+    buffer_free(b);
+    free(r.uri.authority.ptr);
+    free(r.target_orig.ptr);
+    array_free_data(&r.rqst_headers);
+}
+
+#ifdef ACCESSLOG_RING
+
+static void test_mod_accesslog_file_check (int fd, const char *s, size_t len)
+{
+    char buf[16384];
+    assert(len < sizeof(buf));
+    assert((ssize_t)len == pread(fd, buf, sizeof(buf), 0));
+    assert(0 == memcmp(buf, s, len));
+}
+
+static void test_mod_accesslog_ring_append_drain (plugin_data * const p, log_error_st * const errh, const int fd)
+{
+    accesslog_ring * const ring = p->ring;
+    buffer * const b = buffer_init();
+    char rec[1000];
+
+    /* records drained in order to log file */
+    accesslog_ring_append(p, 0, CONST_STR_LEN("one\n"));
+    accesslog_ring_append(p, 0, CONST_STR_LEN("two\n"));
+    assert(1 == accesslog_ring_drain(p, errh));
+    assert(ring->tail == ring->head);
+    assert(0 == accesslog_ring_drain(p, errh));
+    buffer_append_string_len(b, CONST_STR_LEN("one\ntwo\n"));
+    test_mod_accesslog_file_check(fd, BUF_PTR_LEN(b));
+
+    /* consumed ring data is zeroed (record len 0 until committed) */
+    for (uint32_t i = 0; i < p->ring_sz; ++i) assert(0 == ring->data[i]);
+
+    /* record which does not fit at end of ring wraps to start of ring */
+    for (int i = 0; i < 5; ++i) {
+        memset(rec, 'a' + i, sizeof(rec) - 1);
+        rec[sizeof(rec)-1] = '\n';
+        accesslog_ring_append(p, 0, rec, sizeof(rec));
+        buffer_append_string_len(b, rec, sizeof(rec));
+        if (i == 2) assert(1 == accesslog_ring_drain(p, errh));
+    }
+    assert((ring->head & (p->ring_sz-1)) < (ring->tail & (p->ring_sz-1)));
+    assert(1 == accesslog_ring_drain(p, errh));
+    assert(ring->tail == ring->head);
+    test_mod_accesslog_file_check(fd, BUF_PTR_LEN(b));
+
+    /* records are dropped (not blocking) when ring is full,
+     * and records larger than 1/4 ring size are always dropped */
+    accesslog_ring_append(p, 0, rec, p->ring_sz >> 2);
+    assert(1 == p->ring_dropped);
+    for (int i = 0; i < 5; ++i)
+        accesslog_ring_append(p, 0, rec, sizeof(rec));
+    assert(2 == p->ring_dropped);
+    assert(1 == accesslog_ring_drain(p, errh));
+    for (int i = 0; i < 4; ++i)
+        buffer_append_string_len(b, rec, sizeof(rec));
+    test_mod_accesslog_file_check(fd, BUF_PTR_LEN(b));
+    p->ring_dropped = 0;
+
+    /* record reserved, but not yet committed, stalls drain */
+    const uint64_t h = ring->head;
+    ring->head += ACCESSLOG_RING_RECSZ(4);
+    accesslog_ring_append(p, 0, CONST_STR_LEN("skip\n"));
+    assert(0 == accesslog_ring_drain(p, errh));
+    accesslog_ring_rec * const r = (accesslog_ring_rec *)(void *)
+      (ring->data + (h & (p->ring_sz-1)));
+    r->idx = 0;
+    memcpy(r+1, "two\n", 4);
+    __atomic_store_n(&r->len, 4 | ACCESSLOG_RING_COMMIT, __ATOMIC_RELEASE);
+    assert(1 == accesslog_ring_drain(p, errh));
+    buffer_append_string_len(b, CONST_STR_LEN("two\nskip\n"));
+    test_mod_accesslog_file_check(fd, BUF_PTR_LEN(b));
+
+    buffer_free(b);
+}
+
+static void test_mod_accesslog_ring_writer (plugin_data * const p, log_error_st * const errh, const int fd)
+{
+    accesslog_ring * const ring = p->ring;
+    server srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.errh = errh;
+
+    /* producer killed after reserving record, but before committing it */
+    const off_t sz = lseek(fd, 0, SEEK_END);
+    ring->head += ACCESSLOG_RING_RECSZ(4);
+    accesslog_ring_append(p, 0, CONST_STR_LEN("lost\n"));
+    const uint64_t skip_head = ring->head;
+
+    const pid_t pid = fork();
+    assert(-1 != pid);
+    if (0 == pid)
+        accesslog_ring_writer(&srv, p);
+
+    /* writer does not skip stalled records unless producer was killed */
+    const struct timespec ts = { 0, 100000000 }; /* 100ms */
+    for (int i = 0; i < 15; ++i) nanosleep(&ts, NULL);
+    assert(ring->tail == skip_head - ACCESSLOG_RING_RECSZ(5)
+                                   - ACCESSLOG_RING_RECSZ(4));
+
+    /* writer skips stalled records after (reported) killed producer */
+    __atomic_add_fetch(&ring->crashed, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < 50 && ring->tail != skip_head; ++i)
+        nanosleep(&ts, NULL);
+    assert(ring->tail == skip_head);
+    for (uint32_t i = 0; i < p->ring_sz; ++i) assert(0 == ring->data[i]);
+
+    /* writer drains records appended after skip, then exits on shutdown */
+    accesslog_ring_append(p, 0, CONST_STR_LEN("next\n"));
+    __atomic_store_n(&ring->shutdown, 1, __ATOMIC_RELEASE);
+    int status;
+    assert(pid == waitpid(pid, &status, 0));
+    assert(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    assert(ring->tail == ring->head);
+
+    char buf[8];
+    assert(5 == pread(fd, buf, sizeof(buf), sz));
+    assert(0 == memcmp(buf, "next\n", 5));
+}
+
+static void test_mod_accesslog_ring (log_error_st * const errh)
+{
+    const char *tmpdir = getenv("TMPDIR");
+  #ifdef _WIN32
+    if (NULL == tmpdir) tmpdir = getenv("TEMP");
+  #endif
+    if (NULL == tmpdir) tmpdir = "/tmp";
+    buffer fnb = { NULL, 0, 0 };
+    buffer_copy_path_len2(&fnb, tmpdir, strlen(tmpdir),
+                          CONST_STR_LEN("lighttpd_mod_accesslog.XXXXXX"));
+    char * const fn = fnb.ptr;
+    int fd = fdevent_mkostemp(fn, 0);
+    if (fd < 0) {
+        perror("mkstemp()");
+        buffer_free_ptr(&fnb);
+        exit(1);
+    }
+    close(fd);
+    fd = fdevent_open_cloexec(fn, 0, O_RDONLY, 0); /*(log file opened O_WRONLY)*/
+    assert(-1 != fd);
+
+    plugin_data * const p = mod_accesslog_init();
+    p->ring_sz = 4096;
+    p->ring = mmap(NULL, sizeof(accesslog_ring) + p->ring_sz,
+                   PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    assert(MAP_FAILED != p->ring);
+    p->ring_logs = ck_malloc(sizeof(fdlog_st *));
+    p->ring_logs[p->ring_nlogs++] = fdlog_open(fn);
+    assert(NULL != p->ring_logs[0]);
+
+    test_mod_accesslog_ring_append_drain(p, errh, fd);
+    test_mod_accesslog_ring_writer(p, errh, fd);
+
+    accesslog_ring_free(p);
+    fdlog_closeall(errh);
+    close(fd);
+    unlink(fn);
+    free(fnb.ptr);
+    free(p);
+}
+
+#endif /* ACCESSLOG_RING */
+
+void test_mod_accesslog (void);
+void test_mod_accesslog (void)
+{
+    log_error_st * const errh = fdlog_init(NULL, -1, FDLOG_FD);
+    errh->fd = -1; /* (disable) */
+
+    test_mod_accesslog_binary();
+
+  #ifdef ACCESSLOG_RING
+    test_mod_accesslog_ring(errh);
+  #endif
+
+    fdlog_free(errh);
+}
@@ -0,0 +1,139 @@
+#include "first.h"
+
+#undef NDEBUG
+#include <sys/types.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* (test cache index; compression libraries not linked into test_mod) */
+#undef HAVE_LIBZ
+#undef HAVE_LIBBZ2
+#undef HAVE_BROTLI
+#undef HAVE_ZSTD
+#include "mod_deflate.c"
+
+#ifndef _WIN32
+
+static void test_mod_deflate_cache_mkfile (buffer * const b, const char * const name, const off_t size)
+{
+    const uint32_t blen = buffer_clen(b);
+    buffer_append_path_len(b, name, strlen(name));
+    int fd = fdevent_open_cloexec(b->ptr, 0, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+    assert(fd >= 0);
+    assert(0 == ftruncate(fd, size));
+    close(fd);
+    mod_deflate_cache_insert(b->ptr, buffer_clen(b), size);
+    buffer_truncate(b, blen);
+}
+
+static int test_mod_deflate_cache_exists (buffer * const b, const char * const name)
+{
+    const uint32_t blen = buffer_clen(b);
+    buffer_append_path_len(b, name, strlen(name));
+    struct stat st;
+    const int rc = (0 == stat(b->ptr, &st));
+    buffer_truncate(b, blen);
+    return rc;
+}
+
+static void test_mod_deflate_cache_rm (buffer * const b, const char * const name)
+{
+    const uint32_t blen = buffer_clen(b);
+    buffer_append_path_len(b, name, strlen(name));
+    unlink(b->ptr);
+    buffer_truncate(b, blen);
+}
+
+static void test_mod_deflate_cache_evict (void)
+{
+    struct mod_deflate_cache * const dc = &mod_deflate_cache;
+    log_error_st * const errh = fdlog_init(NULL, -1, FDLOG_FD);
+    errh->fd = -1; /* (disable error logging) */
+
+    const char *tmpdir = getenv("TMPDIR");
+  #ifdef __COVERITY__
+    if (tmpdir && strlen(tmpdir) > 4096) tmpdir = NULL;
+  #endif
+    if (NULL == tmpdir) tmpdir = "/tmp";
+    buffer * const b = buffer_init();
+    buffer_copy_path_len2(b, tmpdir, strlen(tmpdir),
+                          CONST_STR_LEN("lighttpd_mod_deflate.XXXXXX"));
+    assert(NULL != mkdtemp(b->ptr));
+
+    mod_deflate_cache_free();
+    dc->max = 1000;
+
+    /* files indexed oldest first (as by mod_deflate_cache_scan()) */
+    test_mod_deflate_cache_mkfile(b, "a", 400);
+    test_mod_deflate_cache_mkfile(b, "b", 400);
+    test_mod_deflate_cache_mkfile(b, "c", 400);
+    assert(1200 == dc->used);
+    mod_deflate_cache_total_init(errh);
+    assert(1200 == mod_deflate_cache_total());
+
+    /* least recently used entry is removed when limit is exceeded */
+    mod_deflate_cache_evict(errh);
+    assert(!test_mod_deflate_cache_exists(b, "a"));
+    assert(test_mod_deflate_cache_exists(b, "b"));
+    assert(test_mod_deflate_cache_exists(b, "c"));
+    assert(800 == dc->used);
+    assert(800 == mod_deflate_cache_total());
+
+    /* entry hit since reaching LRU tail is given another pass */
+    const uint32_t blen = buffer_clen(b);
+    buffer_append_path_len(b, CONST_STR_LEN("b"));
+    mod_deflate_cache_entry *e =
+      mod_deflate_cache_find(b->ptr, buffer_clen(b),
+                             hashtab_hash(b->ptr, buffer_clen(b)));
+    buffer_truncate(b, blen);
+    assert(e && e == dc->tail);
+    e->hits = 1;
+    test_mod_deflate_cache_mkfile(b, "d", 400);
+    mod_deflate_cache_total_add(400);
+    mod_deflate_cache_evict(errh);
+    assert(test_mod_deflate_cache_exists(b, "b"));
+    assert(!test_mod_deflate_cache_exists(b, "c"));
+    assert(test_mod_deflate_cache_exists(b, "d"));
+    assert(0 == e->hits);
+    assert(800 == mod_deflate_cache_total());
+
+  #ifdef MOD_DEFLATE_CACHE_SHARED
+    /* total is shared: files added by other workers (not in this index)
+     * count toward limit and cause eviction from this index */
+    mod_deflate_cache_total_add(300);
+    mod_deflate_cache_evict(errh);
+    assert(test_mod_deflate_cache_exists(b, "b"));
+    assert(!test_mod_deflate_cache_exists(b, "d"));
+    assert(400 == dc->used);
+    assert(700 == mod_deflate_cache_total());
+
+    /* file already removed (e.g. by another worker) is not subtracted again */
+    test_mod_deflate_cache_rm(b, "b");
+    mod_deflate_cache_total_add(400);
+    mod_deflate_cache_evict(errh);
+    assert(NULL == dc->tail);
+    assert(0 == dc->used);
+    assert(1100 == mod_deflate_cache_total());
+    mod_deflate_cache_total_add(-1100);
+  #else
+    test_mod_deflate_cache_rm(b, "b");
+    test_mod_deflate_cache_rm(b, "d");
+  #endif
+
+    mod_deflate_cache_free();
+    assert(NULL == dc->total);
+    rmdir(b->ptr);
+    buffer_free(b);
+    fdlog_free(errh);
+}
+
+#endif /* !_WIN32 */
+
+void test_mod_deflate (void);
+void test_mod_deflate (void)
+{
+  #ifndef _WIN32
+    test_mod_deflate_cache_evict();
+  #endif
+}
@@ -6,12 +6,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
 
 #include "mod_staticfile.c"
 #include "fdlog.h"
 #include "http_date.h"
 #include "http_etag.h"
 #include "http_header.h"
+#include "worker_stats.h"
 
 __attribute_noinline__
 static void test_mod_staticfile_reset (request_st * const r)
@@ -367,6 +369,224 @@ test_mod_staticfile_process (request_st * const r, plugin_config * const pconf)
 }
 
 #include "sys-unistd.h" /* unlink() */
+
+static void
+test_mod_staticfile_precompressed (request_st * const r, plugin_config * const pconf)
+{
+    test_mod_staticfile_reset(r);
+    const buffer *vb;
+
+    const uint32_t plen = buffer_clen(&r->physical.path);
+    buffer_append_string_len(&r->physical.path, CONST_STR_LEN(".gz"));
+    FILE * const fp = fopen(r->physical.path.ptr, "wb");
+    assert(fp);
+    fputs("not really gzip", fp);
+    fclose(fp);
+    buffer_truncate(&r->physical.path, plen);
+
+    static const unsigned char precompressed[] = { 1, 3, 0 }; /* br, gzip */
+    pconf->precompressed = precompressed;
+
+    run_mod_staticfile_process(r, pconf, __LINE__, 200,
+      "precompressed (no Accept-Encoding)");
+    assert(!light_btst(r->resp_htags, HTTP_HEADER_CONTENT_ENCODING));
+    vb = http_header_response_get(r, HTTP_HEADER_VARY, CONST_STR_LEN("Vary"));
+    assert(vb && buffer_eq_slen(vb, CONST_STR_LEN("Accept-Encoding")));
+    test_mod_staticfile_reset(r);
+
+    http_header_request_set(r, HTTP_HEADER_ACCEPT_ENCODING,
+                            CONST_STR_LEN("Accept-Encoding"),
+                            CONST_STR_LEN("br, gzip;q=0"));
+    run_mod_staticfile_process(r, pconf, __LINE__, 200,
+      "precompressed (encoding not accepted or file not present)");
+    assert(!light_btst(r->resp_htags, HTTP_HEADER_CONTENT_ENCODING));
+    test_mod_staticfile_reset(r);
+
+    http_header_request_set(r, HTTP_HEADER_ACCEPT_ENCODING,
+                            CONST_STR_LEN("Accept-Encoding"),
+                            CONST_STR_LEN("deflate, br, gzip;q=0.5"));
+    run_mod_staticfile_process(r, pconf, __LINE__, 200,
+      "precompressed (gzip)");
+    vb = http_header_response_get(r, HTTP_HEADER_CONTENT_ENCODING,
+                                  CONST_STR_LEN("Content-Encoding"));
+    assert(vb && buffer_eq_slen(vb, CONST_STR_LEN("gzip")));
+    vb = http_header_response_get(r, HTTP_HEADER_CONTENT_TYPE,
+                                  CONST_STR_LEN("Content-Type"));
+    assert(vb && buffer_eq_slen(vb, CONST_STR_LEN("text/plain")));
+    vb = http_header_response_get(r, HTTP_HEADER_ETAG, CONST_STR_LEN("ETag"));
+    assert(vb && buffer_clen(vb) > 6
+           && 0 == memcmp(vb->ptr+buffer_clen(vb)-6, "-gzip\"", 6));
+    assert(15 == chunkqueue_length(&r->write_queue));
+    test_mod_staticfile_reset(r);
+
+    http_header_request_unset(r, HTTP_HEADER_ACCEPT_ENCODING,
+                              CONST_STR_LEN("Accept-Encoding"));
+    pconf->precompressed = NULL;
+    buffer_append_string_len(&r->physical.path, CONST_STR_LEN(".gz"));
+    unlink(r->physical.path.ptr);
+    buffer_truncate(&r->physical.path, plen);
+}
+
+static void
+test_http_response_send_file_mem (request_st * const r)
+{
+    test_mod_staticfile_reset(r);
+
+    /* (separate file; stat_cache entry for empty file used above) */
+    const uint32_t plen = buffer_clen(&r->physical.path);
+    buffer_append_string_len(&r->physical.path, CONST_STR_LEN("-mem"));
+    FILE *fp = fopen(r->physical.path.ptr, "wb");
+    assert(fp);
+    fputs("small file", fp);
+    fclose(fp);
+    const uint64_t hits = worker_stats_self->mem_cache_hits;
+
+    /* memory cache disabled (default) */
+    run_http_response_send_file(r, __LINE__, 200,
+      "small file (memory cache disabled)");
+    assert(r->write_queue.first && r->write_queue.first->type == FILE_CHUNK);
+    assert(10 == chunkqueue_length(&r->write_queue));
+    test_mod_staticfile_reset(r);
+
+    /* file larger than stat-cache-mem-max-file */
+    stat_cache_memcache_limits(9, 16);
+    run_http_response_send_file(r, __LINE__, 200,
+      "small file (larger than memory cache max file size)");
+    assert(r->write_queue.first && r->write_queue.first->type == FILE_CHUNK);
+    assert(0 == worker_stats_self->mem_cache_bytes);
+    test_mod_staticfile_reset(r);
+
+    /* file contents read into memory, then sent from memory */
+    stat_cache_memcache_limits(16384, 16);
+    run_http_response_send_file(r, __LINE__, 200,
+      "small file (read into memory cache)");
+    chunk *c = r->write_queue.first;
+    assert(c && c->type == MEM_CHUNK && NULL == c->next);
+    assert(buffer_eq_slen(c->mem, CONST_STR_LEN("small file")));
+    assert(10 == worker_stats_self->mem_cache_bytes);
+    assert(hits == worker_stats_self->mem_cache_hits);
+    assert(http_header_response_get(r, HTTP_HEADER_ETAG,
+                                    CONST_STR_LEN("ETag")));
+    test_mod_staticfile_reset(r);
+
+    run_http_response_send_file(r, __LINE__, 200,
+      "small file (sent from memory cache)");
+    c = r->write_queue.first;
+    assert(c && c->type == MEM_CHUNK);
+    assert(buffer_eq_slen(c->mem, CONST_STR_LEN("small file")));
+    assert(hits + 1 == worker_stats_self->mem_cache_hits);
+    test_mod_staticfile_reset(r);
+
+    /* conditional request is not affected by memory cache */
+    const buffer *vb;
+    run_http_response_send_file(r, __LINE__, 200, "small file (etag)");
+    vb = http_header_response_get(r, HTTP_HEADER_ETAG, CONST_STR_LEN("ETag"));
+    assert(vb);
+    http_header_request_set(r, HTTP_HEADER_IF_NONE_MATCH,
+                            CONST_STR_LEN("If-None-Match"), BUF_PTR_LEN(vb));
+    test_mod_staticfile_reset(r);
+    run_http_response_send_file(r, __LINE__, 304,
+      "small file (if-none-match, memory cache)");
+    assert(NULL == r->write_queue.first);
+    test_mod_staticfile_reset(r);
+    r->rqst_htags = 0;
+    array_reset_data_strings(&r->rqst_headers);
+
+    /* cached contents discarded when file changes (on stat() revalidation) */
+    fp = fopen(r->physical.path.ptr, "wb");
+    assert(fp);
+    fputs("modified small file", fp);
+    fclose(fp);
+    ++log_monotonic_secs;
+    run_http_response_send_file(r, __LINE__, 200,
+      "small file (modified; memory cache refreshed)");
+    c = r->write_queue.first;
+    assert(c && c->type == MEM_CHUNK);
+    assert(buffer_eq_slen(c->mem, CONST_STR_LEN("modified small file")));
+    assert(19 == worker_stats_self->mem_cache_bytes);
+    test_mod_staticfile_reset(r);
+
+    stat_cache_memcache_limits(0, 0);
+    unlink(r->physical.path.ptr);
+    buffer_truncate(&r->physical.path, plen);
+}
+
+static void
+test_stat_cache_fd_lru (request_st * const r)
+{
+    /* (separate files; each stat_cache entry holds its own fd) */
+    const uint32_t plen = buffer_clen(&r->physical.path);
+    buffer fnb[3];
+    stat_cache_entry *sce[3];
+    memset(fnb, 0, sizeof(fnb));
+    for (int i = 0; i < 3; ++i) {
+        buffer_copy_buffer(fnb+i, &r->physical.path);
+        buffer_append_string_len(fnb+i, CONST_STR_LEN("-fd"));
+        buffer_append_int(fnb+i, i);
+        FILE * const fp = fopen(fnb[i].ptr, "wb");
+        assert(fp);
+        fputs("fd cache", fp);
+        fclose(fp);
+    }
+
+    /* most recently used fd is kept even if over limit */
+    stat_cache_fdcache_limits(0, 0);
+    sce[0] = stat_cache_get_entry_open(fnb+0, 1);
+    assert(sce[0] && sce[0]->fd >= 0);
+    assert(1 == worker_stats_self->fd_cache_open);
+
+    /* least recently used fd closed when over limit */
+    stat_cache_fdcache_limits(2, 16);
+    sce[1] = stat_cache_get_entry_open(fnb+1, 1);
+    sce[2] = stat_cache_get_entry_open(fnb+2, 1);
+    assert(sce[1] && sce[1]->fd >= 0);
+    assert(sce[2] && sce[2]->fd >= 0);
+    assert(-1 == sce[0]->fd);
+    assert(2 == worker_stats_self->fd_cache_open);
+
+    /* reuse of cached fd refreshes LRU */
+    const uint64_t hits = worker_stats_self->fd_cache_hits;
+    const int fd1 = sce[1]->fd;
+    assert(fd1 == stat_cache_entry_open(sce[1], 1));
+    assert(hits + 1 == worker_stats_self->fd_cache_hits);
+    assert(stat_cache_entry_open(sce[0], 1) >= 0);
+    assert(-1 == sce[2]->fd);
+    assert(fd1 == sce[1]->fd);
+    assert(2 == worker_stats_self->fd_cache_open);
+
+    /* fd in use by response (refcnt > 1) is not closed when over limit */
+    stat_cache_entry_refchg(sce[1], 1);
+    assert(stat_cache_entry_open(sce[2], 1) >= 0);
+    assert(fd1 == sce[1]->fd);
+    assert(-1 == sce[0]->fd);
+    assert(2 == worker_stats_self->fd_cache_open);
+
+    /* fds unused for ttl are closed (unless in use or most recently used) */
+    stat_cache_fdcache_limits(8, 16);
+    assert(stat_cache_entry_open(sce[0], 1) >= 0);
+    assert(3 == worker_stats_self->fd_cache_open);
+    const int fd2 = sce[2]->fd;
+    log_monotonic_secs += 16;
+    sce[0] = stat_cache_get_entry_open(fnb+0, 1); /*(refresh; same entry)*/
+    assert(sce[0] && sce[0]->fd >= 0);
+    stat_cache_trigger_cleanup(); /*(sce[2] might be freed; do not use)*/
+    assert(-1 == fcntl(fd2, F_GETFD));
+    assert(fd1 == sce[1]->fd && -1 != fcntl(fd1, F_GETFD));
+    assert(sce[0]->fd >= 0);
+    /*(expired sce[1] removed from stat_cache and LRU, but fd kept open
+     * until response releases it)*/
+    assert(1 == worker_stats_self->fd_cache_open);
+    stat_cache_entry_refchg(sce[1], -1);
+    assert(-1 == fcntl(fd1, F_GETFD));
+
+    stat_cache_fdcache_limits(0, 0);
+    for (int i = 0; i < 3; ++i) {
+        unlink(fnb[i].ptr);
+        free(fnb[i].ptr);
+    }
+    buffer_truncate(&r->physical.path, plen);
+}
+
 #include "fdevent.h"
 
 void test_mod_staticfile (void);
@@ -430,6 +650,17 @@ void test_mod_staticfile (void)
     buffer_copy_string_len(&r.physical.path, fn, fnlen);
     test_mod_staticfile_process(&r, &p->conf);
 
+    buffer_copy_string_len(&r.physical.path, fn, fnlen);
+    test_mod_staticfile_precompressed(&r, &p->conf);
+
+    array_set_key_value(mimetypes, CONST_STR_LEN("-mem"),
+                                   CONST_STR_LEN("text/plain"));
+    buffer_copy_string_len(&r.physical.path, fn, fnlen);
+    test_http_response_send_file_mem(&r);
+
+    buffer_copy_string_len(&r.physical.path, fn, fnlen);
+    test_stat_cache_fd_lru(&r);
+
     array_free(mimetypes);
     fdlog_free(r.conf.errh);
     buffer_free(r.tmp_buf);
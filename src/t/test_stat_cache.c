@@ -0,0 +1,291 @@
+#include "first.h"
+
+#undef NDEBUG
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stat_cache.c"
+#include "fdevent_impl.h"
+#include "fdlog.h"
+#include "sys-wait.h"
+
+#ifdef STAT_CACHE_SHARED
+
+static stat_cache_shared_entry *
+test_stat_cache_shared_entry (const char * const name, const uint32_t len)
+{
+    const uint32_t h = hashtab_hash(name, len);
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_PROBE; ++i) {
+        stat_cache_shared_entry * const e =
+          sc.shm->e + ((h + i) & (STAT_CACHE_SHARED_ENTRIES-1));
+        if (e->hash == h && e->nlen == len && 0 == memcmp(e->name, name, len))
+            return e;
+    }
+    return NULL;
+}
+
+static void test_stat_cache_shared_put_get (void)
+{
+    struct stat st, rst;
+    memset(&st, 0, sizeof(st));
+    st.st_size = 1234;
+    st.st_mode = S_IFREG;
+    const unix_time64_t cur_ts = log_monotonic_secs;
+
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+    stat_cache_shared_put(CONST_STR_LEN("/a/file"), &st, cur_ts, 0);
+    memset(&rst, 0, sizeof(rst));
+    assert(stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+    assert(1234 == rst.st_size);
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/a/fil"), &rst));
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/a/file2"), &rst));
+
+    /* put replaces matching entry (gen incremented by 2 per write) */
+    stat_cache_shared_entry * const e =
+      test_stat_cache_shared_entry(CONST_STR_LEN("/a/file"));
+    assert(e && 2 == e->gen);
+    st.st_size = 5678;
+    stat_cache_shared_put(CONST_STR_LEN("/a/file"), &st, cur_ts, 0);
+    assert(e == test_stat_cache_shared_entry(CONST_STR_LEN("/a/file")));
+    assert(4 == e->gen);
+    assert(stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+    assert(5678 == rst.st_size);
+
+    /* unmonitored entry trusted only within the same second */
+    ++log_monotonic_secs;
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+
+    /* monitored entry trusted for up to 16 seconds */
+    stat_cache_shared_put(CONST_STR_LEN("/a/file"), &st, cur_ts, 1);
+    assert(stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+    log_monotonic_secs = cur_ts + 15;
+    assert(stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+    log_monotonic_secs = cur_ts + 16;
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/a/file"), &rst));
+    log_monotonic_secs = cur_ts;
+
+    /* names which do not fit in entry are not shared */
+    char name[256];
+    memset(name, 'x', sizeof(name));
+    name[0] = '/';
+    stat_cache_shared_put(name, sizeof(name), &st, cur_ts, 0);
+    assert(!stat_cache_shared_get(name, sizeof(name), &rst));
+    assert(NULL == test_stat_cache_shared_entry(name, sizeof(name)));
+    stat_cache_shared_put(name, sizeof(name)-1, &st, cur_ts, 0);
+    assert(stat_cache_shared_get(name, sizeof(name)-1, &rst));
+    stat_cache_shared_invalidate(name, sizeof(name)-1);
+    assert(!stat_cache_shared_get(name, sizeof(name)-1, &rst));
+}
+
+static void test_stat_cache_shared_invalidate (void)
+{
+    struct stat st, rst;
+    memset(&st, 0, sizeof(st));
+    const unix_time64_t cur_ts = log_monotonic_secs;
+
+    stat_cache_shared_put(CONST_STR_LEN("/b"), &st, cur_ts, 0);
+    stat_cache_shared_put(CONST_STR_LEN("/b/file"), &st, cur_ts, 0);
+    stat_cache_shared_put(CONST_STR_LEN("/b/dir/file"), &st, cur_ts, 0);
+    stat_cache_shared_put(CONST_STR_LEN("/bb/file"), &st, cur_ts, 0);
+    stat_cache_shared_put(CONST_STR_LEN("/c/file"), &st, cur_ts, 0);
+
+    stat_cache_shared_invalidate(CONST_STR_LEN("/c/file"));
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/c/file"), &rst));
+    stat_cache_shared_invalidate(CONST_STR_LEN("/c/file")); /*(no entry)*/
+    assert(stat_cache_shared_get(CONST_STR_LEN("/b/file"), &rst));
+
+    /* invalidate_dir removes entries under dir, but not dir itself
+     * and not entries which merely share a prefix with dir */
+    stat_cache_shared_invalidate_dir(CONST_STR_LEN("/b"));
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/b/file"), &rst));
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/b/dir/file"), &rst));
+    assert(stat_cache_shared_get(CONST_STR_LEN("/b"), &rst));
+    assert(stat_cache_shared_get(CONST_STR_LEN("/bb/file"), &rst));
+
+    /* empty entry is reused */
+    stat_cache_shared_put(CONST_STR_LEN("/b/file"), &st, cur_ts, 0);
+    assert(stat_cache_shared_get(CONST_STR_LEN("/b/file"), &rst));
+}
+
+static void test_stat_cache_shared_busy (void)
+{
+    struct stat st, rst;
+    memset(&st, 0, sizeof(st));
+    st.st_size = 1;
+    const unix_time64_t cur_ts = log_monotonic_secs;
+
+    stat_cache_shared_put(CONST_STR_LEN("/d/file"), &st, cur_ts, 0);
+    stat_cache_shared_entry * const e =
+      test_stat_cache_shared_entry(CONST_STR_LEN("/d/file"));
+    assert(e);
+
+    /* entry held by (simulated) writer in another process (odd gen) */
+    uint32_t gen;
+    assert(e == stat_cache_shared_lock(e, &gen));
+    assert(e->gen & 1);
+    assert(NULL == stat_cache_shared_lock(e, &gen));
+
+    /* readers skip busy entry (miss) */
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/d/file"), &rst));
+
+    /* writers skip busy entry (never block) */
+    st.st_size = 2;
+    stat_cache_shared_put(CONST_STR_LEN("/d/file"), &st, cur_ts, 0);
+    assert(1 == e->st.st_size);
+
+    /* invalidate gives up after bounded spin (writer killed holding entry) */
+    stat_cache_shared_invalidate(CONST_STR_LEN("/d/file"));
+    assert(0 != e->nlen);
+
+    /* entry usable again once released */
+    stat_cache_shared_unlock(e, gen);
+    assert(!(e->gen & 1));
+    assert(stat_cache_shared_get(CONST_STR_LEN("/d/file"), &rst));
+    assert(1 == rst.st_size);
+    stat_cache_shared_put(CONST_STR_LEN("/d/file"), &st, cur_ts, 0);
+    assert(stat_cache_shared_get(CONST_STR_LEN("/d/file"), &rst));
+    assert(2 == rst.st_size);
+    stat_cache_shared_invalidate(CONST_STR_LEN("/d/file"));
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/d/file"), &rst));
+}
+
+#ifdef HAVE_FAM_H
+
+static int test_stat_cache_event_set (fdevents *ev, fdnode *fdn, int events)
+{
+    UNUSED(ev);
+    UNUSED(events);
+    fdn->fde_ndx = fdn->fd;
+    return 0;
+}
+
+static int test_stat_cache_event_del (fdevents *ev, fdnode *fdn)
+{
+    UNUSED(ev);
+    UNUSED(fdn);
+    return 0;
+}
+
+static void test_stat_cache_shared_owner (log_error_st * const errh)
+{
+    struct stat st, rst;
+    memset(&st, 0, sizeof(st));
+    const unix_time64_t cur_ts = log_monotonic_secs;
+
+    fdevents ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.maxfds = 4096;
+    ev.fdarray = ck_calloc(ev.maxfds, sizeof(*ev.fdarray));
+    ev.event_set = test_stat_cache_event_set;
+    ev.event_del = test_stat_cache_event_del;
+    ev.errh = errh;
+    sc.ev = &ev;
+    sc.errh = errh;
+
+    /* entries published as monitored by (prior) owner */
+    stat_cache_shared_put(CONST_STR_LEN("/e/file1"), &st, cur_ts, 1);
+    stat_cache_shared_put(CONST_STR_LEN("/e/file2"), &st, cur_ts, 1);
+    stat_cache_shared_put(CONST_STR_LEN("/e/file3"), &st, cur_ts, 0);
+
+    /* owner alive; not claimed */
+    const pid_t ppid = getppid();
+    sc.shm->owner = (int32_t)ppid;
+    assert(0 == stat_cache_shared_claim());
+    assert(0 == sc.shm_owner);
+    assert(ppid == sc.shm->owner);
+    assert(test_stat_cache_shared_entry(CONST_STR_LEN("/e/file1"))->monitored);
+
+    /* owner exited without releasing entries; take over monitoring */
+    const pid_t pid = fork();
+    if (0 == pid) _exit(0);
+    assert(-1 != pid);
+    assert(pid == waitpid(pid, NULL, 0));
+    sc.shm->owner = (int32_t)pid;
+    assert(1 == stat_cache_shared_claim());
+    assert(1 == sc.shm_owner);
+    assert(getpid() == sc.shm->owner);
+    assert(STAT_CACHE_ENGINE_FAM == sc.stat_cache_engine);
+    assert(NULL != sc.scf);
+
+    /* entries monitored by prior owner are no longer trusted past
+     * the second in which they were stat()ed */
+    for (uint32_t i = 0; i < STAT_CACHE_SHARED_ENTRIES; ++i)
+        assert(!sc.shm->e[i].monitored);
+    assert(stat_cache_shared_get(CONST_STR_LEN("/e/file1"), &rst));
+    ++log_monotonic_secs;
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/e/file1"), &rst));
+    assert(!stat_cache_shared_get(CONST_STR_LEN("/e/file2"), &rst));
+    --log_monotonic_secs;
+
+    /* owner releases ownership and monitored entries */
+    stat_cache_shared_put(CONST_STR_LEN("/e/file3"), &st, cur_ts, 1);
+    stat_cache_shared_release();
+    assert(0 == sc.shm_owner);
+    assert(0 == sc.shm->owner);
+    assert(!test_stat_cache_shared_entry(CONST_STR_LEN("/e/file3"))->monitored);
+
+    fdevent_fdnode_event_del(&ev, sc.scf->fdn);
+    fdevent_unregister(&ev, sc.scf->fdn);
+    sc.scf->fdn = NULL;
+    stat_cache_free_fam(sc.scf);
+    sc.scf = NULL;
+    sc.stat_cache_engine = STAT_CACHE_ENGINE_SIMPLE;
+    sc.ev = NULL;
+    sc.errh = NULL;
+    free(ev.fdarray);
+}
+
+#endif /* HAVE_FAM_H */
+
+static void test_stat_cache_shared (void)
+{
+    log_error_st * const errh = fdlog_init(NULL, -1, FDLOG_FD);
+    errh->fd = -1; /* (disable) */
+
+    assert(stat_cache_shared_init(errh));
+    assert(NULL != sc.shm);
+    assert(stat_cache_shared_init(errh)); /*(already initialized)*/
+
+    test_stat_cache_shared_put_get();
+    test_stat_cache_shared_invalidate();
+    test_stat_cache_shared_busy();
+  #ifdef HAVE_FAM_H
+    test_stat_cache_shared_owner(errh);
+  #endif
+
+    stat_cache_free();
+    assert(NULL == sc.shm);
+    fdlog_free(errh);
+}
+
+#endif /* STAT_CACHE_SHARED */
+
+int main (void)
+{
+    log_monotonic_secs = 1000;
+  #ifdef STAT_CACHE_SHARED
+    test_stat_cache_shared();
+  #endif
+    return 0;
+}
+
+
+#if defined(LIGHTTPD_STATIC)
+
+#include "base_decls.h" /*(plugin *)*/
+
+/* For static builds, plugin.c contains references to module init funcs,
+ * so create stubs for module init funcs */
+#define PLUGIN_INIT_EXPAND(x) \
+        int x ## _plugin_init(plugin *p); \
+        int x ## _plugin_init(plugin *p) { UNUSED(p); return 0; }
+#define PLUGIN_INIT(x) \
+        PLUGIN_INIT_EXPAND(x)
+
+#include "plugin-static.h"
+
+#undef PLUGIN_INIT
+#undef PLUGIN_INIT_EXPAND
+
+#endif /* LIGHTTPD_STATIC */
@@ -0,0 +1,442 @@
+/*
+ * worker_stats - server statistics counters shared across workers
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#include "first.h"
+#include "worker_stats.h"
+
+#include <sys/types.h>
+#include "sys-mmap.h"
+#include "sys-unistd.h" /* <unistd.h> */
+
+#include <errno.h>
+#include <string.h>
+
+#include "base.h"
+#include "ck.h"
+#include "log.h"
+#include "plugin_config.h" /* plugin_stats */
+#include "request.h"
+
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS)
+#ifdef MAP_ANON
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#if defined(HAVE_FORK) && defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+#define WORKER_STATS_SHARED
+#endif
+
+#ifdef __ATOMIC_ACQUIRE
+#define worker_stats_load_acquire(p)  __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define worker_stats_store_release(p,v) \
+        __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define worker_stats_fence_acquire()  __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define worker_stats_fence_release()  __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define worker_stats_load_acquire(p)  (*(volatile uint32_t *)(p))
+#define worker_stats_store_release(p,v) (*(volatile uint32_t *)(p) = (v))
+#define worker_stats_fence_acquire()  do { } while (0)
+#define worker_stats_fence_release()  do { } while (0)
+#endif
+
+/* plugin_stats serialized as records: (uint16_t klen, key, int value) */
+#define WORKER_STATS_PSTATS_SZ 16000
+
+typedef struct worker_stats_slot {
+    worker_stats s;
+    int32_t pid;
+    uint32_t gen;  /* seqlock: odd while pstats being updated */
+    uint32_t plen;
+    uint32_t nvhosts; /* (entries are appended; name set before nvhosts) */
+    uint32_t nbackends;
+    worker_stats_vhost vhosts[WORKER_STATS_VHOSTS];
+    worker_stats_backend backends[WORKER_STATS_BACKENDS];
+    char pstats[WORKER_STATS_PSTATS_SZ];
+} worker_stats_slot;
+
+/* (slot stride rounded up to cache line size to avoid false sharing) */
+#define WORKER_STATS_SLOT_STRIDE ((sizeof(worker_stats_slot) + 63) & ~63uL)
+
+static worker_stats_slot worker_stats_local;
+static worker_stats_slot *worker_stats_self_slot = &worker_stats_local;
+worker_stats *worker_stats_self = &worker_stats_local.s;
+
+int worker_stats_metrics;
+
+const uint32_t worker_stats_hist_bounds[WORKER_STATS_HIST_BUCKETS-1] = {
+  1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000
+};
+
+#ifdef WORKER_STATS_SHARED
+static char *worker_stats_shm;
+static uint32_t worker_stats_nslots;
+#endif
+
+
+static worker_stats_slot *
+worker_stats_slot_get (const uint32_t i)
+{
+  #ifdef WORKER_STATS_SHARED
+    if (worker_stats_shm)
+        return (worker_stats_slot *)
+          (void *)(worker_stats_shm + i * WORKER_STATS_SLOT_STRIDE);
+  #endif
+    UNUSED(i);
+    return &worker_stats_local;
+}
+
+
+void
+worker_stats_free (void)
+{
+    worker_stats_self_slot = &worker_stats_local;
+    worker_stats_self = &worker_stats_local.s;
+  #ifdef WORKER_STATS_SHARED
+    if (worker_stats_shm) {
+        munmap(worker_stats_shm, worker_stats_nslots*WORKER_STATS_SLOT_STRIDE);
+        worker_stats_shm = NULL;
+        worker_stats_nslots = 0;
+    }
+  #endif
+}
+
+
+void
+worker_stats_init (server * const srv, const int nworkers)
+{
+    worker_stats_free();
+    memset(&worker_stats_local, 0, sizeof(worker_stats_local));
+  #ifdef WORKER_STATS_SHARED
+    if (nworkers <= 0) return;
+    const size_t sz = (size_t)nworkers * WORKER_STATS_SLOT_STRIDE;
+    void * const shm = mmap(NULL, sz, PROT_READ|PROT_WRITE,
+                            MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == shm) {
+        log_perror(srv->errh, __FILE__, __LINE__,
+          "mmap() worker stats; statistics will be per-worker");
+        return;
+    }
+    /*(anonymous mapping is zero-filled)*/
+    worker_stats_shm = shm;
+    worker_stats_nslots = (uint32_t)nworkers;
+  #else
+    UNUSED(srv);
+    UNUSED(nworkers);
+  #endif
+}
+
+
+void
+worker_stats_worker (const int wkr)
+{
+  #ifdef WORKER_STATS_SHARED
+    if (worker_stats_shm && (uint32_t)wkr < worker_stats_nslots) {
+        /* (counters of slot are retained if worker is restarted) */
+        worker_stats_slot * const slot = worker_stats_slot_get((uint32_t)wkr);
+        slot->pid = (int32_t)getpid();
+        worker_stats_self_slot = slot;
+        worker_stats_self = &slot->s;
+    }
+  #else
+    UNUSED(wkr);
+  #endif
+}
+
+
+uint32_t
+worker_stats_nworkers (void)
+{
+  #ifdef WORKER_STATS_SHARED
+    if (worker_stats_shm)
+        return worker_stats_nslots;
+  #endif
+    return 1;
+}
+
+
+void
+worker_stats_hist_add (const int h, const uint64_t ns)
+{
+    worker_stats_hist * const hist = worker_stats_self->hist + h;
+    const uint64_t us = ns / 1000;
+    int i = 0;
+    while (i < WORKER_STATS_HIST_BUCKETS-1 && us > worker_stats_hist_bounds[i])
+        ++i;
+    ++hist->count[i];
+    hist->sum_us += us;
+}
+
+
+static worker_stats_vhost *
+worker_stats_entry_get (worker_stats_vhost * const tbl, uint32_t * const np, const uint32_t max, uint32_t * const lastp, const buffer * const name)
+{
+    const uint32_t n = *np;
+    uint32_t nlen = buffer_clen(name);
+    if (nlen >= sizeof(tbl[0].name))
+        nlen = sizeof(tbl[0].name)-1; /*(truncate)*/
+    uint32_t last = *lastp; /*(check most recent first)*/
+    if (last < n && tbl[last].nlen == nlen
+        && 0 == memcmp(tbl[last].name, name->ptr, nlen))
+        return tbl + last;
+    for (uint32_t i = 0; i < n; ++i) {
+        worker_stats_vhost * const vh = tbl + i;
+        if (vh->nlen == nlen && 0 == memcmp(vh->name, name->ptr, nlen))
+            return tbl + (*lastp = i);
+    }
+    if (n == max) /*(table full; last entry is "*")*/
+        return tbl + (*lastp = n-1);
+    worker_stats_vhost * const vh = tbl + n;
+    const char *k = name->ptr;
+    if (n == max-1) { /*(reserve last entry for excess)*/
+        k = "*";
+        nlen = 1;
+    }
+    memcpy(vh->name, k, nlen);
+    vh->name[nlen] = '\0';
+    vh->nlen = nlen;
+    worker_stats_store_release(np, n+1);
+    return tbl + (*lastp = n);
+}
+
+
+static worker_stats_vhost *
+worker_stats_vhost_get (const buffer * const name)
+{
+    worker_stats_slot * const slot = worker_stats_self_slot;
+    static uint32_t last;
+    return worker_stats_entry_get(slot->vhosts, &slot->nvhosts,
+                                  WORKER_STATS_VHOSTS, &last, name);
+}
+
+
+void
+worker_stats_request_done (const request_st * const r)
+{
+    worker_stats * const ws = worker_stats_self;
+    const uint32_t sc = (uint32_t)r->http_status / 100;
+    const uint32_t si = sc < 6 ? sc : 0;
+    const uint64_t bytes_in = (uint64_t)http_request_stats_bytes_in(r);
+    ++ws->requests;
+    ++ws->status[si];
+    ws->bytes_in += bytes_in;
+
+    if (!worker_stats_metrics) return;
+
+    const uint64_t start = r->timing[REQ_TIMING_START];
+    if (start) {
+        const uint64_t end = r->timing[REQ_TIMING_RESP_END]
+          ? r->timing[REQ_TIMING_RESP_END]
+          : request_timing_ns();
+        worker_stats_hist_add(WORKER_STATS_HIST_REQUEST, end - start);
+        const uint64_t ttfb =
+          request_timing_elapsed(r, REQ_TIMING_RESP_START);
+        if (ttfb)
+            worker_stats_hist_add(WORKER_STATS_HIST_TTFB, ttfb);
+    }
+
+    worker_stats_vhost * const vh = worker_stats_vhost_get(r->server_name);
+    ++vh->requests;
+    ++vh->status[si];
+    vh->bytes_in += bytes_in;
+    vh->bytes_out += (uint64_t)http_request_stats_bytes_out(r);
+}
+
+
+void
+worker_stats_backend_done (const buffer * const name, const int http_status, const off_t bytes_in, const off_t bytes_out)
+{
+    worker_stats_slot * const slot = worker_stats_self_slot;
+    static uint32_t last;
+    worker_stats_backend * const be =
+      worker_stats_entry_get(slot->backends, &slot->nbackends,
+                             WORKER_STATS_BACKENDS, &last, name);
+    const uint32_t sc = (uint32_t)http_status / 100;
+    ++be->requests;
+    ++be->status[sc < 6 ? sc : 0];
+    be->bytes_in += (uint64_t)bytes_in;
+    be->bytes_out += (uint64_t)bytes_out;
+}
+
+
+static uint32_t
+worker_stats_pstats_encode (char * const buf, const array * const a)
+{
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < a->used; ++i) {
+        const data_integer * const di = (const data_integer *)a->data[i];
+        const uint32_t klen = buffer_clen(&di->key);
+        if (klen > 0xFFFF
+            || len + sizeof(uint16_t) + klen + sizeof(int)
+               > WORKER_STATS_PSTATS_SZ)
+            continue; /*(skip; should not happen)*/
+        const uint16_t k16 = (uint16_t)klen;
+        memcpy(buf+len, &k16, sizeof(k16));
+        len += sizeof(k16);
+        memcpy(buf+len, di->key.ptr, klen);
+        len += klen;
+        memcpy(buf+len, &di->value, sizeof(int));
+        len += sizeof(int);
+    }
+    return len;
+}
+
+
+static void
+worker_stats_pstats_decode (array * const a, const char * const buf, const uint32_t len)
+{
+    for (uint32_t i = 0; i + sizeof(uint16_t) <= len; ) {
+        uint16_t klen;
+        int v;
+        memcpy(&klen, buf+i, sizeof(klen));
+        i += sizeof(klen);
+        if (i + klen + sizeof(int) > len) break; /*(should not happen)*/
+        const char * const k = buf+i;
+        i += klen;
+        memcpy(&v, buf+i, sizeof(int));
+        i += sizeof(int);
+        *array_get_int_ptr(a, k, klen) += v;
+    }
+}
+
+
+void
+worker_stats_publish (const server * const srv)
+{
+    worker_stats * const ws = worker_stats_self;
+    ws->conns_active = srv->srvconf.max_conns - srv->lim_conns;
+    ws->conns_idle   = srv->lim_conns;
+
+  #ifdef WORKER_STATS_SHARED
+    worker_stats_slot * const slot = worker_stats_self_slot;
+    if (slot == &worker_stats_local) return;
+    const uint32_t gen = slot->gen;
+    worker_stats_store_release(&slot->gen, gen+1);
+    worker_stats_fence_release();
+    slot->plen = worker_stats_pstats_encode(slot->pstats, &plugin_stats);
+    worker_stats_store_release(&slot->gen, gen+2);
+  #endif
+}
+
+
+void
+worker_stats_sum (worker_stats * const ws)
+{
+    memset(ws, 0, sizeof(*ws));
+    for (uint32_t i = 0, n = worker_stats_nworkers(); i < n; ++i) {
+        const volatile worker_stats * const s = &worker_stats_slot_get(i)->s;
+        ws->requests     += s->requests;
+        ws->bytes_in     += s->bytes_in;
+        ws->bytes_out    += s->bytes_out;
+        ws->conns        += s->conns;
+        ws->conns_active += s->conns_active;
+        ws->fd_cache_hits   += s->fd_cache_hits;
+        ws->fd_cache_misses += s->fd_cache_misses;
+        ws->fd_cache_open   += s->fd_cache_open;
+        ws->mem_cache_hits  += s->mem_cache_hits;
+        ws->mem_cache_bytes += s->mem_cache_bytes;
+        ws->conns_idle   += s->conns_idle;
+        for (uint32_t j = 0; j < sizeof(ws->status)/sizeof(*ws->status); ++j)
+            ws->status[j] += s->status[j];
+        for (int h = 0; h < WORKER_STATS_HIST_MAX; ++h) {
+            for (int j = 0; j < WORKER_STATS_HIST_BUCKETS; ++j)
+                ws->hist[h].count[j] += s->hist[h].count[j];
+            ws->hist[h].sum_us += s->hist[h].sum_us;
+        }
+    }
+}
+
+
+void
+worker_stats_plugin_stats (array * const a)
+{
+    /* plugin_stats of this worker are current; other workers published
+     * plugin_stats within the past second */
+    const array * const st = &plugin_stats;
+    for (uint32_t i = 0; i < st->used; ++i) {
+        const data_integer * const di = (const data_integer *)st->data[i];
+        *array_get_int_ptr(a, BUF_PTR_LEN(&di->key)) += di->value;
+    }
+
+  #ifdef WORKER_STATS_SHARED
+    static char buf[WORKER_STATS_PSTATS_SZ];
+    for (uint32_t i = 0, n = worker_stats_nworkers(); i < n; ++i) {
+        worker_stats_slot * const slot = worker_stats_slot_get(i);
+        if (&slot->s == worker_stats_self || &slot->s == &worker_stats_local.s)
+            continue;
+        for (int tries = 0; tries < 8; ++tries) {
+            const uint32_t gen = worker_stats_load_acquire(&slot->gen);
+            if (gen & 1) continue; /*(being updated)*/
+            uint32_t len = *(volatile uint32_t *)&slot->plen;
+            if (len > sizeof(buf)) len = 0;
+            memcpy(buf, slot->pstats, len);
+            worker_stats_fence_acquire();
+            if (gen == worker_stats_load_acquire(&slot->gen)) {
+                worker_stats_pstats_decode(a, buf, len);
+                break;
+            }
+        }
+    }
+  #endif
+}
+
+
+static uint32_t
+worker_stats_entries_sum (worker_stats_vhost ** const vhp, const uint32_t max, const size_t tbl_offset, const size_t n_offset)
+{
+    const uint32_t nw = worker_stats_nworkers();
+    worker_stats_vhost * const vhosts =
+      ck_calloc((size_t)nw * max, sizeof(*vhosts));
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < nw; ++i) {
+        worker_stats_slot * const slot = worker_stats_slot_get(i);
+        const worker_stats_vhost * const tbl = (const worker_stats_vhost *)
+          (const void *)((const char *)slot + tbl_offset);
+        uint32_t n = worker_stats_load_acquire(
+          (uint32_t *)(void *)((char *)slot + n_offset));
+        if (n > max) n = max;
+        for (uint32_t j = 0; j < n; ++j) {
+            const volatile worker_stats_vhost * const v = tbl + j;
+            const uint32_t nlen = v->nlen < sizeof(v->name) ? v->nlen : 0;
+            uint32_t k = 0;
+            while (k < used && (vhosts[k].nlen != nlen
+                                || 0 != memcmp(vhosts[k].name,
+                                               (const char *)v->name, nlen)))
+                ++k;
+            worker_stats_vhost * const vh = vhosts + k;
+            if (k == used) {
+                ++used;
+                memcpy(vh->name, (const char *)v->name, nlen);
+                vh->nlen = nlen;
+            }
+            vh->requests  += v->requests;
+            vh->bytes_in  += v->bytes_in;
+            vh->bytes_out += v->bytes_out;
+            for (uint32_t m = 0; m < sizeof(vh->status)/sizeof(*vh->status);++m)
+                vh->status[m] += v->status[m];
+        }
+    }
+    *vhp = vhosts;
+    return used;
+}
+
+
+uint32_t
+worker_stats_vhosts_sum (worker_stats_vhost ** const vhp)
+{
+    return worker_stats_entries_sum(vhp, WORKER_STATS_VHOSTS,
+                                    offsetof(worker_stats_slot, vhosts),
+                                    offsetof(worker_stats_slot, nvhosts));
+}
+
+
+uint32_t
+worker_stats_backends_sum (worker_stats_backend ** const bep)
+{
+    return worker_stats_entries_sum(bep, WORKER_STATS_BACKENDS,
+                                    offsetof(worker_stats_slot, backends),
+                                    offsetof(worker_stats_slot, nbackends));
+}
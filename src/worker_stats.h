@@ -0,0 +1,115 @@
+#ifndef LI_WORKER_STATS_H
+#define LI_WORKER_STATS_H
+#include "first.h"
+
+#include "base_decls.h"
+#include "array.h"
+
+/* server statistics counters
+ *
+ * Each worker process owns a slot in a shared memory region created by the
+ * parent before forking workers (server.max-worker), so that statistics can
+ * be aggregated across all workers from any worker.  Each slot is written
+ * only by its worker (lock-free; single writer) and read by other workers.
+ * Without server.max-worker, counters are kept in process-local memory. */
+
+enum {
+  WORKER_STATS_HIST_REQUEST,  /* request time */
+  WORKER_STATS_HIST_TTFB,     /* time to first response byte */
+  WORKER_STATS_HIST_CONNECT,  /* backend connect time */
+  WORKER_STATS_HIST_MAX
+};
+
+/* latency histogram buckets (upper bounds in usec); last bucket is +Inf */
+#define WORKER_STATS_HIST_BUCKETS 14
+extern const uint32_t worker_stats_hist_bounds[WORKER_STATS_HIST_BUCKETS-1];
+
+typedef struct worker_stats_hist {
+    uint64_t count[WORKER_STATS_HIST_BUCKETS];  /* (not cumulative) */
+    uint64_t sum_us;
+} worker_stats_hist;
+
+typedef struct worker_stats {
+    uint64_t requests;      /* requests completed */
+    uint64_t bytes_in;      /* request bytes read (counted at request done) */
+    uint64_t bytes_out;     /* bytes written to clients */
+    uint64_t conns;         /* connections accepted */
+    uint64_t status[6];     /* responses by status class [1..5]xx, [0] other */
+    uint64_t fd_cache_hits;   /* stat_cache open fd reused */
+    uint64_t fd_cache_misses; /* stat_cache file open()ed */
+    uint32_t fd_cache_open;   /* stat_cache fds currently open */
+    uint64_t mem_cache_hits;  /* responses sent from stat_cache file contents */
+    uint64_t mem_cache_bytes; /* stat_cache file contents held in memory */
+    uint32_t conns_active;  /* (updated periodically) */
+    uint32_t conns_idle;    /* (updated periodically) */
+    worker_stats_hist hist[WORKER_STATS_HIST_MAX]; /* (if metrics enabled) */
+} worker_stats;
+
+/* per-vhost stats (if metrics enabled); excess vhosts are summed in an
+ * entry with name "*" */
+#define WORKER_STATS_VHOSTS 64
+typedef struct worker_stats_vhost {
+    uint64_t requests;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t status[6];
+    uint32_t nlen;
+    char name[60];
+} worker_stats_vhost;
+
+/* per-backend stats (if metrics enabled), keyed by gw_proc connection name
+ * (bytes_in: response bytes received; bytes_out: request body bytes sent)
+ * (same layout as per-vhost stats; excess backends summed as "*") */
+#define WORKER_STATS_BACKENDS 64
+typedef worker_stats_vhost worker_stats_backend;
+
+extern worker_stats *worker_stats_self;
+
+/* enable latency histograms and per-vhost stats (set before forking)
+ * (also requires request_timing enabled for latency histograms) */
+extern int worker_stats_metrics;
+
+#define worker_stats_requests_inc() \
+        (++worker_stats_self->requests)
+#define worker_stats_bytes_out_add(n) \
+        (worker_stats_self->bytes_out += (uint64_t)(n))
+#define worker_stats_conns_inc() \
+        (++worker_stats_self->conns)
+
+void worker_stats_hist_add (int h, uint64_t ns);
+
+void worker_stats_request_done (const request_st *r);
+
+void worker_stats_backend_done (const buffer *name, int http_status, off_t bytes_in, off_t bytes_out);
+
+/* (called in parent before forking workers) */
+__attribute_cold__
+void worker_stats_init (server *srv, int nworkers);
+
+/* (called in worker after fork) */
+__attribute_cold__
+void worker_stats_worker (int wkr);
+
+__attribute_cold__
+void worker_stats_free (void);
+
+/* publish periodically updated stats, including plugin_stats (1x/sec) */
+void worker_stats_publish (const server *srv);
+
+/* number of workers sharing stats (1 if not shared) */
+__attribute_pure__
+uint32_t worker_stats_nworkers (void);
+
+/* sum of counters for all workers */
+void worker_stats_sum (worker_stats *ws);
+
+/* sum of plugin_stats for all workers (into empty array a) */
+void worker_stats_plugin_stats (array *a);
+
+/* sum of per-vhost stats for all workers; returns count (caller frees *vh) */
+uint32_t worker_stats_vhosts_sum (worker_stats_vhost **vh);
+
+/* sum of per-backend stats for all workers; returns count (caller frees *be)*/
+uint32_t worker_stats_backends_sum (worker_stats_backend **be);
+
+#endif
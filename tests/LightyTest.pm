@@ -266,6 +266,13 @@ BIND_OVERRIDE
 
 		$ENV{'SRCDIR'} = $testdir;
 
+		# lighttpd with server.max-worker signals its process group
+		# (kill(0, ...)) at shutdown; do not signal test harness
+		if (!$self->{"win32native"}) {
+			require POSIX;
+			POSIX::setpgid(0, 0);
+		}
+
 		my @cmdline = ($self->{LIGHTTPD_PATH}, "-D", "-f", $conf, "-m", $modules_path);
 		splice(@cmdline, -2) if exists $ENV{LIGHTTPD_EXE_PATH};
 		if (!defined $ENV{"TRACEME"}) {
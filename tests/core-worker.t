@@ -0,0 +1,66 @@
+#!/usr/bin/env perl
+BEGIN {
+	# add current source dir to the include-path
+	# we need this for make distcheck
+	(my $srcdir = $0) =~ s,/[^/]+$,/,;
+	unshift @INC, $srcdir;
+}
+
+use strict;
+use IO::Socket;
+use Test::More tests => 8;
+use LightyTest;
+
+my $tf = LightyTest->new();
+my $t;
+
+$tf->{CONFIGFILE} = 'worker.conf';
+$ENV{EPHEMERAL_PORT_REUSEPORT} = LightyTest->get_ephemeral_tcp_port();
+$ENV{SRCDIR} = $tf->{TESTDIR};
+
+# invalid server.cpu-affinity CPU list is rejected at startup
+# (lighttpd -tt runs startup checks without starting server)
+SKIP: {
+	skip "server.cpu-affinity not supported on this platform", 3
+	  if $^O ne 'linux';
+	my $cmd = "'$$tf{LIGHTTPD_PATH}' -tt -f '$$tf{TESTDIR}/$$tf{CONFIGFILE}'";
+	$cmd .= " -m '$$tf{MODULES_PATH}'" unless exists $ENV{LIGHTTPD_EXE_PATH};
+	foreach my $cpus ("3-1", "0,", "1,,2") {
+		$ENV{CPU_AFFINITY} = $cpus;
+		my $out = `$cmd 2>&1`;
+		ok($? != 0 && $out =~ /invalid CPU list/,
+		   "server.cpu-affinity invalid CPU list \"$cpus\" rejected");
+	}
+}
+
+$ENV{CPU_AFFINITY} = "auto";
+ok($tf->start_proc == 0, "Starting lighttpd with server.max-worker") or die();
+
+$t->{REQUEST}  = ( <<EOF
+GET /index.html HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'workers serve request on shared listen socket');
+
+# listen socket per worker with server.reuseport
+my $port = $tf->{PORT};
+$tf->{PORT} = $ENV{EPHEMERAL_PORT_REUSEPORT};
+
+my $rc = 0;
+for (my $i = 0; $i < 8; ++$i) {
+	$rc |= $tf->handle_http($t);
+}
+ok($rc == 0, 'workers serve requests on server.reuseport listen sockets');
+
+$t->{REQUEST}  = ( <<EOF
+GET /nonexistent HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 404 } ];
+ok($tf->handle_http($t) == 0, 'file not found on server.reuseport listen socket');
+
+$tf->{PORT} = $port;
+ok($tf->stop_proc == 0, "Stopping lighttpd");
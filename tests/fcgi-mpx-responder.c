@@ -0,0 +1,363 @@
+/*
+ * simple FastCGI server which multiplexes requests, for use in unit tests
+ * - listens on FCGI_LISTENSOCK_FILENO
+ *   (socket on FCGI_LISTENSOCK_FILENO must be set up by invoker)
+ * - serves multiple connections, each with multiple concurrent requests
+ * - response body is QUERY_STRING
+ * - requests with QUERY_STRING beginning "hold" are not answered until a
+ *   request with QUERY_STRING "release" is answered; held requests are then
+ *   answered in reverse order, with records for the requests interleaved
+ * - response to "release" is "release rejected=<n>", where <n> is number of
+ *   requests rejected with FCGI_CANT_MPX_CONN
+ * - if FCGI_CANT_MPX_CONN is set in environment, requests are rejected with
+ *   FCGI_CANT_MPX_CONN if another request is active on the same connection
+ * - no write timeouts; might block writing response
+ *
+ * License: BSD 3-clause (same as lighttpd)
+ */
+#if defined(__sun)
+#define __EXTENSIONS__
+#endif
+
+#include <sys/types.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "../src/compat/fastcgi.h"
+
+#define MPX_CONNS 16
+#define MPX_IDS   16
+
+typedef struct {
+    int active;
+    int keep_conn;
+    int params_done;
+    uint32_t plen;
+    unsigned char params[4096];
+} mpx_req;
+
+typedef struct {
+    int fd;
+    uint32_t blen;
+    unsigned char buf[65536+8];
+    mpx_req reqs[MPX_IDS+1];
+} mpx_conn;
+
+static mpx_conn conns[MPX_CONNS];
+static int cant_mpx;
+static int rejected;
+
+/* requests held until "release" */
+static struct { mpx_conn *c; int id; } held[MPX_CONNS*MPX_IDS];
+static int nheld;
+
+
+static void
+fcgi_header (FCGI_Header * const header, const unsigned char type, const int request_id, const int contentLength)
+{
+    header->version         = FCGI_VERSION_1;
+    header->type            = type;
+    header->requestIdB1     = (request_id    >> 8) & 0xff;
+    header->requestIdB0     =  request_id          & 0xff;
+    header->contentLengthB1 = (contentLength >> 8) & 0xff;
+    header->contentLengthB0 =  contentLength       & 0xff;
+    header->paddingLength   = 0;
+    header->reserved        = 0;
+}
+
+
+static void
+mpx_write (mpx_conn * const c, const void * const data, size_t len)
+{
+    const char *s = data;
+    while (len && c->fd >= 0) {
+        const ssize_t wr = write(c->fd, s, len);
+        if (wr > 0) {
+            s += wr;
+            len -= (size_t)wr;
+        }
+        else if (wr < 0 && errno == EINTR)
+            continue;
+        else
+            break; /*(ignore error; connection closed when read fails)*/
+    }
+}
+
+
+static void
+mpx_record (mpx_conn * const c, const int type, const int id, const void * const data, const int len)
+{
+    FCGI_Header header;
+    fcgi_header(&header, type, id, len);
+    mpx_write(c, &header, sizeof(header));
+    if (len) mpx_write(c, data, (size_t)len);
+}
+
+
+static void
+mpx_close (mpx_conn * const c)
+{
+    for (int i = 0; i < nheld; ++i) {
+        if (held[i].c == c) {
+            memmove(held+i, held+i+1, (size_t)(--nheld - i) * sizeof(*held));
+            --i;
+        }
+    }
+    close(c->fd);
+    c->fd = -1;
+}
+
+
+static void
+mpx_end_request (mpx_conn * const c, const int id, const unsigned char protocolStatus)
+{
+    FCGI_EndRequestBody body;
+    memset(&body, 0, sizeof(body));
+    body.protocolStatus = protocolStatus;
+    mpx_record(c, FCGI_END_REQUEST, id, &body, sizeof(body));
+    mpx_req * const req = c->reqs + id;
+    req->active = 0;
+    if (!req->keep_conn && protocolStatus == FCGI_REQUEST_COMPLETE
+        && c->fd >= 0)
+        mpx_close(c);
+}
+
+
+static const char *
+mpx_getenv (const mpx_req * const req, const char * const name, const uint32_t nlen, uint32_t * const len)
+{
+    const unsigned char * const r = req->params;
+    for (uint32_t i = 0; i < req->plen; ) {
+        uint32_t klen = r[i];
+        if (!(r[i] & 0x80))
+            ++i;
+        else {
+            klen = ((r[i] & ~0x80u)<<24) | (r[i+1]<<16) | (r[i+2]<<8) | r[i+3];
+            i += 4;
+        }
+        uint32_t vlen = r[i];
+        if (!(r[i] & 0x80))
+            ++i;
+        else {
+            vlen = ((r[i] & ~0x80u)<<24) | (r[i+1]<<16) | (r[i+2]<<8) | r[i+3];
+            i += 4;
+        }
+        if (klen == nlen && 0 == memcmp(r+i, name, klen)) {
+            *len = vlen;
+            return (const char *)r+i+klen;
+        }
+        i += klen + vlen;
+    }
+    *len = 0;
+    return "";
+}
+
+
+static void
+mpx_respond_held (void)
+{
+    /* answer held requests in reverse order, interleaving records */
+    static const char hdrs[] = "Status: 200 OK\r\n\r\n";
+    uint32_t len;
+    for (int i = nheld; i--; )
+        mpx_record(held[i].c, FCGI_STDOUT, held[i].id,
+                   hdrs, (int)sizeof(hdrs)-1);
+    for (int i = nheld; i--; ) {
+        const mpx_req * const req = held[i].c->reqs + held[i].id;
+        const char * const qs = mpx_getenv(req, "QUERY_STRING", 12, &len);
+        mpx_record(held[i].c, FCGI_STDOUT, held[i].id, qs, (int)len);
+    }
+    for (int i = nheld; i--; )
+        mpx_record(held[i].c, FCGI_STDOUT, held[i].id, NULL, 0);
+    while (nheld) {
+        /*(mpx_end_request() might close connection and modify held[])*/
+        --nheld;
+        mpx_end_request(held[nheld].c, held[nheld].id, FCGI_REQUEST_COMPLETE);
+    }
+}
+
+
+static void
+mpx_respond (mpx_conn * const c, const int id)
+{
+    mpx_req * const req = c->reqs + id;
+    uint32_t len;
+    const char *qs = mpx_getenv(req, "QUERY_STRING", 12, &len);
+    if (len >= 4 && 0 == memcmp(qs, "hold", 4)) {
+        held[nheld].c = c;
+        held[nheld].id = id;
+        ++nheld;
+        return;
+    }
+
+    char body[64];
+    const int release = (7 == len && 0 == memcmp(qs, "release", 7));
+    if (release) {
+        len = (uint32_t)snprintf(body, sizeof(body),
+                                 "release rejected=%d", rejected);
+        qs = body;
+    }
+    static const char hdrs[] = "Status: 200 OK\r\n\r\n";
+    mpx_record(c, FCGI_STDOUT, id, hdrs, (int)sizeof(hdrs)-1);
+    mpx_record(c, FCGI_STDOUT, id, qs, (int)len);
+    mpx_record(c, FCGI_STDOUT, id, NULL, 0);
+    mpx_end_request(c, id, FCGI_REQUEST_COMPLETE);
+    if (release)
+        mpx_respond_held();
+}
+
+
+static int
+mpx_dispatch (mpx_conn * const c, const unsigned char * const h, const uint32_t len)
+{
+    const int type = h[1];
+    const int id = (h[2] << 8) | h[3];
+    const unsigned char * const data = h + FCGI_HEADER_LEN;
+
+    if (0 == id) return 0; /* ignore management records */
+    if (id > MPX_IDS) return -1;
+    mpx_req * const req = c->reqs + id;
+
+    switch (type) {
+      case FCGI_BEGIN_REQUEST:
+        if (len < sizeof(FCGI_BeginRequestBody) || req->active) return -1;
+        if (cant_mpx) {
+            for (int i = 1; i <= MPX_IDS; ++i) {
+                if (c->reqs[i].active) {
+                    ++rejected;
+                    mpx_end_request(c, id, FCGI_CANT_MPX_CONN);
+                    return 0;
+                }
+            }
+        }
+        memset(req, 0, sizeof(*req));
+        req->active = 1;
+        req->keep_conn = (data[2] & FCGI_KEEP_CONN);
+        return 0;
+      case FCGI_PARAMS:
+        if (!req->active) return 0; /*(e.g. rejected request)*/
+        if (0 == len)
+            req->params_done = 1;
+        else if (req->plen + len <= sizeof(req->params)) {
+            memcpy(req->params + req->plen, data, len);
+            req->plen += len;
+        }
+        return 0;
+      case FCGI_STDIN:
+        if (!req->active) return 0; /*(e.g. rejected request)*/
+        if (0 == len && req->params_done)
+            mpx_respond(c, id);
+        return 0; /*(request body is read and discarded)*/
+      case FCGI_ABORT_REQUEST:
+        if (!req->active) return 0;
+        for (int i = 0; i < nheld; ++i) {
+            if (held[i].c == c && held[i].id == id) {
+                memmove(held+i, held+i+1, (size_t)(--nheld-i)*sizeof(*held));
+                break;
+            }
+        }
+        mpx_end_request(c, id, FCGI_REQUEST_COMPLETE);
+        return 0;
+      default:
+        return -1; /* unexpected */
+    }
+}
+
+
+static void
+mpx_recv (mpx_conn * const c)
+{
+    ssize_t rd;
+    do {
+        rd = read(c->fd, c->buf + c->blen, sizeof(c->buf) - c->blen);
+    } while (rd < 0 && errno == EINTR);
+    if (rd <= 0) {
+        mpx_close(c);
+        return;
+    }
+    c->blen += (uint32_t)rd;
+
+    uint32_t off = 0;
+    while (c->blen - off >= FCGI_HEADER_LEN) {
+        const unsigned char * const h = c->buf + off;
+        const uint32_t len = (h[4] << 8) | h[5];
+        const uint32_t rlen = FCGI_HEADER_LEN + len + h[6];
+        if (c->blen - off < rlen) break;
+        const int fd = c->fd;
+        if (h[0] != FCGI_VERSION_1 || 0 != mpx_dispatch(c, h, len)) {
+            if (c->fd >= 0) mpx_close(c);
+            return;
+        }
+        if (fd != c->fd) return; /*(connection closed)*/
+        off += rlen;
+    }
+    if (off) {
+        memmove(c->buf, c->buf + off, c->blen - off);
+        c->blen -= off;
+    }
+}
+
+
+int
+main (void)
+{
+    cant_mpx = (NULL != getenv("FCGI_CANT_MPX_CONN"));
+    for (int i = 0; i < MPX_CONNS; ++i) conns[i].fd = -1;
+    fcntl(FCGI_LISTENSOCK_FILENO, F_SETFL,
+          fcntl(FCGI_LISTENSOCK_FILENO, F_GETFL) & ~O_NONBLOCK);
+
+    for (;;) {
+        struct pollfd pfds[MPX_CONNS+1];
+        int n = 0;
+        pfds[n].fd = FCGI_LISTENSOCK_FILENO;
+        pfds[n].events = POLLIN;
+        pfds[n++].revents = 0;
+        for (int i = 0; i < MPX_CONNS; ++i) {
+            pfds[n].fd = conns[i].fd; /*(poll() ignores fd < 0)*/
+            pfds[n].events = POLLIN;
+            pfds[n++].revents = 0;
+        }
+        if (poll(pfds, (nfds_t)n, -1) < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+
+        for (int i = 0; i < MPX_CONNS; ++i) {
+            if (pfds[i+1].revents && conns[i].fd >= 0)
+                mpx_recv(conns + i);
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            const int fd = accept(FCGI_LISTENSOCK_FILENO, NULL, NULL);
+            if (fd < 0) continue;
+            int i = 0;
+            while (i < MPX_CONNS && conns[i].fd >= 0) ++i;
+            if (i == MPX_CONNS) {
+                close(fd);
+                continue;
+            }
+            memset(conns+i, 0, sizeof(conns[i]));
+            conns[i].fd = fd;
+        }
+    }
+}
+
+#else /* _WIN32 */
+
+int
+main (void)
+{
+    return 1; /* not implemented; tests/ do not run under native Windows */
+}
+
+#endif /* _WIN32 */
@@ -7,7 +7,7 @@ BEGIN {
 }
 
 use strict;
-use Test::More tests => 24;
+use Test::More tests => 29;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -15,12 +15,15 @@ my $tf = LightyTest->new();
 my $t;
 
 SKIP: {
-	skip "no fcgi-responder found", 24
+	skip "no fcgi-responder found", 29
 	  unless (   -x $tf->{BASEDIR}."/tests/fcgi-responder"
 		  || -x $tf->{BASEDIR}."/tests/fcgi-responder.exe");
 
 	my $ephemeral_port = LightyTest->get_ephemeral_tcp_port();
 	$ENV{EPHEMERAL_PORT} = $ephemeral_port;
+	$ENV{EPHEMERAL_PORT_DOWN} = LightyTest->get_ephemeral_tcp_port();
+	$ENV{EPHEMERAL_PORT_MPX} = LightyTest->get_ephemeral_tcp_port();
+	$ENV{EPHEMERAL_PORT_CANT_MPX} = LightyTest->get_ephemeral_tcp_port();
 
 	$tf->{CONFIGFILE} = 'fastcgi-responder.conf';
 	ok($tf->start_proc == 0, "Starting lighttpd with $tf->{CONFIGFILE}") or die();
@@ -189,6 +192,64 @@ EOF
 	$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '' } ];
 	ok($tf->handle_http($t) == 0, 'SCRIPT_NAME (wsgi)');
 
+	# concurrent requests (in order sent); returns response bodies
+	# (fcgi-mpx-responder holds "hold*" requests until "release" request)
+	my $mpx_get = sub {
+		my $host = shift;
+		my @socks;
+		my @bodies;
+		local $SIG{ALRM} = sub { die "timeout\n"; };
+		alarm(10);
+		eval {
+			for my $qs (@_) {
+				my $sock = IO::Socket::INET->new(
+					PeerAddr => '127.0.0.1',
+					PeerPort => $tf->{PORT},
+					Proto    => 'tcp') or die "connect: $!\n";
+				print $sock "GET /mpx?$qs HTTP/1.0\r\nHost: $host\r\n\r\n";
+				push @socks, $sock;
+				select(undef, undef, undef, 0.1);
+			}
+			for my $sock (@socks) {
+				local $/;
+				my $resp = <$sock>;
+				push @bodies, (defined($resp)
+				               && $resp =~ m|^HTTP/1\.0 200 .*?\r\n\r\n(.*)\z|s)
+				  ? $1 : '';
+			}
+		};
+		alarm(0);
+		close($_) for @socks;
+		return join(',', @bodies);
+	};
+
+	is($mpx_get->('mpx.example.org', 'hold-a', 'hold-b', 'release'),
+	   'hold-a,hold-b,release rejected=0',
+	   'FastCGI multiplexed requests, responses interleaved out of order');
+
+	is($mpx_get->('mpx.example.org', 'hold-c', 'release'),
+	   'hold-c,release rejected=0',
+	   'FastCGI multiplexed requests, connection reused');
+
+	$t->{REQUEST}  = ( <<EOF
+POST /mpx?post HTTP/1.0
+Host: mpx.example.org
+Content-Length: 4
+
+123
+EOF
+ );
+	$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => 'post' } ];
+	ok($tf->handle_http($t) == 0, 'FastCGI request with request body (not multiplexed)');
+
+	is($mpx_get->('cant-mpx.example.org', 'hold-a', 'release'),
+	   'hold-a,release rejected=1',
+	   'FastCGI request rejected with FCGI_CANT_MPX_CONN is retried');
+
+	is($mpx_get->('cant-mpx.example.org', 'hold-b', 'release'),
+	   'hold-b,release rejected=1',
+	   'FastCGI one request at a time per connection after FCGI_CANT_MPX_CONN');
+
 
     # skip timing-sensitive test during CI testing, but run for user 'gps'
     my $user = `id -un`;
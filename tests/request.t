@@ -8,7 +8,10 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 164;
+use IO::Select;
+use POSIX ();
+use IO::Uncompress::Gunzip ();
+use Test::More tests => 188;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -1394,7 +1397,7 @@ ok($tf->handle_http($t) == 0, 'broken header via perl cgi');
 
 SKIP: {
     my $has_zlib = $tf->has_feature("zlib support");
-    skip "skipping tests requiring zlib", 9 unless $has_zlib;
+    skip "skipping tests requiring zlib", 15 unless $has_zlib;
 
 $t->{REQUEST}  = ( <<EOF
 GET /index.html HTTP/1.0
@@ -1483,6 +1486,93 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, '+Vary' => '', 'Content-Encoding' => 'gzip', 'Content-Type' => "text/plain;charset=utf-8" } ];
 ok($tf->handle_http($t) == 0, 'bzip2 requested but disabled');
 
+# deflate.threads: larger responses are compressed in compression threads;
+# response headers are sent before compression completes and response body
+# is then sent with Transfer-Encoding: chunked (HTTP/1.1 required)
+my $deflate_file = $tf->{TESTDIR}.'/tmp/lighttpd/servers/www.example.org/pages/deflate-threads.txt';
+my $deflate_body = join('', map { sprintf("%07d\n", $_) } 0..524287);
+open(my $deflate_fh, '>', $deflate_file) or die "open: $!";
+print $deflate_fh $deflate_body;
+close($deflate_fh);
+
+my $deflate_get = sub {
+	my ($host, $abort) = @_;
+	my $remote = IO::Socket::INET->new(Proto => "tcp",
+	                                   PeerAddr => "127.0.0.1",
+	                                   PeerPort => $tf->{PORT});
+	return undef unless defined $remote;
+	print $remote "GET /deflate-threads.txt HTTP/1.1\r\nHost: $host\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n";
+	my ($resp, $buf) = ('', undef);
+	while (sysread($remote, $buf, 65536)) {
+		$resp .= $buf;
+		last if $abort && $resp =~ /\r\n\r\n/;
+	}
+	# (abort with TCP RST so that server resets request while compressing)
+	setsockopt($remote, SOL_SOCKET, SO_LINGER, pack("ii", 1, 0)) if $abort;
+	close($remote);
+	my ($hdrs, $body) = split(/\r\n\r\n/, $resp, 2);
+	return $hdrs if $abort;
+	return undef unless defined $body && $hdrs =~ m|^HTTP/1.1 200 |
+	                 && $hdrs =~ /^Content-Encoding: gzip\r?$/mi;
+	if ($hdrs =~ /^Transfer-Encoding: chunked\r?$/mi) {
+		my $gz = '';
+		while ($body =~ s/^([0-9a-fA-F]+)\r\n//) {
+			my $len = hex($1);
+			last if 0 == $len;
+			$gz .= substr($body, 0, $len, '');
+			$body =~ s/^\r\n// or return undef;
+		}
+		$body = $gz;
+	}
+	my $out;
+	IO::Uncompress::Gunzip::gunzip(\$body => \$out) or return undef;
+	return $out;
+};
+
+SKIP: {
+    skip "deflate.threads not supported on _WIN32", 1 if $tf->{"win32native"};
+$t->{REQUEST}  = ( <<EOF
+GET /deflate-threads.txt HTTP/1.1
+Host: deflate.example.org
+Accept-Encoding: gzip
+Connection: close
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 200, 'Content-Encoding' => 'gzip', 'Transfer-Encoding' => 'chunked', '-Content-Length' => '' } ];
+ok($tf->handle_http($t) == 0, 'deflate.threads - response headers sent while compressing');
+}
+
+my $out = $deflate_get->("deflate.example.org");
+ok(defined $out && $out eq $deflate_body, 'deflate.threads - response body compressed in compression thread');
+
+# client aborts connection (request reset) while compression job is in
+# flight; detached job is freed when compression thread completes job
+my $rc = 1;
+for (my $i = 0; $i < 4; ++$i) {
+	my $hdrs = $deflate_get->("deflate.example.org", 1);
+	$rc = 0 unless defined $hdrs && $hdrs =~ m|^HTTP/1.1 200 |;
+}
+ok($rc, 'deflate.threads - client abort while compressing');
+
+$out = $deflate_get->("deflate.example.org");
+ok(defined $out && $out eq $deflate_body, 'deflate.threads - response compressed after request reset while compressing');
+
+# compressed in compression thread to deflate.cache-dir, then sent from cache
+$out = $deflate_get->("deflate-cache.example.org");
+ok(defined $out && $out eq $deflate_body, 'deflate.threads - response compressed to cache file in compression thread');
+
+$t->{REQUEST}  = ( <<EOF
+GET /deflate-threads.txt HTTP/1.1
+Host: deflate-cache.example.org
+Accept-Encoding: gzip
+Connection: close
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 200, 'Content-Encoding' => 'gzip', '+Content-Length' => '' } ];
+ok($tf->handle_http($t) == 0, 'deflate.threads - compressed response sent from cache');
+
+unlink($deflate_file);
+
 }
 
 
@@ -1559,8 +1649,74 @@ do {
 my $tf_proxy = LightyTest->new();
 $tf_proxy->{CONFIGFILE} = 'proxy.conf';
 
+# scripted HTTP/1.1 backend for keep-alive connection tests
+# (response body is "<conn> <req>": num of backend connection and num of
+#  request on that connection; query string selects backend behavior)
+my $ka_listen = IO::Socket::INET->new(Proto     => 'tcp',
+                                      LocalAddr => '127.0.0.1',
+                                      LocalPort => 0,
+                                      Listen    => 8,
+                                      ReuseAddr => 1) or die "listen: $!";
+my $ka_pid = fork();
+die "fork: $!" unless defined $ka_pid;
+if (0 == $ka_pid) {
+	my $sel = IO::Select->new($ka_listen);
+	my (%buf, %id, %nreq);
+	my $nconn = 0;
+	while (my @ready = $sel->can_read()) {
+		foreach my $fh (@ready) {
+			if ($fh == $ka_listen) {
+				my $c = $ka_listen->accept() or next;
+				$sel->add($c);
+				$id{$c} = ++$nconn;
+				$nreq{$c} = 0;
+				$buf{$c} = '';
+				next;
+			}
+			my $n = sysread($fh, $buf{$fh}, 8192, length($buf{$fh}));
+			if (!$n) {
+				$sel->remove($fh);
+				close($fh);
+				next;
+			}
+			while (defined $fh->fileno && $buf{$fh} =~ s/^(.*?)\r\n\r\n//s) {
+				my ($method, $target) = ($1 =~ m/^(\S+) (\S+)/);
+				my $q = $target =~ m/\?(.*)$/ ? $1 : '';
+				++$nreq{$fh};
+				# "drop": close reused connection without sending response
+				if ($q =~ /\bdrop\b/ && $nreq{$fh} > 1) {
+					$sel->remove($fh);
+					close($fh);
+					last;
+				}
+				my $status = $q =~ /\bstatus=(\d+)/ ? $1 : 200;
+				my $nobody = ($status == 204 || $status == 304);
+				my $body = $nobody ? '' : "$id{$fh} $nreq{$fh}";
+				my $resp = ($q =~ /\bhttp10\b/ ? 'HTTP/1.0' : 'HTTP/1.1')
+				         . " $status Status\r\n";
+				$resp .= "Content-Length: ".length($body)."\r\n" unless $nobody;
+				$resp .= "Connection: close\r\n" if $q =~ /\bclose\b/;
+				$resp .= "\r\n";
+				$resp .= $body unless $method eq 'HEAD';
+				syswrite($fh, $resp);
+				# "idleclose": close connection after response, as if
+				# backend keep-alive idle timeout expired (no Connection: close)
+				# (connection is otherwise left open, even if HTTP/1.0 or
+				#  Connection: close, to detect if proxy reuses connection)
+				if ($q =~ /\bidleclose\b/) {
+					$sel->remove($fh);
+					close($fh);
+				}
+			}
+		}
+	}
+	POSIX::_exit(0);
+}
+
 local $ENV{EPHEMERAL_PORT} = $tf->{PORT};
-ok($tf_proxy->start_proc == 0, "Starting lighttpd as proxy") or last;
+local $ENV{EPHEMERAL_PORT_DOWN} = LightyTest->get_ephemeral_tcp_port();
+local $ENV{EPHEMERAL_PORT_KEEPALIVE} = $ka_listen->sockport();
+ok($tf_proxy->start_proc == 0, "Starting lighttpd as proxy") or (kill('TERM', $ka_pid), waitpid($ka_pid, 0), last);
 
 $t->{REQUEST}  = ( <<EOF
 GET /index.html HTTP/1.0
@@ -1586,7 +1742,171 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '/some+test%3Axxx%20with%20space' } ];
 ok($tf_proxy->handle_http($t) == 0, 'rewrited urls work with encoded path');
 
+$t->{REQUEST}  = ( <<EOF
+GET /h2c/cgi.pl?env=SERVER_PROTOCOL HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => 'HTTP/2.0' } ];
+ok($tf_proxy->handle_http($t) == 0, 'h2c to backend, after connect error to first host');
+
+$t->{REQUEST}  = ( <<EOF
+GET /h2c/index.html HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf_proxy->handle_http($t) == 0, 'h2c to backend, reuse connection');
+
+# large response body with Content-Length, streamed (bufmin) to client
+# (spliced from backend socket into pipe and from pipe to client socket)
+my $splice_file = $tf->{TESTDIR}.'/tmp/lighttpd/servers/www.example.org/pages/splice.txt';
+my $splice_body = join('', map { sprintf("%07d\n", $_) } 0..524287);
+open(my $splice_fh, '>', $splice_file) or die "open: $!";
+print $splice_fh $splice_body;
+close($splice_fh);
+
+$t->{REQUEST}  = ( <<EOF
+GET /splice/splice.txt HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'Content-Length' => length($splice_body), 'HTTP-Content' => $splice_body } ];
+ok($tf_proxy->handle_http($t) == 0, 'large response body spliced to client');
+
+# client disconnects while response body is queued in pipe
+do {
+	my $remote = IO::Socket::INET->new(Proto => "tcp",
+	                                   PeerAddr => "127.0.0.1",
+	                                   PeerPort => $tf_proxy->{PORT});
+	my $buf;
+	if (defined $remote) {
+		print $remote "GET /splice/splice.txt HTTP/1.0\r\nHost: www.example.org\r\n\r\n";
+		sysread($remote, $buf, 4096);
+		select(undef, undef, undef, 0.2);
+		close($remote);
+	}
+	ok(defined $buf && $buf =~ m|^HTTP/1.0 200 |, 'client disconnect during spliced response body');
+};
+
+$t->{REQUEST}  = ( <<EOF
+GET /splice/splice.txt HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => $splice_body } ];
+ok($tf_proxy->handle_http($t) == 0, 'large response body spliced after client disconnect');
+unlink($splice_file);
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '1 1' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, new connection');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '1 2' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, reuse connection');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka?idleclose HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '1 3' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, backend closes idle connection');
+
+select(undef, undef, undef, 0.2);
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '2 1' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, closed idle connection not reused');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka?drop HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '3 1' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, retry if reused connection closed');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka?http10 HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '3 2' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, HTTP/1.0 response');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '4 1' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, not reused after HTTP/1.0');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka?close HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '4 2' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, Connection: close');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '5 1' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, not reused after Connection: close');
+
+$t->{REQUEST}  = ( <<EOF
+HEAD /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, '-HTTP-Content' => '', 'Content-Length' => '3' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, HEAD response has no body');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka?status=204 HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 204, '-HTTP-Content' => '' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, 204 response has no body');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka?status=304 HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 304, '-HTTP-Content' => '' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, 304 response has no body');
+
+$t->{REQUEST}  = ( <<EOF
+GET /keepalive/ka HTTP/1.0
+Host: www.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '5 5' } ];
+ok($tf_proxy->handle_http($t) == 0, 'keep-alive to backend, reused after HEAD, 204, 304');
+
 ok($tf_proxy->stop_proc == 0, "Stopping lighttpd proxy");
+kill('TERM', $ka_pid);
+waitpid($ka_pid, 0);
 
 } while (0);
 